@@ -0,0 +1,197 @@
+/*
+ * libcassava/arena.c
+ * vim: set cin ts=4 sw=4 et cc=100:
+ *
+ * Copyright (c) 2012 Ben Morgan <neembi@googlemail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "arena.h"
+
+#include <assert.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* The types with the strictest alignment, as malloc() guarantees it. */
+union max_align {
+    long double ld;
+    long long ll;
+    double d;
+    void *p;
+    void (*f)(void);
+};
+
+struct align_probe {
+    char c;
+    union max_align u;
+};
+
+#define ALIGNMENT  offsetof(struct align_probe, u)
+#define ALIGN(x)   (((x) + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT)
+
+/* Header of a block; the memory handed out follows it. */
+struct block {
+    struct block *next;
+    union max_align data[];
+};
+
+struct cs_arena {
+    struct block *blocks;   /* the current block first */
+    char *pos;              /* next free byte in the current block */
+    char *end;
+    size_t block_size;
+    size_t size;
+};
+
+static struct block *new_block(size_t size);
+static struct block *home_block(struct cs_arena *arena);
+static void free_blocks(struct block *block, struct block *keep);
+
+struct cs_arena *cs_arena_new(size_t block_size)
+{
+    struct cs_arena *arena;
+    struct block *first;
+
+    if (block_size == 0)
+        block_size = CS_ARENA_BLOCK;
+    block_size = ALIGN(block_size);
+
+    /* The arena lives at the start of its first block. */
+    first = new_block(ALIGN(sizeof (struct cs_arena)) + block_size);
+    if (first == NULL)
+        return NULL;
+    arena = (struct cs_arena *)first->data;
+    arena->blocks = first;
+    arena->pos = (char *)first->data + ALIGN(sizeof (struct cs_arena));
+    arena->end = arena->pos + block_size;
+    arena->block_size = block_size;
+    arena->size = 0;
+    return arena;
+}
+
+void *cs_arena_alloc(struct cs_arena *arena, size_t size)
+{
+    assert(arena != NULL);
+
+    struct block *block;
+    void *memory;
+
+    size = ALIGN(size ? size : 1);
+    if (size <= (size_t)(arena->end - arena->pos)) {
+        memory = arena->pos;
+        arena->pos += size;
+        arena->size += size;
+        return memory;
+    }
+
+    if (size > arena->block_size / 4) {
+        /* Put it behind the current block, which stays current. */
+        block = new_block(size);
+        if (block == NULL)
+            return NULL;
+        block->next = arena->blocks->next;
+        arena->blocks->next = block;
+        arena->size += size;
+        return block->data;
+    }
+
+    block = new_block(arena->block_size);
+    if (block == NULL)
+        return NULL;
+    block->next = arena->blocks;
+    arena->blocks = block;
+    arena->pos = (char *)block->data + size;
+    arena->end = (char *)block->data + arena->block_size;
+    arena->size += size;
+    return block->data;
+}
+
+char *cs_arena_strndup(struct cs_arena *arena, const char *string, size_t len)
+{
+    assert(string != NULL);
+
+    char *copy = cs_arena_alloc(arena, len + 1);
+    if (copy != NULL) {
+        memcpy(copy, string, len);
+        copy[len] = '\0';
+    }
+    return copy;
+}
+
+char *cs_arena_strdup(struct cs_arena *arena, const char *string)
+{
+    assert(string != NULL);
+
+    return cs_arena_strndup(arena, string, strlen(string));
+}
+
+void cs_arena_reset(struct cs_arena *arena)
+{
+    assert(arena != NULL);
+
+    struct block *home = home_block(arena);
+
+    free_blocks(arena->blocks, home);
+    home->next = NULL;
+    arena->blocks = home;
+    arena->pos = (char *)home->data + ALIGN(sizeof (struct cs_arena));
+    arena->end = arena->pos + arena->block_size;
+    arena->size = 0;
+}
+
+size_t cs_arena_size(const struct cs_arena *arena)
+{
+    assert(arena != NULL);
+
+    return arena->size;
+}
+
+void cs_arena_free(struct cs_arena *arena)
+{
+    if (arena == NULL)
+        return;
+    free_blocks(arena->blocks, home_block(arena));
+    free(home_block(arena));
+}
+
+static struct block *new_block(size_t size)
+{
+    struct block *block = malloc(sizeof (struct block) + size);
+
+    if (block != NULL)
+        block->next = NULL;
+    return block;
+}
+
+/*
+ * Returns the block that the arena itself lives in.
+ */
+static struct block *home_block(struct cs_arena *arena)
+{
+    return (struct block *)((char *)arena - offsetof(struct block, data));
+}
+
+/*
+ * Free the blocks in the list starting at block, except keep.
+ */
+static void free_blocks(struct block *block, struct block *keep)
+{
+    while (block != NULL) {
+        struct block *next = block->next;
+        if (block != keep)
+            free(block);
+        block = next;
+    }
+}
@@ -0,0 +1,112 @@
+/*
+ * libcassava/arena.h
+ * vim: set cin ts=4 sw=4 et cc=80:
+ *
+ * Copyright (c) 2012 Ben Morgan <neembi@googlemail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION
+ * OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/**
+ * \file
+ * A region allocator: many small allocations carved out of a few large
+ * blocks, all freed at once.
+ *
+ * Allocating from an arena only moves a pointer, and nothing is freed
+ * individually; cs_arena_free() releases everything with one call per block.
+ * Objects allocated one after the other lie next to each other in memory.
+ *
+ * <b>Example Usage:</b>
+ * \code
+ *     struct cs_arena *arena = cs_arena_new(0);
+ *     NodeStr *head;
+ *     get_filepaths_arena("/usr/include", &head, arena);
+ *     list_println(head, "");
+ *     cs_arena_free(arena);   // the whole list is gone
+ * \endcode
+ *
+ * \author Ben Morgan
+ * \date 17. October 2026
+ */
+
+#ifndef LIBCASSAVA_ARENA_H
+#define LIBCASSAVA_ARENA_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+#include <stdlib.h>
+
+/** Default size of the blocks of an arena. */
+#define CS_ARENA_BLOCK (64 * 1024)
+
+/**
+ * A region of memory; see arena.h.
+ */
+struct cs_arena;
+
+/**
+ * Create a new arena.
+ *
+ * \param block_size Size of the blocks memory is carved out of, 0 for
+ *                   CS_ARENA_BLOCK. Larger allocations get a block of their
+ *                   own.
+ * \return Newly allocated arena, to be freed with cs_arena_free(), or \c NULL
+ *         if there is not enough memory.
+ */
+extern struct cs_arena *cs_arena_new(size_t block_size);
+
+/**
+ * Allocate \a size bytes from \a arena, suitably aligned for any type.
+ * The memory is not initialized; it is freed only together with the arena.
+ *
+ * \return Pointer to the memory, or \c NULL if there is not enough memory.
+ */
+extern void *cs_arena_alloc(struct cs_arena *arena, size_t size);
+
+/**
+ * Copy the first \a len characters of \a string into \a arena and terminate
+ * the copy with '\\0'.
+ */
+extern char *cs_arena_strndup(struct cs_arena *arena, const char *string, size_t len);
+
+/**
+ * Copy \a string into \a arena.
+ */
+extern char *cs_arena_strdup(struct cs_arena *arena, const char *string);
+
+/**
+ * Free everything allocated from \a arena, but keep its first block for
+ * further allocations.
+ */
+extern void cs_arena_reset(struct cs_arena *arena);
+
+/**
+ * Returns the number of bytes allocated from \a arena so far, including
+ * padding for alignment.
+ */
+extern size_t cs_arena_size(const struct cs_arena *arena);
+
+/**
+ * Free \a arena and everything allocated from it.
+ */
+extern void cs_arena_free(struct cs_arena *arena);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* LIBCASSAVA_ARENA_H */
@@ -0,0 +1,384 @@
+/*
+ * libcassava/bench.c
+ * vim: set cin ts=4 sw=4 fdm=syntax et:
+ *
+ * Copyright (c) 2012 Ben Morgan <neembi@googlemail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION
+ * OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * Benchmarks of libcassava functions against the obvious alternatives.
+ *
+ * Usage: ./bench [directory]
+ *
+ * The names used are generated, plus those in directory if given.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <pthread.h>
+#include <regex.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "globset.h"
+#include "list.h"
+#include "list_str.h"
+#include "lockfree.h"
+#include "parallel.h"
+#include "string.h"
+#include "strset.h"
+#include "system.h"
+#include "ulist.h"
+
+#define NAMES    100000
+#define ROUNDS   20
+#define ELEMENTS 10000000
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/*
+ * Make up file names of the kind found in a log or build directory.
+ */
+static char **make_names(const char *path, size_t *count)
+{
+    static const char *stems[] = { "access", "error", "core", "libfoo", "main", "README" };
+    static const char *exts[] = { ".log", ".log.1", ".c", ".h", ".o", ".so.1", "", ".tmp" };
+    char **names = malloc(NAMES * sizeof (char *));
+    char buffer[64];
+    size_t n;
+
+    srand(42);
+    for (n = 0; n < NAMES; n++) {
+        const char *stem = stems[rand() % 6];
+        if (stem[0] == 'c' && rand() % 2)
+            snprintf(buffer, sizeof buffer, "core.%d", rand() % 100000);
+        else
+            snprintf(buffer, sizeof buffer, "%s-%d%s", stem, rand() % 1000, exts[rand() % 8]);
+        names[n] = strdup(buffer);
+    }
+
+    if (path != NULL) {
+        NodeStr *head, *iter;
+        size_t more = get_filenames(path, &head);
+        names = realloc(names, (n + more) * sizeof (char *));
+        for (iter = head; iter != NULL; iter = iter->next)
+            names[n++] = strdup(iter->data);
+        list_free_all(&head);
+    }
+    *count = n;
+    return names;
+}
+
+/*
+ * Match all names against a glob and against the equivalent regex, and
+ * print the time per name of each.
+ */
+static void bench_glob(char **names, size_t count, const char *label,
+                       const char *const *globs, size_t nglobs, const char *regex)
+{
+    struct cs_glob *glob = cs_glob_set_new(globs, nglobs);
+    regex_t preg;
+    size_t i, round, glob_hits = 0, regex_hits = 0;
+    double start, glob_time, regex_time;
+
+    regcomp(&preg, regex, REG_EXTENDED | REG_NOSUB);
+
+    start = now();
+    for (round = 0; round < ROUNDS; round++) {
+        for (i = 0; i < count; i++)
+            glob_hits += cs_glob_match(glob, names[i]);
+    }
+    glob_time = now() - start;
+
+    start = now();
+    for (round = 0; round < ROUNDS; round++) {
+        for (i = 0; i < count; i++)
+            regex_hits += regexec(&preg, names[i], 0, NULL, 0) == 0;
+    }
+    regex_time = now() - start;
+
+    printf("%-16s glob %6.1f ns, regexec %6.1f ns: %5.1fx%s\n",
+           label, glob_time / (ROUNDS * count) * 1e9,
+           regex_time / (ROUNDS * count) * 1e9,
+           regex_time / glob_time,
+           glob_hits == regex_hits ? "" : "  (results differ!)");
+
+    regfree(&preg);
+    cs_glob_free(glob);
+}
+
+/*
+ * Use a list as a queue of varying length, with nodes from malloc() and from
+ * a list_pool, and print the time per push and pop of each.
+ */
+static void bench_list_pool(char **names, size_t count)
+{
+    struct list_pool *pool = list_pool_new(0);
+    struct list_node *head = NULL;
+    size_t i, round, depth = count < 64 ? count : 64;
+    double start, malloc_time, pool_time;
+
+    start = now();
+    for (round = 0; round < ROUNDS; round++) {
+        for (i = 0; i < count; i++) {
+            list_push(&head, names[i]);
+            if (i % depth == depth - 1)
+                while (head != NULL)
+                    list_pop(&head);
+        }
+        while (head != NULL)
+            list_pop(&head);
+    }
+    malloc_time = now() - start;
+
+    start = now();
+    for (round = 0; round < ROUNDS; round++) {
+        for (i = 0; i < count; i++) {
+            list_pool_push(pool, &head, names[i]);
+            if (i % depth == depth - 1)
+                while (head != NULL)
+                    list_pool_pop(pool, &head);
+        }
+        list_pool_free_nodes(pool, &head);
+    }
+    pool_time = now() - start;
+
+    printf("%-16s malloc %6.1f ns, list_pool %6.1f ns: %5.1fx\n", "list push+pop",
+           malloc_time / (ROUNDS * count) * 1e9, pool_time / (ROUNDS * count) * 1e9,
+           malloc_time / pool_time);
+    list_pool_free(pool);
+}
+
+/*
+ * Go through a list and an unrolled list of ELEMENTS names, by searching
+ * for a name that is not there and by copying them into an array, and print
+ * the time per element of each.
+ */
+static void bench_ulist(char **names, size_t count)
+{
+    NodeStr *head = NULL;
+    struct ulist list;
+    void **array;
+    size_t i;
+    double start, list_search_time, ulist_search_time, list_array_time, ulist_array_time;
+
+    ulist_init(&list);
+    for (i = 0; i < ELEMENTS; i++) {
+        list_push((struct list_node **)&head, names[i % count]);
+        ulist_push(&list, names[i % count]);
+    }
+
+    start = now();
+    list_search(head, "not there");
+    list_search_time = now() - start;
+    start = now();
+    ulist_search(&list, "not there");
+    ulist_search_time = now() - start;
+
+    start = now();
+    list_to_array((struct list_node *)head, &array);
+    list_array_time = now() - start;
+    free(array);
+    start = now();
+    ulist_to_array(&list, &array);
+    ulist_array_time = now() - start;
+    free(array);
+
+    printf("%-16s list %6.1f ns, ulist %6.1f ns: %5.1fx\n", "search",
+           list_search_time / ELEMENTS * 1e9, ulist_search_time / ELEMENTS * 1e9,
+           list_search_time / ulist_search_time);
+    printf("%-16s list %6.1f ns, ulist %6.1f ns: %5.1fx\n", "to_array",
+           list_array_time / ELEMENTS * 1e9, ulist_array_time / ELEMENTS * 1e9,
+           list_array_time / ulist_array_time);
+
+    list_free_nodes((struct list_node **)&head);
+    ulist_free_chunks(&list);
+}
+
+static int compare_names(const void *a, const void *b, void *arg)
+{
+    (void)arg;
+    return strcmp(a, b);
+}
+
+static void bench_list_sort(char **names, size_t count)
+{
+    NodeStr *head = NULL, *other = NULL;
+    char **array;
+    size_t i;
+    double start, qsort_time, sort_time, sorted_time, parallel_time;
+
+    /* The same names over and over, in an order that is far from sorted. */
+    array = malloc(ELEMENTS * sizeof (char *));
+    for (i = 0; i < ELEMENTS; i++) {
+        array[i] = names[(i * 7919) % count];
+        list_push((struct list_node **)&head, array[i]);
+        list_push((struct list_node **)&other, array[i]);
+    }
+
+    start = now();
+    cs_qsort(array, ELEMENTS);
+    qsort_time = now() - start;
+    start = now();
+    list_strsort(&head);
+    sort_time = now() - start;
+    start = now();
+    list_strsort(&head);
+    sorted_time = now() - start;
+    start = now();
+    list_sort_parallel((struct list_node **)&other, compare_names, NULL, 0);
+    parallel_time = now() - start;
+
+    printf("%-16s qsort %6.1f ns, list %6.1f ns, sorted %6.1f ns, parallel %6.1f ns\n",
+           "sort", qsort_time / ELEMENTS * 1e9, sort_time / ELEMENTS * 1e9,
+           sorted_time / ELEMENTS * 1e9, parallel_time / ELEMENTS * 1e9);
+
+    list_free_nodes((struct list_node **)&head);
+    list_free_nodes((struct list_node **)&other);
+    free(array);
+}
+
+struct stack_bench {
+    pthread_mutex_t lock;
+    struct list_node *head;
+    struct lfstack *stack;
+};
+
+static void push_pop_locked(size_t begin, size_t end, void *arg)
+{
+    struct stack_bench *bench = arg;
+    size_t i;
+
+    for (i = begin; i < end; i++) {
+        pthread_mutex_lock(&bench->lock);
+        list_push(&bench->head, NULL);
+        pthread_mutex_unlock(&bench->lock);
+        pthread_mutex_lock(&bench->lock);
+        list_pop(&bench->head);
+        pthread_mutex_unlock(&bench->lock);
+    }
+}
+
+static void push_pop_lockfree(size_t begin, size_t end, void *arg)
+{
+    struct stack_bench *bench = arg;
+    struct list_node *node = list_node();
+    size_t i;
+
+    for (i = begin; i < end; i++) {
+        lfstack_push(bench->stack, node);
+        node = lfstack_pop(bench->stack);
+    }
+    free(node);
+}
+
+static void bench_lockfree(void)
+{
+    struct stack_bench bench;
+    unsigned threads = cs_parallel_threads();
+    double start, locked_time, lockfree_time;
+
+    pthread_mutex_init(&bench.lock, NULL);
+    bench.head = NULL;
+    bench.stack = lfstack_new();
+
+    /* Many pairs per range, so that the threads contend rather than take turns. */
+    start = now();
+    cs_parallel_for(ELEMENTS, ELEMENTS / 64, threads, push_pop_locked, &bench);
+    locked_time = now() - start;
+    start = now();
+    cs_parallel_for(ELEMENTS, ELEMENTS / 64, threads, push_pop_lockfree, &bench);
+    lockfree_time = now() - start;
+
+    printf("%-16s mutex %6.1f ns, lfstack %6.1f ns: %5.1fx (%u threads)\n", "push+pop",
+           locked_time / ELEMENTS * 1e9, lockfree_time / ELEMENTS * 1e9,
+           locked_time / lockfree_time, threads);
+
+    lfstack_free(bench.stack);
+    pthread_mutex_destroy(&bench.lock);
+}
+
+static void bench_strset(char **names, size_t count)
+{
+    NodeStr *head = NULL;
+    struct cs_strset *set;
+    size_t i, queries = count < 10000 ? count : 10000, found = 0;
+    double start, search_time, build_time, find_time;
+
+    for (i = 0; i < count; i++)
+        list_push((struct list_node **)&head, names[i]);
+
+    /* Every name looked up is in the list, so list_search() goes through half of it. */
+    start = now();
+    for (i = 0; i < queries; i++)
+        found += list_search(head, names[(i * 7919) % count]) != NULL;
+    search_time = now() - start;
+
+    start = now();
+    set = cs_strset_new(count, NULL);
+    cs_strset_add_list(set, head);
+    build_time = now() - start;
+    start = now();
+    for (i = 0; i < queries; i++) {
+        const char *name = names[(i * 7919) % count];
+        found += cs_strset_contains(set, name, strlen(name));
+    }
+    find_time = now() - start;
+
+    printf("%-16s list %8.1f ns, strset %6.1f ns (%.1f ns to add): %7.1fx%s\n", "search",
+           search_time / queries * 1e9, find_time / queries * 1e9, build_time / count * 1e9,
+           search_time / find_time, found == 2 * queries ? "" : " (mismatch)");
+
+    cs_strset_free(set);
+    list_free_nodes((struct list_node **)&head);
+}
+
+int main(int argc, char **argv)
+{
+    static const char *log[] = { "*.log" };
+    static const char *core[] = { "core.[0-9]*" };
+    static const char *source[] = { "*.[ch]" };
+    static const char *lib[] = { "lib*.so.[0-9]" };
+    static const char *readme[] = { "README*" };
+    static const char *set[] = { "*.log", "*.tmp", "core.[0-9]*" };
+    size_t count, i;
+    char **names = make_names(argc > 1 ? argv[1] : NULL, &count);
+
+    printf("%zu names, %d rounds; time per name\n", count, ROUNDS);
+    bench_glob(names, count, log[0], log, 1, "^.*\\.log$");
+    bench_glob(names, count, core[0], core, 1, "^core\\.[0-9].*$");
+    bench_glob(names, count, source[0], source, 1, "^.*\\.[ch]$");
+    bench_glob(names, count, lib[0], lib, 1, "^lib.*\\.so\\.[0-9]$");
+    bench_glob(names, count, readme[0], readme, 1, "^README.*$");
+    bench_glob(names, count, "set of 3", set, 3, "^(.*\\.log|.*\\.tmp|core\\.[0-9].*)$");
+    bench_list_pool(names, count);
+    bench_ulist(names, count);
+    bench_list_sort(names, count);
+    bench_lockfree();
+    bench_strset(names, count);
+
+    for (i = 0; i < count; i++)
+        free(names[i]);
+    free(names);
+    return 0;
+}
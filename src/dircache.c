@@ -0,0 +1,416 @@
+/*
+ * libcassava/dircache.c
+ * vim: set cin ts=4 sw=4 et cc=100:
+ *
+ * Copyright (c) 2012 Ben Morgan <neembi@googlemail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#define _GNU_SOURCE
+
+#include "dircache.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+
+#include "list.h"
+#include "system.h"
+
+/*
+ * The names of a directory, one after the other with their terminating
+ * '\0', stored right behind this header.
+ */
+struct listing {
+    dev_t dev;
+    ino_t ino;
+    struct timespec mtime;
+    struct timespec ctime;
+    size_t count;
+    size_t size;                /* bytes of names */
+    struct listing *chain;      /* next in the same hash bucket */
+    struct listing *prev;       /* towards the most recently used */
+    struct listing *next;
+};
+
+struct cs_dircache {
+    pthread_mutex_t lock;
+    struct listing **buckets;
+    size_t nbuckets;            /* a power of two */
+    struct listing *head;       /* most recently used */
+    struct listing *tail;
+    struct cs_dircache_stats stats;
+};
+
+/* The names read by collect_name(). */
+struct name_buffer {
+    char *data;
+    size_t size;
+    size_t used;
+    size_t count;
+};
+
+static int list_cached(struct cs_dircache *cache, const char *path, bool full_pathnames,
+                       NodeStr **head, struct cs_arena *arena);
+static int collect_name(const char *data, size_t len, const struct cs_dirent *entry, void *arg);
+static int build_list(const char *path, bool full_pathnames, const char *names, size_t count,
+                      NodeStr **head, struct cs_arena *arena);
+static struct listing **find(struct cs_dircache *cache, dev_t dev, ino_t ino);
+static void insert(struct cs_dircache *cache, struct listing *listing);
+static void drop(struct cs_dircache *cache, struct listing **link);
+static void touch(struct cs_dircache *cache, struct listing *listing);
+static bool same_time(const struct timespec *a, const struct timespec *b);
+
+struct cs_dircache *cs_dircache_new(size_t max_bytes)
+{
+    struct cs_dircache *cache = calloc(1, sizeof (struct cs_dircache));
+    if (cache == NULL)
+        goto error;
+
+    cache->nbuckets = 64;
+    cache->buckets = calloc(cache->nbuckets, sizeof (struct listing *));
+    if (cache->buckets == NULL)
+        goto error;
+    pthread_mutex_init(&cache->lock, NULL);
+    cache->stats.max_bytes = max_bytes;
+    return cache;
+
+error:
+    perror("Error (cs_dircache_new)");
+    free(cache);
+    return NULL;
+}
+
+void cs_dircache_free(struct cs_dircache *cache)
+{
+    struct listing *listing;
+
+    if (cache == NULL)
+        return;
+    listing = cache->head;
+    while (listing != NULL) {
+        struct listing *next = listing->next;
+        free(listing);
+        listing = next;
+    }
+    free(cache->buckets);
+    pthread_mutex_destroy(&cache->lock);
+    free(cache);
+}
+
+int cs_dircache_list(struct cs_dircache *cache, const char *path, bool full_pathnames,
+                     NodeStr **head)
+{
+    return list_cached(cache, path, full_pathnames, head, NULL);
+}
+
+int cs_dircache_list_arena(struct cs_dircache *cache, const char *path, bool full_pathnames,
+                           NodeStr **head, struct cs_arena *arena)
+{
+    assert(arena != NULL);
+
+    return list_cached(cache, path, full_pathnames, head, arena);
+}
+
+void cs_dircache_invalidate(struct cs_dircache *cache, const char *path)
+{
+    assert(cache != NULL);
+    assert(path != NULL);
+
+    struct listing **link;
+    struct stat st;
+
+    if (stat(path, &st) != 0)
+        return;
+    pthread_mutex_lock(&cache->lock);
+    link = find(cache, st.st_dev, st.st_ino);
+    if (*link != NULL)
+        drop(cache, link);
+    pthread_mutex_unlock(&cache->lock);
+}
+
+void cs_dircache_stats(struct cs_dircache *cache, struct cs_dircache_stats *stats)
+{
+    assert(cache != NULL);
+    assert(stats != NULL);
+
+    pthread_mutex_lock(&cache->lock);
+    *stats = cache->stats;
+    pthread_mutex_unlock(&cache->lock);
+}
+
+static int list_cached(struct cs_dircache *cache, const char *path, bool full_pathnames,
+                       NodeStr **head, struct cs_arena *arena)
+{
+    assert(cache != NULL);
+    assert(path != NULL);
+    assert(head != NULL);
+
+    struct name_buffer names = { NULL, 0, 0, 0 };
+    struct listing **link, *listing;
+    struct timespec now;
+    struct stat st;
+    int count;
+
+    *head = NULL;
+    if (stat(path, &st) != 0) {
+        perror("Error (cs_dircache_list)");
+        return -1;
+    }
+
+    pthread_mutex_lock(&cache->lock);
+    link = find(cache, st.st_dev, st.st_ino);
+    if (*link != NULL) {
+        listing = *link;
+        if (same_time(&listing->mtime, &st.st_mtim) && same_time(&listing->ctime, &st.st_ctim)) {
+            cache->stats.hits++;
+            touch(cache, listing);
+            count = build_list(path, full_pathnames, (char *)(listing + 1), listing->count,
+                               head, arena);
+            pthread_mutex_unlock(&cache->lock);
+            return count;
+        }
+        cache->stats.stale++;
+        drop(cache, link);
+    } else {
+        cache->stats.misses++;
+    }
+    pthread_mutex_unlock(&cache->lock);
+
+    clock_gettime(CLOCK_REALTIME, &now);
+    if (read_directory_foreach(path, false, collect_name, &names) < 0) {
+        free(names.data);
+        return -1;
+    }
+    count = build_list(path, full_pathnames, names.data, names.count, head, arena);
+
+    /* A change within the same second could leave the times as they are. */
+    if (count < 0 || st.st_mtim.tv_sec + 1 >= now.tv_sec || st.st_ctim.tv_sec + 1 >= now.tv_sec
+        || sizeof (struct listing) + names.used > cache->stats.max_bytes) {
+        free(names.data);
+        return count;
+    }
+
+    /* Without memory for the listing, the directory is just not cached. */
+    listing = malloc(sizeof (struct listing) + names.used);
+    if (listing == NULL) {
+        free(names.data);
+        return count;
+    }
+    listing->dev = st.st_dev;
+    listing->ino = st.st_ino;
+    listing->mtime = st.st_mtim;
+    listing->ctime = st.st_ctim;
+    listing->count = names.count;
+    listing->size = names.used;
+    memcpy(listing + 1, names.data, names.used);
+    free(names.data);
+
+    pthread_mutex_lock(&cache->lock);
+    link = find(cache, st.st_dev, st.st_ino);
+    if (*link != NULL)
+        drop(cache, link);
+    insert(cache, listing);
+    pthread_mutex_unlock(&cache->lock);
+    return count;
+}
+
+/*
+ * A cs_dir_visitor that appends every name to a struct name_buffer.
+ */
+static int collect_name(const char *data, size_t len, const struct cs_dirent *entry, void *arg)
+{
+    struct name_buffer *names = arg;
+
+    (void)entry;
+    if (names->used + len + 1 > names->size) {
+        char *data = realloc(names->data, 2 * (names->used + len + 1));
+        if (data == NULL)
+            return -1;
+        names->data = data;
+        names->size = 2 * (names->used + len + 1);
+    }
+    memcpy(names->data + names->used, data, len + 1);
+    names->used += len + 1;
+    names->count++;
+    return 0;
+}
+
+/*
+ * Make a list of count names stored one after the other, prefixed with
+ * path if full_pathnames, allocated from arena unless it is NULL.
+ *
+ * \return count, or -1 if there is not enough memory.
+ */
+static int build_list(const char *path, bool full_pathnames, const char *names, size_t count,
+                      NodeStr **head, struct cs_arena *arena)
+{
+    size_t prefix = full_pathnames ? strlen(path) : 0;
+    bool slash = full_pathnames && (prefix == 0 || path[prefix-1] != '/');
+    NodeStr *tail = NULL;
+    size_t i;
+
+    *head = NULL;
+    for (i = 0; i < count; i++) {
+        size_t len = strlen(names);
+        size_t size = prefix + slash + len + 1;
+        NodeStr *node;
+
+        if (arena != NULL) {
+            node = cs_arena_alloc(arena, sizeof (NodeStr) + size);
+            if (node == NULL)
+                goto error;
+            node->data = (char *)(node + 1);
+            node->next = NULL;
+        } else {
+            node = list_node();
+            if (node == NULL)
+                goto error;
+            node->data = malloc(size);
+            if (node->data == NULL) {
+                free(node);
+                goto error;
+            }
+        }
+        memcpy(node->data, path, prefix);
+        if (slash)
+            node->data[prefix] = '/';
+        memcpy(node->data + prefix + slash, names, len + 1);
+        names += len + 1;
+
+        if (tail == NULL)
+            *head = node;
+        else
+            tail->next = node;
+        tail = node;
+    }
+    return count;
+
+error:
+    /* Nodes from an arena are only freed with the arena. */
+    if (arena == NULL)
+        list_free_all((struct list_node **)head);
+    *head = NULL;
+    errno = ENOMEM;
+    perror("Error (cs_dircache_list)");
+    return -1;
+}
+
+/*
+ * Returns the link pointing to the listing of (dev, ino), which points to
+ * NULL if there is none. Must be called with the lock held.
+ */
+static struct listing **find(struct cs_dircache *cache, dev_t dev, ino_t ino)
+{
+    uint64_t hash = ((uint64_t)ino ^ (uint64_t)dev << 32) * 0x9e3779b97f4a7c15ULL;
+    struct listing **link = &cache->buckets[(hash >> 32) & (cache->nbuckets - 1)];
+
+    while (*link != NULL && ((*link)->ino != ino || (*link)->dev != dev))
+        link = &(*link)->chain;
+    return link;
+}
+
+/*
+ * Add a listing that is not in the cache yet as the most recently used,
+ * and evict others until the cache is within its cap.
+ * Must be called with the lock held.
+ */
+static void insert(struct cs_dircache *cache, struct listing *listing)
+{
+    struct listing **link, **buckets;
+
+    /* If there is no memory for more buckets, the chains just get longer. */
+    if (cache->stats.entries >= cache->nbuckets
+        && (buckets = calloc(cache->nbuckets * 2, sizeof (struct listing *))) != NULL) {
+        struct listing *iter;
+        free(cache->buckets);
+        cache->buckets = buckets;
+        cache->nbuckets *= 2;
+        for (iter = cache->head; iter != NULL; iter = iter->next) {
+            link = find(cache, iter->dev, iter->ino);
+            iter->chain = NULL;
+            *link = iter;
+        }
+    }
+
+    link = find(cache, listing->dev, listing->ino);
+    listing->chain = NULL;
+    *link = listing;
+    listing->prev = NULL;
+    listing->next = cache->head;
+    if (cache->head != NULL)
+        cache->head->prev = listing;
+    else
+        cache->tail = listing;
+    cache->head = listing;
+    cache->stats.entries++;
+    cache->stats.bytes += sizeof (struct listing) + listing->size;
+
+    while (cache->stats.bytes > cache->stats.max_bytes) {
+        struct listing *victim = cache->tail;
+        cache->stats.evictions++;
+        drop(cache, find(cache, victim->dev, victim->ino));
+    }
+}
+
+/*
+ * Remove the listing that link points to from the cache and free it.
+ * Must be called with the lock held.
+ */
+static void drop(struct cs_dircache *cache, struct listing **link)
+{
+    struct listing *listing = *link;
+
+    *link = listing->chain;
+    if (listing->prev != NULL)
+        listing->prev->next = listing->next;
+    else
+        cache->head = listing->next;
+    if (listing->next != NULL)
+        listing->next->prev = listing->prev;
+    else
+        cache->tail = listing->prev;
+    cache->stats.entries--;
+    cache->stats.bytes -= sizeof (struct listing) + listing->size;
+    free(listing);
+}
+
+/*
+ * Make listing the most recently used. Must be called with the lock held.
+ */
+static void touch(struct cs_dircache *cache, struct listing *listing)
+{
+    if (listing == cache->head)
+        return;
+    listing->prev->next = listing->next;
+    if (listing->next != NULL)
+        listing->next->prev = listing->prev;
+    else
+        cache->tail = listing->prev;
+    listing->prev = NULL;
+    listing->next = cache->head;
+    cache->head->prev = listing;
+    cache->head = listing;
+}
+
+static bool same_time(const struct timespec *a, const struct timespec *b)
+{
+    return a->tv_sec == b->tv_sec && a->tv_nsec == b->tv_nsec;
+}
@@ -0,0 +1,141 @@
+/*
+ * libcassava/dircache.h
+ * vim: set cin ts=4 sw=4 et cc=80:
+ *
+ * Copyright (c) 2012 Ben Morgan <neembi@googlemail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION
+ * OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/**
+ * \file
+ * A cache of directory listings for directories that are listed again and
+ * again but rarely change.
+ *
+ * Listings are keyed by the device and inode of the directory, and stored
+ * together with its modification and change times. Asking for a listing
+ * costs a single stat() of the directory: if neither time has changed, the
+ * stored names are returned without reading the directory at all. Listings
+ * of directories modified within the last second before they were read are
+ * not kept, since a change in the same tick of the clock would not show.
+ *
+ * The cache holds at most a given number of bytes of names, evicting the
+ * least recently used listings first. All functions are thread-safe.
+ *
+ * <b>Example Usage:</b>
+ * \code
+ *     struct cs_dircache *cache = cs_dircache_new(16 << 20);
+ *     for (;;) {
+ *         NodeStr *head;
+ *         cs_dircache_list(cache, "/var/spool/jobs", true, &head);
+ *         process(head);
+ *         list_free_all(&head);
+ *         sleep(5);
+ *     }
+ * \endcode
+ *
+ * \author Ben Morgan
+ * \date 17. October 2026
+ */
+
+#ifndef LIBCASSAVA_DIRCACHE_H
+#define LIBCASSAVA_DIRCACHE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+#include <stdbool.h>
+#include <stdlib.h>
+
+#include "arena.h"
+#include "list_str.h"
+
+/**
+ * Directory listings kept for reuse; see dircache.h.
+ */
+struct cs_dircache;
+
+/**
+ * Counters of a cache, as returned by cs_dircache_stats().
+ */
+struct cs_dircache_stats {
+    unsigned long hits;      /**< Listings returned without reading. */
+    unsigned long misses;    /**< Directories not in the cache. */
+    unsigned long stale;     /**< Directories changed since they were read. */
+    unsigned long evictions; /**< Listings dropped to stay within the cap. */
+    size_t entries;          /**< Listings currently cached. */
+    size_t bytes;            /**< Memory used by the cached listings. */
+    size_t max_bytes;        /**< The cap given to cs_dircache_new(). */
+};
+
+/**
+ * Create a new, empty cache.
+ *
+ * \param max_bytes Upper limit of the memory used for listings; listings that
+ *                  are larger by themselves are never cached.
+ * \return Newly allocated cache, to be freed with cs_dircache_free(), or
+ *         \c NULL if out of memory.
+ */
+extern struct cs_dircache *cs_dircache_new(size_t max_bytes);
+
+/**
+ * Free a cache and all listings in it.
+ */
+extern void cs_dircache_free(struct cs_dircache *cache);
+
+/**
+ * List the directory \a path like read_directory(), from the cache if the
+ * directory has not changed since it was last read.
+ *
+ * \param cache          Cache to use.
+ * \param path           Directory to list.
+ * \param full_pathnames Whether to list full pathnames or just names.
+ * \param head           Set to the head of a newly allocated list, to be
+ *                       freed with list_free_all().
+ * \return Number of entries in the list, -1 on error.
+ */
+extern int cs_dircache_list(struct cs_dircache *cache,
+                            const char *path,
+                            bool full_pathnames,
+                            NodeStr **head);
+
+/**
+ * Same as cs_dircache_list(), but allocate the list from \a arena, as
+ * read_directory_arena() does.
+ */
+extern int cs_dircache_list_arena(struct cs_dircache *cache,
+                                  const char *path,
+                                  bool full_pathnames,
+                                  NodeStr **head,
+                                  struct cs_arena *arena);
+
+/**
+ * Drop the listing of \a path from the cache, if there is one.
+ */
+extern void cs_dircache_invalidate(struct cs_dircache *cache,
+                                  const char *path);
+
+/**
+ * Fill in \a stats with the current counters of \a cache.
+ */
+extern void cs_dircache_stats(struct cs_dircache *cache,
+                              struct cs_dircache_stats *stats);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* LIBCASSAVA_DIRCACHE_H */
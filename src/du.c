@@ -0,0 +1,619 @@
+/*
+ * libcassava/du.c
+ * vim: set cin ts=4 sw=4 et cc=100:
+ *
+ * Copyright (c) 2012 Ben Morgan <neembi@googlemail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#define _GNU_SOURCE
+
+#include "du.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "walk.h"
+
+/*
+ * Directories and inodes are kept in this many hash tables, each with its
+ * own lock, chosen by the hash of the key. Every inode table also has its
+ * own spill file, so the spill files are the partitions.
+ */
+#define DU_STRIPES 256
+
+struct du_dir {
+    struct du_dir *chain;
+    uint32_t hash;
+    size_t len;
+    struct cs_du_dir info;
+};
+
+struct dir_stripe {
+    pthread_mutex_t lock;
+    struct du_dir **buckets;
+    size_t nbuckets;
+    size_t count;
+};
+
+struct inode_key {
+    uint64_t dev;
+    uint64_t ino;
+};
+
+/* A file with several links that did not fit in memory. */
+struct spill_record {
+    uint64_t dev;
+    uint64_t ino;
+    uint64_t size;
+    uint64_t blocks;
+    struct du_dir *dir;
+};
+
+struct inode_stripe {
+    pthread_mutex_t lock;
+    struct inode_key *keys;     /* open addressing, 0/0 is empty */
+    size_t capacity;
+    size_t count;
+    FILE *spill;
+    size_t spilled;
+};
+
+struct du_run {
+    unsigned long id;
+    const char *spill_dir;
+    size_t max_inodes;          /* per stripe */
+    int error;                  /* errno of a failed spill or allocation */
+    struct du_dir *root;
+    struct dir_stripe dirs[DU_STRIPES];
+    struct inode_stripe inodes[DU_STRIPES];
+};
+
+struct cs_du {
+    struct cs_du_dir *dirs;
+    size_t count;
+    bool spilled;
+};
+
+/* The directory a worker thread added to last, for the run with the id. */
+static __thread struct du_dir *last_dir;
+static __thread unsigned long last_run;
+static unsigned long next_run = 1;
+
+static int visit_entry(const struct cs_walk_entry *entry, void *arg);
+static struct du_dir *get_dir(struct du_run *run, const char *path, size_t len, size_t depth);
+static struct du_dir *find_dir(struct du_run *run, const char *path, size_t len);
+static bool first_link(struct du_run *run, const struct stat *st, struct du_dir *dir);
+static bool insert_inode(struct inode_stripe *stripe, uint64_t dev, uint64_t ino, size_t limit);
+static bool find_inode(const struct inode_stripe *stripe, uint64_t dev, uint64_t ino);
+static int count_spilled(struct inode_stripe *stripe);
+static void add(struct du_dir *dir, uint64_t size, uint64_t blocks, uint64_t entries);
+static int roll_up(struct du_run *run);
+static struct cs_du *collect(struct du_run *run);
+static void free_run(struct du_run *run);
+static uint32_t hash_path(const char *path, size_t len);
+static uint64_t hash_inode(uint64_t dev, uint64_t ino);
+static int compare_inode(const void *p1, const void *p2);
+static int compare_depth(const void *p1, const void *p2);
+static int compare_path(const void *p1, const void *p2);
+
+struct cs_du *cs_du(const char *path, const struct cs_du_opts *opts)
+{
+    assert(path != NULL);
+
+    struct cs_walk_opts walk = { 0, false, 0 };
+    struct cs_du *du = NULL;
+    struct du_run *run;
+    struct stat st;
+    size_t max_inodes = CS_DU_MAX_INODES;
+    size_t i;
+
+    if (lstat(path, &st) != 0) {
+        perror("Error (cs_du)");
+        return NULL;
+    }
+
+    run = calloc(1, sizeof (struct du_run));
+    if (run == NULL) {
+        perror("Error (cs_du)");
+        return NULL;
+    }
+    run->id = __atomic_fetch_add(&next_run, 1, __ATOMIC_RELAXED);
+    run->spill_dir = getenv("TMPDIR") ? getenv("TMPDIR") : "/tmp";
+    if (opts != NULL) {
+        walk.threads = opts->threads;
+        if (opts->max_inodes > 0)
+            max_inodes = opts->max_inodes;
+        if (opts->spill_dir != NULL)
+            run->spill_dir = opts->spill_dir;
+    }
+    run->max_inodes = max_inodes / DU_STRIPES > 0 ? max_inodes / DU_STRIPES : 1;
+    for (i = 0; i < DU_STRIPES; i++) {
+        pthread_mutex_init(&run->dirs[i].lock, NULL);
+        pthread_mutex_init(&run->inodes[i].lock, NULL);
+    }
+
+    run->root = get_dir(run, path, strlen(path), 0);
+    if (run->root == NULL) {
+        perror("Error (cs_du)");
+        goto finally;
+    }
+    add(run->root, st.st_size, st.st_blocks, 1);
+    if (cs_walk(path, &walk, visit_entry, run) < 0)
+        goto finally;
+
+    for (i = 0; i < DU_STRIPES && run->error == 0; i++) {
+        if (run->inodes[i].spilled > 0 && count_spilled(&run->inodes[i]) != 0)
+            run->error = errno;
+    }
+    if (run->error != 0) {
+        errno = run->error;
+        perror("Error (cs_du)");
+        goto finally;
+    }
+
+    if (roll_up(run) != 0 || (du = collect(run)) == NULL)
+        perror("Error (cs_du)");
+
+finally:
+    free_run(run);
+    return du;
+}
+
+size_t cs_du_dirs(const struct cs_du *du, const struct cs_du_dir **dirs)
+{
+    assert(du != NULL);
+    assert(dirs != NULL);
+
+    *dirs = du->dirs;
+    return du->count;
+}
+
+const struct cs_du_dir *cs_du_find(const struct cs_du *du, const char *path)
+{
+    assert(du != NULL);
+    assert(path != NULL);
+
+    struct cs_du_dir key;
+
+    key.path = (char *)path;
+    return bsearch(&key, du->dirs, du->count, sizeof (struct cs_du_dir), compare_path);
+}
+
+bool cs_du_spilled(const struct cs_du *du)
+{
+    assert(du != NULL);
+
+    return du->spilled;
+}
+
+void cs_du_free(struct cs_du *du)
+{
+    size_t i;
+
+    if (du == NULL)
+        return;
+    for (i = 0; i < du->count; i++)
+        free(du->dirs[i].path);
+    free(du->dirs);
+    free(du);
+}
+
+/*
+ * A cs_walk_fn that adds an entry to the directory it is in, or, for
+ * directories, to their own record. Stops the walk if out of memory.
+ */
+static int visit_entry(const struct cs_walk_entry *entry, void *arg)
+{
+    struct du_run *run = arg;
+    struct du_dir *parent;
+    struct stat st;
+
+    if (fstatat(entry->dirfd, entry->name, &st, AT_SYMLINK_NOFOLLOW) != 0)
+        return CS_WALK_CONTINUE;
+
+    if (S_ISDIR(st.st_mode)) {
+        struct du_dir *dir = get_dir(run, entry->path, strlen(entry->path), entry->depth + 1);
+        if (dir == NULL)
+            goto error;
+        add(dir, st.st_size, st.st_blocks, 1);
+        return CS_WALK_CONTINUE;
+    }
+
+    if (entry->depth == 0)
+        parent = run->root;
+    else
+        parent = get_dir(run, entry->path, entry->name - entry->path - 1, entry->depth);
+    if (parent == NULL)
+        goto error;
+    if (st.st_nlink > 1 && !first_link(run, &st, parent))
+        return CS_WALK_CONTINUE;
+    add(parent, st.st_size, st.st_blocks, 1);
+    return CS_WALK_CONTINUE;
+
+error:
+    __atomic_store_n(&run->error, ENOMEM, __ATOMIC_RELAXED);
+    return CS_WALK_STOP;
+}
+
+/*
+ * Find the record of the directory with the first len bytes of path as
+ * its path, creating it if there is none. Returns NULL if out of memory.
+ */
+static struct du_dir *get_dir(struct du_run *run, const char *path, size_t len, size_t depth)
+{
+    struct dir_stripe *stripe;
+    struct du_dir *dir;
+    uint32_t hash;
+
+    /* The entries of a directory mostly come one after the other. */
+    if (last_run == run->id && last_dir->len == len && memcmp(last_dir->info.path, path, len) == 0)
+        return last_dir;
+
+    hash = hash_path(path, len);
+    stripe = &run->dirs[hash % DU_STRIPES];
+    pthread_mutex_lock(&stripe->lock);
+    for (dir = stripe->nbuckets ? stripe->buckets[(hash >> 8) & (stripe->nbuckets - 1)] : NULL;
+         dir != NULL; dir = dir->chain) {
+        if (dir->hash == hash && dir->len == len && memcmp(dir->info.path, path, len) == 0)
+            break;
+    }
+
+    if (dir == NULL) {
+        if (stripe->count >= stripe->nbuckets) {
+            size_t nbuckets = stripe->nbuckets ? 2 * stripe->nbuckets : 16, i;
+            struct du_dir **buckets = calloc(nbuckets, sizeof (struct du_dir *));
+            /* Without room to grow, the chains just get longer. */
+            if (buckets == NULL && stripe->nbuckets == 0)
+                goto error;
+            for (i = 0; buckets != NULL && i < stripe->nbuckets; i++) {
+                struct du_dir *iter = stripe->buckets[i], *next;
+                for (; iter != NULL; iter = next) {
+                    struct du_dir **link = &buckets[(iter->hash >> 8) & (nbuckets - 1)];
+                    next = iter->chain;
+                    iter->chain = *link;
+                    *link = iter;
+                }
+            }
+            if (buckets != NULL) {
+                free(stripe->buckets);
+                stripe->buckets = buckets;
+                stripe->nbuckets = nbuckets;
+            }
+        }
+        dir = calloc(1, sizeof (struct du_dir));
+        if (dir == NULL)
+            goto error;
+        dir->info.path = strndup(path, len);
+        if (dir->info.path == NULL) {
+            free(dir);
+            goto error;
+        }
+        dir->hash = hash;
+        dir->len = len;
+        dir->info.depth = depth;
+        dir->chain = stripe->buckets[(hash >> 8) & (stripe->nbuckets - 1)];
+        stripe->buckets[(hash >> 8) & (stripe->nbuckets - 1)] = dir;
+        stripe->count++;
+    }
+    pthread_mutex_unlock(&stripe->lock);
+
+    last_run = run->id;
+    last_dir = dir;
+    return dir;
+
+error:
+    pthread_mutex_unlock(&stripe->lock);
+    return NULL;
+}
+
+/*
+ * Same as get_dir(), but without creating it, for use after the walk.
+ */
+static struct du_dir *find_dir(struct du_run *run, const char *path, size_t len)
+{
+    uint32_t hash = hash_path(path, len);
+    struct dir_stripe *stripe = &run->dirs[hash % DU_STRIPES];
+    struct du_dir *dir;
+
+    if (stripe->nbuckets == 0)
+        return NULL;
+    for (dir = stripe->buckets[(hash >> 8) & (stripe->nbuckets - 1)]; dir != NULL;
+         dir = dir->chain) {
+        if (dir->hash == hash && dir->len == len && memcmp(dir->info.path, path, len) == 0)
+            return dir;
+    }
+    return NULL;
+}
+
+/*
+ * Returns true if the file with several links in st is to be counted now,
+ * false if it was counted already or is left for count_spilled().
+ */
+static bool first_link(struct du_run *run, const struct stat *st, struct du_dir *dir)
+{
+    uint64_t hash = hash_inode(st->st_dev, st->st_ino);
+    struct inode_stripe *stripe = &run->inodes[hash % DU_STRIPES];
+    struct spill_record record;
+    bool first;
+
+    pthread_mutex_lock(&stripe->lock);
+    if (find_inode(stripe, st->st_dev, st->st_ino)) {
+        first = false;
+    } else if (insert_inode(stripe, st->st_dev, st->st_ino, run->max_inodes)) {
+        first = true;
+    } else {
+        first = false;
+        if (stripe->spill == NULL) {
+            size_t len = strlen(run->spill_dir);
+            char template[len + 20];
+            int fd;
+
+            memcpy(template, run->spill_dir, len);
+            memcpy(template + len, "/cassava-du-XXXXXX", 19);
+            fd = mkstemp(template);
+            if (fd >= 0) {
+                unlink(template);
+                stripe->spill = fdopen(fd, "w+b");
+            }
+        }
+        record.dev = st->st_dev;
+        record.ino = st->st_ino;
+        record.size = st->st_size;
+        record.blocks = st->st_blocks;
+        record.dir = dir;
+        if (stripe->spill == NULL || fwrite(&record, sizeof record, 1, stripe->spill) != 1)
+            __atomic_store_n(&run->error, errno ? errno : EIO, __ATOMIC_RELAXED);
+        else
+            stripe->spilled++;
+    }
+    pthread_mutex_unlock(&stripe->lock);
+    return first;
+}
+
+/*
+ * Add an inode to an open addressing table, growing it up to the limit.
+ * Returns false if the table is full or cannot grow, so that the inode is
+ * spilled instead.
+ */
+static bool insert_inode(struct inode_stripe *stripe, uint64_t dev, uint64_t ino, size_t limit)
+{
+    size_t i;
+
+    if (stripe->count >= limit)
+        return false;
+    if (4 * (stripe->count + 1) > 3 * stripe->capacity) {
+        size_t capacity = stripe->capacity ? 2 * stripe->capacity : 16;
+        struct inode_key *keys = calloc(capacity, sizeof (struct inode_key));
+        if (keys == NULL)
+            return false;
+        for (i = 0; i < stripe->capacity; i++) {
+            struct inode_key *key = &stripe->keys[i];
+            if (key->dev != 0 || key->ino != 0) {
+                size_t j = (hash_inode(key->dev, key->ino) >> 16) & (capacity - 1);
+                while (keys[j].dev != 0 || keys[j].ino != 0)
+                    j = (j + 1) & (capacity - 1);
+                keys[j] = *key;
+            }
+        }
+        free(stripe->keys);
+        stripe->keys = keys;
+        stripe->capacity = capacity;
+    }
+
+    i = (hash_inode(dev, ino) >> 16) & (stripe->capacity - 1);
+    while (stripe->keys[i].dev != 0 || stripe->keys[i].ino != 0)
+        i = (i + 1) & (stripe->capacity - 1);
+    stripe->keys[i].dev = dev;
+    stripe->keys[i].ino = ino;
+    stripe->count++;
+    return true;
+}
+
+static bool find_inode(const struct inode_stripe *stripe, uint64_t dev, uint64_t ino)
+{
+    size_t i;
+
+    if (stripe->capacity == 0)
+        return false;
+    i = (hash_inode(dev, ino) >> 16) & (stripe->capacity - 1);
+    while (stripe->keys[i].dev != 0 || stripe->keys[i].ino != 0) {
+        if (stripe->keys[i].dev == dev && stripe->keys[i].ino == ino)
+            return true;
+        i = (i + 1) & (stripe->capacity - 1);
+    }
+    return false;
+}
+
+/*
+ * Read back the spill file of a stripe, sort it by inode and count every
+ * inode that is not in memory once.
+ */
+static int count_spilled(struct inode_stripe *stripe)
+{
+    struct spill_record *records = malloc(stripe->spilled * sizeof (struct spill_record));
+    size_t i;
+
+    if (records == NULL)
+        return -1;
+    rewind(stripe->spill);
+    if (fread(records, sizeof (struct spill_record), stripe->spilled, stripe->spill)
+        != stripe->spilled) {
+        free(records);
+        errno = EIO;
+        return -1;
+    }
+    qsort(records, stripe->spilled, sizeof (struct spill_record), compare_inode);
+
+    for (i = 0; i < stripe->spilled; i++) {
+        const struct spill_record *r = &records[i];
+        if (i > 0 && r->dev == r[-1].dev && r->ino == r[-1].ino)
+            continue;
+        if (!find_inode(stripe, r->dev, r->ino))
+            add(r->dir, r->size, r->blocks, 1);
+    }
+    free(records);
+    return 0;
+}
+
+static void add(struct du_dir *dir, uint64_t size, uint64_t blocks, uint64_t entries)
+{
+    __atomic_fetch_add(&dir->info.size, size, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&dir->info.blocks, blocks, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&dir->info.entries, entries, __ATOMIC_RELAXED);
+}
+
+/*
+ * Add the totals of every directory to its parent, the deepest first, so
+ * that each one is complete when it is added. Returns -1 if out of memory.
+ */
+static int roll_up(struct du_run *run)
+{
+    struct du_dir **dirs;
+    size_t count = 0, i, j;
+
+    for (i = 0; i < DU_STRIPES; i++)
+        count += run->dirs[i].count;
+    dirs = malloc(count * sizeof (struct du_dir *));
+    if (dirs == NULL)
+        return -1;
+    count = 0;
+    for (i = 0; i < DU_STRIPES; i++) {
+        for (j = 0; j < run->dirs[i].nbuckets; j++) {
+            struct du_dir *dir;
+            for (dir = run->dirs[i].buckets[j]; dir != NULL; dir = dir->chain)
+                dirs[count++] = dir;
+        }
+    }
+    qsort(dirs, count, sizeof (struct du_dir *), compare_depth);
+
+    for (i = 0; i < count && dirs[i]->info.depth > 0; i++) {
+        struct du_dir *dir = dirs[i], *parent = run->root;
+        if (dir->info.depth > 1) {
+            const char *slash = memrchr(dir->info.path, '/', dir->len);
+            parent = find_dir(run, dir->info.path, slash - dir->info.path);
+            if (parent == NULL)
+                continue;
+        }
+        add(parent, dir->info.size, dir->info.blocks, dir->info.entries);
+    }
+    free(dirs);
+    return 0;
+}
+
+/*
+ * Move the totals of all directories into a result, sorted by path.
+ * Returns NULL if out of memory.
+ */
+static struct cs_du *collect(struct du_run *run)
+{
+    struct cs_du *du = calloc(1, sizeof (struct cs_du));
+    size_t i, j;
+
+    if (du == NULL)
+        return NULL;
+    for (i = 0; i < DU_STRIPES; i++) {
+        du->count += run->dirs[i].count;
+        du->spilled |= run->inodes[i].spilled > 0;
+    }
+    du->dirs = malloc(du->count * sizeof (struct cs_du_dir));
+    if (du->dirs == NULL) {
+        free(du);
+        return NULL;
+    }
+    du->count = 0;
+    for (i = 0; i < DU_STRIPES; i++) {
+        for (j = 0; j < run->dirs[i].nbuckets; j++) {
+            struct du_dir *dir;
+            for (dir = run->dirs[i].buckets[j]; dir != NULL; dir = dir->chain) {
+                du->dirs[du->count++] = dir->info;
+                dir->info.path = NULL;
+            }
+        }
+    }
+    qsort(du->dirs, du->count, sizeof (struct cs_du_dir), compare_path);
+    return du;
+}
+
+static void free_run(struct du_run *run)
+{
+    size_t i, j;
+
+    for (i = 0; i < DU_STRIPES; i++) {
+        for (j = 0; j < run->dirs[i].nbuckets; j++) {
+            struct du_dir *dir = run->dirs[i].buckets[j], *next;
+            for (; dir != NULL; dir = next) {
+                next = dir->chain;
+                free(dir->info.path);
+                free(dir);
+            }
+        }
+        free(run->dirs[i].buckets);
+        free(run->inodes[i].keys);
+        if (run->inodes[i].spill != NULL)
+            fclose(run->inodes[i].spill);
+        pthread_mutex_destroy(&run->dirs[i].lock);
+        pthread_mutex_destroy(&run->inodes[i].lock);
+    }
+    free(run);
+}
+
+/* FNV-1a */
+static uint32_t hash_path(const char *path, size_t len)
+{
+    uint32_t hash = 2166136261u;
+    size_t i;
+
+    for (i = 0; i < len; i++)
+        hash = (hash ^ (unsigned char)path[i]) * 16777619u;
+    return hash;
+}
+
+/* The finalizer of splitmix64 */
+static uint64_t hash_inode(uint64_t dev, uint64_t ino)
+{
+    uint64_t x = ino ^ (dev * 0x9e3779b97f4a7c15ULL);
+
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+static int compare_inode(const void *p1, const void *p2)
+{
+    const struct spill_record *a = p1, *b = p2;
+
+    if (a->dev != b->dev)
+        return a->dev < b->dev ? -1 : 1;
+    return (a->ino > b->ino) - (a->ino < b->ino);
+}
+
+static int compare_depth(const void *p1, const void *p2)
+{
+    const struct du_dir *a = *(struct du_dir *const *)p1, *b = *(struct du_dir *const *)p2;
+
+    return (a->info.depth < b->info.depth) - (a->info.depth > b->info.depth);
+}
+
+static int compare_path(const void *p1, const void *p2)
+{
+    return strcmp(((const struct cs_du_dir *)p1)->path, ((const struct cs_du_dir *)p2)->path);
+}
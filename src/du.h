@@ -0,0 +1,150 @@
+/*
+ * libcassava/du.h
+ * vim: set cin ts=4 sw=4 et cc=80:
+ *
+ * Copyright (c) 2012 Ben Morgan <neembi@googlemail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION
+ * OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/**
+ * \file
+ * Disk usage of directory trees, summed up in parallel.
+ *
+ * cs_du() walks a tree with cs_walk(), stat()s every entry relative to the
+ * directory it is in from the worker thread that found it, and adds it up
+ * for every directory, including everything below it, like du(1) does.
+ *
+ * Files with more than one link are only counted once, for the directory in
+ * which they are found first. To know which were seen already, their device
+ * and inode numbers are kept in a hash set of bounded size. Once it is full,
+ * further such files are written to temporary files, partitioned by the hash
+ * of their inode, and each partition is sorted and counted on its own after
+ * the walk. Trees with any number of hard links can so be summed up in
+ * bounded memory.
+ *
+ * <b>Example Usage:</b>
+ * \code
+ *     struct cs_du *du = cs_du("/home", NULL);
+ *     const struct cs_du_dir *dirs;
+ *     size_t i, count = cs_du_dirs(du, &dirs);
+ *     for (i = 0; i < count; i++) {
+ *         if (dirs[i].depth == 1)
+ *             printf("%llu\t%s\n", dirs[i].blocks / 2, dirs[i].path);
+ *     }
+ *     cs_du_free(du);
+ * \endcode
+ *
+ * \author Ben Morgan
+ * \date 17. October 2026
+ */
+
+#ifndef LIBCASSAVA_DU_H
+#define LIBCASSAVA_DU_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+/** Number of files with several links kept in memory unless changed. */
+#define CS_DU_MAX_INODES (1 << 22)
+
+/**
+ * Options for cs_du(). Passing \c NULL to cs_du() is the same as passing a
+ * zero-initialized struct.
+ *
+ * \param threads    Number of threads to walk with, or 0 for one per CPU.
+ * \param max_inodes Files with several links to keep in memory before
+ *                   spilling to disk, or 0 for CS_DU_MAX_INODES.
+ * \param spill_dir  Directory for the temporary files, or \c NULL for
+ *                   $TMPDIR or else /tmp.
+ */
+struct cs_du_opts {
+    unsigned threads;
+    size_t max_inodes;
+    const char *spill_dir;
+};
+
+/**
+ * Disk usage of a directory, including everything below it and the
+ * directory itself.
+ *
+ * \param path    Path of the directory, starting with the path given to
+ *                cs_du().
+ * \param depth   Depth of the directory, 0 for the path given to cs_du().
+ * \param size    Sum of the apparent sizes in bytes.
+ * \param blocks  Sum of the blocks allocated, in units of 512 bytes.
+ * \param entries Number of entries counted.
+ */
+struct cs_du_dir {
+    char *path;
+    size_t depth;
+    uint64_t size;
+    uint64_t blocks;
+    uint64_t entries;
+};
+
+/**
+ * The result of cs_du().
+ */
+struct cs_du;
+
+/**
+ * Sum up the disk usage of the tree below \a path.
+ *
+ * Entries that cannot be stat()ed are not counted; directories that cannot
+ * be read are reported with perror() and counted without their entries.
+ *
+ * \return Newly allocated result to be freed with cs_du_free(), or \c NULL
+ *         if \a path cannot be read, a spill file cannot be written or
+ *         memory runs out.
+ */
+extern struct cs_du *cs_du(const char *path, const struct cs_du_opts *opts);
+
+/**
+ * Get the directories of a result, sorted by path; the first is the one
+ * given to cs_du().
+ *
+ * \return Number of directories.
+ */
+extern size_t cs_du_dirs(const struct cs_du *du, const struct cs_du_dir **dirs);
+
+/**
+ * Returns the directory with the full path \a path, or \c NULL if it is not
+ * in the result.
+ */
+extern const struct cs_du_dir *cs_du_find(const struct cs_du *du,
+                                          const char *path);
+
+/**
+ * Returns true if the files with several links did not fit in memory and
+ * were partly counted from spill files.
+ */
+extern bool cs_du_spilled(const struct cs_du *du);
+
+/**
+ * Free a result of cs_du().
+ */
+extern void cs_du_free(struct cs_du *du);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* LIBCASSAVA_DU_H */
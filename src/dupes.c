@@ -0,0 +1,645 @@
+/*
+ * libcassava/dupes.c
+ * vim: set cin ts=4 sw=4 et cc=100:
+ *
+ * Copyright (c) 2012 Ben Morgan <neembi@googlemail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#define _GNU_SOURCE
+
+#include "dupes.h"
+
+#include <assert.h>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "hash.h"
+#include "list.h"
+#include "parallel.h"
+#include "stat_batch.h"
+#include "walk.h"
+
+/* Size of the reads of the last stages. */
+#define DUPES_CHUNK (1 << 20)
+
+/* Files compared to the first of their group at once, each open at the same time. */
+#define CONFIRM_BATCH 8
+
+/*
+ * A file that might have a duplicate. The hash is of its edges after the
+ * second stage, and of all of it after the third; whole is set once it is.
+ * After the last stage, same is the index of the first file it is equal to.
+ */
+struct dupe_file {
+    char *path;
+    uint64_t dev;
+    uint64_t ino;
+    uint64_t size;
+    struct cs_hash128 hash;
+    bool whole;
+    bool failed;
+    size_t same;
+};
+
+struct finder {
+    struct dupe_file *files;
+    size_t *groups;             /* where the groups of the last stage start */
+    size_t count;
+    size_t capacity;
+    pthread_mutex_t lock;
+    unsigned threads;
+    uint64_t min_size;
+    uint64_t bytes_read;
+    bool failed;                /* out of memory */
+};
+
+static struct finder *new_finder(const struct cs_dupes_opts *opts);
+static void free_finder(struct finder *f);
+static int add_file(struct finder *f, const char *path, const struct cs_stat *st);
+static int visit_entry(const struct cs_walk_entry *entry, void *arg);
+static struct cs_dupes *find_dupes(struct finder *f);
+static void keep_groups(struct finder *f, int (*compare)(const void *, const void *));
+static void hash_edges(size_t begin, size_t end, void *arg);
+static void hash_whole(size_t begin, size_t end, void *arg);
+static void confirm_groups(size_t begin, size_t end, void *arg);
+static size_t split_equal(struct finder *f, size_t first, size_t end, unsigned char *buffers);
+static bool read_at(struct finder *f, int fd, void *buffer, size_t len, off_t offset);
+static int compare_inode(const void *p1, const void *p2);
+static int compare_size(const void *p1, const void *p2);
+static int compare_hash(const void *p1, const void *p2);
+static int compare_group(const void *p1, const void *p2);
+static int compare_string(const void *p1, const void *p2);
+
+struct cs_dupes *cs_dupes_list(const NodeStr *head, const struct cs_dupes_opts *opts)
+{
+    struct finder *f = new_finder(opts);
+    size_t count = list_length((const struct list_node *)head), i;
+    const char **paths = malloc(count * sizeof (char *));
+    struct cs_stat *results = malloc(count * sizeof (struct cs_stat));
+    const NodeStr *iter;
+
+    if (f == NULL || ((paths == NULL || results == NULL) && count > 0))
+        goto error;
+    for (i = 0, iter = head; iter != NULL; iter = iter->next)
+        paths[i++] = iter->data;
+    cs_stat_batch(AT_FDCWD, paths, count, 0, results);
+    for (i = 0; i < count; i++) {
+        if (results[i].error == 0 && S_ISREG(results[i].mode)
+            && add_file(f, paths[i], &results[i]) != 0)
+            goto error;
+    }
+    free(paths);
+    free(results);
+    return find_dupes(f);
+
+error:
+    perror("Error (cs_dupes_list)");
+    free(paths);
+    free(results);
+    free_finder(f);
+    return NULL;
+}
+
+struct cs_dupes *cs_dupes_tree(const char *path, const struct cs_dupes_opts *opts)
+{
+    assert(path != NULL);
+
+    struct finder *f = new_finder(opts);
+
+    if (f == NULL) {
+        perror("Error (cs_dupes_tree)");
+        return NULL;
+    }
+    if (cs_walk(path, NULL, visit_entry, f) < 0) {
+        free_finder(f);
+        return NULL;
+    }
+    if (f->failed) {
+        errno = ENOMEM;
+        perror("Error (cs_dupes_tree)");
+        free_finder(f);
+        return NULL;
+    }
+    return find_dupes(f);
+}
+
+void cs_dupes_free(struct cs_dupes *dupes)
+{
+    size_t i, j;
+
+    if (dupes == NULL)
+        return;
+    for (i = 0; i < dupes->count; i++) {
+        for (j = 0; j < dupes->groups[i].count; j++)
+            free(dupes->groups[i].paths[j]);
+        free(dupes->groups[i].paths);
+    }
+    free(dupes->groups);
+    free(dupes);
+}
+
+/*
+ * Returns a finder without files, or NULL if out of memory.
+ */
+static struct finder *new_finder(const struct cs_dupes_opts *opts)
+{
+    struct finder *f = calloc(1, sizeof (struct finder));
+
+    if (f == NULL)
+        return NULL;
+    f->capacity = 1024;
+    f->files = malloc(f->capacity * sizeof (struct dupe_file));
+    if (f->files == NULL) {
+        free(f);
+        return NULL;
+    }
+    pthread_mutex_init(&f->lock, NULL);
+    f->threads = 2 * cs_parallel_threads();
+    f->min_size = 1;
+    if (opts != NULL) {
+        if (opts->threads > 0)
+            f->threads = opts->threads;
+        if (opts->min_size > 1)
+            f->min_size = opts->min_size;
+    }
+    return f;
+}
+
+/*
+ * Free a finder together with the paths of its files.
+ */
+static void free_finder(struct finder *f)
+{
+    size_t i;
+
+    if (f == NULL)
+        return;
+    for (i = 0; i < f->count; i++)
+        free(f->files[i].path);
+    pthread_mutex_destroy(&f->lock);
+    free(f->files);
+    free(f);
+}
+
+/*
+ * Returns -1 and marks the finder as failed if out of memory.
+ */
+static int add_file(struct finder *f, const char *path, const struct cs_stat *st)
+{
+    struct dupe_file *file;
+    char *copy;
+
+    if ((uint64_t)st->size < f->min_size)
+        return 0;
+    pthread_mutex_lock(&f->lock);
+    if (f->count == f->capacity) {
+        file = realloc(f->files, 2 * f->capacity * sizeof (struct dupe_file));
+        if (file == NULL)
+            goto error;
+        f->files = file;
+        f->capacity *= 2;
+    }
+    if ((copy = strdup(path)) == NULL)
+        goto error;
+    file = &f->files[f->count++];
+    memset(file, 0, sizeof (struct dupe_file));
+    file->path = copy;
+    file->dev = st->dev;
+    file->ino = st->ino;
+    file->size = st->size;
+    pthread_mutex_unlock(&f->lock);
+    return 0;
+
+error:
+    f->failed = true;
+    pthread_mutex_unlock(&f->lock);
+    return -1;
+}
+
+/*
+ * A cs_walk_fn that adds every regular file to the finder, and stops the
+ * walk if out of memory.
+ */
+static int visit_entry(const struct cs_walk_entry *entry, void *arg)
+{
+    struct stat st;
+    struct cs_stat cs;
+
+    if (entry->type != DT_REG)
+        return CS_WALK_CONTINUE;
+    if (fstatat(entry->dirfd, entry->name, &st, AT_SYMLINK_NOFOLLOW) != 0)
+        return CS_WALK_CONTINUE;
+    cs.dev = st.st_dev;
+    cs.ino = st.st_ino;
+    cs.size = st.st_size;
+    if (add_file(arg, entry->path, &cs) != 0)
+        return CS_WALK_STOP;
+    return CS_WALK_CONTINUE;
+}
+
+/*
+ * Run the stages on the files collected, and free the finder. Returns NULL
+ * if out of memory.
+ */
+static struct cs_dupes *find_dupes(struct finder *f)
+{
+    struct cs_dupes *dupes = calloc(1, sizeof (struct cs_dupes));
+    size_t capacity = 0, i, j, k;
+
+    if (dupes == NULL) {
+        perror("Error (cs_dupes)");
+        free_finder(f);
+        return NULL;
+    }
+    dupes->files = f->count;
+
+    /* Drop the other links to files that are there already. */
+    qsort(f->files, f->count, sizeof (struct dupe_file), compare_inode);
+    for (i = 0, j = 0; i < f->count; i++) {
+        if (j > 0 && f->files[i].dev == f->files[j-1].dev && f->files[i].ino == f->files[j-1].ino)
+            free(f->files[i].path);
+        else
+            f->files[j++] = f->files[i];
+    }
+    f->count = j;
+
+    qsort(f->files, f->count, sizeof (struct dupe_file), compare_size);
+    keep_groups(f, compare_size);
+
+    cs_parallel_for(f->count, 1, f->threads, hash_edges, f);
+    qsort(f->files, f->count, sizeof (struct dupe_file), compare_hash);
+    keep_groups(f, compare_hash);
+
+    cs_parallel_for(f->count, 1, f->threads, hash_whole, f);
+    if (f->failed) {
+        i = 0;
+        goto error;
+    }
+    qsort(f->files, f->count, sizeof (struct dupe_file), compare_hash);
+    keep_groups(f, compare_hash);
+
+    /* Files of the same hash are only likely to be equal: compare them. */
+    f->groups = malloc((f->count + 1) * sizeof (size_t));
+    if (f->groups == NULL) {
+        i = 0;
+        goto error;
+    }
+    for (i = 0, j = 0; i < f->count; i++) {
+        if (i == 0 || compare_hash(&f->files[i-1], &f->files[i]) != 0)
+            f->groups[j++] = i;
+    }
+    f->groups[j] = f->count;
+    cs_parallel_for(j, 1, f->threads, confirm_groups, f);
+    free(f->groups);
+    if (f->failed) {
+        i = 0;
+        goto error;
+    }
+
+    /* What is left are groups of equal files. */
+    for (i = 0; i < f->count; i = j) {
+        struct cs_dupes_group *group;
+
+        for (j = i + 1; j < f->count && f->files[j].same == f->files[i].same; j++)
+            ;
+        if (j - i < 2 || f->files[i].failed) {
+            for (k = i; k < j; k++)
+                free(f->files[k].path);
+            continue;
+        }
+        if (dupes->count == capacity) {
+            group = realloc(dupes->groups, (2 * capacity + 16) * sizeof (struct cs_dupes_group));
+            if (group == NULL)
+                goto error;
+            dupes->groups = group;
+            capacity = 2 * capacity + 16;
+        }
+        group = &dupes->groups[dupes->count];
+        group->paths = malloc((j - i) * sizeof (char *));
+        if (group->paths == NULL)
+            goto error;
+        dupes->count++;
+        group->size = f->files[i].size;
+        group->count = j - i;
+        for (k = 0; k < group->count; k++)
+            group->paths[k] = f->files[i + k].path;
+        qsort(group->paths, group->count, sizeof (char *), compare_string);
+    }
+    if (dupes->count > 1)
+        qsort(dupes->groups, dupes->count, sizeof (struct cs_dupes_group), compare_group);
+    dupes->bytes_read = f->bytes_read;
+
+    f->count = 0;
+    free_finder(f);
+    return dupes;
+
+error:
+    /* The paths before file i have been freed or moved into dupes already. */
+    errno = ENOMEM;
+    perror("Error (cs_dupes)");
+    for (k = 0; k < i; k++)
+        f->files[k].path = NULL;
+    free_finder(f);
+    cs_dupes_free(dupes);
+    return NULL;
+}
+
+/*
+ * Keep only the files that were read, sorted with compare, that are equal
+ * to another one according to it.
+ */
+static void keep_groups(struct finder *f, int (*compare)(const void *, const void *))
+{
+    size_t i, j = 0;
+
+    for (i = 0; i < f->count; i++) {
+        if (f->files[i].failed)
+            free(f->files[i].path);
+        else
+            f->files[j++] = f->files[i];
+    }
+    f->count = j;
+
+    for (i = 0, j = 0; i < f->count; i++) {
+        struct dupe_file *file = &f->files[i];
+        if ((i > 0 && compare(file - 1, file) == 0)
+            || (i + 1 < f->count && compare(file, file + 1) == 0))
+            f->files[j++] = *file;
+        else
+            free(file->path);
+    }
+    f->count = j;
+}
+
+/*
+ * A body for cs_parallel_for() to hash the first and last CS_DUPES_EDGE
+ * bytes of each file, which is the whole file if it is small.
+ */
+static void hash_edges(size_t begin, size_t end, void *arg)
+{
+    struct finder *f = arg;
+    unsigned char buffer[2 * CS_DUPES_EDGE];
+    size_t i;
+
+    for (i = begin; i < end; i++) {
+        struct dupe_file *file = &f->files[i];
+        int fd = open(file->path, O_RDONLY | O_CLOEXEC);
+
+        if (fd < 0) {
+            perror("Error (cs_dupes)");
+            file->failed = true;
+            continue;
+        }
+        if (file->size <= 2 * CS_DUPES_EDGE) {
+            file->failed = !read_at(f, fd, buffer, file->size, 0);
+            file->whole = true;
+        } else {
+            file->failed = !read_at(f, fd, buffer, CS_DUPES_EDGE, 0)
+                || !read_at(f, fd, buffer + CS_DUPES_EDGE, CS_DUPES_EDGE,
+                            file->size - CS_DUPES_EDGE);
+        }
+        if (!file->failed)
+            file->hash = cs_hash128(buffer, file->whole ? file->size : 2 * CS_DUPES_EDGE, 0);
+        close(fd);
+    }
+}
+
+/*
+ * A body for cs_parallel_for() to hash the whole contents of each file
+ * whose edges only were hashed. Marks the finder as failed if out of memory.
+ */
+static void hash_whole(size_t begin, size_t end, void *arg)
+{
+    struct finder *f = arg;
+    unsigned char *buffer = NULL;
+    size_t i;
+
+    for (i = begin; i < end; i++) {
+        struct dupe_file *file = &f->files[i];
+        struct cs_hash128_state state;
+        uint64_t offset;
+        int fd;
+
+        if (file->whole)
+            continue;
+        if (buffer == NULL && (buffer = malloc(DUPES_CHUNK)) == NULL) {
+            __atomic_store_n(&f->failed, true, __ATOMIC_RELAXED);
+            return;
+        }
+        fd = open(file->path, O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            perror("Error (cs_dupes)");
+            file->failed = true;
+            continue;
+        }
+        posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+        cs_hash128_init(&state, 0);
+        for (offset = 0; offset < file->size; offset += DUPES_CHUNK) {
+            size_t len = file->size - offset < DUPES_CHUNK ? file->size - offset : DUPES_CHUNK;
+            if (!read_at(f, fd, buffer, len, offset)) {
+                file->failed = true;
+                break;
+            }
+            cs_hash128_update(&state, buffer, len);
+        }
+        file->hash = cs_hash128_final(&state);
+        file->whole = true;
+        close(fd);
+    }
+    free(buffer);
+}
+
+/*
+ * A body for cs_parallel_for() to compare the files of each group left
+ * after the last stage byte by byte, splitting it into groups of files
+ * that are equal. Files that cannot be read end up in groups of their own;
+ * if out of memory, the finder is marked as failed.
+ */
+static void confirm_groups(size_t begin, size_t end, void *arg)
+{
+    struct finder *f = arg;
+    unsigned char *buffers = NULL;
+    size_t i, first;
+
+    for (i = begin; i < end; i++) {
+        for (first = f->groups[i]; first < f->groups[i+1]; ) {
+            if (buffers == NULL && (buffers = malloc(2 * DUPES_CHUNK)) == NULL) {
+                __atomic_store_n(&f->failed, true, __ATOMIC_RELAXED);
+                return;
+            }
+            if (f->files[first].failed) {
+                f->files[first].same = first;
+                first++;
+                continue;
+            }
+            first += split_equal(f, first, f->groups[i+1], buffers);
+        }
+    }
+    free(buffers);
+}
+
+/*
+ * Compare the files from first to end to the one at first, reading them in
+ * chunks side by side, and move those that are equal to it right behind it.
+ * Returns the number of files equal to the one at first, including itself,
+ * whose same is set to first. Files that cannot be read are marked as failed.
+ */
+static size_t split_equal(struct finder *f, size_t first, size_t end, unsigned char *buffers)
+{
+    struct dupe_file *files = f->files;
+    uint64_t size = files[first].size, offset;
+    size_t equal = first + 1, i, j;
+    int fd = open(files[first].path, O_RDONLY | O_CLOEXEC);
+
+    if (fd < 0) {
+        perror("Error (cs_dupes)");
+        files[first].failed = true;
+        files[first].same = first;
+        return 1;
+    }
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+    for (i = first + 1; i < end; i += CONFIRM_BATCH) {
+        size_t batch = end - i < CONFIRM_BATCH ? end - i : CONFIRM_BATCH;
+        int fds[CONFIRM_BATCH];
+        size_t alike = 0;
+
+        for (j = 0; j < batch; j++) {
+            files[i+j].same = (size_t)-1;
+            fds[j] = files[i+j].failed ? -1 : open(files[i+j].path, O_RDONLY | O_CLOEXEC);
+            if (fds[j] < 0 && !files[i+j].failed) {
+                perror("Error (cs_dupes)");
+                files[i+j].failed = true;
+            }
+            alike += fds[j] >= 0;
+        }
+
+        /* Files drop out as soon as they differ. */
+        for (offset = 0; offset < size && alike > 0; offset += DUPES_CHUNK) {
+            size_t len = size - offset < DUPES_CHUNK ? size - offset : DUPES_CHUNK;
+            if (!read_at(f, fd, buffers, len, offset)) {
+                files[first].failed = true;
+                break;
+            }
+            for (j = 0; j < batch; j++) {
+                if (fds[j] < 0)
+                    continue;
+                if (!read_at(f, fds[j], buffers + DUPES_CHUNK, len, offset))
+                    files[i+j].failed = true;
+                else if (memcmp(buffers, buffers + DUPES_CHUNK, len) == 0)
+                    continue;
+                close(fds[j]);
+                fds[j] = -1;
+                alike--;
+            }
+        }
+
+        for (j = 0; j < batch; j++) {
+            if (fds[j] < 0)
+                continue;
+            close(fds[j]);
+            if (!files[first].failed)
+                files[i+j].same = first;
+        }
+        if (files[first].failed)
+            break;
+    }
+    close(fd);
+
+    if (files[first].failed) {
+        files[first].same = first;
+        return 1;
+    }
+
+    /* Move the equal files to the front, keeping the others in order. */
+    for (i = first + 1; i < end; i++) {
+        if (files[i].same == first && !files[i].failed) {
+            struct dupe_file file = files[i];
+            memmove(&files[equal + 1], &files[equal], (i - equal) * sizeof (struct dupe_file));
+            files[equal++] = file;
+        }
+    }
+    files[first].same = first;
+    return equal - first;
+}
+
+/*
+ * Read exactly len bytes at offset; a file that got shorter fails.
+ */
+static bool read_at(struct finder *f, int fd, void *buffer, size_t len, off_t offset)
+{
+    size_t done = 0;
+
+    while (done < len) {
+        ssize_t n = pread(fd, (char *)buffer + done, len - done, offset + done);
+        if (n <= 0)
+            return false;
+        done += n;
+    }
+    __atomic_fetch_add(&f->bytes_read, len, __ATOMIC_RELAXED);
+    return true;
+}
+
+static int compare_inode(const void *p1, const void *p2)
+{
+    const struct dupe_file *a = p1, *b = p2;
+
+    if (a->dev != b->dev)
+        return a->dev < b->dev ? -1 : 1;
+    if (a->ino != b->ino)
+        return a->ino < b->ino ? -1 : 1;
+    return strcmp(a->path, b->path);
+}
+
+static int compare_size(const void *p1, const void *p2)
+{
+    const struct dupe_file *a = p1, *b = p2;
+
+    return (a->size > b->size) - (a->size < b->size);
+}
+
+static int compare_hash(const void *p1, const void *p2)
+{
+    const struct dupe_file *a = p1, *b = p2;
+
+    if (a->size != b->size)
+        return a->size < b->size ? -1 : 1;
+    if (a->hash.high != b->hash.high)
+        return a->hash.high < b->hash.high ? -1 : 1;
+    return (a->hash.low > b->hash.low) - (a->hash.low < b->hash.low);
+}
+
+static int compare_group(const void *p1, const void *p2)
+{
+    const struct cs_dupes_group *a = p1, *b = p2;
+
+    if (a->size != b->size)
+        return a->size > b->size ? -1 : 1;
+    return strcmp(a->paths[0], b->paths[0]);
+}
+
+static int compare_string(const void *p1, const void *p2)
+{
+    return strcmp(*(char *const *)p1, *(char *const *)p2);
+}
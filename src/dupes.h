@@ -0,0 +1,146 @@
+/*
+ * libcassava/dupes.h
+ * vim: set cin ts=4 sw=4 et cc=80:
+ *
+ * Copyright (c) 2012 Ben Morgan <neembi@googlemail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION
+ * OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/**
+ * \file
+ * Finding files with the same contents.
+ *
+ * Files are compared in stages, and only the files that might still have a
+ * duplicate after one stage are read in the next:
+ *
+ *  1. Files are grouped by size, which costs nothing but a stat().
+ *  2. Files of the same size are grouped by a hash of their first and last
+ *     4 KiB. For files of up to 8 KiB, that is all of them.
+ *  3. Files that are still alike are grouped by a hash of their whole
+ *     contents, read in large chunks.
+ *  4. The files of each group are compared byte by byte, reading them side
+ *     by side in the same chunks, so that files are only reported as equal
+ *     if they are, even if their hashes collide by chance or on purpose.
+ *
+ * The files of each stage are read by a pool of threads. The hash is the
+ * 128-bit one of hash.h.
+ *
+ * Several links to the same file count as one file, since they take up no
+ * more space; only the first path found is reported.
+ *
+ * <b>Example Usage:</b>
+ * \code
+ *     struct cs_dupes *dupes = cs_dupes_tree("/srv/share", NULL);
+ *     size_t i, j;
+ *     for (i = 0; i < dupes->count; i++) {
+ *         for (j = 1; j < dupes->groups[i].count; j++)
+ *             printf("%s is a copy of %s\n", dupes->groups[i].paths[j],
+ *                    dupes->groups[i].paths[0]);
+ *     }
+ *     cs_dupes_free(dupes);
+ * \endcode
+ *
+ * \author Ben Morgan
+ * \date 17. October 2026
+ */
+
+#ifndef LIBCASSAVA_DUPES_H
+#define LIBCASSAVA_DUPES_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "list_str.h"
+
+/** Bytes hashed at the start and at the end of a file in the second stage. */
+#define CS_DUPES_EDGE 4096
+
+/**
+ * Options for cs_dupes_list() and cs_dupes_tree(). Passing \c NULL is the
+ * same as passing a zero-initialized struct.
+ *
+ * \param threads  Number of threads reading files, 0 for twice the number
+ *                 of CPUs, since they mostly wait for the disk.
+ * \param min_size Ignore files smaller than this; empty files are always
+ *                 ignored.
+ */
+struct cs_dupes_opts {
+    unsigned threads;
+    uint64_t min_size;
+};
+
+/**
+ * Files with the same contents.
+ *
+ * \param size  Size of each file.
+ * \param count Number of files, at least 2.
+ * \param paths The paths of the files, sorted.
+ */
+struct cs_dupes_group {
+    uint64_t size;
+    size_t count;
+    char **paths;
+};
+
+/**
+ * The result of cs_dupes_list() and cs_dupes_tree().
+ *
+ * \param groups     The groups of equal files, the largest files first.
+ * \param count      Number of groups.
+ * \param files      Number of files looked at.
+ * \param bytes_read Number of bytes read to tell the files apart.
+ */
+struct cs_dupes {
+    struct cs_dupes_group *groups;
+    size_t count;
+    size_t files;
+    uint64_t bytes_read;
+};
+
+/**
+ * Find the files with the same contents among the paths in a list, such as
+ * one from get_filepaths(). Paths that are not regular files are ignored.
+ *
+ * \return Newly allocated result to be freed with cs_dupes_free(), or
+ *         \c NULL if out of memory.
+ */
+extern struct cs_dupes *cs_dupes_list(const NodeStr *head,
+                                      const struct cs_dupes_opts *opts);
+
+/**
+ * Find the files with the same contents among all regular files below the
+ * directory \a path.
+ *
+ * \return Newly allocated result to be freed with cs_dupes_free(), or
+ *         \c NULL if \a path cannot be read or memory runs out.
+ */
+extern struct cs_dupes *cs_dupes_tree(const char *path,
+                                      const struct cs_dupes_opts *opts);
+
+/**
+ * Free a result of cs_dupes_list() or cs_dupes_tree().
+ */
+extern void cs_dupes_free(struct cs_dupes *dupes);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* LIBCASSAVA_DUPES_H */
@@ -0,0 +1,317 @@
+/*
+ * libcassava/filter.c
+ * vim: set cin ts=4 sw=4 et cc=100:
+ *
+ * Copyright (c) 2012 Ben Morgan <neembi@googlemail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#define _GNU_SOURCE
+
+#include "filter.h"
+
+#include <assert.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <regex.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+
+#include "regex_cache.h"
+#include "system.h"
+
+/*
+ * The kinds of condition, in the order in which they are checked:
+ * from what only needs the string to what needs the metadata of the file.
+ */
+enum predicate_kind {
+    PRED_REGEX,
+    PRED_TYPE,
+    PRED_MTIME,
+    PRED_SIZE,
+    PRED_CUSTOM
+};
+
+/* Metadata fields needed by the conditions. */
+#define NEED_TYPE  0x1
+#define NEED_MTIME 0x2
+#define NEED_SIZE  0x4
+
+struct predicate {
+    enum predicate_kind kind;
+    int comparison;
+    union {
+        const struct cs_regex *regex;
+        time_t time;
+        off_t size;
+        struct {
+            bool (*function)(void *, void *);
+            void *arguments;
+        } custom;
+    } u;
+};
+
+struct cs_filter {
+    struct predicate **preds;
+    size_t count;
+    unsigned need;
+    unsigned types;
+};
+
+/* The metadata of a file, as far as the conditions need it. */
+struct metadata {
+    unsigned char type;
+    time_t mtime;
+    off_t size;
+};
+
+static struct predicate *add_predicate(struct cs_filter *filter, enum predicate_kind kind);
+static bool load_metadata(const char *string, unsigned need, struct metadata *meta);
+static bool compare(int comparison, long long value, long long reference);
+
+struct cs_filter *cs_filter_new(void)
+{
+    return calloc(1, sizeof (struct cs_filter));
+}
+
+void cs_filter_free(struct cs_filter *filter)
+{
+    size_t i;
+
+    if (filter == NULL)
+        return;
+    for (i = 0; i < filter->count; i++) {
+        if (filter->preds[i]->kind == PRED_REGEX)
+            cs_regex_release(filter->preds[i]->u.regex);
+        free(filter->preds[i]);
+    }
+    free(filter->preds);
+    free(filter);
+}
+
+int cs_filter_regex(struct cs_filter *filter, const char *regex)
+{
+    assert(filter != NULL);
+    assert(regex != NULL);
+
+    const struct cs_regex *compiled = cs_regex_get(regex, REG_EXTENDED | REG_NOSUB);
+    if (compiled == NULL)
+        return -1;
+
+    struct predicate *pred = add_predicate(filter, PRED_REGEX);
+    if (pred == NULL) {
+        cs_regex_release(compiled);
+        return -1;
+    }
+    pred->u.regex = compiled;
+    return 0;
+}
+
+int cs_filter_type(struct cs_filter *filter, unsigned char type)
+{
+    assert(filter != NULL);
+    assert(type < 8 * sizeof (unsigned));
+
+    /* All types are checked together by a single condition. */
+    if (filter->types == 0 && add_predicate(filter, PRED_TYPE) == NULL)
+        return -1;
+    filter->types |= 1U << type;
+    return 0;
+}
+
+int cs_filter_mtime(struct cs_filter *filter, int comparison, time_t time)
+{
+    assert(filter != NULL);
+
+    struct predicate *pred = add_predicate(filter, PRED_MTIME);
+    if (pred == NULL)
+        return -1;
+    pred->comparison = comparison;
+    pred->u.time = time;
+    filter->need |= NEED_MTIME;
+    return 0;
+}
+
+int cs_filter_size(struct cs_filter *filter, int comparison, off_t size)
+{
+    assert(filter != NULL);
+
+    struct predicate *pred = add_predicate(filter, PRED_SIZE);
+    if (pred == NULL)
+        return -1;
+    pred->comparison = comparison;
+    pred->u.size = size;
+    filter->need |= NEED_SIZE;
+    return 0;
+}
+
+int cs_filter_custom(struct cs_filter *filter, bool (*custom)(void *, void *), void *arguments)
+{
+    assert(filter != NULL);
+    assert(custom != NULL);
+
+    struct predicate *pred = add_predicate(filter, PRED_CUSTOM);
+    if (pred == NULL)
+        return -1;
+    pred->u.custom.function = custom;
+    pred->u.custom.arguments = arguments;
+    return 0;
+}
+
+bool cs_filter_match(const struct cs_filter *filter, const char *string)
+{
+    assert(filter != NULL);
+    assert(string != NULL);
+
+    const struct cs_dirent *entry;
+    struct metadata meta;
+    bool loaded = false;
+    size_t i;
+
+    for (i = 0; i < filter->count; i++) {
+        const struct predicate *pred = filter->preds[i];
+        unsigned char type;
+
+        switch (pred->kind) {
+        case PRED_REGEX:
+            if (!cs_regex_match(pred->u.regex, string))
+                return false;
+            break;
+
+        case PRED_TYPE:
+            if (cs_dir_current(string, NULL, &entry) && entry->type != DT_UNKNOWN) {
+                type = entry->type;
+            } else {
+                if (!loaded && !(loaded = load_metadata(string, filter->need | NEED_TYPE, &meta)))
+                    return false;
+                type = meta.type;
+            }
+            if (!(filter->types & 1U << type))
+                return false;
+            break;
+
+        case PRED_MTIME:
+        case PRED_SIZE:
+            if (!loaded && !(loaded = load_metadata(string, filter->need, &meta)))
+                return false;
+            if (pred->kind == PRED_MTIME) {
+                if (!compare(pred->comparison, meta.mtime, pred->u.time))
+                    return false;
+            } else {
+                if (!compare(pred->comparison, meta.size, pred->u.size))
+                    return false;
+            }
+            break;
+
+        case PRED_CUSTOM:
+            if (!pred->u.custom.function((void *)string, pred->u.custom.arguments))
+                return false;
+            break;
+        }
+    }
+    return true;
+}
+
+bool filter_all(void *string, void *filter)
+{
+    return cs_filter_match(filter, string);
+}
+
+/*
+ * Create a new condition of the given kind, and keep the conditions
+ * sorted by kind, so that the cheaper ones are checked first.
+ * Returns NULL if out of memory, leaving filter as it was.
+ */
+static struct predicate *add_predicate(struct cs_filter *filter, enum predicate_kind kind)
+{
+    struct predicate *pred = calloc(1, sizeof (struct predicate));
+    struct predicate **preds;
+    size_t i;
+
+    if (pred == NULL) {
+        perror("Error (add_predicate)");
+        return NULL;
+    }
+    preds = realloc(filter->preds, (filter->count + 1) * sizeof (struct predicate *));
+    if (preds == NULL) {
+        perror("Error (add_predicate)");
+        free(pred);
+        return NULL;
+    }
+    filter->preds = preds;
+    pred->kind = kind;
+    for (i = filter->count; i > 0 && filter->preds[i-1]->kind > kind; i--)
+        filter->preds[i] = filter->preds[i-1];
+    filter->preds[i] = pred;
+    filter->count++;
+    return pred;
+}
+
+/*
+ * Fetch the fields in need of the metadata of string with one system call,
+ * relative to the directory being read if string is the current entry.
+ * Symbolic links are not followed.
+ */
+static bool load_metadata(const char *string, unsigned need, struct metadata *meta)
+{
+    const struct cs_dirent *entry;
+    int dirfd = AT_FDCWD;
+    const char *name = string;
+
+    if (cs_dir_current(string, &dirfd, &entry))
+        name = entry->name;
+
+#ifdef STATX_TYPE
+    struct statx stx;
+    unsigned mask = 0;
+    if (need & NEED_TYPE)
+        mask |= STATX_TYPE;
+    if (need & NEED_MTIME)
+        mask |= STATX_MTIME;
+    if (need & NEED_SIZE)
+        mask |= STATX_SIZE;
+
+    if (statx(dirfd, name, AT_SYMLINK_NOFOLLOW, mask, &stx) != 0) {
+        perror("Error (statx)");
+        return false;
+    }
+    meta->type = IFTODT(stx.stx_mode);
+    meta->mtime = stx.stx_mtime.tv_sec;
+    meta->size = stx.stx_size;
+#else
+    struct stat fstat;
+    (void)need;
+
+    if (fstatat(dirfd, name, &fstat, AT_SYMLINK_NOFOLLOW) != 0) {
+        perror("Error (fstatat)");
+        return false;
+    }
+    meta->type = IFTODT(fstat.st_mode);
+    meta->mtime = fstat.st_mtime;
+    meta->size = fstat.st_size;
+#endif
+    return true;
+}
+
+static bool compare(int comparison, long long value, long long reference)
+{
+    if (comparison < 0)
+        return value < reference;
+    else if (comparison > 0)
+        return value > reference;
+    else
+        return value == reference;
+}
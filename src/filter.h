@@ -0,0 +1,147 @@
+/*
+ * libcassava/filter.h
+ * vim: set cin ts=4 sw=4 et cc=80:
+ *
+ * Copyright (c) 2012 Ben Morgan <neembi@googlemail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION
+ * OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/**
+ * \file
+ * Filters made of several conditions, evaluated in a single pass.
+ *
+ * Chaining filter_regex(), filter_isreg() and filter_mtime() with several
+ * calls to list_filter() walks the list several times and calls stat() once
+ * per filter. A struct cs_filter holds all the conditions instead, checks the
+ * cheap ones (names, then types) first, and fetches the metadata of a file at
+ * most once, asking only for the fields that the conditions need.
+ *
+ * <b>Example Usage:</b>
+ * \code
+ *     // Regular files ending in .log not modified for a week:
+ *     struct cs_filter *f = cs_filter_new();
+ *     cs_filter_regex(f, "\\.log$");
+ *     cs_filter_type(f, DT_REG);
+ *     cs_filter_mtime(f, -1, time(NULL) - 7*24*60*60);
+ *
+ *     NodeStr *head;
+ *     get_filepaths_filter("/var/log", &head, filter_all, f);
+ *     cs_filter_free(f);
+ * \endcode
+ *
+ * \author Ben Morgan
+ * \date 17. October 2026
+ */
+
+#ifndef LIBCASSAVA_FILTER_H
+#define LIBCASSAVA_FILTER_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+#include <stdbool.h>
+#include <sys/types.h>
+#include <time.h>
+
+/**
+ * A set of conditions which must all hold; see filter.h.
+ */
+struct cs_filter;
+
+/**
+ * Create a new filter without any conditions; it accepts everything.
+ *
+ * \return Newly allocated filter, to be freed with cs_filter_free(), or \c NULL
+ *         if out of memory.
+ */
+extern struct cs_filter *cs_filter_new(void);
+
+/**
+ * Free a filter and all its conditions.
+ */
+extern void cs_filter_free(struct cs_filter *filter);
+
+/**
+ * Add the condition that the string being filtered (the name or the full
+ * pathname of a file) matches the extended regular expression \a regex.
+ *
+ * \return 0 on success, -1 if \a regex could not be compiled or if out of
+ *         memory, in which case \a filter is left as it was.
+ */
+extern int cs_filter_regex(struct cs_filter *filter, const char *regex);
+
+/**
+ * Add \a type to the types of file accepted; \a type is one of the \c DT_
+ * constants of dirent.h, for example \c DT_REG. Calling this several times
+ * accepts files of any of the types given. Symbolic links are not followed.
+ *
+ * \return 0 on success, -1 if out of memory, in which case \a filter is left
+ *         as it was.
+ */
+extern int cs_filter_type(struct cs_filter *filter, unsigned char type);
+
+/**
+ * Add a condition on the modification time of a file, with the same meaning
+ * of \a comparison as in struct filter_time_args: the mtime must be less than
+ * \a time if \a comparison is negative, greater if positive, equal if 0.
+ *
+ * \return As for cs_filter_type().
+ */
+extern int cs_filter_mtime(struct cs_filter *filter, int comparison, time_t time);
+
+/**
+ * Add a condition on the size of a file in bytes, with \a comparison as for
+ * cs_filter_mtime().
+ *
+ * \return As for cs_filter_type().
+ */
+extern int cs_filter_size(struct cs_filter *filter, int comparison, off_t size);
+
+/**
+ * Add any other filter function, as would be passed to list_filter(). These
+ * are assumed to be expensive and are checked after all other conditions.
+ *
+ * \return As for cs_filter_type().
+ */
+extern int cs_filter_custom(struct cs_filter *filter,
+                            bool (*custom)(void *, void *),
+                            void *arguments);
+
+/**
+ * Returns true if \a string satisfies all conditions of \a filter.
+ *
+ * If \a string is the entry of a listing function currently being filtered
+ * (see cs_dir_current()), the entry type is taken from the directory and
+ * the metadata is looked up relative to it.
+ */
+extern bool cs_filter_match(const struct cs_filter *filter, const char *string);
+
+/**
+ * A filter function for list_filter() and the get_file*_filter() functions,
+ * that keeps the strings matching a struct cs_filter.
+ *
+ * \param string String to match.
+ * \param filter Pointer to a struct cs_filter.
+ * \return The result of cs_filter_match().
+ */
+extern bool filter_all(void *string, void *filter);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* LIBCASSAVA_FILTER_H */
@@ -0,0 +1,731 @@
+/*
+ * libcassava/globset.c
+ * vim: set cin ts=4 sw=4 et cc=100:
+ *
+ * Copyright (c) 2012 Ben Morgan <neembi@googlemail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#define _GNU_SOURCE
+
+#include "globset.h"
+
+#include <assert.h>
+#include <ctype.h>
+#include <fnmatch.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "system.h"
+
+/*
+ * How a glob is matched: the single-pattern shapes that only need memcmp(),
+ * the automaton, or fnmatch() if the automaton would be too large.
+ */
+enum glob_kind {
+    GLOB_EXACT,     /* literal */
+    GLOB_PREFIX,    /* literal* */
+    GLOB_SUFFIX,    /* *literal */
+    GLOB_CONTAINS,  /* *literal* */
+    GLOB_AFFIX,     /* literal*literal */
+    GLOB_CLASSES,   /* at most one star, and items matching single bytes */
+    GLOB_DFA,
+    GLOB_FNMATCH
+};
+
+/* A state of the automaton from which no match is possible. */
+#define DEAD 0
+
+/* One element of a pattern: a set of bytes, to be matched once or any number of times. */
+struct item {
+    uint64_t bytes[4];
+    bool star;
+};
+
+struct cs_glob {
+    enum glob_kind kind;
+    char **patterns;
+    size_t count;
+
+    /* GLOB_EXACT ... GLOB_AFFIX */
+    char *prefix;
+    size_t prefix_len;
+    char *suffix;
+    size_t suffix_len;
+
+    /* GLOB_CLASSES */
+    struct item *items;
+    size_t nitems;
+    size_t star;                    /* index of the star, or nitems */
+
+    /*
+     * GLOB_DFA: states are numbered so that those which decide the result
+     * come first: the dead state, then those that every continuation matches.
+     * Rows are addressed by offset (state * nclasses), so that a transition
+     * is a single load.
+     */
+    unsigned char classes[256];     /* byte -> byte class */
+    unsigned nclasses;
+    uint32_t start;                 /* offset of the first state */
+    uint32_t stop;                  /* offsets below this decide the result */
+    uint32_t *table;                /* [offset + class] -> offset */
+    int *accept;                    /* state -> first pattern accepted, or -1 */
+};
+
+/* The patterns of a set, one after the other, as the positions of an NFA. */
+struct nfa {
+    struct item *items;     /* the item at each position, unused at final positions */
+    int *final;             /* the pattern ending at each position, or -1 */
+    size_t positions;
+    size_t words;           /* words in a set of positions */
+};
+
+/* The states of the automaton while it is built, and their sets of positions. */
+struct subsets {
+    uint64_t *sets;
+    uint32_t *table;
+    uint32_t *index;        /* hash table of states by set */
+    size_t words;
+    size_t count;
+    size_t capacity;
+    unsigned nclasses;
+};
+
+/* Twice CS_GLOB_MAX_STATES, so that the hash table never gets too full. */
+#define SUBSET_BUCKETS (2 * CS_GLOB_MAX_STATES)
+
+static size_t parse(const char *pattern, struct item **items);
+static const char *parse_bracket(const char *p, struct item *item);
+static bool add_class(const char *name, size_t len, struct item *item);
+static bool simple_shape(struct cs_glob *glob, const struct item *items, size_t n);
+static bool single_byte(const struct item *item, char *c);
+static bool build_dfa(struct cs_glob *glob, const struct nfa *nfa);
+static bool subsets_init(struct subsets *subsets, size_t words, unsigned nclasses);
+static long subsets_intern(struct subsets *subsets, const uint64_t *set);
+static void subsets_free(struct subsets *subsets);
+static void closure(const struct nfa *nfa, uint64_t *set);
+
+static inline bool has_byte(const struct item *item, unsigned char c)
+{
+    return item->bytes[c >> 6] >> (c & 63) & 1;
+}
+
+static inline void add_byte(struct item *item, unsigned char c)
+{
+    item->bytes[c >> 6] |= (uint64_t)1 << (c & 63);
+}
+
+struct cs_glob *cs_glob_new(const char *pattern)
+{
+    assert(pattern != NULL);
+
+    return cs_glob_set_new(&pattern, 1);
+}
+
+struct cs_glob *cs_glob_set_new(const char *const *patterns, size_t count)
+{
+    assert(count == 0 || patterns != NULL);
+
+    struct cs_glob *glob = calloc(1, sizeof (struct cs_glob));
+    struct nfa nfa = { NULL, NULL, 0, 0 };
+    size_t i, j;
+
+    if (glob == NULL)
+        goto error;
+    glob->patterns = malloc(count * sizeof (char *));
+    if (glob->patterns == NULL && count > 0)
+        goto error;
+    for (; glob->count < count; glob->count++) {
+        glob->patterns[glob->count] = strdup(patterns[glob->count]);
+        if (glob->patterns[glob->count] == NULL)
+            goto error;
+    }
+
+    for (i = 0; i < count; i++) {
+        struct item *items, *grown;
+        size_t n = parse(patterns[i], &items);
+        int *final;
+
+        if (items == NULL)
+            goto error;
+        if (count == 1 && simple_shape(glob, items, n)) {
+            free(items);
+            return glob;
+        }
+        grown = realloc(nfa.items, (nfa.positions + n + 1) * sizeof (struct item));
+        if (grown != NULL)
+            nfa.items = grown;
+        final = realloc(nfa.final, (nfa.positions + n + 1) * sizeof (int));
+        if (final != NULL)
+            nfa.final = final;
+        if (grown == NULL || final == NULL) {
+            free(items);
+            goto error;
+        }
+        for (j = 0; j < n; j++) {
+            nfa.items[nfa.positions] = items[j];
+            nfa.final[nfa.positions++] = -1;
+        }
+        memset(&nfa.items[nfa.positions], 0, sizeof (struct item));
+        nfa.final[nfa.positions++] = i;
+        free(items);
+    }
+    nfa.words = (nfa.positions + 63) / 64;
+
+    glob->kind = build_dfa(glob, &nfa) ? GLOB_DFA : GLOB_FNMATCH;
+    free(nfa.items);
+    free(nfa.final);
+    return glob;
+
+error:
+    perror("Error (cs_glob_set_new)");
+    free(nfa.items);
+    free(nfa.final);
+    cs_glob_free(glob);
+    return NULL;
+}
+
+void cs_glob_free(struct cs_glob *glob)
+{
+    size_t i;
+
+    if (glob == NULL)
+        return;
+    for (i = 0; i < glob->count; i++)
+        free(glob->patterns[i]);
+    free(glob->patterns);
+    free(glob->prefix);
+    free(glob->suffix);
+    free(glob->table);
+    free(glob->accept);
+    free(glob->items);
+    free(glob);
+}
+
+bool cs_glob_match(const struct cs_glob *glob, const char *string)
+{
+    return cs_glob_find(glob, string) >= 0;
+}
+
+int cs_glob_find(const struct cs_glob *glob, const char *string)
+{
+    assert(glob != NULL);
+    assert(string != NULL);
+
+    const unsigned char *s = (const unsigned char *)string;
+    size_t len, i;
+    uint32_t offset;
+
+    switch (glob->kind) {
+    case GLOB_EXACT:
+        return strcmp(string, glob->prefix) == 0 ? 0 : -1;
+
+    case GLOB_PREFIX:
+        return strncmp(string, glob->prefix, glob->prefix_len) == 0 ? 0 : -1;
+
+    case GLOB_CONTAINS:
+        return strstr(string, glob->prefix) != NULL ? 0 : -1;
+
+    case GLOB_SUFFIX:
+    case GLOB_AFFIX:
+        len = strlen(string);
+        if (len < glob->prefix_len + glob->suffix_len)
+            return -1;
+        if (memcmp(string, glob->prefix, glob->prefix_len) != 0)
+            return -1;
+        return memcmp(string + len - glob->suffix_len, glob->suffix, glob->suffix_len) == 0
+               ? 0 : -1;
+
+    case GLOB_CLASSES:
+        len = strlen(string);
+        if (glob->star == glob->nitems ? len != glob->nitems : len < glob->nitems - 1)
+            return -1;
+        for (i = 0; i < glob->star; i++) {
+            if (!has_byte(&glob->items[i], s[i]))
+                return -1;
+        }
+        for (i = glob->star + 1; i < glob->nitems; i++) {
+            if (!has_byte(&glob->items[i], s[len - (glob->nitems - i)]))
+                return -1;
+        }
+        return 0;
+
+    case GLOB_DFA:
+        offset = glob->start;
+        /* Two bytes per check: the states that decide the result never leave. */
+        while (*s != '\0' && offset >= glob->stop) {
+            offset = glob->table[offset + glob->classes[s[0]]];
+            if (s[1] == '\0')
+                break;
+            offset = glob->table[offset + glob->classes[s[1]]];
+            s += 2;
+        }
+        return glob->accept[offset / glob->nclasses];
+
+    case GLOB_FNMATCH:
+        for (i = 0; i < glob->count; i++) {
+            if (fnmatch(glob->patterns[i], string, 0) == 0)
+                return i;
+        }
+        return -1;
+    }
+    return -1;
+}
+
+bool filter_glob(void *string, void *glob)
+{
+    const struct cs_dirent *entry;
+
+    if (cs_dir_current(string, NULL, &entry))
+        return cs_glob_match(glob, entry->name);
+    return cs_glob_match(glob, string);
+}
+
+/*
+ * Split a pattern into items, with any run of stars as a single item.
+ *
+ * \return Number of items in the newly allocated array items, which is
+ *         NULL if out of memory.
+ */
+static size_t parse(const char *pattern, struct item **items)
+{
+    size_t n = 0;
+    const char *p = pattern;
+
+    *items = calloc(strlen(pattern) + 1, sizeof (struct item));
+    if (*items == NULL)
+        return 0;
+    while (*p != '\0') {
+        struct item *item = &(*items)[n];
+        const char *end;
+
+        switch (*p) {
+        case '*':
+            while (*p == '*')
+                p++;
+            memset(item->bytes, 0xff, sizeof item->bytes);
+            item->star = true;
+            break;
+        case '?':
+            memset(item->bytes, 0xff, sizeof item->bytes);
+            p++;
+            break;
+        case '[':
+            end = parse_bracket(p, item);
+            if (end != NULL) {
+                p = end;
+                break;
+            }
+            /* An unterminated bracket matches itself. */
+            memset(item->bytes, 0, sizeof item->bytes);
+            add_byte(item, *p++);
+            break;
+        case '\\':
+            /* A trailing backslash, like in fnmatch(), matches nothing. */
+            if (*++p == '\0')
+                break;
+            /* Fall through. */
+        default:
+            add_byte(item, *p++);
+        }
+        n++;
+    }
+    return n;
+}
+
+/*
+ * Parse the bracket expression at p into item.
+ *
+ * \return The first character after it, or NULL if it is not terminated.
+ */
+static const char *parse_bracket(const char *p, struct item *item)
+{
+    bool negate = false;
+    bool first = true;
+    size_t i;
+
+    p++;
+    if (*p == '!' || *p == '^') {
+        negate = true;
+        p++;
+    }
+    for (;; first = false) {
+        unsigned char lo, hi;
+
+        if (*p == '\0')
+            return NULL;
+        if (*p == ']' && !first)
+            break;
+        if (p[0] == '[' && p[1] == ':') {
+            const char *end = strstr(p + 2, ":]");
+            if (end != NULL && add_class(p + 2, end - p - 2, item)) {
+                p = end + 2;
+                continue;
+            }
+        }
+
+        if (*p == '\\' && p[1] != '\0')
+            p++;
+        lo = hi = *p++;
+        if (p[0] == '-' && p[1] != ']' && p[1] != '\0') {
+            p++;
+            if (*p == '\\' && p[1] != '\0')
+                p++;
+            hi = *p++;
+        }
+        for (i = lo; i <= hi; i++)
+            add_byte(item, i);
+    }
+
+    if (negate) {
+        for (i = 0; i < 4; i++)
+            item->bytes[i] = ~item->bytes[i];
+    }
+    return p + 1;
+}
+
+/*
+ * Add the bytes of the character class called name, such as "digit", to item.
+ *
+ * \return false if there is no such class.
+ */
+static bool add_class(const char *name, size_t len, struct item *item)
+{
+    static const struct {
+        const char *name;
+        int (*test)(int);
+    } classes[] = {
+        { "alnum", isalnum }, { "alpha", isalpha }, { "blank", isblank },
+        { "cntrl", iscntrl }, { "digit", isdigit }, { "graph", isgraph },
+        { "lower", islower }, { "print", isprint }, { "punct", ispunct },
+        { "space", isspace }, { "upper", isupper }, { "xdigit", isxdigit }
+    };
+    size_t i;
+    int c;
+
+    for (i = 0; i < sizeof classes / sizeof classes[0]; i++) {
+        if (strlen(classes[i].name) == len && strncmp(classes[i].name, name, len) == 0) {
+            for (c = 0; c < 128; c++) {
+                if (classes[i].test(c))
+                    add_byte(item, c);
+            }
+            return true;
+        }
+    }
+    return false;
+}
+
+/*
+ * If the pattern has at most one star (or a star at either end of a literal),
+ * set glob up to match it without the automaton and return true. If out of
+ * memory, glob is left as it was and the automaton is tried instead.
+ */
+static bool simple_shape(struct cs_glob *glob, const struct item *items, size_t n)
+{
+    char *text = malloc(n + 1);
+    size_t stars = 0, star = n, i;
+    bool literal = true;
+
+    if (text == NULL)
+        return false;
+
+    for (i = 0; i < n; i++) {
+        if (items[i].star) {
+            stars++;
+            star = i;
+        } else if (!single_byte(&items[i], &text[i])) {
+            literal = false;
+        }
+    }
+
+    if (literal && stars == 2 && items[0].star && items[n-1].star) {
+        glob->kind = GLOB_CONTAINS;
+        glob->prefix = strndup(text + 1, n - 2);
+        glob->suffix = strdup("");
+    } else if (literal && stars <= 1) {
+        if (star == n)
+            glob->kind = GLOB_EXACT;
+        else if (star == n - 1)
+            glob->kind = GLOB_PREFIX;
+        else
+            glob->kind = star == 0 ? GLOB_SUFFIX : GLOB_AFFIX;
+        glob->prefix = strndup(text, star);
+        glob->suffix = star < n ? strndup(text + star + 1, n - star - 1) : strdup("");
+    } else if (stars <= 1) {
+        glob->kind = GLOB_CLASSES;
+        glob->items = malloc(n * sizeof (struct item));
+        if (glob->items != NULL)
+            memcpy(glob->items, items, n * sizeof (struct item));
+        glob->nitems = n;
+        glob->star = star;
+    } else {
+        free(text);
+        return false;
+    }
+    free(text);
+    if (glob->kind == GLOB_CLASSES ? glob->items == NULL
+                                   : glob->prefix == NULL || glob->suffix == NULL) {
+        free(glob->prefix);
+        free(glob->suffix);
+        glob->prefix = glob->suffix = NULL;
+        return false;
+    }
+    if (glob->prefix != NULL) {
+        glob->prefix_len = strlen(glob->prefix);
+        glob->suffix_len = strlen(glob->suffix);
+    }
+    return true;
+}
+
+/*
+ * Returns true if item matches exactly one byte, other than the end of a string.
+ */
+static bool single_byte(const struct item *item, char *c)
+{
+    int i, found = -1;
+
+    if (item->star)
+        return false;
+    for (i = 1; i < 256; i++) {
+        if (has_byte(item, i)) {
+            if (found >= 0)
+                return false;
+            found = i;
+        }
+    }
+    *c = found;
+    return found > 0;
+}
+
+/*
+ * Build the automaton by subset construction: each state is a set of NFA
+ * positions, and bytes that no item tells apart share a column of the table.
+ *
+ * \return false if it would have more than CS_GLOB_MAX_STATES states, or if
+ *         out of memory, in which case the patterns are left to fnmatch().
+ */
+static bool build_dfa(struct cs_glob *glob, const struct nfa *nfa)
+{
+    struct subsets subsets;
+    unsigned char representative[256];
+    uint64_t *next = NULL;
+    uint32_t *renumber = NULL;
+    int *accept = NULL;
+    bool *stop = NULL;
+    long id, nstop;
+    size_t p, state;
+    unsigned c;
+    bool ok = false;
+
+    /* Split the bytes into classes that every item treats alike. */
+    memset(glob->classes, 0, sizeof glob->classes);
+    glob->nclasses = 1;
+    for (p = 0; p < nfa->positions; p++) {
+        int split[2 * 256];
+        unsigned n = 0;
+        if (nfa->final[p] >= 0)
+            continue;
+        memset(split, -1, sizeof split);
+        for (c = 0; c < 256; c++) {
+            int *slot = &split[2 * glob->classes[c] + has_byte(&nfa->items[p], c)];
+            if (*slot < 0)
+                *slot = n++;
+            glob->classes[c] = *slot;
+        }
+        glob->nclasses = n;
+    }
+    for (c = 256; c-- > 0;)
+        representative[glob->classes[c]] = c;
+
+    if (!subsets_init(&subsets, nfa->words ? nfa->words : 1, glob->nclasses))
+        return false;
+    next = calloc(subsets.words, sizeof (uint64_t));
+    if (next == NULL)
+        goto finally;
+
+    /* The empty set comes first, so that it is DEAD. */
+    if (subsets_intern(&subsets, next) < 0)
+        goto finally;
+    for (p = 0; p < nfa->positions; p++) {
+        if (p == 0 || nfa->final[p-1] >= 0)
+            next[p / 64] |= (uint64_t)1 << (p % 64);
+    }
+    closure(nfa, next);
+    if ((id = subsets_intern(&subsets, next)) < 0)
+        goto finally;
+    glob->start = id;
+
+    for (state = 0; state < subsets.count; state++) {
+        for (c = 0; c < glob->nclasses; c++) {
+            const uint64_t *set = &subsets.sets[state * subsets.words];
+            memset(next, 0, subsets.words * sizeof (uint64_t));
+            for (p = 0; p < nfa->positions; p++) {
+                if (!(set[p / 64] >> (p % 64) & 1) || nfa->final[p] >= 0)
+                    continue;
+                if (!has_byte(&nfa->items[p], representative[c]))
+                    continue;
+                size_t to = nfa->items[p].star ? p : p + 1;
+                next[to / 64] |= (uint64_t)1 << (to % 64);
+            }
+            closure(nfa, next);
+            if ((id = subsets_intern(&subsets, next)) < 0)
+                goto finally;
+            subsets.table[state * glob->nclasses + c] = id;
+        }
+    }
+
+    /* A state accepts the first pattern whose final position it contains. */
+    accept = malloc(subsets.count * sizeof (int));
+    stop = calloc(subsets.count, sizeof (bool));
+    renumber = malloc(subsets.count * sizeof (uint32_t));
+    glob->table = malloc(subsets.count * glob->nclasses * sizeof (uint32_t));
+    glob->accept = malloc(subsets.count * sizeof (int));
+    if (accept == NULL || stop == NULL || renumber == NULL || glob->table == NULL
+        || glob->accept == NULL) {
+        free(glob->table);
+        free(glob->accept);
+        glob->table = NULL;
+        glob->accept = NULL;
+        goto finally;
+    }
+    for (state = 0; state < subsets.count; state++) {
+        const uint64_t *set = &subsets.sets[state * subsets.words];
+        accept[state] = -1;
+        for (p = 0; p < nfa->positions; p++) {
+            if (nfa->final[p] >= 0 && set[p / 64] >> (p % 64) & 1) {
+                accept[state] = nfa->final[p];
+                break;
+            }
+        }
+        for (c = 0; c < glob->nclasses; c++) {
+            if (subsets.table[state * glob->nclasses + c] != state)
+                break;
+        }
+        stop[state] = state == DEAD || (accept[state] >= 0 && c == glob->nclasses);
+    }
+
+    /* Number the states that decide the result first, keeping DEAD at 0. */
+    for (state = 0, nstop = 0; state < subsets.count; state++) {
+        if (stop[state])
+            renumber[state] = nstop++;
+    }
+    for (state = 0, id = nstop; state < subsets.count; state++) {
+        if (!stop[state])
+            renumber[state] = id++;
+    }
+    for (state = 0; state < subsets.count; state++) {
+        uint32_t row = renumber[state] * glob->nclasses;
+        for (c = 0; c < glob->nclasses; c++) {
+            uint32_t to = subsets.table[state * glob->nclasses + c];
+            glob->table[row + c] = renumber[to] * glob->nclasses;
+        }
+        glob->accept[renumber[state]] = accept[state];
+    }
+    glob->start = renumber[glob->start] * glob->nclasses;
+    glob->stop = nstop * glob->nclasses;
+    ok = true;
+
+finally:
+    free(accept);
+    free(stop);
+    free(renumber);
+    free(next);
+    subsets_free(&subsets);
+    return ok;
+}
+
+/*
+ * Returns false if out of memory, with nothing left to free.
+ */
+static bool subsets_init(struct subsets *subsets, size_t words, unsigned nclasses)
+{
+    size_t i;
+
+    subsets->words = words;
+    subsets->nclasses = nclasses;
+    subsets->count = 0;
+    subsets->capacity = 16;
+    subsets->sets = malloc(subsets->capacity * words * sizeof (uint64_t));
+    subsets->table = malloc(subsets->capacity * nclasses * sizeof (uint32_t));
+    subsets->index = malloc(SUBSET_BUCKETS * sizeof (uint32_t));
+    if (subsets->sets == NULL || subsets->table == NULL || subsets->index == NULL) {
+        subsets_free(subsets);
+        return false;
+    }
+    for (i = 0; i < SUBSET_BUCKETS; i++)
+        subsets->index[i] = UINT32_MAX;
+    return true;
+}
+
+/*
+ * Returns the state for set, adding a new state if there is none yet,
+ * or -1 if there would be too many states or if out of memory.
+ */
+static long subsets_intern(struct subsets *subsets, const uint64_t *set)
+{
+    size_t bytes = subsets->words * sizeof (uint64_t);
+    uint64_t hash = 14695981039346656037ULL;
+    size_t i, bucket;
+
+    for (i = 0; i < subsets->words; i++)
+        hash = (hash ^ set[i]) * 1099511628211ULL;
+    for (bucket = hash % SUBSET_BUCKETS; subsets->index[bucket] != UINT32_MAX;
+         bucket = (bucket + 1) % SUBSET_BUCKETS) {
+        if (memcmp(&subsets->sets[subsets->index[bucket] * subsets->words], set, bytes) == 0)
+            return subsets->index[bucket];
+    }
+
+    if (subsets->count == CS_GLOB_MAX_STATES)
+        return -1;
+    if (subsets->count == subsets->capacity) {
+        size_t capacity = 2 * subsets->capacity;
+        uint64_t *sets = realloc(subsets->sets, capacity * bytes);
+        uint32_t *table;
+        if (sets == NULL)
+            return -1;
+        subsets->sets = sets;
+        table = realloc(subsets->table, capacity * subsets->nclasses * sizeof (uint32_t));
+        if (table == NULL)
+            return -1;
+        subsets->table = table;
+        subsets->capacity = capacity;
+    }
+    memcpy(&subsets->sets[subsets->count * subsets->words], set, bytes);
+    subsets->index[bucket] = subsets->count;
+    return subsets->count++;
+}
+
+static void subsets_free(struct subsets *subsets)
+{
+    free(subsets->sets);
+    free(subsets->table);
+    free(subsets->index);
+}
+
+/*
+ * Add to set every position that can be reached from it without consuming a
+ * byte, that is, the position after each star.
+ */
+static void closure(const struct nfa *nfa, uint64_t *set)
+{
+    size_t p;
+
+    for (p = 0; p + 1 < nfa->positions; p++) {
+        if (nfa->final[p] < 0 && nfa->items[p].star && set[p / 64] >> (p % 64) & 1)
+            set[(p + 1) / 64] |= (uint64_t)1 << ((p + 1) % 64);
+    }
+}
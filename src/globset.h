@@ -0,0 +1,125 @@
+/*
+ * libcassava/globset.h
+ * vim: set cin ts=4 sw=4 et cc=80:
+ *
+ * Copyright (c) 2012 Ben Morgan <neembi@googlemail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION
+ * OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/**
+ * \file
+ * Matching file names against shell glob patterns.
+ *
+ * A pattern, or a set of patterns, is compiled once into a struct cs_glob,
+ * which then matches a string in a single pass without backtracking:
+ * patterns such as "*.log", "core*" or "README" are matched with memcmp(),
+ * everything else with a deterministic automaton that is a table indexed by
+ * state and byte class. This is much faster than translating the pattern into
+ * a regular expression for regexec(); see bench.c.
+ *
+ * The syntax is that of fnmatch() without flags: \c * matches any sequence of
+ * characters, \c ? any single character, \c [...] any character in the bracket
+ * expression (with ranges, classes such as [:digit:], and negation with \c !
+ * or \c ^), and a backslash makes the next character match itself. Like
+ * fnmatch() without flags, \c * and \c ? also match slashes and leading dots.
+ * Characters are bytes, as in the C locale.
+ *
+ * <b>Example Usage:</b>
+ * \code
+ *     const char *patterns[] = { "*.log", "core.[0-9]*" };
+ *     struct cs_glob *glob = cs_glob_set_new(patterns, 2);
+ *     list_filter(&head, filter_glob, glob);
+ *     cs_glob_free(glob);
+ * \endcode
+ *
+ * \author Ben Morgan
+ * \date 17. October 2026
+ */
+
+#ifndef LIBCASSAVA_GLOBSET_H
+#define LIBCASSAVA_GLOBSET_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+#include <stdbool.h>
+#include <stdlib.h>
+
+/**
+ * Upper limit on the number of automaton states of a compiled set. Sets that
+ * would need more are matched with fnmatch(), one pattern after the other.
+ */
+#define CS_GLOB_MAX_STATES 4096
+
+/**
+ * One or more compiled glob patterns; see globset.h.
+ */
+struct cs_glob;
+
+/**
+ * Compile a single glob pattern.
+ *
+ * \return Newly allocated glob, to be freed with cs_glob_free(), or \c NULL
+ *         if out of memory.
+ */
+extern struct cs_glob *cs_glob_new(const char *pattern);
+
+/**
+ * Compile a set of glob patterns, which a string matches if it matches any
+ * one of them.
+ *
+ * \param patterns Array of \a count patterns.
+ * \param count    Number of patterns; a set of 0 patterns matches nothing.
+ * \return Newly allocated glob, to be freed with cs_glob_free(), or \c NULL
+ *         if out of memory.
+ */
+extern struct cs_glob *cs_glob_set_new(const char *const *patterns, size_t count);
+
+/**
+ * Free a compiled glob.
+ */
+extern void cs_glob_free(struct cs_glob *glob);
+
+/**
+ * Returns true if \a string matches \a glob (any of its patterns).
+ */
+extern bool cs_glob_match(const struct cs_glob *glob, const char *string);
+
+/**
+ * Returns the index of the first pattern of \a glob that \a string matches,
+ * or -1 if it matches none of them.
+ */
+extern int cs_glob_find(const struct cs_glob *glob, const char *string);
+
+/**
+ * A filter function for list_filter() and the get_file*_filter() functions,
+ * to keep the strings matching a glob.
+ *
+ * With the get_file*_filter() functions, the name of each file is matched,
+ * even if full pathnames are being listed; otherwise the whole string is.
+ *
+ * \param string String to match.
+ * \param glob   Pointer to a struct cs_glob.
+ * \return The result of cs_glob_match().
+ */
+extern bool filter_glob(void *string, void *glob);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* LIBCASSAVA_GLOBSET_H */
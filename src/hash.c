@@ -0,0 +1,251 @@
+/*
+ * libcassava/hash.c
+ * vim: set cin ts=4 sw=4 et cc=100:
+ *
+ * Copyright (c) 2012 Ben Morgan <neembi@googlemail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#define _GNU_SOURCE
+
+#include "hash.h"
+
+#include <assert.h>
+#include <string.h>
+
+/*
+ * Words are read in the byte order of the machine, so the hashes equal the
+ * published ones on little-endian machines only.
+ */
+
+#define XXH_P1 0x9e3779b185ebca87ULL
+#define XXH_P2 0xc2b2ae3d27d4eb4fULL
+#define XXH_P3 0x165667b19e3779f9ULL
+#define XXH_P4 0x85ebca77c2b2ae63ULL
+#define XXH_P5 0x27d4eb2f165667c5ULL
+
+#define MUR_C1 0x87c37b91114253d5ULL
+#define MUR_C2 0x4cf5ad432745937fULL
+
+static uint64_t rotl(uint64_t x, int r);
+static uint64_t read64(const unsigned char *p);
+static uint32_t read32(const unsigned char *p);
+static uint64_t xxh_round(uint64_t acc, uint64_t input);
+static uint64_t xxh_merge(uint64_t acc, uint64_t value);
+static void murmur_block(struct cs_hash128_state *state, const unsigned char *block);
+static uint64_t murmur_fmix(uint64_t k);
+
+uint64_t cs_hash64(const void *data, size_t len, uint64_t seed)
+{
+    assert(data != NULL || len == 0);
+
+    const unsigned char *p = data, *end = p + len;
+    uint64_t h;
+
+    if (len >= 32) {
+        uint64_t v1 = seed + XXH_P1 + XXH_P2;
+        uint64_t v2 = seed + XXH_P2;
+        uint64_t v3 = seed;
+        uint64_t v4 = seed - XXH_P1;
+
+        do {
+            v1 = xxh_round(v1, read64(p));
+            v2 = xxh_round(v2, read64(p + 8));
+            v3 = xxh_round(v3, read64(p + 16));
+            v4 = xxh_round(v4, read64(p + 24));
+            p += 32;
+        } while (p + 32 <= end);
+
+        h = rotl(v1, 1) + rotl(v2, 7) + rotl(v3, 12) + rotl(v4, 18);
+        h = xxh_merge(h, v1);
+        h = xxh_merge(h, v2);
+        h = xxh_merge(h, v3);
+        h = xxh_merge(h, v4);
+    } else {
+        h = seed + XXH_P5;
+    }
+    h += len;
+
+    for (; p + 8 <= end; p += 8) {
+        h ^= xxh_round(0, read64(p));
+        h = rotl(h, 27) * XXH_P1 + XXH_P4;
+    }
+    if (p + 4 <= end) {
+        h ^= read32(p) * XXH_P1;
+        h = rotl(h, 23) * XXH_P2 + XXH_P3;
+        p += 4;
+    }
+    for (; p < end; p++) {
+        h ^= *p * XXH_P5;
+        h = rotl(h, 11) * XXH_P1;
+    }
+
+    h ^= h >> 33;
+    h *= XXH_P2;
+    h ^= h >> 29;
+    h *= XXH_P3;
+    h ^= h >> 32;
+    return h;
+}
+
+struct cs_hash128 cs_hash128(const void *data, size_t len, uint32_t seed)
+{
+    struct cs_hash128_state state;
+
+    cs_hash128_init(&state, seed);
+    cs_hash128_update(&state, data, len);
+    return cs_hash128_final(&state);
+}
+
+void cs_hash128_init(struct cs_hash128_state *state, uint32_t seed)
+{
+    assert(state != NULL);
+
+    state->h1 = seed;
+    state->h2 = seed;
+    state->length = 0;
+    state->tail_len = 0;
+}
+
+void cs_hash128_update(struct cs_hash128_state *state, const void *data, size_t len)
+{
+    assert(state != NULL);
+    assert(data != NULL || len == 0);
+
+    const unsigned char *p = data, *end = p + len;
+
+    state->length += len;
+    if (state->tail_len > 0) {
+        size_t n = 16 - state->tail_len < len ? 16 - state->tail_len : len;
+        memcpy(state->tail + state->tail_len, p, n);
+        state->tail_len += n;
+        p += n;
+        if (state->tail_len < 16)
+            return;
+        murmur_block(state, state->tail);
+        state->tail_len = 0;
+    }
+    for (; p + 16 <= end; p += 16)
+        murmur_block(state, p);
+    if (p < end) {
+        memcpy(state->tail, p, end - p);
+        state->tail_len = end - p;
+    }
+}
+
+struct cs_hash128 cs_hash128_final(const struct cs_hash128_state *state)
+{
+    assert(state != NULL);
+
+    uint64_t h1 = state->h1, h2 = state->h2, k1 = 0, k2 = 0;
+    const unsigned char *tail = state->tail;
+    struct cs_hash128 hash;
+    size_t i;
+
+    for (i = state->tail_len; i > 8; i--)
+        k2 = k2 << 8 | tail[i - 1];
+    if (state->tail_len > 8) {
+        k2 *= MUR_C2;
+        k2 = rotl(k2, 33);
+        k2 *= MUR_C1;
+        h2 ^= k2;
+    }
+    for (i = state->tail_len < 8 ? state->tail_len : 8; i > 0; i--)
+        k1 = k1 << 8 | tail[i - 1];
+    if (state->tail_len > 0) {
+        k1 *= MUR_C1;
+        k1 = rotl(k1, 31);
+        k1 *= MUR_C2;
+        h1 ^= k1;
+    }
+
+    h1 ^= state->length;
+    h2 ^= state->length;
+    h1 += h2;
+    h2 += h1;
+    h1 = murmur_fmix(h1);
+    h2 = murmur_fmix(h2);
+    h1 += h2;
+    h2 += h1;
+
+    hash.low = h1;
+    hash.high = h2;
+    return hash;
+}
+
+bool cs_hash128_equal(struct cs_hash128 a, struct cs_hash128 b)
+{
+    return a.low == b.low && a.high == b.high;
+}
+
+static uint64_t rotl(uint64_t x, int r)
+{
+    return (x << r) | (x >> (64 - r));
+}
+
+static uint64_t read64(const unsigned char *p)
+{
+    uint64_t v;
+    memcpy(&v, p, sizeof v);
+    return v;
+}
+
+static uint32_t read32(const unsigned char *p)
+{
+    uint32_t v;
+    memcpy(&v, p, sizeof v);
+    return v;
+}
+
+static uint64_t xxh_round(uint64_t acc, uint64_t input)
+{
+    acc += input * XXH_P2;
+    acc = rotl(acc, 31);
+    return acc * XXH_P1;
+}
+
+static uint64_t xxh_merge(uint64_t acc, uint64_t value)
+{
+    acc ^= xxh_round(0, value);
+    return acc * XXH_P1 + XXH_P4;
+}
+
+static void murmur_block(struct cs_hash128_state *state, const unsigned char *block)
+{
+    uint64_t k1 = read64(block), k2 = read64(block + 8);
+
+    k1 *= MUR_C1;
+    k1 = rotl(k1, 31);
+    k1 *= MUR_C2;
+    state->h1 ^= k1;
+    state->h1 = rotl(state->h1, 27) + state->h2;
+    state->h1 = state->h1 * 5 + 0x52dce729;
+
+    k2 *= MUR_C2;
+    k2 = rotl(k2, 33);
+    k2 *= MUR_C1;
+    state->h2 ^= k2;
+    state->h2 = rotl(state->h2, 31) + state->h1;
+    state->h2 = state->h2 * 5 + 0x38495ab5;
+}
+
+static uint64_t murmur_fmix(uint64_t k)
+{
+    k ^= k >> 33;
+    k *= 0xff51afd7ed558ccdULL;
+    k ^= k >> 33;
+    k *= 0xc4ceb9fe1a85ec53ULL;
+    k ^= k >> 33;
+    return k;
+}
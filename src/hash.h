@@ -0,0 +1,105 @@
+/*
+ * libcassava/hash.h
+ * vim: set cin ts=4 sw=4 et cc=80:
+ *
+ * Copyright (c) 2012 Ben Morgan <neembi@googlemail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION
+ * OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/**
+ * \file
+ * Fast non-cryptographic hash functions.
+ *
+ * cs_hash64() is xxHash64, meant for short keys such as file names in hash
+ * tables. The 128-bit hash is MurmurHash3 (x64, 128 bits), which can also be
+ * computed piecewise over data that is read in chunks, and is meant for
+ * telling whether the contents of files are equal.
+ *
+ * Neither is any protection against data made up to collide on purpose.
+ *
+ * \author Ben Morgan
+ * \date 17. October 2026
+ */
+
+#ifndef LIBCASSAVA_HASH_H
+#define LIBCASSAVA_HASH_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+/**
+ * A 128-bit hash value.
+ */
+struct cs_hash128 {
+    uint64_t low;
+    uint64_t high;
+};
+
+/**
+ * The state of a 128-bit hash computed piecewise; see cs_hash128_init().
+ */
+struct cs_hash128_state {
+    uint64_t h1;
+    uint64_t h2;
+    uint64_t length;
+    unsigned char tail[16];
+    size_t tail_len;
+};
+
+/**
+ * Returns the 64-bit hash of the \a len bytes at \a data.
+ */
+extern uint64_t cs_hash64(const void *data, size_t len, uint64_t seed);
+
+/**
+ * Returns the 128-bit hash of the \a len bytes at \a data.
+ */
+extern struct cs_hash128 cs_hash128(const void *data, size_t len,
+                                    uint32_t seed);
+
+/**
+ * Start computing a 128-bit hash piecewise. Feeding all data to
+ * cs_hash128_update(), in pieces of any size, and then calling
+ * cs_hash128_final() gives the same hash as cs_hash128() on all of it.
+ */
+extern void cs_hash128_init(struct cs_hash128_state *state, uint32_t seed);
+
+/**
+ * Add the next \a len bytes at \a data to a hash.
+ */
+extern void cs_hash128_update(struct cs_hash128_state *state,
+                              const void *data, size_t len);
+
+/**
+ * Returns the hash of all data given to cs_hash128_update().
+ */
+extern struct cs_hash128 cs_hash128_final(const struct cs_hash128_state *state);
+
+/**
+ * Returns true if both hashes are equal.
+ */
+extern bool cs_hash128_equal(struct cs_hash128 a, struct cs_hash128 b);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* LIBCASSAVA_HASH_H */
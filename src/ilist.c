@@ -0,0 +1,159 @@
+/*
+ * libcassava/ilist.c
+ * vim: set cin ts=4 sw=4 et cc=100:
+ *
+ * Copyright (c) 2012 Ben Morgan <neembi@googlemail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#define _GNU_SOURCE
+
+#include "ilist.h"
+
+#include <assert.h>
+
+/* The pointer to the element after elem. */
+#define NEXT(elem, offset) (*(void **)((char *)(elem) + (offset)))
+
+/* Levels of runs ilist_sort() keeps, enough for 2^64 of them. */
+#define SORT_LEVELS 64
+
+/*
+ * How the elements of a list are linked and compared, which is the same
+ * for every call while sorting it.
+ */
+struct sort_context {
+    size_t offset;
+    int (*compare)(const void *, const void *, void *);
+    void *arg;
+};
+
+static void *take_run(void **rest, const struct sort_context *context, void **tail);
+static void *merge_runs(void *first, void *first_tail, void *second, void *second_tail,
+                        const struct sort_context *context, void **tail);
+
+/*
+ * The same algorithm as list_sort() in list.c, but comparing the elements
+ * themselves rather than the data they point to.
+ */
+void *ilist_sort(void *head, size_t offset, int (*compare)(const void *, const void *, void *),
+                 void *arg, void **tail)
+{
+    assert(compare != NULL);
+    assert(tail != NULL);
+
+    struct sort_context context = {offset, compare, arg};
+    void *pending[SORT_LEVELS], *pending_tails[SORT_LEVELS];
+    void *run;
+    size_t i, levels = 0;
+
+    *tail = NULL;
+    while (head != NULL) {
+        run = take_run(&head, &context, tail);
+        for (i = 0; i < levels && pending[i] != NULL; i++) {
+            run = merge_runs(pending[i], pending_tails[i], run, *tail, &context, tail);
+            pending[i] = NULL;
+        }
+        if (i == levels)
+            levels++;
+        pending[i] = run;
+        pending_tails[i] = *tail;
+    }
+
+    run = NULL;
+    for (i = 0; i < levels; i++) {
+        if (pending[i] == NULL)
+            continue;
+        if (run == NULL) {
+            run = pending[i];
+            *tail = pending_tails[i];
+        } else {
+            run = merge_runs(pending[i], pending_tails[i], run, *tail, &context, tail);
+        }
+    }
+    return run;
+}
+
+/*
+ * Detach the run of elements in order at the front of rest and return it,
+ * advancing rest past it and setting tail to its last element. A run in
+ * strictly descending order is reversed.
+ */
+static void *take_run(void **rest, const struct sort_context *context, void **tail)
+{
+    size_t offset = context->offset;
+    void *first = *rest, *elem = first, *next = NEXT(first, offset);
+
+    if (next != NULL && context->compare(next, first, context->arg) < 0) {
+        void *prev = NULL;
+        do {
+            next = NEXT(elem, offset);
+            NEXT(elem, offset) = prev;
+            prev = elem;
+            elem = next;
+        } while (elem != NULL && context->compare(elem, prev, context->arg) < 0);
+        *rest = elem;
+        *tail = first;
+        return prev;
+    }
+
+    while (next != NULL && context->compare(next, elem, context->arg) >= 0) {
+        elem = next;
+        next = NEXT(elem, offset);
+    }
+    NEXT(elem, offset) = NULL;
+    *rest = next;
+    *tail = elem;
+    return first;
+}
+
+/*
+ * Merge the runs first and second into one and return it, setting tail to
+ * its last element. Of elements that compare equal, those of first come
+ * first.
+ */
+static void *merge_runs(void *first, void *first_tail, void *second, void *second_tail,
+                        const struct sort_context *context, void **tail)
+{
+    size_t offset = context->offset;
+    void *head, **link = &head;
+
+    if (context->compare(second, first_tail, context->arg) >= 0) {
+        NEXT(first_tail, offset) = second;
+        *tail = second_tail;
+        return first;
+    }
+
+    for (;;) {
+        if (context->compare(second, first, context->arg) < 0) {
+            *link = second;
+            link = &NEXT(second, offset);
+            second = *link;
+            if (second == NULL) {
+                *link = first;
+                *tail = first_tail;
+                return head;
+            }
+        } else {
+            *link = first;
+            link = &NEXT(first, offset);
+            first = *link;
+            if (first == NULL) {
+                *link = second;
+                *tail = second_tail;
+                return head;
+            }
+        }
+    }
+}
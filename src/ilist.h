@@ -0,0 +1,334 @@
+/*
+ * libcassava/ilist.h
+ * vim: set cin ts=4 sw=4 et cc=80:
+ *
+ * Copyright (c) 2012 Ben Morgan <neembi@googlemail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION
+ * OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/**
+ * \file
+ * Intrusive lists, whose elements contain the link to the next one.
+ *
+ * A struct list_node points to its data, so every element of a list.h list
+ * takes two allocations, and getting at the data takes one more cache miss.
+ * Since struct list_node can only be defined once, all lists of a program
+ * also have to hold the same kind of data.
+ *
+ * Here, the element is the node: any struct with a pointer to the next
+ * element of the same type can be put into a list. ILIST_DEFINE() generates
+ * a list type and the functions for it, which are static inline, so that the
+ * compiler can inline them and check the types of their arguments. Lists of
+ * different element types, and lists of the same type linked through
+ * different members, can be defined side by side.
+ *
+ * An element can only be in one list per pointer member at a time. ilist.hpp
+ * has a C++ template with the same functions.
+ *
+ * <b>Example Usage:</b>
+ * \code
+ *     struct file {
+ *         off_t size;
+ *         struct file *next;
+ *         char name[];
+ *     };
+ *
+ *     ILIST_DEFINE(file_list, struct file, next)
+ *
+ *     struct file_list files;
+ *     struct file *file;
+ *     file_list_init(&files);
+ *     file_list_append(&files, new_file("a.out"));
+ *     ILIST_FOREACH(file, &files, next)
+ *         puts(file->name);
+ *     file_list_free_all(&files, (void (*)(struct file *))free);
+ * \endcode
+ *
+ * \author Ben Morgan
+ * \date 17. October 2026
+ */
+
+#ifndef LIBCASSAVA_ILIST_H
+#define LIBCASSAVA_ILIST_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdlib.h>
+
+/**
+ * Go through all elements of an intrusive list, from first to last. The
+ * element \a var must not be removed in the body.
+ *
+ * \param var  Variable of the element type, set to each element in turn.
+ * \param list Pointer to the list.
+ * \param next Name of the member linking the elements.
+ */
+#define ILIST_FOREACH(var, list, next) \
+    for ((var) = (list)->head; (var) != NULL; (var) = (var)->next)
+
+/**
+ * Sort elements linked by a pointer at \a offset bytes into each element, as
+ * list_sort() does: stable, in place, and with as many comparisons as there
+ * are elements if they are already sorted.
+ *
+ * This is what the _sort() function of ILIST_DEFINE() calls, and not meant to
+ * be called directly.
+ *
+ * \param head    First element, or \c NULL.
+ * \param offset  Offset of the pointer to the next element.
+ * \param compare Comparison of two elements.
+ * \param arg     Passed to \a compare unchanged.
+ * \param tail    Set to the last element after sorting, or \c NULL.
+ * \return The first element after sorting.
+ */
+extern void *ilist_sort(void *head, size_t offset,
+                        int (*compare)(const void *, const void *, void *),
+                        void *arg, void **tail);
+
+/**
+ * Define a list of elements of type \a type, linked through their member
+ * \a next, which must be of type pointer to \a type. This defines
+ * <tt>struct name</tt>, with the members \a head, \a tail and \a length as
+ * in struct list_head, and the functions below, all prefixed by \a name and
+ * an underscore. A zero-initialized list is empty. The struct
+ * <tt>name_compare</tt> and the function <tt>name_compare_thunk()</tt> are
+ * also defined, for use by <tt>name_sort()</tt> only.
+ *
+ * - <tt>void name_init(struct name *list)</tt> \n
+ *   Initialize an empty list.
+ * - <tt>bool name_empty(const struct name *list)</tt> \n
+ *   Returns true if the list is empty.
+ * - <tt>size_t name_length(const struct name *list)</tt> \n
+ *   Returns the number of elements, in constant time.
+ * - <tt>void name_push(struct name *list, type *elem)</tt> \n
+ *   Add \a elem in front of the list.
+ * - <tt>void name_append(struct name *list, type *elem)</tt> \n
+ *   Add \a elem to the end of the list.
+ * - <tt>type *name_pop(struct name *list)</tt> \n
+ *   Remove the first element and return it, or \c NULL if there is none.
+ * - <tt>void name_insert(struct name *list, type *after, type *elem)</tt> \n
+ *   Insert \a elem after \a after, or in front if \a after is \c NULL.
+ * - <tt>type *name_remove_after(struct name *list, type *after)</tt> \n
+ *   Remove the element after \a after, or the first if \a after is \c NULL,
+ *   and return it, or \c NULL if there is none.
+ * - <tt>void name_concat(struct name *list, struct name *other)</tt> \n
+ *   Move all elements of \a other to the end of \a list in constant time.
+ * - <tt>type *name_find(const struct name *list,
+ *   bool (*match)(const type *, const void *), const void *key)</tt> \n
+ *   Returns the first element for which \a match returns true, or \c NULL.
+ * - <tt>size_t name_filter(struct name *list,
+ *   bool (*filter)(type *, void *), void *arg,
+ *   void (*destroy)(type *))</tt> \n
+ *   Remove the elements for which \a filter does not return true, as
+ *   list_filter() does, and pass each to \a destroy, unless it is \c NULL.
+ *   Returns the number of elements left.
+ * - <tt>void name_sort(struct name *list,
+ *   int (*compare)(const type *, const type *, void *), void *arg)</tt> \n
+ *   Sort the list as list_sort() does.
+ * - <tt>size_t name_to_array(const struct name *list, type ***output)</tt> \n
+ *   Set \a output to a newly allocated \c NULL-terminated array of the
+ *   elements, or \c NULL if out of memory, and return the number of
+ *   elements.
+ * - <tt>void name_free_all(struct name *list, void (*destroy)(type *))</tt> \n
+ *   Pass every element to \a destroy, leaving the list empty.
+ *
+ * \param name Name of the list type and prefix of the functions.
+ * \param type Type of the elements, such as <tt>struct file</tt>.
+ * \param next Name of the member linking the elements.
+ */
+#define ILIST_DEFINE(name, type, next) \
+    struct name { \
+        type *head; \
+        type *tail; \
+        size_t length; \
+    }; \
+    \
+    struct name##_compare { \
+        int (*compare)(const type *, const type *, void *); \
+        void *arg; \
+    }; \
+    \
+    static inline void name##_init(struct name *list) \
+    { \
+        list->head = list->tail = NULL; \
+        list->length = 0; \
+    } \
+    \
+    static inline bool name##_empty(const struct name *list) \
+    { \
+        return list->head == NULL; \
+    } \
+    \
+    static inline size_t name##_length(const struct name *list) \
+    { \
+        return list->length; \
+    } \
+    \
+    static inline void name##_push(struct name *list, type *elem) \
+    { \
+        elem->next = list->head; \
+        list->head = elem; \
+        if (list->tail == NULL) \
+            list->tail = elem; \
+        list->length++; \
+    } \
+    \
+    static inline void name##_append(struct name *list, type *elem) \
+    { \
+        elem->next = NULL; \
+        if (list->tail == NULL) \
+            list->head = elem; \
+        else \
+            list->tail->next = elem; \
+        list->tail = elem; \
+        list->length++; \
+    } \
+    \
+    static inline void name##_insert(struct name *list, type *after, \
+                                     type *elem) \
+    { \
+        if (after == NULL) { \
+            name##_push(list, elem); \
+            return; \
+        } \
+        elem->next = after->next; \
+        after->next = elem; \
+        if (list->tail == after) \
+            list->tail = elem; \
+        list->length++; \
+    } \
+    \
+    static inline type *name##_remove_after(struct name *list, type *after) \
+    { \
+        type *elem = after != NULL ? after->next : list->head; \
+        if (elem == NULL) \
+            return NULL; \
+        if (after != NULL) \
+            after->next = elem->next; \
+        else \
+            list->head = elem->next; \
+        if (list->tail == elem) \
+            list->tail = after; \
+        elem->next = NULL; \
+        list->length--; \
+        return elem; \
+    } \
+    \
+    static inline type *name##_pop(struct name *list) \
+    { \
+        return name##_remove_after(list, NULL); \
+    } \
+    \
+    static inline void name##_concat(struct name *list, struct name *other) \
+    { \
+        if (other->head == NULL) \
+            return; \
+        if (list->tail == NULL) \
+            list->head = other->head; \
+        else \
+            list->tail->next = other->head; \
+        list->tail = other->tail; \
+        list->length += other->length; \
+        name##_init(other); \
+    } \
+    \
+    static inline type *name##_find(const struct name *list, \
+                                    bool (*match)(const type *, const void *), \
+                                    const void *key) \
+    { \
+        type *elem; \
+        for (elem = list->head; elem != NULL; elem = elem->next) \
+            if (match(elem, key)) \
+                return elem; \
+        return NULL; \
+    } \
+    \
+    static inline size_t name##_filter(struct name *list, \
+                                       bool (*filter)(type *, void *), \
+                                       void *arg, void (*destroy)(type *)) \
+    { \
+        type *elem = list->head, **link = &list->head; \
+        list->tail = NULL; \
+        list->length = 0; \
+        while (elem != NULL) { \
+            type *following = elem->next; \
+            if (filter(elem, arg)) { \
+                *link = list->tail = elem; \
+                link = &elem->next; \
+                list->length++; \
+            } else if (destroy != NULL) { \
+                destroy(elem); \
+            } \
+            elem = following; \
+        } \
+        *link = NULL; \
+        return list->length; \
+    } \
+    \
+    /* Calls the compare of name_sort() through the type ilist_sort() takes. */ \
+    static inline int name##_compare_thunk(const void *a, const void *b, \
+                                           void *context) \
+    { \
+        const struct name##_compare *c = \
+            (const struct name##_compare *)context; \
+        return c->compare((const type *)a, (const type *)b, c->arg); \
+    } \
+    \
+    static inline void name##_sort(struct name *list, \
+                                   int (*compare)(const type *, const type *, \
+                                                  void *), \
+                                   void *arg) \
+    { \
+        struct name##_compare context; \
+        void *tail; \
+        context.compare = compare; \
+        context.arg = arg; \
+        list->head = (type *)ilist_sort(list->head, offsetof(type, next), \
+                                        name##_compare_thunk, &context, &tail); \
+        list->tail = (type *)tail; \
+    } \
+    \
+    static inline size_t name##_to_array(const struct name *list, \
+                                         type ***output) \
+    { \
+        type *elem; \
+        size_t count = 0; \
+        *output = (type **)malloc((list->length + 1) * sizeof (type *)); \
+        if (*output == NULL) \
+            return 0; \
+        for (elem = list->head; elem != NULL; elem = elem->next) \
+            (*output)[count++] = elem; \
+        (*output)[count] = NULL; \
+        return count; \
+    } \
+    \
+    static inline void name##_free_all(struct name *list, \
+                                       void (*destroy)(type *)) \
+    { \
+        type *elem; \
+        while ((elem = name##_pop(list)) != NULL) \
+            destroy(elem); \
+    }
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* LIBCASSAVA_ILIST_H */
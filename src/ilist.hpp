@@ -0,0 +1,276 @@
+/*
+ * libcassava/ilist.hpp
+ * vim: set cin ts=4 sw=4 et cc=80:
+ *
+ * Copyright (c) 2012 Ben Morgan <neembi@googlemail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION
+ * OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/**
+ * \file
+ * Intrusive lists for C++, as ilist.h has them for C.
+ *
+ * The template cassava::ilist takes the element type and a pointer to the
+ * member linking the elements, so that the compiler checks both. Everything
+ * is in this header, except for sort(), which calls ilist_sort() of the
+ * library. The list does not own its elements: they are neither copied nor
+ * freed, except by free_all() and filter().
+ *
+ * <b>Example Usage:</b>
+ * \code
+ *     struct file {
+ *         off_t size;
+ *         file *next;
+ *     };
+ *
+ *     cassava::ilist<file, &file::next> files;
+ *     files.push_back(new file());
+ *     files.sort([](const file &a, const file &b) { return a.size < b.size; });
+ *     for (file &f : files)
+ *         std::cout << f.size << '\n';
+ *     files.free_all([](file *f) { delete f; });
+ * \endcode
+ *
+ * \author Ben Morgan
+ * \date 17. October 2026
+ */
+
+#ifndef LIBCASSAVA_ILIST_HPP
+#define LIBCASSAVA_ILIST_HPP
+
+#include <cstddef>
+#include <iterator>
+
+#include "ilist.h"
+
+namespace cassava {
+
+/**
+ * A list of elements of type \a T, linked through their member \a Next.
+ * Lists can be moved, but not copied, since an element can only be in one
+ * list per member.
+ */
+template <typename T, T *T::*Next>
+class ilist {
+public:
+    /** Forward iterator over the elements of a list. */
+    class iterator {
+    public:
+        typedef std::forward_iterator_tag iterator_category;
+        typedef T value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef T *pointer;
+        typedef T &reference;
+
+        explicit iterator(T *elem = nullptr) : elem_(elem) {}
+        T &operator*() const { return *elem_; }
+        T *operator->() const { return elem_; }
+        iterator &operator++() { elem_ = elem_->*Next; return *this; }
+        iterator operator++(int) { iterator old(*this); ++*this; return old; }
+        bool operator==(const iterator &other) const { return elem_ == other.elem_; }
+        bool operator!=(const iterator &other) const { return elem_ != other.elem_; }
+
+    private:
+        T *elem_;
+    };
+
+    ilist() : head_(nullptr), tail_(nullptr), length_(0) {}
+
+    ilist(ilist &&other)
+        : head_(other.head_), tail_(other.tail_), length_(other.length_)
+    {
+        other.clear();
+    }
+
+    ilist &operator=(ilist &&other)
+    {
+        if (this != &other) {
+            head_ = other.head_;
+            tail_ = other.tail_;
+            length_ = other.length_;
+            other.clear();
+        }
+        return *this;
+    }
+
+    ilist(const ilist &) = delete;
+    ilist &operator=(const ilist &) = delete;
+
+    iterator begin() const { return iterator(head_); }
+    iterator end() const { return iterator(); }
+
+    bool empty() const { return head_ == nullptr; }
+    std::size_t size() const { return length_; }
+    T *front() const { return head_; }
+    T *back() const { return tail_; }
+
+    /** Forget all elements, without freeing them. */
+    void clear()
+    {
+        head_ = tail_ = nullptr;
+        length_ = 0;
+    }
+
+    void push_front(T *elem)
+    {
+        elem->*Next = head_;
+        head_ = elem;
+        if (tail_ == nullptr)
+            tail_ = elem;
+        length_++;
+    }
+
+    void push_back(T *elem)
+    {
+        elem->*Next = nullptr;
+        if (tail_ == nullptr)
+            head_ = elem;
+        else
+            tail_->*Next = elem;
+        tail_ = elem;
+        length_++;
+    }
+
+    /** Remove the first element and return it, or nullptr if there is none. */
+    T *pop_front() { return remove_after(nullptr); }
+
+    /** Insert \a elem after \a after, or in front if \a after is nullptr. */
+    void insert_after(T *after, T *elem)
+    {
+        if (after == nullptr) {
+            push_front(elem);
+            return;
+        }
+        elem->*Next = after->*Next;
+        after->*Next = elem;
+        if (tail_ == after)
+            tail_ = elem;
+        length_++;
+    }
+
+    /**
+     * Remove the element after \a after, or the first if \a after is
+     * nullptr, and return it, or nullptr if there is none.
+     */
+    T *remove_after(T *after)
+    {
+        T *elem = after != nullptr ? after->*Next : head_;
+        if (elem == nullptr)
+            return nullptr;
+        if (after != nullptr)
+            after->*Next = elem->*Next;
+        else
+            head_ = elem->*Next;
+        if (tail_ == elem)
+            tail_ = after;
+        elem->*Next = nullptr;
+        length_--;
+        return elem;
+    }
+
+    /** Move all elements of \a other to the end, in constant time. */
+    void splice_back(ilist &other)
+    {
+        if (other.head_ == nullptr)
+            return;
+        if (tail_ == nullptr)
+            head_ = other.head_;
+        else
+            tail_->*Next = other.head_;
+        tail_ = other.tail_;
+        length_ += other.length_;
+        other.clear();
+    }
+
+    /** Returns the first element for which \a match is true, or nullptr. */
+    template <typename Match>
+    T *find(Match match) const
+    {
+        for (T *elem = head_; elem != nullptr; elem = elem->*Next)
+            if (match(*elem))
+                return elem;
+        return nullptr;
+    }
+
+    /**
+     * Remove the elements for which \a keep is false, and pass each to
+     * \a destroy. Returns the number of elements left.
+     */
+    template <typename Keep, typename Destroy>
+    std::size_t filter(Keep keep, Destroy destroy)
+    {
+        T *elem = head_, **link = &head_;
+        tail_ = nullptr;
+        length_ = 0;
+        while (elem != nullptr) {
+            T *following = elem->*Next;
+            if (keep(*elem)) {
+                *link = tail_ = elem;
+                link = &(elem->*Next);
+                length_++;
+            } else {
+                destroy(elem);
+            }
+            elem = following;
+        }
+        *link = nullptr;
+        return length_;
+    }
+
+    /**
+     * Sort the list as list_sort() does, stable and in place, with \a less
+     * telling whether its first argument goes before its second.
+     */
+    template <typename Less>
+    void sort(Less less)
+    {
+        if (head_ == nullptr)
+            return;
+        /* The offset of a member of a class that is not standard layout can
+         * only be taken from an object. */
+        std::size_t offset = reinterpret_cast<char *>(&(head_->*Next)) -
+                             reinterpret_cast<char *>(head_);
+        void *tail;
+        head_ = static_cast<T *>(ilist_sort(head_, offset, &compare<Less>, &less, &tail));
+        tail_ = static_cast<T *>(tail);
+    }
+
+    /** Sort the list by the operator < of its elements. */
+    void sort() { sort([](const T &a, const T &b) { return a < b; }); }
+
+    /** Pass every element to \a destroy, leaving the list empty. */
+    template <typename Destroy>
+    void free_all(Destroy destroy)
+    {
+        while (T *elem = pop_front())
+            destroy(elem);
+    }
+
+private:
+    /* ilist_sort() only tells less from not less, so that is all this returns. */
+    template <typename Less>
+    static int compare(const void *a, const void *b, void *less)
+    {
+        return (*static_cast<Less *>(less))(*static_cast<const T *>(a),
+                                            *static_cast<const T *>(b)) ? -1 : 0;
+    }
+
+    T *head_;
+    T *tail_;
+    std::size_t length_;
+};
+
+} // namespace cassava
+
+#endif /* LIBCASSAVA_ILIST_HPP */
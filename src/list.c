@@ -18,8 +18,11 @@
  */
 
 #include "list.h"
+#include "parallel.h"
 
 #include <assert.h>
+#include <pthread.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <stdbool.h>
 
@@ -33,11 +36,108 @@ struct list_node {
     struct list_node *next;
 };
 
+/* Number of nodes moved between the cache of a thread and a pool at once. */
+#define POOL_BATCH 256
+
+/* A thread cache that would grow beyond this gives its nodes to the pool. */
+#define POOL_CACHE_MAX (4 * POOL_BATCH)
+
+/* Number of pools a thread keeps a cache for at the same time. */
+#define POOL_CACHES 4
+
+/* Chunks per thread list_filter_parallel() aims for, to balance uneven filters. */
+#define FILTER_CHUNKS 8
+
+/* Fewest nodes in a chunk of list_filter_parallel(). */
+#define FILTER_CHUNK_MIN 64
+
+/*
+ * The chunks list_filter_parallel() cuts a list into, with the number of
+ * nodes each has left after filtering.
+ */
+struct filter_chunks {
+    struct list_node **heads;
+    struct list_node **tails;
+    size_t *counts;
+    size_t count;
+    bool (*filter)(void *, void *);
+    void *arguments;
+};
+
+/* Levels of runs list_sort() keeps, enough for 2^64 of them. */
+#define SORT_LEVELS 64
+
+/*
+ * The parts list_sort_parallel() cuts a list into. In the merge rounds,
+ * part i is merged with part i + width, for every i divisible by 2 * width.
+ */
+struct sort_parts {
+    struct list_node **heads;
+    struct list_node **tails;
+    size_t count;
+    size_t width;
+    list_compare_fn compare;
+    void *arg;
+};
+
+struct pool_slab {
+    struct pool_slab *next;
+    struct list_node nodes[];
+};
+
+struct list_pool {
+    pthread_mutex_t lock;
+    struct list_node *free;
+    struct pool_slab *slabs;
+    size_t slab_nodes;
+    uint64_t id;
+    struct list_pool *next;
+};
+
+/*
+ * The free nodes a thread keeps for a pool, from first to last. Pools are
+ * told apart by id rather than address, since the address of a freed pool
+ * may be reused; id 0 marks an unused cache.
+ */
+struct pool_cache {
+    uint64_t id;
+    struct list_node *first;
+    struct list_node *last;
+    size_t count;
+};
+
+static __thread struct pool_cache pool_caches[POOL_CACHES] __attribute__((tls_model("initial-exec")));
+
+/* All pools that have not been freed, so that caches can tell. */
+static pthread_mutex_t pools_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct list_pool *pools;
+static uint64_t pools_created;
+
+static size_t filter_nodes(struct list_node **head, bool (*filter)(void *, void *),
+                           void *arguments, struct list_node **tail);
+static struct list_node *take_run(struct list_node **rest, list_compare_fn compare, void *arg,
+                                  struct list_node **tail);
+static struct list_node *merge_runs(struct list_node *first, struct list_node *first_tail,
+                                    struct list_node *second, struct list_node *second_tail,
+                                    list_compare_fn compare, void *arg, struct list_node **tail);
+static size_t filter_parallel(struct list_node **head, bool (*filter)(void *, void *),
+                              void *arguments, unsigned threads, struct list_node **tail);
+static void filter_chunks(size_t begin, size_t end, void *arg);
+static void sort_parts(size_t begin, size_t end, void *arg);
+static void merge_parts(size_t begin, size_t end, void *arg);
+static struct pool_cache *pool_cache(struct list_pool *pool);
+static void pool_flush(struct pool_cache *cache);
+static bool pool_refill(struct list_pool *pool, struct pool_cache *cache);
+static void pool_give(struct list_pool *pool, struct list_node *first, struct list_node *last,
+                      size_t count);
+
 struct list_node *list_node()
 {
     struct list_node *ptr;
 
     ptr = malloc(sizeof (struct list_node));
+    if (ptr == NULL)
+        return NULL;
     ptr->data = NULL;
     ptr->next = NULL;
     return ptr;
@@ -73,6 +173,8 @@ size_t list_to_array(const struct list_node *head, void ***output)
 
     /* add all non-NULL items to array and terminate with NULL */
     *output = malloc(count * sizeof (void *));
+    if (*output == NULL)
+        return 0;
     if (count > 1) {
         size_t index = 0;
         for (iter = head; iter != NULL; iter = iter->next)
@@ -84,15 +186,18 @@ size_t list_to_array(const struct list_node *head, void ***output)
     return count-1;
 }
 
-void list_push(struct list_node **head, void *data)
+bool list_push(struct list_node **head, void *data)
 {
     assert(head != NULL);
 
     struct list_node *node = list_node();
+    if (node == NULL)
+        return false;
     node->data = data;
 
     node->next = *head;
     *head = node;
+    return true;
 }
 
 void *list_pop(struct list_node **head)
@@ -149,6 +254,462 @@ struct list_node *list_remove(struct list_node **head)
 }
 
 size_t list_filter(struct list_node **head, bool (*filter)(void *, void *), void *arguments)
+{
+    struct list_node *tail;
+
+    return filter_nodes(head, filter, arguments, &tail);
+}
+
+size_t list_filter_parallel(struct list_node **head, bool (*filter)(void *, void *),
+                            void *arguments, unsigned threads)
+{
+    struct list_node *tail;
+
+    return filter_parallel(head, filter, arguments, threads, &tail);
+}
+
+struct list_node *list_sort(struct list_node **head, list_compare_fn compare, void *arg)
+{
+    assert(head != NULL);
+    assert(compare != NULL);
+
+    /*
+     * Runs are merged like a binary counter is incremented: pending[i] holds
+     * a merge of 2^i runs, or nothing. Merging the runs while they are still
+     * in the cache is much faster than merging pairs in passes over the
+     * whole list. Higher levels hold earlier nodes, so they are merged first.
+     */
+    struct list_node *pending[SORT_LEVELS], *pending_tails[SORT_LEVELS];
+    struct list_node *rest = *head, *run = NULL, *tail = NULL;
+    size_t i, levels = 0;
+
+    while (rest != NULL) {
+        run = take_run(&rest, compare, arg, &tail);
+        for (i = 0; i < levels && pending[i] != NULL; i++) {
+            run = merge_runs(pending[i], pending_tails[i], run, tail, compare, arg, &tail);
+            pending[i] = NULL;
+        }
+        if (i == levels)
+            levels++;
+        pending[i] = run;
+        pending_tails[i] = tail;
+    }
+
+    run = NULL;
+    for (i = 0; i < levels; i++) {
+        if (pending[i] == NULL)
+            continue;
+        if (run == NULL) {
+            run = pending[i];
+            tail = pending_tails[i];
+        } else {
+            run = merge_runs(pending[i], pending_tails[i], run, tail, compare, arg, &tail);
+        }
+    }
+
+    *head = run;
+    return tail;
+}
+
+struct list_node *list_sort_parallel(struct list_node **head, list_compare_fn compare, void *arg,
+                                     unsigned threads)
+{
+    assert(head != NULL);
+    assert(compare != NULL);
+
+    size_t length = list_length(*head);
+    if (threads == 0)
+        threads = cs_parallel_threads();
+    if (threads < 2 || length < LIST_SORT_PARALLEL_MIN)
+        return list_sort(head, compare, arg);
+
+    /* Every part needs at least one node. */
+    struct sort_parts parts;
+    parts.count = threads < length ? threads : length;
+    parts.compare = compare;
+    parts.arg = arg;
+    parts.heads = malloc(2 * parts.count * sizeof (struct list_node *));
+    if (parts.heads == NULL)
+        return list_sort(head, compare, arg);
+    parts.tails = parts.heads + parts.count;
+
+    /* Cut the list into parts of equal length, the first ones one node longer. */
+    struct list_node *node = *head;
+    size_t i, j;
+    for (i = 0; i < parts.count; i++) {
+        size_t part_length = length / parts.count + (i < length % parts.count);
+        parts.heads[i] = node;
+        for (j = 1; j < part_length; j++)
+            node = node->next;
+        parts.tails[i] = node;
+        node = node->next;
+        parts.tails[i]->next = NULL;
+    }
+
+    cs_parallel_for(parts.count, 1, threads, sort_parts, &parts);
+    for (parts.width = 1; parts.width < parts.count; parts.width *= 2) {
+        size_t pairs = (parts.count + 2*parts.width - 1) / (2*parts.width);
+        cs_parallel_for(pairs, 1, threads, merge_parts, &parts);
+    }
+
+    struct list_node *tail = parts.tails[0];
+    *head = parts.heads[0];
+    free(parts.heads);
+    return tail;
+}
+
+void list_free_nodes(struct list_node **head)
+{
+    assert(head != NULL);
+
+    while (*head != NULL) {
+        struct list_node *temp = (*head)->next;
+        free(*head);
+        *head = temp;
+    }
+    *head = NULL;
+}
+
+void list_free_all(struct list_node **head)
+{
+    assert(head != NULL);
+
+    while (*head != NULL) {
+        struct list_node *temp;
+        if ((*head)->data != NULL)
+            free((*head)->data);
+        temp = (*head)->next;
+        free(*head);
+        *head = temp;
+    }
+    *head = NULL;
+}
+
+void list_head_init(struct list_head *list)
+{
+    assert(list != NULL);
+
+    list->head = list->tail = NULL;
+    list->length = 0;
+}
+
+void list_head_from(struct list_head *list, struct list_node *head)
+{
+    assert(list != NULL);
+
+    list->head = list->tail = head;
+    list->length = 0;
+    if (head == NULL)
+        return;
+
+    list->length = 1;
+    while (list->tail->next != NULL) {
+        list->tail = list->tail->next;
+        list->length++;
+    }
+}
+
+bool list_head_push(struct list_head *list, void *data)
+{
+    assert(list != NULL);
+
+    if (!list_push(&list->head, data))
+        return false;
+    if (list->tail == NULL)
+        list->tail = list->head;
+    list->length++;
+    return true;
+}
+
+bool list_head_append(struct list_head *list, void *data)
+{
+    assert(list != NULL);
+
+    struct list_node *node = list_node();
+    if (node == NULL)
+        return false;
+    node->data = data;
+
+    if (list->tail == NULL)
+        list->head = node;
+    else
+        list->tail->next = node;
+    list->tail = node;
+    list->length++;
+    return true;
+}
+
+void *list_head_pop(struct list_head *list)
+{
+    assert(list != NULL);
+
+    if (list_empty(list->head))
+        return NULL;
+
+    if (list->head == list->tail)
+        list->tail = NULL;
+    list->length--;
+    return list_pop(&list->head);
+}
+
+struct list_node *list_head_remove(struct list_head *list)
+{
+    assert(list != NULL);
+
+    if (list_empty(list->head))
+        return NULL;
+
+    if (list->head == list->tail)
+        list->tail = NULL;
+    list->length--;
+    return list_remove(&list->head);
+}
+
+void list_head_insert(struct list_head *list, struct list_node *after, struct list_node *node)
+{
+    assert(list != NULL);
+
+    struct list_node *last = node;
+    size_t count = 1;
+
+    if (node == NULL)
+        return;
+    while (last->next != NULL) {
+        last = last->next;
+        count++;
+    }
+
+    if (after == NULL) {
+        last->next = list->head;
+        list->head = node;
+        if (list->tail == NULL)
+            list->tail = last;
+    } else {
+        last->next = after->next;
+        after->next = node;
+        if (after == list->tail)
+            list->tail = last;
+    }
+    list->length += count;
+}
+
+void list_head_concat(struct list_head *list, struct list_head *other)
+{
+    assert(list != NULL);
+    assert(other != NULL);
+
+    if (other->head == NULL)
+        return;
+
+    if (list->tail == NULL)
+        list->head = other->head;
+    else
+        list->tail->next = other->head;
+    list->tail = other->tail;
+    list->length += other->length;
+    list_head_init(other);
+}
+
+size_t list_head_filter(struct list_head *list, bool (*filter)(void *, void *), void *arguments)
+{
+    assert(list != NULL);
+
+    list->length = filter_nodes(&list->head, filter, arguments, &list->tail);
+    return list->length;
+}
+
+size_t list_head_filter_parallel(struct list_head *list, bool (*filter)(void *, void *),
+                                 void *arguments, unsigned threads)
+{
+    assert(list != NULL);
+
+    list->length = filter_parallel(&list->head, filter, arguments, threads, &list->tail);
+    return list->length;
+}
+
+void list_head_sort(struct list_head *list, list_compare_fn compare, void *arg)
+{
+    assert(list != NULL);
+
+    list->tail = list_sort(&list->head, compare, arg);
+}
+
+size_t list_head_to_array(const struct list_head *list, void ***output)
+{
+    assert(list != NULL);
+    assert(output != NULL);
+
+    const struct list_node *iter;
+    size_t count = 0;
+
+    *output = malloc((list->length + 1) * sizeof (void *));
+    if (*output == NULL)
+        return 0;
+    for (iter = list->head; iter != NULL; iter = iter->next)
+        if (iter->data != NULL)
+            (*output)[count++] = iter->data;
+    (*output)[count] = NULL;
+
+    return count;
+}
+
+void list_head_free_nodes(struct list_head *list)
+{
+    assert(list != NULL);
+
+    list_free_nodes(&list->head);
+    list_head_init(list);
+}
+
+void list_head_free_all(struct list_head *list)
+{
+    assert(list != NULL);
+
+    list_free_all(&list->head);
+    list_head_init(list);
+}
+
+struct list_pool *list_pool_new(size_t slab_nodes)
+{
+    struct list_pool *pool = calloc(1, sizeof (struct list_pool));
+    if (pool == NULL)
+        return NULL;
+
+    pthread_mutex_init(&pool->lock, NULL);
+    pool->slab_nodes = slab_nodes > 0 ? slab_nodes : LIST_POOL_SLAB;
+
+    pthread_mutex_lock(&pools_lock);
+    pool->id = ++pools_created;
+    pool->next = pools;
+    pools = pool;
+    pthread_mutex_unlock(&pools_lock);
+    return pool;
+}
+
+void list_pool_free(struct list_pool *pool)
+{
+    struct list_pool **iter;
+    size_t i;
+
+    if (pool == NULL)
+        return;
+
+    pthread_mutex_lock(&pools_lock);
+    for (iter = &pools; *iter != pool; iter = &(*iter)->next)
+        ;
+    *iter = pool->next;
+    pthread_mutex_unlock(&pools_lock);
+
+    /* The caches of other threads find out when they next look for the pool. */
+    for (i = 0; i < POOL_CACHES; i++) {
+        if (pool_caches[i].id == pool->id) {
+            pool_caches[i].id = 0;
+            pool_caches[i].first = pool_caches[i].last = NULL;
+            pool_caches[i].count = 0;
+        }
+    }
+
+    while (pool->slabs != NULL) {
+        struct pool_slab *next = pool->slabs->next;
+        free(pool->slabs);
+        pool->slabs = next;
+    }
+    pthread_mutex_destroy(&pool->lock);
+    free(pool);
+}
+
+struct list_node *list_pool_node(struct list_pool *pool)
+{
+    assert(pool != NULL);
+
+    struct pool_cache *cache = pool_cache(pool);
+    struct list_node *node;
+
+    if (cache->first == NULL && !pool_refill(pool, cache))
+        return NULL;
+
+    node = cache->first;
+    cache->first = node->next;
+    if (--cache->count == 0)
+        cache->last = NULL;
+    node->data = NULL;
+    node->next = NULL;
+    return node;
+}
+
+bool list_pool_push(struct list_pool *pool, struct list_node **head, void *data)
+{
+    assert(head != NULL);
+
+    struct list_node *node = list_pool_node(pool);
+    if (node == NULL)
+        return false;
+
+    node->data = data;
+    node->next = *head;
+    *head = node;
+    return true;
+}
+
+void *list_pool_pop(struct list_pool *pool, struct list_node **head)
+{
+    assert(head != NULL);
+
+    struct list_node *node = *head;
+    void *data;
+
+    if (list_empty(node))
+        return NULL;
+
+    data = node->data;
+    *head = node->next;
+    pool_give(pool, node, node, 1);
+    return data;
+}
+
+void list_pool_free_nodes(struct list_pool *pool, struct list_node **head)
+{
+    assert(head != NULL);
+
+    struct list_node *last = *head;
+    size_t count = 1;
+
+    if (last == NULL)
+        return;
+    while (last->next != NULL) {
+        last = last->next;
+        count++;
+    }
+    pool_give(pool, *head, last, count);
+    *head = NULL;
+}
+
+void list_pool_free_all(struct list_pool *pool, struct list_node **head)
+{
+    assert(head != NULL);
+
+    struct list_node *last = *head;
+    size_t count = 1;
+
+    if (last == NULL)
+        return;
+    for (;;) {
+        free(last->data);
+        if (last->next == NULL)
+            break;
+        last = last->next;
+        count++;
+    }
+    pool_give(pool, *head, last, count);
+    *head = NULL;
+}
+
+/*
+ * Remove the nodes that do not pass the filter as list_filter() does, and
+ * set tail to the last node kept.
+ */
+static size_t filter_nodes(struct list_node **head, bool (*filter)(void *, void *),
+                           void *arguments, struct list_node **tail)
 {
     assert(head != NULL);
     assert(filter != NULL);
@@ -175,32 +736,307 @@ size_t list_filter(struct list_node **head, bool (*filter)(void *, void *), void
         }
     }
 
+    *tail = current;
     return count;
 }
 
-void list_free_nodes(struct list_node **head)
+/*
+ * Filter the list as list_filter_parallel() does, and set tail to the last
+ * node kept.
+ */
+static size_t filter_parallel(struct list_node **head, bool (*filter)(void *, void *),
+                              void *arguments, unsigned threads, struct list_node **tail)
 {
     assert(head != NULL);
+    assert(filter != NULL);
 
-    while (*head != NULL) {
-        struct list_node *temp = (*head)->next;
-        free(*head);
-        *head = temp;
+    size_t length = list_length(*head);
+    if (threads == 0)
+        threads = cs_parallel_threads();
+    if (threads < 2 || length < LIST_FILTER_PARALLEL_MIN)
+        return filter_nodes(head, filter, arguments, tail);
+
+    struct filter_chunks chunks;
+    chunks.count = (size_t)threads * FILTER_CHUNKS;
+    if (chunks.count > length / FILTER_CHUNK_MIN)
+        chunks.count = length / FILTER_CHUNK_MIN;
+    chunks.filter = filter;
+    chunks.arguments = arguments;
+    chunks.heads = malloc(chunks.count * (2 * sizeof (struct list_node *) + sizeof (size_t)));
+    if (chunks.heads == NULL)
+        return filter_nodes(head, filter, arguments, tail);
+    chunks.tails = chunks.heads + chunks.count;
+    chunks.counts = (size_t *)(chunks.tails + chunks.count);
+
+    /* Cut the list into chunks of equal length, the first ones one node longer. */
+    struct list_node *node = *head;
+    size_t i, j;
+    for (i = 0; i < chunks.count; i++) {
+        size_t chunk_length = length / chunks.count + (i < length % chunks.count);
+        chunks.heads[i] = node;
+        for (j = 1; j < chunk_length; j++)
+            node = node->next;
+        chunks.tails[i] = node;
+        node = node->next;
+        chunks.tails[i]->next = NULL;
     }
-    *head = NULL;
+
+    cs_parallel_for(chunks.count, 1, threads, filter_chunks, &chunks);
+
+    /* Link the chunks that have nodes left, in order. */
+    struct list_node **link = head;
+    size_t count = 0;
+    *tail = NULL;
+    for (i = 0; i < chunks.count; i++) {
+        if (chunks.counts[i] == 0)
+            continue;
+        *link = chunks.heads[i];
+        link = &chunks.tails[i]->next;
+        *tail = chunks.tails[i];
+        count += chunks.counts[i];
+    }
+    *link = NULL;
+
+    free(chunks.heads);
+    return count;
 }
 
-void list_free_all(struct list_node **head)
+/*
+ * Filter the chunks from begin to end of list_filter_parallel().
+ */
+static void filter_chunks(size_t begin, size_t end, void *arg)
 {
-    assert(head != NULL);
+    struct filter_chunks *chunks = arg;
+    size_t i;
 
-    while (*head != NULL) {
-        struct list_node *temp;
-        if ((*head)->data != NULL)
-            free((*head)->data);
-        temp = (*head)->next;
-        free(*head);
-        *head = temp;
+    for (i = begin; i < end; i++)
+        chunks->counts[i] = filter_nodes(&chunks->heads[i], chunks->filter, chunks->arguments,
+                                         &chunks->tails[i]);
+}
+
+/*
+ * Detach the run of nodes in order at the front of rest and return it,
+ * advancing rest past it and setting tail to its last node. A run in
+ * strictly descending order is reversed, which keeps the sort stable.
+ */
+static struct list_node *take_run(struct list_node **rest, list_compare_fn compare, void *arg,
+                                  struct list_node **tail)
+{
+    struct list_node *first = *rest, *node = first, *next = first->next;
+
+    if (next != NULL && compare(next->data, first->data, arg) < 0) {
+        struct list_node *prev = NULL;
+        do {
+            next = node->next;
+            node->next = prev;
+            prev = node;
+            node = next;
+        } while (node != NULL && compare(node->data, prev->data, arg) < 0);
+        *rest = node;
+        *tail = first;
+        return prev;
     }
-    *head = NULL;
+
+    while (next != NULL && compare(next->data, node->data, arg) >= 0) {
+        node = next;
+        next = node->next;
+    }
+    node->next = NULL;
+    *rest = next;
+    *tail = node;
+    return first;
+}
+
+/*
+ * Merge the runs first and second into one and return it, setting tail to
+ * its last node. Of nodes that compare equal, those of first come first.
+ */
+static struct list_node *merge_runs(struct list_node *first, struct list_node *first_tail,
+                                    struct list_node *second, struct list_node *second_tail,
+                                    list_compare_fn compare, void *arg, struct list_node **tail)
+{
+    struct list_node *head, **link = &head;
+
+    /* Runs that are already in order only need to be linked. */
+    if (compare(second->data, first_tail->data, arg) >= 0) {
+        first_tail->next = second;
+        *tail = second_tail;
+        return first;
+    }
+
+    for (;;) {
+        if (compare(second->data, first->data, arg) < 0) {
+            *link = second;
+            link = &second->next;
+            second = second->next;
+            if (second == NULL) {
+                *link = first;
+                *tail = first_tail;
+                return head;
+            }
+        } else {
+            *link = first;
+            link = &first->next;
+            first = first->next;
+            if (first == NULL) {
+                *link = second;
+                *tail = second_tail;
+                return head;
+            }
+        }
+    }
+}
+
+/*
+ * Sort the parts from begin to end of list_sort_parallel().
+ */
+static void sort_parts(size_t begin, size_t end, void *arg)
+{
+    struct sort_parts *parts = arg;
+    size_t i;
+
+    for (i = begin; i < end; i++)
+        parts->tails[i] = list_sort(&parts->heads[i], parts->compare, parts->arg);
+}
+
+/*
+ * Merge the pairs from begin to end of the current round of
+ * list_sort_parallel(), leaving the result in the first part of each pair.
+ */
+static void merge_parts(size_t begin, size_t end, void *arg)
+{
+    struct sort_parts *parts = arg;
+    size_t i;
+
+    for (i = begin; i < end; i++) {
+        size_t a = 2 * i * parts->width, b = a + parts->width;
+        if (b < parts->count)
+            parts->heads[a] = merge_runs(parts->heads[a], parts->tails[a], parts->heads[b],
+                                         parts->tails[b], parts->compare, parts->arg,
+                                         &parts->tails[a]);
+    }
+}
+
+/*
+ * Returns the cache of this thread for pool, giving up the cache of
+ * another pool if need be.
+ */
+static struct pool_cache *pool_cache(struct list_pool *pool)
+{
+    struct pool_cache *cache;
+    size_t i;
+
+    for (i = 0; i < POOL_CACHES; i++)
+        if (pool_caches[i].id == pool->id)
+            return &pool_caches[i];
+
+    cache = &pool_caches[0];
+    for (i = 1; i < POOL_CACHES && cache->id != 0; i++)
+        if (pool_caches[i].id == 0 || pool_caches[i].count < cache->count)
+            cache = &pool_caches[i];
+
+    pool_flush(cache);
+    cache->id = pool->id;
+    return cache;
+}
+
+/*
+ * Give the nodes of a cache back to its pool, if the pool still exists, and
+ * empty it.
+ */
+static void pool_flush(struct pool_cache *cache)
+{
+    struct list_pool *pool;
+
+    if (cache->count > 0) {
+        pthread_mutex_lock(&pools_lock);
+        for (pool = pools; pool != NULL; pool = pool->next) {
+            if (pool->id == cache->id) {
+                pthread_mutex_lock(&pool->lock);
+                cache->last->next = pool->free;
+                pool->free = cache->first;
+                pthread_mutex_unlock(&pool->lock);
+                break;
+            }
+        }
+        pthread_mutex_unlock(&pools_lock);
+    }
+    cache->id = 0;
+    cache->first = cache->last = NULL;
+    cache->count = 0;
+}
+
+/*
+ * Move a batch of nodes from the pool into an empty cache, allocating a new
+ * slab if the pool has none left.
+ */
+static bool pool_refill(struct list_pool *pool, struct pool_cache *cache)
+{
+    struct list_node *last;
+    size_t count = 1, i;
+
+    pthread_mutex_lock(&pool->lock);
+    if (pool->free == NULL) {
+        struct pool_slab *slab = malloc(sizeof (struct pool_slab)
+                                        + pool->slab_nodes * sizeof (struct list_node));
+        if (slab == NULL) {
+            pthread_mutex_unlock(&pool->lock);
+            return false;
+        }
+        for (i = 0; i + 1 < pool->slab_nodes; i++)
+            slab->nodes[i].next = &slab->nodes[i+1];
+        slab->nodes[i].next = NULL;
+        slab->next = pool->slabs;
+        pool->slabs = slab;
+        pool->free = slab->nodes;
+    }
+
+    last = pool->free;
+    while (count < POOL_BATCH && last->next != NULL) {
+        last = last->next;
+        count++;
+    }
+    cache->first = pool->free;
+    cache->last = last;
+    cache->count = count;
+    pool->free = last->next;
+    last->next = NULL;
+    pthread_mutex_unlock(&pool->lock);
+    return true;
+}
+
+/*
+ * Give the nodes from first to last back to the cache of this thread, or
+ * make room for them by giving the cache back to the pool.
+ */
+static void pool_give(struct list_pool *pool, struct list_node *first, struct list_node *last,
+                      size_t count)
+{
+    assert(pool != NULL);
+
+    struct pool_cache *cache = pool_cache(pool);
+
+    if (cache->count + count > POOL_CACHE_MAX) {
+        struct list_node *spill_first = first, *spill_last = last;
+
+        /* Keep the nodes just given back, if they fit, and hand on the old. */
+        if (count <= POOL_CACHE_MAX && cache->count > 0) {
+            spill_first = cache->first;
+            spill_last = cache->last;
+            cache->first = first;
+            cache->last = last;
+            cache->count = count;
+        }
+        pthread_mutex_lock(&pool->lock);
+        spill_last->next = pool->free;
+        pool->free = spill_first;
+        pthread_mutex_unlock(&pool->lock);
+        return;
+    }
+
+    last->next = cache->first;
+    if (cache->first == NULL)
+        cache->last = last;
+    cache->first = first;
+    cache->count += count;
 }
@@ -67,7 +67,7 @@ extern "C" {
  * The node returned by this function constitutes a list of length 1.
  * For safety, \a data and \a next of the node are initialized to \c NULL.
  *
- * \return Pointer to an allocated list node.
+ * \return Pointer to an allocated list node, or \c NULL if out of memory.
  */
 extern struct list_node *list_node();
 
@@ -89,7 +89,8 @@ extern bool list_empty(const struct list_node *head);
  * \param head Pointer to the head of the list.
  * \return Length of the list, 0 if empty.
  *
- * \note Calling this function should be avoided, as it works in time O(n).
+ * \note Calling this function should be avoided, as it works in time O(n);
+ * keep the list in a struct list_head if you need its length.
  */
 extern size_t list_length(const struct list_node *head);
 
@@ -102,7 +103,8 @@ extern size_t list_length(const struct list_node *head);
  *               to a newly allocated array, which needs to be freed. The last
  *               entry in the array has the pointer entry \c NULL.
  * \return Number of elements (without the last \c NULL element) in the returned
- *         array.
+ *         array. If out of memory, \a output is set to \c NULL and 0 is
+ *         returned.
  *
  * \b Example:
  * \code
@@ -120,11 +122,12 @@ extern size_t list_to_array(const struct list_node *head, void ***output);
  *
  * \param head Pointer to pointer to the head of the list; will be modified.
  * \param data Data to push on top of the list, will replace previous head.
+ * \return false if out of memory, in which case the list is unchanged.
  *
  * \warning Beware of pushing non-dynamic allocated data onto the list,
  * as list_free_all() will try to free the data.
  */
-extern void list_push(struct list_node **head, void *data);
+extern bool list_push(struct list_node **head, void *data);
 
 /**
  * Pop data from head and remove top node.
@@ -224,6 +227,36 @@ extern size_t list_filter(struct list_node **head,
                           void *arguments
                           );
 
+/**
+ * Lists shorter than this are filtered by list_filter_parallel() in the
+ * calling thread only, since starting threads would take longer than
+ * calling the filter for every node.
+ */
+#define LIST_FILTER_PARALLEL_MIN 1024
+
+/**
+ * Remove all nodes for which \a filter does not return true, as
+ * list_filter() does, but with up to \a threads threads.
+ *
+ * The list is cut into many more chunks than there are threads, so that a
+ * thread that is done with its chunk takes the next one, and each chunk is
+ * filtered by one thread, which also frees the nodes it removes. The chunks
+ * are then linked together in their original order, so the result is the
+ * same as that of list_filter(), except that \a filter is called from
+ * several threads and must be thread-safe.
+ *
+ * This pays off for filters that take much longer than going to the next
+ * node, such as those matching regular expressions or calling stat(), and
+ * for lists of at least #LIST_FILTER_PARALLEL_MIN nodes; for shorter lists,
+ * list_filter() is called instead.
+ *
+ * \param threads Maximum number of threads, 0 for cs_parallel_threads().
+ * \return The number of nodes left.
+ */
+extern size_t list_filter_parallel(struct list_node **head,
+                                   bool (*filter)(void *, void *),
+                                   void *arguments, unsigned threads);
+
 /**
  * Free all the nodes (not the data) in the list.
  * We assume that all the nodes have been allocated using malloc().
@@ -242,6 +275,248 @@ extern void list_free_nodes(struct list_node **head);
  */
 extern void list_free_all(struct list_node **head);
 
+/**
+ * A function comparing the data of two nodes, returning less than, equal
+ * to, or greater than zero as with qsort(), and getting \a arg passed to
+ * list_sort() as its third argument.
+ */
+typedef int (*list_compare_fn)(const void *a, const void *b, void *arg);
+
+/**
+ * Sort the list in place by relinking its nodes, so that no data is moved
+ * and nothing is allocated.
+ *
+ * This is a bottom-up merge sort without recursion: the list is cut into
+ * runs of nodes that are already in order, and runs of equal size are
+ * merged as soon as there are two of them, while they are still in the
+ * cache. Runs in strictly descending order are reversed first. A sorted
+ * list is thus recognized with n - 1 comparisons, and a list made of k runs
+ * takes about n log2(k) of them. Only a fixed number of pointers is used
+ * besides the nodes. The sort is stable, so nodes comparing equal keep
+ * their order.
+ *
+ * \b Example:
+ * \code
+ *     int compare_str(const void *a, const void *b, void *arg)
+ *     {
+ *         return strcmp(a, b);
+ *     }
+ *
+ *     list_sort(&head, compare_str, NULL);
+ * \endcode
+ *
+ * \param head    Pointer to the head of the list; set to the new head.
+ * \param compare Comparison of the data of two nodes.
+ * \param arg     Passed to \a compare unchanged.
+ * \return The last node of the sorted list, or \c NULL if it is empty.
+ */
+extern struct list_node *list_sort(struct list_node **head,
+                                   list_compare_fn compare, void *arg);
+
+/**
+ * Lists shorter than this are sorted by list_sort_parallel() in the calling
+ * thread only, since starting threads would take longer.
+ */
+#define LIST_SORT_PARALLEL_MIN 65536
+
+/**
+ * Sort the list as list_sort() does, but with up to \a threads threads:
+ * the list is cut into one part per thread, the parts are sorted at the
+ * same time, and then merged pairwise, also in parallel, until one is left.
+ * The result is the same as that of list_sort(), so \a compare must be
+ * thread-safe.
+ *
+ * \param threads Maximum number of threads, 0 for cs_parallel_threads().
+ * \return The last node of the sorted list, or \c NULL if it is empty.
+ */
+extern struct list_node *list_sort_parallel(struct list_node **head,
+                                            list_compare_fn compare, void *arg,
+                                            unsigned threads);
+
+/**
+ * A list together with its last node and its length, so that both are
+ * known in constant time, and nodes can be appended and lists concatenated
+ * in constant time.
+ *
+ * The list_head_ functions are the variants of the list_ functions that
+ * keep \a tail and \a length up to date. Functions that only read a list,
+ * such as list_search() or list_strjoin(), are simply passed \a head.
+ *
+ * \b Example:
+ * \code
+ *     struct list_head list;
+ *     list_head_init(&list);
+ *     list_head_append(&list, cs_strclone("first"));
+ *     list_head_append(&list, cs_strclone("second"));
+ *     list_println((NodeStr *)list.head, "- ");
+ *     list_head_free_all(&list);
+ * \endcode
+ *
+ * \param head   First node of the list, \c NULL if it is empty.
+ * \param tail   Last node of the list, \c NULL if it is empty.
+ * \param length Number of nodes in the list.
+ */
+struct list_head {
+    struct list_node *head;
+    struct list_node *tail;
+    size_t length;
+};
+
+/**
+ * Initialize an empty list.
+ */
+extern void list_head_init(struct list_head *list);
+
+/**
+ * Make \a list hold the nodes of the list \a head, going through it once to
+ * find its end.
+ */
+extern void list_head_from(struct list_head *list, struct list_node *head);
+
+/** Same as list_push(), keeping \a list in sync. */
+extern bool list_head_push(struct list_head *list, void *data);
+
+/**
+ * Append data to the end of the list in a new node from list_node(), in
+ * constant time.
+ *
+ * \return false if out of memory, in which case the list is unchanged.
+ */
+extern bool list_head_append(struct list_head *list, void *data);
+
+/** Same as list_pop(), keeping \a list in sync. */
+extern void *list_head_pop(struct list_head *list);
+
+/** Same as list_remove(), keeping \a list in sync. */
+extern struct list_node *list_head_remove(struct list_head *list);
+
+/**
+ * Insert a list or a single node after the node \a after of \a list, or in
+ * front of the list if \a after is \c NULL, as list_insert() does. The
+ * inserted nodes are counted, which takes time in proportion to their
+ * number.
+ */
+extern void list_head_insert(struct list_head *list,
+                             struct list_node *after,
+                             struct list_node *node);
+
+/**
+ * Move all nodes of \a other to the end of \a list in constant time,
+ * leaving \a other empty.
+ */
+extern void list_head_concat(struct list_head *list, struct list_head *other);
+
+/** Same as list_filter(), keeping \a list in sync. */
+extern size_t list_head_filter(struct list_head *list,
+                               bool (*filter)(void *, void *),
+                               void *arguments);
+
+/**
+ * Same as list_to_array(), but the array is allocated at once, since the
+ * length is known.
+ */
+extern size_t list_head_to_array(const struct list_head *list, void ***output);
+
+/** Same as list_filter_parallel(), keeping \a list in sync. */
+extern size_t list_head_filter_parallel(struct list_head *list,
+                                        bool (*filter)(void *, void *),
+                                        void *arguments, unsigned threads);
+
+/** Same as list_sort(), keeping \a list in sync. */
+extern void list_head_sort(struct list_head *list, list_compare_fn compare,
+                           void *arg);
+
+/** Same as list_free_nodes(), leaving \a list empty. */
+extern void list_head_free_nodes(struct list_head *list);
+
+/** Same as list_free_all(), leaving \a list empty. */
+extern void list_head_free_all(struct list_head *list);
+
+/**
+ * \struct list_pool
+ *
+ * A pool of list nodes, as an alternative to allocating every node with
+ * malloc() for lists that grow and shrink all the time, such as queues.
+ *
+ * Nodes are cut out of slabs of many nodes at a time. Every thread keeps a
+ * cache of free nodes for each pool it uses, so that getting and returning
+ * a node needs neither a lock nor an atomic instruction; only when a cache
+ * runs empty or overflows does it exchange a batch of nodes with the pool
+ * under a lock. A whole list is given back at once by list_pool_free_nodes().
+ *
+ * Nodes of a pool must only be given back to the same pool, never to
+ * free() or list_free_nodes(), but any thread may give them back. All nodes
+ * are freed together with the pool; the few nodes left in the cache of a
+ * thread that has exited are only reused then.
+ *
+ * \b Example:
+ * \code
+ *     struct list_pool *pool = list_pool_new(0);
+ *     NodeStr *queue = NULL;
+ *     list_pool_push(pool, (struct list_node **)&queue, job);
+ *     ...
+ *     job = list_pool_pop(pool, (struct list_node **)&queue);
+ *     list_pool_free(pool);
+ * \endcode
+ */
+struct list_pool;
+
+/** Number of nodes in a slab of a pool created with list_pool_new(0). */
+#define LIST_POOL_SLAB 4096
+
+/**
+ * Create a new, empty pool of list nodes.
+ *
+ * \param slab_nodes Number of nodes allocated at a time, 0 for
+ *                   LIST_POOL_SLAB.
+ * \return Newly allocated pool, to be freed with list_pool_free(), or
+ *         \c NULL if out of memory.
+ */
+extern struct list_pool *list_pool_new(size_t slab_nodes);
+
+/**
+ * Free a pool and all of its nodes, including those still in lists; the
+ * data of the nodes is not freed.
+ */
+extern void list_pool_free(struct list_pool *pool);
+
+/**
+ * Take a node from the pool, as list_node() does from malloc().
+ *
+ * \return Node with \a data and \a next set to \c NULL, or \c NULL if out
+ *         of memory.
+ */
+extern struct list_node *list_pool_node(struct list_pool *pool);
+
+/**
+ * Push data on top of the list as list_push() does, with a node from the
+ * pool.
+ *
+ * \return false if out of memory, in which case the list is unchanged.
+ */
+extern bool list_pool_push(struct list_pool *pool, struct list_node **head, void *data);
+
+/**
+ * Pop data from the head of the list as list_pop() does, and give the node
+ * back to the pool.
+ */
+extern void *list_pool_pop(struct list_pool *pool, struct list_node **head);
+
+/**
+ * Give all nodes (not the data) of the list back to the pool at once.
+ *
+ * \param head Pointer to pointer to the head of the list; becomes \c NULL.
+ */
+extern void list_pool_free_nodes(struct list_pool *pool, struct list_node **head);
+
+/**
+ * Free the data of all nodes with free(), and give the nodes back to the
+ * pool.
+ *
+ * \param head Pointer to pointer to the head of the list; becomes \c NULL.
+ */
+extern void list_pool_free_all(struct list_pool *pool, struct list_node **head);
+
 
 #ifdef __cplusplus
 }
@@ -18,8 +18,11 @@
  */
 
 #include "list_str.h"
+#include "globset.h"
 #include "list.h"
+#include "regex_cache.h"
 #include "string.h"
+#include "strset.h"
 
 #include <assert.h>
 #include <dirent.h>
@@ -31,6 +34,8 @@
 #include <sys/stat.h>
 
 
+static int compare_str(const void *a, const void *b, void *arg);
+
 void list_print(const NodeStr *head, const char *sep)
 {
     const NodeStr *iter;
@@ -70,34 +75,70 @@ const NodeStr *list_search(const NodeStr *haystack, const char *needle)
 char *list_strjoin(const NodeStr *head, const char *delim)
 {
     char *str, *t;
-    const char *s;
-    size_t len = 1;
-    size_t m, n;
+    size_t len = 1, n = 0, m;
     const NodeStr *node;
 
-    n = list_length(head);
+    /* Count the strings and add up their lengths at the same time. */
+    for (node = head; node != NULL; node = node->next, n++)
+        len += strlen(node->data);
     if (n == 0)
         return NULL;
 
     m = strlen(delim);
     len += (n-1) * m;
-    for (node = head; node != NULL; node = node->next)
-        len += strlen(node->data);
 
     t = str = malloc(len * sizeof (char));
-    for (node = head; node != NULL; node = node->next, n--) {
-        s = node->data;
-        while ((*t = *s) != '\0')
-            t++, s++;
-        if (n > 1) {
-            s = delim;
-            while ((*t = *s) != '\0')
-                t++, s++;
+    for (node = head; node != NULL; node = node->next) {
+        size_t k = strlen(node->data);
+        memcpy(t, node->data, k);
+        t += k;
+        if (node->next != NULL) {
+            memcpy(t, delim, m);
+            t += m;
         }
     }
+    *t = '\0';
     return str;
 }
 
+void list_strsort(NodeStr **head)
+{
+    assert(head != NULL);
+
+    list_sort(head, compare_str, NULL);
+}
+
+int list_dedup(NodeStr **head)
+{
+    assert(head != NULL);
+
+    /* Only the strings of nodes that are kept go into the set, so it need not copy them. */
+    struct cs_strset *seen = cs_strset_new(0, NULL);
+    if (seen == NULL)
+        return -1;
+
+    NodeStr **link = head, *node;
+    int count = 0;
+    while ((node = *link) != NULL) {
+        int retval = cs_strset_add(seen, node->data, strlen(node->data), NULL);
+        if (retval < 0) {
+            count = -1;
+            break;
+        }
+        if (retval == 0) {
+            *link = node->next;
+            free(node->data);
+            free(node);
+        } else {
+            link = &node->next;
+            count++;
+        }
+    }
+
+    cs_strset_free(seen);
+    return count;
+}
+
 bool filter_regex(void *string, void *arguments)
 {
     assert(string != NULL);
@@ -113,20 +154,62 @@ int list_filter_regex(NodeStr **head, const char *regex)
     assert(head != NULL);
     assert(regex != NULL);
 
-    int retval;
-    struct filter_regex_args args;
-    int errcode = regcomp(&args.preg, regex, REG_EXTENDED);
-    if (errcode != 0) {
-        char errbuf[BUFSIZ];
-        regerror(errcode, &args.preg, errbuf, sizeof errbuf);
-        fprintf(stderr, "Error (regcomp): %s\n", errbuf);
-        retval = -1;
-        goto finally;
-    }
+    const struct cs_regex *compiled = cs_regex_get(regex, REG_EXTENDED | REG_NOSUB);
+    if (compiled == NULL)
+        return -1;
+
+    int retval = list_filter(head, filter_regex_cached, (void *)compiled);
+    cs_regex_release(compiled);
+    return retval;
+}
 
-    retval = list_filter(head, filter_regex, (void *)&args);
+int list_filter_glob(NodeStr **head, const char *pattern)
+{
+    assert(head != NULL);
+    assert(pattern != NULL);
+
+    struct cs_glob *glob = cs_glob_new(pattern);
+    if (glob == NULL)
+        return -1;
 
-finally:
-    regfree(&args.preg);
+    int retval = list_filter(head, filter_glob, glob);
+    cs_glob_free(glob);
     return retval;
 }
+
+int list_head_filter_regex(struct list_head *list, const char *regex)
+{
+    assert(list != NULL);
+    assert(regex != NULL);
+
+    const struct cs_regex *compiled = cs_regex_get(regex, REG_EXTENDED | REG_NOSUB);
+    if (compiled == NULL)
+        return -1;
+
+    int retval = list_head_filter(list, filter_regex_cached, (void *)compiled);
+    cs_regex_release(compiled);
+    return retval;
+}
+
+int list_head_filter_glob(struct list_head *list, const char *pattern)
+{
+    assert(list != NULL);
+    assert(pattern != NULL);
+
+    struct cs_glob *glob = cs_glob_new(pattern);
+    if (glob == NULL)
+        return -1;
+
+    int retval = list_head_filter(list, filter_glob, glob);
+    cs_glob_free(glob);
+    return retval;
+}
+
+/*
+ * Compare the strings a and b for list_sort().
+ */
+static int compare_str(const void *a, const void *b, void *arg)
+{
+    (void)arg;
+    return strcmp(a, b);
+}
@@ -87,6 +87,13 @@ extern const NodeStr *list_search(const NodeStr *haystack, const char *needle);
  */
 extern char *list_strjoin(const NodeStr *head, const char *sep);
 
+/**
+ * Sort a list of strings in place with strcmp(), as list_sort() does.
+ *
+ * \param head Pointer to the head of a linked list; set to the new head.
+ */
+extern void list_strsort(NodeStr **head);
+
 /**
  * Arguments for the filter_regex function, which need to be passed
  * along with list_filter.
@@ -129,6 +136,40 @@ extern bool filter_regex(void *string, void *arguments);
  */
 extern int list_filter_regex(NodeStr **head, const char *regex);
 
+/**
+ * Filter nodes in head with a shell glob, as described in globset.h; only nodes
+ * matching \a pattern remain in the list.
+ *
+ * \param head    Head of a linked list.
+ * \param pattern Glob pattern which nodes must match to remain in the list.
+ * \return count of nodes that match \a pattern, -1 if out of memory.
+ *
+ * \b WARNING: nodes that do NOT match are completely freed: node and data.
+ */
+extern int list_filter_glob(NodeStr **head, const char *pattern);
+
+/**
+ * Remove all nodes whose string is equal to that of an earlier node, so
+ * that every string is left once, in the place it first appeared. The
+ * strings seen are kept in a struct cs_strset, so this takes time in
+ * proportion to the length of the list.
+ *
+ * \param head Head of a linked list.
+ * \return count of nodes left, -1 if out of memory, in which case only
+ *         some of the duplicates are removed.
+ *
+ * \b WARNING: nodes that are removed are completely freed: node and data.
+ */
+extern int list_dedup(NodeStr **head);
+
+struct list_head;
+
+/** Same as list_filter_regex(), keeping \a list in sync; see list.h. */
+extern int list_head_filter_regex(struct list_head *list, const char *regex);
+
+/** Same as list_filter_glob(), keeping \a list in sync; see list.h. */
+extern int list_head_filter_glob(struct list_head *list, const char *pattern);
+
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,294 @@
+/*
+ * libcassava/lockfree.c
+ * vim: set cin ts=4 sw=4 et cc=100:
+ *
+ * Copyright (c) 2012 Ben Morgan <neembi@googlemail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#define _GNU_SOURCE
+
+#include "lockfree.h"
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+/* See list.c: the layout of struct list_node that all of libcassava assumes. */
+struct list_node {
+    void *data;
+    struct list_node *next;
+};
+
+/* Stacks and queues start on a cache line, so they do not share one with other data. */
+#define CACHE_LINE 64
+
+#ifdef __GCC_HAVE_SYNC_COMPARE_AND_SWAP_16
+__extension__ typedef unsigned __int128 stack_pair;
+#endif
+
+/*
+ * The top of a stack and the number of operations on it, which are only
+ * ever changed together.
+ */
+union stack_top {
+    struct {
+        struct list_node *node;
+        uintptr_t tag;
+    } s;
+#ifdef __GCC_HAVE_SYNC_COMPARE_AND_SWAP_16
+    stack_pair pair;
+#endif
+};
+
+struct lfstack {
+    union stack_top top;
+#ifndef __GCC_HAVE_SYNC_COMPARE_AND_SWAP_16
+    char lock;
+#endif
+};
+
+/*
+ * The consumer only touches tail, and producers head, so they are kept on
+ * separate cache lines. The stub is in the queue whenever it would be empty
+ * otherwise, so that head never becomes NULL.
+ */
+struct mpscq {
+    struct list_node *head;
+    char pad[CACHE_LINE - sizeof (struct list_node *)];
+    struct list_node *tail;
+    struct list_node stub;
+};
+
+static void *alloc_aligned(size_t size);
+static struct list_node *stack_swap(struct lfstack *stack, struct list_node *first,
+                                    struct list_node *last, bool pop_all);
+
+struct lfstack *lfstack_new(void)
+{
+    struct lfstack *stack = alloc_aligned(sizeof (struct lfstack));
+    if (stack == NULL)
+        return NULL;
+
+    stack->top.s.node = NULL;
+    stack->top.s.tag = 0;
+#ifndef __GCC_HAVE_SYNC_COMPARE_AND_SWAP_16
+    stack->lock = 0;
+#endif
+    return stack;
+}
+
+void lfstack_free(struct lfstack *stack)
+{
+    free(stack);
+}
+
+bool lfstack_empty(struct lfstack *stack)
+{
+    assert(stack != NULL);
+
+    return __atomic_load_n(&stack->top.s.node, __ATOMIC_ACQUIRE) == NULL;
+}
+
+void lfstack_push(struct lfstack *stack, struct list_node *node)
+{
+    lfstack_push_list(stack, node, node);
+}
+
+void lfstack_push_list(struct lfstack *stack, struct list_node *first, struct list_node *last)
+{
+    assert(stack != NULL);
+    assert(first != NULL);
+    assert(last != NULL);
+
+    stack_swap(stack, first, last, false);
+}
+
+struct list_node *lfstack_pop(struct lfstack *stack)
+{
+    assert(stack != NULL);
+
+    return stack_swap(stack, NULL, NULL, false);
+}
+
+struct list_node *lfstack_pop_all(struct lfstack *stack)
+{
+    assert(stack != NULL);
+
+    return stack_swap(stack, NULL, NULL, true);
+}
+
+struct mpscq *mpscq_new(void)
+{
+    struct mpscq *queue = alloc_aligned(sizeof (struct mpscq));
+    if (queue == NULL)
+        return NULL;
+
+    queue->stub.data = NULL;
+    queue->stub.next = NULL;
+    queue->head = queue->tail = &queue->stub;
+    return queue;
+}
+
+void mpscq_free(struct mpscq *queue)
+{
+    free(queue);
+}
+
+void mpscq_push(struct mpscq *queue, struct list_node *node)
+{
+    mpscq_push_list(queue, node, node);
+}
+
+void mpscq_push_list(struct mpscq *queue, struct list_node *first, struct list_node *last)
+{
+    assert(queue != NULL);
+    assert(first != NULL);
+    assert(last != NULL);
+
+    /*
+     * Once head is swapped, the list is in the queue, but only linked to the
+     * previous head afterwards; until then, the consumer stops in front of it.
+     */
+    __atomic_store_n(&last->next, NULL, __ATOMIC_RELAXED);
+    struct list_node *prev = __atomic_exchange_n(&queue->head, last, __ATOMIC_ACQ_REL);
+    __atomic_store_n(&prev->next, first, __ATOMIC_RELEASE);
+}
+
+struct list_node *mpscq_pop(struct mpscq *queue)
+{
+    assert(queue != NULL);
+
+    struct list_node *tail = queue->tail;
+    struct list_node *next = __atomic_load_n(&tail->next, __ATOMIC_ACQUIRE);
+
+    if (tail == &queue->stub) {
+        if (next == NULL)
+            return NULL;
+        queue->tail = tail = next;
+        next = __atomic_load_n(&tail->next, __ATOMIC_ACQUIRE);
+    }
+
+    if (next == NULL) {
+        /* The last node can only be taken once the stub is behind it. */
+        if (tail != __atomic_load_n(&queue->head, __ATOMIC_ACQUIRE))
+            return NULL;
+        mpscq_push(queue, &queue->stub);
+        next = __atomic_load_n(&tail->next, __ATOMIC_ACQUIRE);
+        if (next == NULL)
+            return NULL;
+    }
+
+    queue->tail = next;
+    tail->next = NULL;
+    return tail;
+}
+
+struct list_node *mpscq_pop_all(struct mpscq *queue, struct list_node **tail)
+{
+    assert(queue != NULL);
+
+    struct list_node *head = NULL, **link = &head, *node, *last = NULL;
+
+    while ((node = mpscq_pop(queue)) != NULL) {
+        *link = last = node;
+        link = &node->next;
+    }
+    if (tail != NULL)
+        *tail = last;
+    return head;
+}
+
+/*
+ * Returns size bytes of memory starting on a cache line, or NULL if out of
+ * memory.
+ */
+static void *alloc_aligned(size_t size)
+{
+    void *memory;
+
+    if (posix_memalign(&memory, CACHE_LINE, size) != 0)
+        return NULL;
+    return memory;
+}
+
+#ifdef __GCC_HAVE_SYNC_COMPARE_AND_SWAP_16
+
+/*
+ * Push the nodes from first to last if first is not NULL, otherwise pop
+ * the node on top, or all nodes if pop_all is true, and return what was
+ * popped.
+ *
+ * Reading the tag before the node gives a pair that may never have been on
+ * the stack, but then the compare-and-swap fails and it is read again.
+ */
+static struct list_node *stack_swap(struct lfstack *stack, struct list_node *first,
+                                    struct list_node *last, bool pop_all)
+{
+    union stack_top old, new;
+
+    do {
+        old.s.tag = __atomic_load_n(&stack->top.s.tag, __ATOMIC_ACQUIRE);
+        old.s.node = __atomic_load_n(&stack->top.s.node, __ATOMIC_ACQUIRE);
+        new.s.tag = old.s.tag + 1;
+        if (first != NULL) {
+            __atomic_store_n(&last->next, old.s.node, __ATOMIC_RELAXED);
+            new.s.node = first;
+        } else if (old.s.node == NULL) {
+            return NULL;
+        } else if (pop_all) {
+            new.s.node = NULL;
+        } else {
+            new.s.node = __atomic_load_n(&old.s.node->next, __ATOMIC_RELAXED);
+        }
+    } while (!__sync_bool_compare_and_swap(&stack->top.pair, old.pair, new.pair));
+
+    if (first != NULL)
+        return NULL;
+    if (!pop_all)
+        __atomic_store_n(&old.s.node->next, NULL, __ATOMIC_RELAXED);
+    return old.s.node;
+}
+
+#else
+
+/*
+ * Same as above, but under a spin lock, for lack of a compare-and-swap that
+ * is wide enough for both the node and the tag.
+ */
+static struct list_node *stack_swap(struct lfstack *stack, struct list_node *first,
+                                    struct list_node *last, bool pop_all)
+{
+    struct list_node *node;
+
+    while (__atomic_test_and_set(&stack->lock, __ATOMIC_ACQUIRE))
+        while (__atomic_load_n(&stack->lock, __ATOMIC_RELAXED))
+            ;
+
+    node = stack->top.s.node;
+    if (first != NULL) {
+        last->next = node;
+        __atomic_store_n(&stack->top.s.node, first, __ATOMIC_RELAXED);
+        node = NULL;
+    } else if (node != NULL) {
+        __atomic_store_n(&stack->top.s.node, pop_all ? NULL : node->next, __ATOMIC_RELAXED);
+        if (!pop_all)
+            node->next = NULL;
+    }
+
+    __atomic_clear(&stack->lock, __ATOMIC_RELEASE);
+    return node;
+}
+
+#endif
@@ -0,0 +1,186 @@
+/*
+ * libcassava/lockfree.h
+ * vim: set cin ts=4 sw=4 et cc=80:
+ *
+ * Copyright (c) 2012 Ben Morgan <neembi@googlemail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION
+ * OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/**
+ * \file
+ * A stack and a queue of list nodes that many threads can use at once
+ * without a mutex.
+ *
+ * Both link the nodes given to them by their \a next member, so nothing is
+ * allocated when a node is added, and the nodes can come from list_node()
+ * or a struct list_pool. The data of the nodes is left alone. As in list.h,
+ * struct list_node is assumed to start with the data pointer, followed by
+ * the pointer to the next node.
+ *
+ * The stack (lfstack_) may be pushed to and popped from by any number of
+ * threads. It is a Treiber stack: the top is replaced with a single
+ * compare-and-swap, together with a counter that changes on every
+ * operation, so that a pop cannot be fooled by a node that was popped and
+ * pushed again in the meantime (the ABA problem). This needs a 16 byte
+ * compare-and-swap, which GCC provides on x86-64 if the processor has it,
+ * as with -march=native or -mcx16. Otherwise the stack falls back to a spin
+ * lock, which is correct, but does not scale.
+ *
+ * The queue (mpscq_) may be pushed to by any number of threads, but popped
+ * from by only one at a time. It is the intrusive queue of Dmitry Vyukov:
+ * a push is a single atomic exchange, however many threads push, and a pop
+ * touches no memory that producers write to, unless the queue is almost
+ * empty. Nodes come out in the order they went in.
+ *
+ * <b>Example Usage:</b>
+ * \code
+ *     struct lfstack *work = lfstack_new();
+ *     lfstack_push(work, list_node());
+ *     // In any number of threads:
+ *     struct list_node *node;
+ *     while ((node = lfstack_pop(work)) != NULL)
+ *         process(node);
+ * \endcode
+ *
+ * \author Ben Morgan
+ * \date 17. October 2026
+ */
+
+#ifndef LIBCASSAVA_LOCKFREE_H
+#define LIBCASSAVA_LOCKFREE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+#include <stdbool.h>
+#include <stdlib.h>
+
+#include "list.h"
+
+/**
+ * \struct lfstack
+ *
+ * A stack of list nodes that any number of threads may use at once.
+ */
+struct lfstack;
+
+/**
+ * Returns a new empty stack, or \c NULL if out of memory.
+ */
+extern struct lfstack *lfstack_new(void);
+
+/**
+ * Free a stack, but not the nodes still on it.
+ */
+extern void lfstack_free(struct lfstack *stack);
+
+/**
+ * Returns true if the stack was empty at the time of the call.
+ */
+extern bool lfstack_empty(struct lfstack *stack);
+
+/**
+ * Push a node on the stack.
+ */
+extern void lfstack_push(struct lfstack *stack, struct list_node *node);
+
+/**
+ * Push a whole list of nodes, from \a first to \a last, on the stack at
+ * once, so that \a first is on top. The nodes must already be linked.
+ */
+extern void lfstack_push_list(struct lfstack *stack, struct list_node *first,
+                              struct list_node *last);
+
+/**
+ * Pop the node on top of the stack.
+ *
+ * \warning Another thread popping at the same time may still read the
+ * \a next member of the node returned, so its memory must stay readable
+ * while others pop; nodes of a struct list_pool, or nodes that are only
+ * freed once all threads are done with the stack, are fine.
+ *
+ * \return The node, with \a next set to \c NULL, or \c NULL if the stack
+ *         is empty.
+ */
+extern struct list_node *lfstack_pop(struct lfstack *stack);
+
+/**
+ * Take all nodes off the stack at once, which is then empty.
+ *
+ * \return The nodes as a list, from the top of the stack down.
+ */
+extern struct list_node *lfstack_pop_all(struct lfstack *stack);
+
+/**
+ * \struct mpscq
+ *
+ * A queue of list nodes that any number of threads may push to, and one
+ * thread may pop from.
+ */
+struct mpscq;
+
+/**
+ * Returns a new empty queue, or \c NULL if out of memory.
+ */
+extern struct mpscq *mpscq_new(void);
+
+/**
+ * Free a queue, but not the nodes still in it.
+ */
+extern void mpscq_free(struct mpscq *queue);
+
+/**
+ * Append a node to the queue. May be called from any thread.
+ */
+extern void mpscq_push(struct mpscq *queue, struct list_node *node);
+
+/**
+ * Append a whole list of nodes, from \a first to \a last, to the queue at
+ * once, with a single atomic exchange. The nodes must already be linked.
+ * May be called from any thread.
+ */
+extern void mpscq_push_list(struct mpscq *queue, struct list_node *first,
+                            struct list_node *last);
+
+/**
+ * Remove the first node of the queue. Only one thread may pop at a time.
+ *
+ * A producer may be caught between the two steps of its push, in which
+ * case the nodes it pushed, and those pushed after them, only become
+ * visible once it is done; until then the queue looks empty.
+ *
+ * \return The node, with \a next set to \c NULL, or \c NULL if the queue
+ *         is empty.
+ */
+extern struct list_node *mpscq_pop(struct mpscq *queue);
+
+/**
+ * Remove all nodes from the queue that mpscq_pop() would return. Only one
+ * thread may pop at a time.
+ *
+ * \param tail Set to the last node removed, or \c NULL if there is none;
+ *             may be \c NULL.
+ * \return The nodes removed as a list, in the order they were pushed.
+ */
+extern struct list_node *mpscq_pop_all(struct mpscq *queue,
+                                       struct list_node **tail);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* LIBCASSAVA_LOCKFREE_H */
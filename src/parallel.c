@@ -0,0 +1,92 @@
+/*
+ * libcassava/parallel.c
+ * vim: set cin ts=4 sw=4 et cc=100:
+ *
+ * Copyright (c) 2012 Ben Morgan <neembi@googlemail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#define _GNU_SOURCE
+
+#include "parallel.h"
+
+#include <assert.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+struct parallel_loop {
+    size_t count;
+    size_t grain;
+    size_t next;
+    void (*body)(size_t, size_t, void *);
+    void *arg;
+};
+
+static void *parallel_worker(void *arg);
+
+unsigned cs_parallel_threads(void)
+{
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n > 0 ? (unsigned)n : 1;
+}
+
+void cs_parallel_for(size_t count, size_t grain, unsigned threads,
+                     void (*body)(size_t begin, size_t end, void *arg), void *arg)
+{
+    assert(body != NULL);
+
+    struct parallel_loop loop = { count, grain ? grain : 1, 0, body, arg };
+    size_t ranges = (count + loop.grain - 1) / loop.grain;
+    pthread_t *tids;
+    unsigned i, started = 0;
+
+    if (threads == 0)
+        threads = cs_parallel_threads();
+    if (threads > ranges)
+        threads = ranges;
+    if (threads <= 1) {
+        if (count > 0)
+            body(0, count, arg);
+        return;
+    }
+
+    tids = malloc((threads - 1) * sizeof (pthread_t));
+    if (tids == NULL) {
+        /* Without memory for the threads, the caller does all the work. */
+        body(0, count, arg);
+        return;
+    }
+    for (i = 0; i < threads - 1; i++) {
+        if (pthread_create(&tids[started], NULL, parallel_worker, &loop) != 0)
+            break;
+        started++;
+    }
+    parallel_worker(&loop);
+    for (i = 0; i < started; i++)
+        pthread_join(tids[i], NULL);
+    free(tids);
+}
+
+static void *parallel_worker(void *arg)
+{
+    struct parallel_loop *loop = arg;
+    size_t begin;
+
+    while ((begin = __atomic_fetch_add(&loop->next, loop->grain, __ATOMIC_RELAXED)) < loop->count) {
+        size_t end = begin + loop->grain;
+        loop->body(begin, end < loop->count ? end : loop->count, loop->arg);
+    }
+    return NULL;
+}
@@ -0,0 +1,69 @@
+/*
+ * libcassava/parallel.h
+ * vim: set cin ts=4 sw=4 et cc=80:
+ *
+ * Copyright (c) 2012 Ben Morgan <neembi@googlemail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION
+ * OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/**
+ * \file
+ * Spreading a loop over several threads.
+ *
+ * \author Ben Morgan
+ * \date 17. October 2026
+ */
+
+#ifndef LIBCASSAVA_PARALLEL_H
+#define LIBCASSAVA_PARALLEL_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+#include <stdlib.h>
+
+/**
+ * Returns the number of online CPUs, at least 1.
+ */
+extern unsigned cs_parallel_threads(void);
+
+/**
+ * Call \a body for consecutive ranges [begin, end) which together cover
+ * [0, \a count), from up to \a threads threads including the calling one.
+ *
+ * Ranges of \a grain indices are handed out one at a time to whichever thread
+ * is free, so uneven work is balanced. The function returns when all ranges
+ * have been processed. If there is only enough work for one range, or only one
+ * thread, \a body is called directly.
+ *
+ * \param count   Number of indices.
+ * \param grain   Number of indices per range, at least 1.
+ * \param threads Maximum number of threads, 0 for cs_parallel_threads().
+ * \param body    Function called for every range; must be thread-safe.
+ * \param arg     Passed to \a body unchanged.
+ */
+extern void cs_parallel_for(size_t count,
+                            size_t grain,
+                            unsigned threads,
+                            void (*body)(size_t begin, size_t end, void *arg),
+                            void *arg);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* LIBCASSAVA_PARALLEL_H */
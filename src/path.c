@@ -0,0 +1,290 @@
+/*
+ * libcassava/path.c
+ * vim: set cin ts=4 sw=4 et cc=100:
+ *
+ * Copyright (c) 2012 Ben Morgan <neembi@googlemail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#define _GNU_SOURCE
+
+#include "path.h"
+
+#include <assert.h>
+#include <string.h>
+
+/* What the directory and basename of an empty path are views of. */
+static const char dot[] = ".";
+
+static size_t strip_slashes(const char *path, size_t len);
+static int reserve(struct cs_pathbuf *buf, size_t len);
+static size_t copy_part(char *buffer, size_t size, size_t pos, const char *part, size_t len);
+
+struct cs_path_view cs_path_base(const char *path, size_t len)
+{
+    struct cs_path_view dir, base;
+
+    cs_path_split(path, len, &dir, &base);
+    return base;
+}
+
+struct cs_path_view cs_path_dir(const char *path, size_t len)
+{
+    struct cs_path_view dir, base;
+
+    cs_path_split(path, len, &dir, &base);
+    return dir;
+}
+
+void cs_path_split(const char *path, size_t len, struct cs_path_view *dir,
+                   struct cs_path_view *base)
+{
+    assert(path != NULL || len == 0);
+    assert(dir != NULL);
+    assert(base != NULL);
+
+    if (len == 0) {
+        dir->data = base->data = dot;
+        dir->len = base->len = 1;
+        return;
+    }
+
+    len = strip_slashes(path, len);
+    if (len == 1 && path[0] == '/') {
+        dir->data = base->data = path;
+        dir->len = base->len = 1;
+        return;
+    }
+
+    const char *slash = memrchr(path, '/', len);
+    if (slash == NULL) {
+        dir->data = dot;
+        dir->len = 1;
+        base->data = path;
+        base->len = len;
+        return;
+    }
+
+    base->data = slash + 1;
+    base->len = path + len - base->data;
+    dir->data = path;
+    dir->len = slash - path;
+    while (dir->len > 0 && path[dir->len-1] == '/')
+        dir->len--;
+    if (dir->len == 0)
+        dir->len = 1;
+}
+
+bool cs_path_next(const char *path, size_t len, size_t *pos, struct cs_path_view *component)
+{
+    assert(path != NULL || len == 0);
+    assert(pos != NULL);
+    assert(component != NULL);
+
+    size_t start = *pos;
+    while (start < len && path[start] == '/')
+        start++;
+    if (start >= len) {
+        *pos = len;
+        return false;
+    }
+
+    const char *slash = memchr(path + start, '/', len - start);
+    *pos = slash != NULL ? (size_t)(slash - path) : len;
+    component->data = path + start;
+    component->len = *pos - start;
+    return true;
+}
+
+size_t cs_path_join(char *buffer, size_t size, const char *dir, size_t dir_len, const char *name,
+                    size_t name_len)
+{
+    assert(buffer != NULL || size == 0);
+    assert(dir != NULL || dir_len == 0);
+    assert(name != NULL || name_len == 0);
+
+    while (name_len > 0 && name[0] == '/') {
+        name++;
+        name_len--;
+    }
+
+    size_t pos = copy_part(buffer, size, 0, dir, dir_len);
+    if (dir_len > 0 && dir[dir_len-1] != '/')
+        pos = copy_part(buffer, size, pos, "/", 1);
+    pos = copy_part(buffer, size, pos, name, name_len);
+
+    if (size > 0)
+        buffer[pos < size ? pos : size - 1] = '\0';
+    return pos;
+}
+
+size_t cs_path_normalize(char *path, size_t len)
+{
+    assert(path != NULL);
+
+    /* Components are moved to the front, never past where they are read from. */
+    size_t root = len > 0 && path[0] == '/' ? 1 : 0;
+    size_t out = root, pos = 0, kept = 0;
+    struct cs_path_view part;
+
+    while (cs_path_next(path, len, &pos, &part)) {
+        if (part.len == 1 && part.data[0] == '.')
+            continue;
+        if (part.len == 2 && part.data[0] == '.' && part.data[1] == '.') {
+            if (kept > 0) {
+                const char *slash = memrchr(path + root, '/', out - root);
+                out = slash != NULL ? (size_t)(slash - path) : root;
+                kept--;
+                continue;
+            }
+            if (root > 0)
+                continue;
+        } else {
+            kept++;
+        }
+        if (out > root)
+            path[out++] = '/';
+        memmove(path + out, part.data, part.len);
+        out += part.len;
+    }
+
+    if (out == 0)
+        path[out++] = '.';
+    path[out] = '\0';
+    return out;
+}
+
+void cs_pathbuf_init(struct cs_pathbuf *buf)
+{
+    assert(buf != NULL);
+
+    buf->data = NULL;
+    buf->len = buf->prefix = buf->size = 0;
+}
+
+void cs_pathbuf_free(struct cs_pathbuf *buf)
+{
+    assert(buf != NULL);
+
+    free(buf->data);
+    cs_pathbuf_init(buf);
+}
+
+int cs_pathbuf_dir(struct cs_pathbuf *buf, const char *dir, size_t len)
+{
+    assert(buf != NULL);
+    assert(dir != NULL || len == 0);
+
+    if (reserve(buf, len + 1) < 0)
+        return -1;
+    memcpy(buf->data, dir, len);
+    if (len > 0 && dir[len-1] != '/')
+        buf->data[len++] = '/';
+    buf->data[len] = '\0';
+    buf->len = buf->prefix = len;
+    return 0;
+}
+
+const char *cs_pathbuf_name(struct cs_pathbuf *buf, const char *name, size_t len)
+{
+    assert(buf != NULL);
+    assert(name != NULL);
+
+    if (reserve(buf, buf->prefix + len) < 0)
+        return NULL;
+    memcpy(buf->data + buf->prefix, name, len);
+    buf->len = buf->prefix + len;
+    buf->data[buf->len] = '\0';
+    return buf->data;
+}
+
+size_t cs_pathbuf_push(struct cs_pathbuf *buf, const char *name, size_t len)
+{
+    assert(buf != NULL);
+    assert(name != NULL);
+
+    size_t prefix = buf->prefix;
+    if (reserve(buf, prefix + len + 1) < 0)
+        return (size_t)-1;
+    memcpy(buf->data + prefix, name, len);
+    buf->data[prefix + len] = '/';
+    buf->len = buf->prefix = prefix + len + 1;
+    buf->data[buf->len] = '\0';
+    return prefix;
+}
+
+void cs_pathbuf_pop(struct cs_pathbuf *buf, size_t prefix)
+{
+    assert(buf != NULL);
+    assert(prefix <= buf->prefix);
+
+    buf->len = buf->prefix = prefix;
+    if (buf->data != NULL)
+        buf->data[prefix] = '\0';
+}
+
+char *cs_pathbuf_copy(const struct cs_pathbuf *buf, struct cs_arena *arena)
+{
+    assert(buf != NULL);
+
+    const char *data = buf->data != NULL ? buf->data : "";
+    if (arena != NULL)
+        return cs_arena_strndup(arena, data, buf->len);
+
+    char *copy = malloc(buf->len + 1);
+    if (copy != NULL)
+        memcpy(copy, data, buf->len + 1);
+    return copy;
+}
+
+/*
+ * Returns the length of path without trailing slashes, but keeps a path
+ * consisting only of slashes as "/".
+ */
+static size_t strip_slashes(const char *path, size_t len)
+{
+    while (len > 1 && path[len-1] == '/')
+        len--;
+    return len;
+}
+
+/*
+ * Copy what fits of part to pos in buffer, leaving room for the '\0', and
+ * return the position after all of part.
+ */
+static size_t copy_part(char *buffer, size_t size, size_t pos, const char *part, size_t len)
+{
+    if (pos + 1 < size)
+        memcpy(buffer + pos, part, pos + len < size ? len : size - pos - 1);
+    return pos + len;
+}
+
+/*
+ * Make room for a path of len characters and its '\0' in buf.
+ */
+static int reserve(struct cs_pathbuf *buf, size_t len)
+{
+    if (len + 1 <= buf->size)
+        return 0;
+
+    size_t size = buf->size > 0 ? buf->size : 256;
+    while (size < len + 1)
+        size *= 2;
+    char *data = realloc(buf->data, size);
+    if (data == NULL)
+        return -1;
+    buf->data = data;
+    buf->size = size;
+    return 0;
+}
@@ -0,0 +1,237 @@
+/*
+ * libcassava/path.h
+ * vim: set cin ts=4 sw=4 et cc=80:
+ *
+ * Copyright (c) 2012 Ben Morgan <neembi@googlemail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION
+ * OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/**
+ * \file
+ * Taking paths apart without copying them.
+ *
+ * The functions here return views, a pointer into the path given and a
+ * length, instead of a new string. They neither allocate nor keep any state,
+ * so they may be called from any number of threads at once. The paths need
+ * not be terminated by \c '\0', since their length is always passed along.
+ *
+ * Components are found by searching for \c '/' with memchr() and memrchr(),
+ * which the C library implements with vector instructions.
+ *
+ * Paths are only looked at as strings: nothing here asks the file system,
+ * so symbolic links are not taken into account.
+ *
+ * <b>Example Usage:</b>
+ * \code
+ *     struct cs_path_view dir, base;
+ *     cs_path_split(path, strlen(path), &dir, &base);
+ *     printf("%.*s in %.*s\n", (int)base.len, base.data,
+ *            (int)dir.len, dir.data);
+ * \endcode
+ *
+ * \author Ben Morgan
+ * \date 17. October 2026
+ */
+
+#ifndef LIBCASSAVA_PATH_H
+#define LIBCASSAVA_PATH_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+#include <stdbool.h>
+#include <stdlib.h>
+
+#include "arena.h"
+
+/**
+ * A part of a path: \a len characters at \a data, which are not terminated
+ * by \c '\0' in general. The view is valid as long as the path it was taken
+ * from.
+ */
+struct cs_path_view {
+    const char *data;
+    size_t len;
+};
+
+/**
+ * Returns the last component of the path \a path of length \a len, as
+ * basename(3) would, but as a view into \a path.
+ *
+ * Trailing slashes are not part of the component, so the basename of
+ * "/usr/" is "usr". The basename of "/" is "/", and that of an empty path
+ * is ".", which is then a view of a string constant.
+ */
+extern struct cs_path_view cs_path_base(const char *path, size_t len);
+
+/**
+ * Returns everything up to the last component of the path \a path of
+ * length \a len, as dirname(3) would, but as a view into \a path.
+ *
+ * The directory of "/usr/lib" is "/usr", of "/usr/" is "/", and of a path
+ * without slashes such as "usr" or "" it is ".".
+ */
+extern struct cs_path_view cs_path_dir(const char *path, size_t len);
+
+/**
+ * Set \a dir and \a base to cs_path_dir() and cs_path_base() of \a path,
+ * going over the path only once.
+ */
+extern void cs_path_split(const char *path, size_t len,
+                          struct cs_path_view *dir, struct cs_path_view *base);
+
+/**
+ * Find the next component of a path, for going over all of them in a loop.
+ * Empty components, as between the slashes of "a//b", are skipped.
+ *
+ * \b Example:
+ * \code
+ *     struct cs_path_view part;
+ *     size_t pos = 0;
+ *     while (cs_path_next(path, len, &pos, &part))
+ *         printf("%.*s\n", (int)part.len, part.data);
+ * \endcode
+ *
+ * \param path      The path.
+ * \param len       Length of \a path.
+ * \param pos       Where to start searching, 0 at first; set to the end of
+ *                  the component found.
+ * \param component Set to the component found.
+ * \return true if a component was found, false at the end of the path.
+ */
+extern bool cs_path_next(const char *path, size_t len, size_t *pos,
+                         struct cs_path_view *component);
+
+/**
+ * Write \a dir, a slash, and \a name to \a buffer, terminated by \c '\0'.
+ * No slash is added if \a dir is empty or already ends in one, and leading
+ * slashes of \a name are left out.
+ *
+ * Like snprintf(), at most \a size bytes are written, and the length of the
+ * whole result is returned, so that a return value of \a size or more means
+ * the result was cut short.
+ *
+ * \return Length of the joined path, not counting the \c '\0'.
+ */
+extern size_t cs_path_join(char *buffer, size_t size,
+                           const char *dir, size_t dir_len,
+                           const char *name, size_t name_len);
+
+/**
+ * Normalize the path \a path of length \a len in place: repeated slashes
+ * become one, "." components and trailing slashes are removed, and a
+ * component followed by ".." is removed together with it. Leading ".."
+ * components of a relative path are kept; those of an absolute path are
+ * dropped, since "/.." is "/". An empty result becomes ".".
+ *
+ * The result is never longer than \a path, except that an empty path
+ * becomes "."; it is terminated by \c '\0', so \a path must have room for
+ * at least \a len + 1 characters, and 2 if \a len is 0.
+ *
+ * \warning Removing "dir/.." is only correct if \a dir is not a symbolic
+ * link.
+ *
+ * \return The length of the normalized path.
+ */
+extern size_t cs_path_normalize(char *path, size_t len);
+
+/**
+ * A buffer for building the paths of the entries of a directory, such that
+ * the directory part is only written once, and each name is then copied
+ * behind it into the same buffer.
+ *
+ * \b Example:
+ * \code
+ *     struct cs_pathbuf buf;
+ *     cs_pathbuf_init(&buf);
+ *     cs_pathbuf_dir(&buf, "/etc", 4);
+ *     while (cs_dir_read(dir, &entry) > 0)
+ *         puts(cs_pathbuf_name(&buf, entry.name, entry.len));
+ *     cs_pathbuf_free(&buf);
+ * \endcode
+ *
+ * \param data   The path, terminated by \c '\0'.
+ * \param len    Length of \a data.
+ * \param prefix Length of the directory part of \a data, including the
+ *               slash that ends it, if any.
+ * \param size   Number of bytes allocated for \a data.
+ */
+struct cs_pathbuf {
+    char *data;
+    size_t len;
+    size_t prefix;
+    size_t size;
+};
+
+/**
+ * Initialize an empty path buffer. Nothing is allocated until a path is put
+ * into it.
+ */
+extern void cs_pathbuf_init(struct cs_pathbuf *buf);
+
+/**
+ * Free the memory of a path buffer, which may then be initialized again.
+ */
+extern void cs_pathbuf_free(struct cs_pathbuf *buf);
+
+/**
+ * Make the directory \a dir of length \a len the directory part of the
+ * buffer. A slash is added unless \a dir is empty or already ends in one.
+ *
+ * \return 0 on success, -1 if out of memory.
+ */
+extern int cs_pathbuf_dir(struct cs_pathbuf *buf, const char *dir, size_t len);
+
+/**
+ * Put the name \a name of length \a len behind the directory part of the
+ * buffer, in place of the previous name.
+ *
+ * \return The whole path, which is valid until the buffer changes, or
+ *         \c NULL if out of memory.
+ */
+extern const char *cs_pathbuf_name(struct cs_pathbuf *buf, const char *name,
+                                   size_t len);
+
+/**
+ * Make the subdirectory \a name of the directory part the new directory
+ * part, for going down a tree depth first.
+ *
+ * \return The previous length of the directory part, to be passed to
+ *         cs_pathbuf_pop() on the way back up, or (size_t)-1 if out of
+ *         memory.
+ */
+extern size_t cs_pathbuf_push(struct cs_pathbuf *buf, const char *name,
+                              size_t len);
+
+/**
+ * Go back to the directory part of length \a prefix returned by
+ * cs_pathbuf_push().
+ */
+extern void cs_pathbuf_pop(struct cs_pathbuf *buf, size_t prefix);
+
+/**
+ * Returns a copy of the path in the buffer, allocated in \a arena, or with
+ * malloc() if \a arena is \c NULL.
+ */
+extern char *cs_pathbuf_copy(const struct cs_pathbuf *buf,
+                             struct cs_arena *arena);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* LIBCASSAVA_PATH_H */
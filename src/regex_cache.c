@@ -0,0 +1,442 @@
+/*
+ * libcassava/regex_cache.c
+ * vim: set cin ts=4 sw=4 et cc=100:
+ *
+ * Copyright (c) 2012 Ben Morgan <neembi@googlemail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#define _GNU_SOURCE
+
+#include "regex_cache.h"
+
+#include <assert.h>
+#include <pthread.h>
+#include <regex.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct cs_regex {
+    regex_t preg;
+    char *pattern;
+    int cflags;
+    char *prefix;           /* literal every match starts with */
+    size_t prefix_len;
+    char *suffix;           /* literal every match ends with */
+    size_t suffix_len;
+    bool exact;             /* the pattern is ^prefix$ */
+    unsigned refs;          /* one for the cache, one per cs_regex_get() */
+    struct cs_regex *prev;  /* towards the most recently used */
+    struct cs_regex *next;
+};
+
+/* Patterns are kept in order of use, the most recently used first. */
+static struct {
+    pthread_mutex_t lock;
+    struct cs_regex *head;
+    struct cs_regex *tail;
+    size_t size;
+    size_t capacity;
+    unsigned long hits;
+    unsigned long misses;
+    unsigned long evictions;
+} cache = { PTHREAD_MUTEX_INITIALIZER, NULL, NULL, 0, CS_REGEX_CACHE_SIZE, 0, 0, 0 };
+
+/* What a piece of a pattern means for extracting literals. */
+enum token {
+    TOK_LITERAL,    /* a single character matching itself */
+    TOK_START,      /* ^ at the beginning */
+    TOK_END,        /* $ at the end */
+    TOK_QUANT,      /* applies to the token before it */
+    TOK_ALT,        /* alternation outside of any group */
+    TOK_OTHER       /* anything else */
+};
+
+static struct cs_regex *cache_find(const char *pattern, int cflags);
+static void cache_unlink(struct cs_regex *regex);
+static void cache_evict(size_t capacity);
+static void regex_free(struct cs_regex *regex);
+static void extract_literals(struct cs_regex *regex);
+static size_t next_token(const char *p, bool extended, int *depth, enum token *tok, char *c);
+static size_t skip_bracket(const char *p);
+
+const struct cs_regex *cs_regex_get(const char *pattern, int cflags)
+{
+    assert(pattern != NULL);
+
+    struct cs_regex *regex, *found;
+
+    pthread_mutex_lock(&cache.lock);
+    regex = cache_find(pattern, cflags);
+    if (regex != NULL) {
+        cache.hits++;
+        regex->refs++;
+        pthread_mutex_unlock(&cache.lock);
+        return regex;
+    }
+    cache.misses++;
+    pthread_mutex_unlock(&cache.lock);
+
+    /* Compile without holding the lock, it can take a while. */
+    regex = calloc(1, sizeof (struct cs_regex));
+    if (regex == NULL) {
+        perror("Error (cs_regex_get)");
+        return NULL;
+    }
+    int errcode = regcomp(&regex->preg, pattern, cflags);
+    if (errcode != 0) {
+        char errbuf[BUFSIZ];
+        regerror(errcode, &regex->preg, errbuf, sizeof errbuf);
+        fprintf(stderr, "Error (regcomp): %s\n", errbuf);
+        free(regex);
+        return NULL;
+    }
+    regex->pattern = strdup(pattern);
+    if (regex->pattern == NULL) {
+        perror("Error (cs_regex_get)");
+        regex_free(regex);
+        return NULL;
+    }
+    regex->cflags = cflags;
+    regex->refs = 1;
+    extract_literals(regex);
+
+    pthread_mutex_lock(&cache.lock);
+    found = cache_find(pattern, cflags);
+    if (found != NULL) {
+        /* Another thread was faster. */
+        found->refs++;
+        pthread_mutex_unlock(&cache.lock);
+        regex_free(regex);
+        return found;
+    }
+    if (cache.capacity > 0) {
+        regex->refs++;
+        regex->next = cache.head;
+        if (cache.head != NULL)
+            cache.head->prev = regex;
+        else
+            cache.tail = regex;
+        cache.head = regex;
+        cache.size++;
+        cache_evict(cache.capacity);
+    }
+    pthread_mutex_unlock(&cache.lock);
+    return regex;
+}
+
+void cs_regex_release(const struct cs_regex *regex)
+{
+    struct cs_regex *r = (struct cs_regex *)regex;
+    bool unused;
+
+    if (r == NULL)
+        return;
+    pthread_mutex_lock(&cache.lock);
+    unused = --r->refs == 0;
+    pthread_mutex_unlock(&cache.lock);
+    if (unused)
+        regex_free(r);
+}
+
+bool cs_regex_match(const struct cs_regex *regex, const char *string)
+{
+    assert(regex != NULL);
+    assert(string != NULL);
+
+    size_t len = strlen(string);
+    if (regex->exact)
+        return len == regex->prefix_len && memcmp(string, regex->prefix, len) == 0;
+    if (regex->prefix_len > 0
+        && (len < regex->prefix_len || memcmp(string, regex->prefix, regex->prefix_len) != 0))
+        return false;
+    if (regex->suffix_len > 0
+        && (len < regex->suffix_len
+            || memcmp(string + len - regex->suffix_len, regex->suffix, regex->suffix_len) != 0))
+        return false;
+    return regexec(&regex->preg, string, 0, NULL, 0) == 0;
+}
+
+bool filter_regex_cached(void *string, void *regex)
+{
+    return cs_regex_match(regex, string);
+}
+
+void cs_regex_cache_resize(size_t capacity)
+{
+    pthread_mutex_lock(&cache.lock);
+    cache.capacity = capacity;
+    cache_evict(capacity);
+    pthread_mutex_unlock(&cache.lock);
+}
+
+void cs_regex_cache_clear(void)
+{
+    pthread_mutex_lock(&cache.lock);
+    cache_evict(0);
+    cache.hits = cache.misses = cache.evictions = 0;
+    pthread_mutex_unlock(&cache.lock);
+}
+
+void cs_regex_cache_stats(struct cs_regex_stats *stats)
+{
+    assert(stats != NULL);
+
+    pthread_mutex_lock(&cache.lock);
+    stats->hits = cache.hits;
+    stats->misses = cache.misses;
+    stats->evictions = cache.evictions;
+    stats->size = cache.size;
+    stats->capacity = cache.capacity;
+    pthread_mutex_unlock(&cache.lock);
+}
+
+/*
+ * Find a pattern in the cache and make it the most recently used.
+ * Must be called with the lock held.
+ */
+static struct cs_regex *cache_find(const char *pattern, int cflags)
+{
+    struct cs_regex *regex;
+
+    for (regex = cache.head; regex != NULL; regex = regex->next) {
+        if (regex->cflags == cflags && strcmp(regex->pattern, pattern) == 0)
+            break;
+    }
+    if (regex != NULL && regex != cache.head) {
+        cache_unlink(regex);
+        regex->next = cache.head;
+        cache.head->prev = regex;
+        cache.head = regex;
+        cache.size++;
+    }
+    return regex;
+}
+
+static void cache_unlink(struct cs_regex *regex)
+{
+    if (regex->prev != NULL)
+        regex->prev->next = regex->next;
+    else
+        cache.head = regex->next;
+    if (regex->next != NULL)
+        regex->next->prev = regex->prev;
+    else
+        cache.tail = regex->prev;
+    regex->prev = regex->next = NULL;
+    cache.size--;
+}
+
+/*
+ * Drop the least recently used patterns until at most capacity are left;
+ * those still in use are freed by the last cs_regex_release().
+ * Must be called with the lock held.
+ */
+static void cache_evict(size_t capacity)
+{
+    while (cache.size > capacity) {
+        struct cs_regex *regex = cache.tail;
+        cache_unlink(regex);
+        cache.evictions++;
+        if (--regex->refs == 0)
+            regex_free(regex);
+    }
+}
+
+static void regex_free(struct cs_regex *regex)
+{
+    regfree(&regex->preg);
+    free(regex->pattern);
+    free(regex->prefix);
+    free(regex->suffix);
+    free(regex);
+}
+
+/*
+ * Find the literal that every match of the pattern must begin with, if it
+ * is anchored with ^, and the one every match must end with, if it is
+ * anchored with $. Anything that is not plainly a literal ends the search,
+ * so the result may be shorter than possible, but is never wrong; if out of
+ * memory, there is no literal at all.
+ */
+static void extract_literals(struct cs_regex *regex)
+{
+    const char *p = regex->pattern;
+    bool extended = regex->cflags & REG_EXTENDED;
+    size_t len = strlen(p), n = 0, i, j;
+    enum token *toks;
+    char *chars;
+    int depth = 0;
+
+    /* Anchors match at every line, and case may differ: no literal applies. */
+    if (regex->cflags & (REG_ICASE | REG_NEWLINE))
+        return;
+
+    toks = malloc((len + 1) * sizeof (enum token));
+    chars = malloc(len + 1);
+    if (toks == NULL || chars == NULL)
+        goto finally;
+    while (*p != '\0') {
+        p += next_token(p, extended, &depth, &toks[n], &chars[n]);
+        if (n == 0 && toks[n] == TOK_OTHER && chars[n] == '^')
+            toks[n] = TOK_START;
+        if (*p == '\0' && toks[n] == TOK_OTHER && chars[n] == '$')
+            toks[n] = TOK_END;
+        if (toks[n] == TOK_ALT)
+            goto finally;
+        n++;
+    }
+
+    if (n > 0 && toks[0] == TOK_START) {
+        for (i = 1; i < n && toks[i] == TOK_LITERAL; i++) {
+            if (i + 1 < n && toks[i+1] == TOK_QUANT)
+                break;
+        }
+        regex->prefix_len = i - 1;
+        regex->prefix = strndup(chars + 1, regex->prefix_len);
+        regex->exact = i + 1 == n && toks[i] == TOK_END;
+    }
+    if (n > 1 && toks[n-1] == TOK_END && !regex->exact) {
+        for (j = n - 1; j > 0 && toks[j-1] == TOK_LITERAL; j--)
+            ;
+        regex->suffix_len = n - 1 - j;
+        regex->suffix = strndup(chars + j, regex->suffix_len);
+    }
+    if ((regex->prefix == NULL && (regex->prefix_len > 0 || regex->exact))
+        || (regex->suffix_len > 0 && regex->suffix == NULL)) {
+        free(regex->prefix);
+        free(regex->suffix);
+        regex->prefix = regex->suffix = NULL;
+        regex->prefix_len = regex->suffix_len = 0;
+        regex->exact = false;
+    }
+
+finally:
+    free(toks);
+    free(chars);
+}
+
+/*
+ * Classify the token at p, which is in ERE syntax if extended, otherwise in
+ * BRE syntax; c is set to the character matched by a literal, or to the
+ * character at p for anything else.
+ *
+ * \return The length of the token.
+ */
+static size_t next_token(const char *p, bool extended, int *depth, enum token *tok, char *c)
+{
+    static const char *special = ".[]()*+?{}|^$\\";
+    size_t n;
+
+    *c = p[0];
+    *tok = TOK_OTHER;
+    if ((unsigned char)p[0] >= 0x80) {
+        /* Part of a multibyte character. */
+        return 1;
+    } else if (p[0] == '[') {
+        return skip_bracket(p);
+    } else if (p[0] == '\\') {
+        if (p[1] == '\0')
+            return 1;
+        if (!extended) {
+            switch (p[1]) {
+            case '(':
+                ++*depth;
+                return 2;
+            case ')':
+                --*depth;
+                return 2;
+            case '|':
+                if (*depth == 0)
+                    *tok = TOK_ALT;
+                return 2;
+            case '+':
+            case '?':
+                *tok = TOK_QUANT;
+                return 2;
+            case '{':
+                *tok = TOK_QUANT;
+                for (n = 2; p[n] != '\0' && !(p[n] == '\\' && p[n+1] == '}'); n++)
+                    ;
+                return p[n] != '\0' ? n + 2 : n;
+            }
+        }
+        if (p[1] != '{' && p[1] != '}' && strchr(special, p[1]) != NULL) {
+            *tok = TOK_LITERAL;
+            *c = p[1];
+        }
+        return 2;
+    } else if (p[0] == '*') {
+        *tok = TOK_QUANT;
+        return 1;
+    } else if (p[0] == '.' || p[0] == '^' || p[0] == '$') {
+        return 1;
+    } else if (!extended) {
+        *tok = TOK_LITERAL;
+        return 1;
+    }
+
+    switch (p[0]) {
+    case '(':
+        ++*depth;
+        break;
+    case ')':
+        --*depth;
+        break;
+    case '|':
+        if (*depth == 0)
+            *tok = TOK_ALT;
+        break;
+    case '+':
+    case '?':
+        *tok = TOK_QUANT;
+        break;
+    case '{':
+        *tok = TOK_QUANT;
+        for (n = 1; p[n] != '\0' && p[n] != '}'; n++)
+            ;
+        return p[n] != '\0' ? n + 1 : n;
+    default:
+        *tok = TOK_LITERAL;
+    }
+    return 1;
+}
+
+/*
+ * Returns the length of the bracket expression at p.
+ */
+static size_t skip_bracket(const char *p)
+{
+    size_t i = 1;
+
+    if (p[i] == '^')
+        i++;
+    if (p[i] == ']')
+        i++;
+    while (p[i] != '\0' && p[i] != ']') {
+        if (p[i] == '[' && (p[i+1] == ':' || p[i+1] == '.' || p[i+1] == '=')) {
+            const char *end = strchr(p + i + 2, p[i+1]);
+            while (end != NULL && end[1] != ']')
+                end = strchr(end + 1, p[i+1]);
+            if (end == NULL)
+                return strlen(p);
+            i = end + 2 - p;
+        } else {
+            i++;
+        }
+    }
+    return p[i] != '\0' ? i + 1 : i;
+}
@@ -0,0 +1,136 @@
+/*
+ * libcassava/regex_cache.h
+ * vim: set cin ts=4 sw=4 et cc=80:
+ *
+ * Copyright (c) 2012 Ben Morgan <neembi@googlemail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION
+ * OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/**
+ * \file
+ * A process-wide cache of compiled regular expressions.
+ *
+ * Functions such as list_filter_regex() and read_directory_filter_regex()
+ * take a pattern as a string. Instead of compiling it with regcomp() on every
+ * call, they get it from this cache, which keeps the most recently used
+ * patterns compiled, keyed by the pattern and the regcomp() flags.
+ *
+ * When a pattern is compiled, the literal text that every match must start
+ * or end with is extracted (as "abc" from "^abc.*\.h$" and ".h" from it too),
+ * so that most names which do not match are rejected with memcmp() before
+ * calling regexec(). Patterns that are nothing but a literal between ^ and $
+ * are matched without regexec() at all.
+ *
+ * All functions are thread-safe. The cache is meant for a handful of patterns
+ * that are used over and over; looking up a pattern is linear in the number
+ * of patterns cached.
+ *
+ * <b>Example Usage:</b>
+ * \code
+ *     const struct cs_regex *re = cs_regex_get("\\.c$", REG_EXTENDED);
+ *     if (re != NULL) {
+ *         list_filter(&head, filter_regex_cached, (void *)re);
+ *         cs_regex_release(re);
+ *     }
+ * \endcode
+ *
+ * \author Ben Morgan
+ * \date 17. October 2026
+ */
+
+#ifndef LIBCASSAVA_REGEX_CACHE_H
+#define LIBCASSAVA_REGEX_CACHE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+#include <stdbool.h>
+#include <stdlib.h>
+
+/** Number of patterns the cache holds unless changed. */
+#define CS_REGEX_CACHE_SIZE 32
+
+/**
+ * A compiled regular expression owned by the cache.
+ */
+struct cs_regex;
+
+/**
+ * Counters of the cache, as returned by cs_regex_cache_stats().
+ */
+struct cs_regex_stats {
+    unsigned long hits;      /**< Lookups that found the pattern compiled. */
+    unsigned long misses;    /**< Lookups that had to compile the pattern. */
+    unsigned long evictions; /**< Patterns dropped to make room. */
+    size_t size;             /**< Patterns currently cached. */
+    size_t capacity;         /**< Maximum number of patterns cached. */
+};
+
+/**
+ * Get \a pattern compiled with the regcomp() \a cflags from the cache,
+ * compiling it if it is not there yet.
+ *
+ * The pattern stays valid until it is given back with cs_regex_release(),
+ * even if it is evicted from the cache in the meantime.
+ *
+ * \return The compiled pattern, or \c NULL if it could not be compiled or if
+ *         out of memory, in which case the reason is printed to stderr.
+ */
+extern const struct cs_regex *cs_regex_get(const char *pattern, int cflags);
+
+/**
+ * Give back a pattern returned by cs_regex_get(); \c NULL is ignored.
+ */
+extern void cs_regex_release(const struct cs_regex *regex);
+
+/**
+ * Returns true if \a string matches \a regex, as regexec() would.
+ */
+extern bool cs_regex_match(const struct cs_regex *regex, const char *string);
+
+/**
+ * A filter function for list_filter() and the get_file*_filter() functions,
+ * to keep the strings matching a pattern from cs_regex_get().
+ *
+ * \param string String to match.
+ * \param regex  Pointer to a struct cs_regex.
+ * \return The result of cs_regex_match().
+ */
+extern bool filter_regex_cached(void *string, void *regex);
+
+/**
+ * Change the number of patterns the cache holds, evicting the least recently
+ * used ones if there are more than \a capacity. A capacity of 0 disables the
+ * cache: every cs_regex_get() compiles the pattern anew.
+ */
+extern void cs_regex_cache_resize(size_t capacity);
+
+/**
+ * Evict all patterns from the cache and reset its counters.
+ */
+extern void cs_regex_cache_clear(void);
+
+/**
+ * Fill in \a stats with the current counters of the cache.
+ */
+extern void cs_regex_cache_stats(struct cs_regex_stats *stats);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* LIBCASSAVA_REGEX_CACHE_H */
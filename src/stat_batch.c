@@ -0,0 +1,409 @@
+/*
+ * libcassava/stat_batch.c
+ * vim: set cin ts=4 sw=4 et cc=100:
+ *
+ * Copyright (c) 2012 Ben Morgan <neembi@googlemail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#define _GNU_SOURCE
+
+#include "stat_batch.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "parallel.h"
+
+#if defined(__linux__) && defined(STATX_BASIC_STATS) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#define HAVE_IO_URING 1
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/sysmacros.h>
+#include <sys/syscall.h>
+#endif
+#endif
+
+/* Lookups are handed to threads in ranges of this many files. */
+#define STAT_GRAIN 32
+
+#ifdef HAVE_IO_URING
+/* Times io_uring_enter() may fail with EAGAIN or EBUSY before the ring is given up. */
+#define URING_STALLS 64
+
+/*
+ * The parts of an io_uring that are mapped into our address space.
+ */
+struct uring {
+    int fd;
+    unsigned entries;
+    unsigned *sq_tail;
+    unsigned *sq_mask;
+    unsigned *sq_array;
+    struct io_uring_sqe *sqes;
+    unsigned *cq_head;
+    unsigned *cq_tail;
+    unsigned *cq_mask;
+    struct io_uring_cqe *cqes;
+    void *sq_ring;
+    void *cq_ring;
+    size_t sq_size;
+    size_t cq_size;
+    size_t sqes_size;
+    struct statx *buffers;
+};
+#endif
+
+struct cs_stat_engine {
+    unsigned depth;
+    unsigned threads;
+#ifdef HAVE_IO_URING
+    struct uring *ring;
+#endif
+};
+
+/* Arguments of stat_range() for cs_parallel_for(). */
+struct stat_job {
+    int dirfd;
+    const char *const *paths;
+    int flags;
+    struct cs_stat *results;
+    size_t ok;
+};
+
+static void stat_range(size_t begin, size_t end, void *arg);
+
+#ifdef HAVE_IO_URING
+static struct uring *uring_open(unsigned entries);
+static void uring_close(struct uring *ring);
+static size_t uring_run(struct cs_stat_engine *engine, int dirfd, const char *const *paths,
+                        size_t count, int flags, struct cs_stat *results);
+static void from_statx(const struct statx *stx, struct cs_stat *result);
+#endif
+
+struct cs_stat_engine *cs_stat_engine_new(unsigned depth, bool uring)
+{
+    struct cs_stat_engine *engine = calloc(1, sizeof (struct cs_stat_engine));
+
+    if (engine == NULL) {
+        perror("Error (cs_stat_engine_new)");
+        return NULL;
+    }
+    engine->depth = depth ? depth : CS_STAT_DEPTH;
+    engine->threads = cs_parallel_threads();
+#ifdef HAVE_IO_URING
+    if (uring)
+        engine->ring = uring_open(engine->depth);
+#else
+    (void)uring;
+#endif
+    return engine;
+}
+
+bool cs_stat_engine_uring(const struct cs_stat_engine *engine)
+{
+    assert(engine != NULL);
+
+#ifdef HAVE_IO_URING
+    return engine->ring != NULL;
+#else
+    return false;
+#endif
+}
+
+size_t cs_stat_engine_run(struct cs_stat_engine *engine, int dirfd, const char *const *paths,
+                          size_t count, int flags, struct cs_stat *results)
+{
+    assert(engine != NULL);
+    assert(count == 0 || paths != NULL);
+    assert(count == 0 || results != NULL);
+
+#ifdef HAVE_IO_URING
+    if (engine->ring != NULL)
+        return uring_run(engine, dirfd, paths, count, flags, results);
+#endif
+
+    /* Threads block in the kernel most of the time, so use more than CPUs. */
+    struct stat_job job = { dirfd, paths, flags, results, 0 };
+    unsigned threads = engine->threads * 4;
+    if (threads > engine->depth / STAT_GRAIN)
+        threads = engine->depth / STAT_GRAIN;
+    cs_parallel_for(count, STAT_GRAIN, threads ? threads : 1, stat_range, &job);
+    return job.ok;
+}
+
+void cs_stat_engine_free(struct cs_stat_engine *engine)
+{
+    if (engine == NULL)
+        return;
+#ifdef HAVE_IO_URING
+    uring_close(engine->ring);
+#endif
+    free(engine);
+}
+
+size_t cs_stat_batch(int dirfd, const char *const *paths, size_t count, int flags,
+                     struct cs_stat *results)
+{
+    struct cs_stat_engine *engine;
+    size_t ok;
+
+    /* Setting up a ring does not pay off for a handful of files. */
+    engine = cs_stat_engine_new(count < CS_STAT_DEPTH ? count : CS_STAT_DEPTH, count > 8);
+    if (engine == NULL) {
+        struct stat_job job = { dirfd, paths, flags, results, 0 };
+        stat_range(0, count, &job);
+        return job.ok;
+    }
+    ok = cs_stat_engine_run(engine, dirfd, paths, count, flags, results);
+    cs_stat_engine_free(engine);
+    return ok;
+}
+
+/*
+ * Look up the files [begin, end) of a stat_job one after the other.
+ */
+static void stat_range(size_t begin, size_t end, void *arg)
+{
+    struct stat_job *job = arg;
+    size_t i, ok = 0;
+
+    for (i = begin; i < end; i++) {
+        struct cs_stat *result = &job->results[i];
+        struct stat fstat;
+
+        if (fstatat(job->dirfd, job->paths[i], &fstat, job->flags) != 0) {
+            result->error = errno;
+            continue;
+        }
+        result->error = 0;
+        result->dev = fstat.st_dev;
+        result->ino = fstat.st_ino;
+        result->mode = fstat.st_mode;
+        result->nlink = fstat.st_nlink;
+        result->size = fstat.st_size;
+        result->blocks = fstat.st_blocks;
+        result->mtime = fstat.st_mtim.tv_sec;
+        result->mtime_nsec = fstat.st_mtim.tv_nsec;
+        ok++;
+    }
+    __atomic_add_fetch(&job->ok, ok, __ATOMIC_RELAXED);
+}
+
+#ifdef HAVE_IO_URING
+/*
+ * Set up an io_uring with room for entries requests, or return NULL if
+ * io_uring is not available or does not support statx.
+ */
+static struct uring *uring_open(unsigned entries)
+{
+    struct io_uring_params params;
+    struct io_uring_probe *probe;
+    struct uring *ring;
+    size_t probe_size;
+    long fd;
+    bool supported;
+
+    memset(&params, 0, sizeof params);
+    fd = syscall(__NR_io_uring_setup, entries, &params);
+    if (fd < 0)
+        return NULL;
+
+    probe_size = sizeof (struct io_uring_probe) + 256 * sizeof (struct io_uring_probe_op);
+    probe = calloc(1, probe_size);
+    supported = probe != NULL
+                && syscall(__NR_io_uring_register, fd, IORING_REGISTER_PROBE, probe, 256) == 0
+                && probe->last_op >= IORING_OP_STATX
+                && (probe->ops[IORING_OP_STATX].flags & IO_URING_OP_SUPPORTED);
+    free(probe);
+    if (!supported) {
+        close(fd);
+        return NULL;
+    }
+
+    ring = calloc(1, sizeof (struct uring));
+    if (ring == NULL) {
+        close(fd);
+        return NULL;
+    }
+    ring->fd = fd;
+    ring->entries = params.sq_entries;
+    ring->sq_size = params.sq_off.array + params.sq_entries * sizeof (unsigned);
+    ring->cq_size = params.cq_off.cqes + params.cq_entries * sizeof (struct io_uring_cqe);
+    ring->sqes_size = params.sq_entries * sizeof (struct io_uring_sqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        if (ring->cq_size > ring->sq_size)
+            ring->sq_size = ring->cq_size;
+        ring->cq_size = ring->sq_size;
+    }
+
+    ring->sq_ring = mmap(NULL, ring->sq_size, PROT_READ | PROT_WRITE,
+                         MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    if (ring->sq_ring == MAP_FAILED)
+        goto error;
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        ring->cq_ring = ring->sq_ring;
+    } else {
+        ring->cq_ring = mmap(NULL, ring->cq_size, PROT_READ | PROT_WRITE,
+                             MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+        if (ring->cq_ring == MAP_FAILED)
+            goto error;
+    }
+    ring->sqes = mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+    if (ring->sqes == MAP_FAILED)
+        goto error;
+
+    ring->sq_tail = (unsigned *)((char *)ring->sq_ring + params.sq_off.tail);
+    ring->sq_mask = (unsigned *)((char *)ring->sq_ring + params.sq_off.ring_mask);
+    ring->sq_array = (unsigned *)((char *)ring->sq_ring + params.sq_off.array);
+    ring->cq_head = (unsigned *)((char *)ring->cq_ring + params.cq_off.head);
+    ring->cq_tail = (unsigned *)((char *)ring->cq_ring + params.cq_off.tail);
+    ring->cq_mask = (unsigned *)((char *)ring->cq_ring + params.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe *)((char *)ring->cq_ring + params.cq_off.cqes);
+    ring->buffers = malloc(ring->entries * sizeof (struct statx));
+    if (ring->buffers == NULL)
+        goto error;
+    return ring;
+
+error:
+    uring_close(ring);
+    return NULL;
+}
+
+static void uring_close(struct uring *ring)
+{
+    if (ring == NULL)
+        return;
+    if (ring->sqes != NULL && ring->sqes != MAP_FAILED)
+        munmap(ring->sqes, ring->sqes_size);
+    if (ring->cq_ring != NULL && ring->cq_ring != MAP_FAILED && ring->cq_ring != ring->sq_ring)
+        munmap(ring->cq_ring, ring->cq_size);
+    if (ring->sq_ring != NULL && ring->sq_ring != MAP_FAILED)
+        munmap(ring->sq_ring, ring->sq_size);
+    close(ring->fd);
+    free(ring->buffers);
+    free(ring);
+}
+
+/*
+ * Submit the lookups to the ring of engine, a ring-full at a time, and wait
+ * for each ring-full to complete before submitting the next.
+ */
+static size_t uring_run(struct cs_stat_engine *engine, int dirfd, const char *const *paths,
+                        size_t count, int flags, struct cs_stat *results)
+{
+    struct uring *ring = engine->ring;
+    size_t base, ok = 0;
+
+    for (base = 0; base < count; base += ring->entries) {
+        unsigned n = count - base < ring->entries ? count - base : ring->entries;
+        unsigned tail = *ring->sq_tail;
+        unsigned done = 0, i;
+        size_t ok_batch = 0;
+
+        for (i = 0; i < n; i++) {
+            unsigned index = (tail + i) & *ring->sq_mask;
+            struct io_uring_sqe *sqe = &ring->sqes[index];
+
+            memset(sqe, 0, sizeof *sqe);
+            sqe->opcode = IORING_OP_STATX;
+            sqe->fd = dirfd;
+            sqe->addr = (uintptr_t)paths[base + i];
+            sqe->len = STATX_BASIC_STATS;
+            sqe->off = (uintptr_t)&ring->buffers[i];
+            sqe->statx_flags = flags;
+            sqe->user_data = i;
+            ring->sq_array[index] = index;
+            results[base + i].error = EINPROGRESS;
+        }
+        __atomic_store_n(ring->sq_tail, tail + n, __ATOMIC_RELEASE);
+
+        /*
+         * Submit everything, then keep waiting until everything is back. If the
+         * kernel is short of resources (EAGAIN) or of room for completions
+         * (EBUSY), wait for a request in flight to complete and try again.
+         */
+        unsigned submit = n, stalls = 0;
+        while (done < n) {
+            bool drain = stalls > 0 && n - submit - done > 0;
+            long retval = syscall(__NR_io_uring_enter, ring->fd, drain ? 0 : submit,
+                                  drain ? 1 : n - done, IORING_ENTER_GETEVENTS, NULL, 0);
+            if (retval < 0 && (errno == EAGAIN || errno == EBUSY) && stalls < URING_STALLS) {
+                stalls++;
+            } else if (retval < 0 && errno != EINTR) {
+                /*
+                 * The ring is unusable, so close it for good, lest later calls read
+                 * completions of this one, and look up the rest ourselves: the files
+                 * of this batch that are still marked as pending, and all after it.
+                 * Requests still in flight may yet write to the buffers, so those
+                 * are left to leak rather than freed under the kernel.
+                 */
+                struct stat_job job = { dirfd, paths, flags, results, 0 };
+                if (n - submit - done > 0)
+                    ring->buffers = NULL;
+                uring_close(ring);
+                engine->ring = NULL;
+                for (i = 0; i < n; i++)
+                    if (results[base + i].error == EINPROGRESS)
+                        stat_range(base + i, base + i + 1, &job);
+                stat_range(base + n, count, &job);
+                return ok + ok_batch + job.ok;
+            }
+            if (retval >= 0)
+                stalls = 0;
+            if (retval > 0)
+                submit -= retval < submit ? retval : submit;
+
+            unsigned head = *ring->cq_head;
+            unsigned cq_tail = __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE);
+            for (; head != cq_tail; head++, done++) {
+                const struct io_uring_cqe *cqe = &ring->cqes[head & *ring->cq_mask];
+                struct cs_stat *result = &results[base + cqe->user_data];
+                if (cqe->res < 0) {
+                    result->error = -cqe->res;
+                } else {
+                    from_statx(&ring->buffers[cqe->user_data], result);
+                    ok_batch++;
+                }
+            }
+            __atomic_store_n(ring->cq_head, head, __ATOMIC_RELEASE);
+        }
+        ok += ok_batch;
+    }
+    return ok;
+}
+
+static void from_statx(const struct statx *stx, struct cs_stat *result)
+{
+    result->error = 0;
+    result->dev = makedev(stx->stx_dev_major, stx->stx_dev_minor);
+    result->ino = stx->stx_ino;
+    result->mode = stx->stx_mode;
+    result->nlink = stx->stx_nlink;
+    result->size = stx->stx_size;
+    result->blocks = stx->stx_blocks;
+    result->mtime = stx->stx_mtime.tv_sec;
+    result->mtime_nsec = stx->stx_mtime.tv_nsec;
+}
+#endif
@@ -0,0 +1,140 @@
+/*
+ * libcassava/stat_batch.h
+ * vim: set cin ts=4 sw=4 et cc=80:
+ *
+ * Copyright (c) 2012 Ben Morgan <neembi@googlemail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION
+ * OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/**
+ * \file
+ * Looking up the metadata of many files at once.
+ *
+ * Calling stat() for one file after the other spends most of the time
+ * waiting, especially on network file systems and with cold caches. A
+ * struct cs_stat_engine instead has many lookups in flight at the same time:
+ * on Linux it submits them as statx requests to an io_uring, otherwise (or if
+ * the kernel does not allow it) it spreads them over a number of threads.
+ *
+ * <b>Example Usage:</b>
+ * \code
+ *     const char *paths[] = { "/etc/passwd", "/etc/group", "/nonexistent" };
+ *     struct cs_stat results[3];
+ *     cs_stat_batch(AT_FDCWD, paths, 3, 0, results);
+ *     for (int i = 0; i < 3; i++)
+ *         if (results[i].error == 0)
+ *             printf("%s: %lld bytes\n", paths[i], (long long)results[i].size);
+ * \endcode
+ *
+ * \author Ben Morgan
+ * \date 17. October 2026
+ */
+
+#ifndef LIBCASSAVA_STAT_BATCH_H
+#define LIBCASSAVA_STAT_BATCH_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <sys/types.h>
+#include <time.h>
+
+/** Default number of lookups an engine keeps in flight. */
+#define CS_STAT_DEPTH 256
+
+/**
+ * The result of looking up one file.
+ *
+ * \param error  0 on success, otherwise the \c errno value of the failed
+ *               lookup, in which case the other fields are undefined.
+ */
+struct cs_stat {
+    int error;
+    dev_t dev;
+    ino_t ino;
+    mode_t mode;
+    nlink_t nlink;
+    off_t size;
+    unsigned long long blocks;
+    time_t mtime;
+    long mtime_nsec;
+};
+
+/**
+ * Looks up metadata of files in batches; see stat_batch.h.
+ */
+struct cs_stat_engine;
+
+/**
+ * Create a new engine.
+ *
+ * \param depth Number of lookups to keep in flight, 0 for CS_STAT_DEPTH.
+ * \param uring Whether to try io_uring at all; if false, or if io_uring is not
+ *              available, a pool of threads is used instead.
+ * \return Newly allocated engine, to be freed with cs_stat_engine_free(), or
+ *         NULL if out of memory.
+ */
+extern struct cs_stat_engine *cs_stat_engine_new(unsigned depth, bool uring);
+
+/**
+ * Returns true if \a engine submits its lookups to an io_uring.
+ */
+extern bool cs_stat_engine_uring(const struct cs_stat_engine *engine);
+
+/**
+ * Look up the metadata of \a count files.
+ *
+ * An engine may only be used by one thread at a time.
+ *
+ * \param engine  Engine to use.
+ * \param dirfd   Directory that relative \a paths are relative to, as for
+ *                fstatat(); \c AT_FDCWD for the working directory.
+ * \param paths   Paths of the files.
+ * \param count   Number of \a paths.
+ * \param flags   0 or \c AT_SYMLINK_NOFOLLOW.
+ * \param results Array of \a count results, which are filled in.
+ * \return Number of files that could be looked up successfully.
+ */
+extern size_t cs_stat_engine_run(struct cs_stat_engine *engine,
+                                 int dirfd,
+                                 const char *const *paths,
+                                 size_t count,
+                                 int flags,
+                                 struct cs_stat *results);
+
+/**
+ * Free an engine.
+ */
+extern void cs_stat_engine_free(struct cs_stat_engine *engine);
+
+/**
+ * Look up the metadata of \a count files with a temporary engine.
+ * See cs_stat_engine_run() for the parameters.
+ */
+extern size_t cs_stat_batch(int dirfd,
+                            const char *const *paths,
+                            size_t count,
+                            int flags,
+                            struct cs_stat *results);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* LIBCASSAVA_STAT_BATCH_H */
@@ -0,0 +1,378 @@
+/*
+ * libcassava/strset.c
+ * vim: set cin ts=4 sw=4 et cc=100:
+ *
+ * Copyright (c) 2012 Ben Morgan <neembi@googlemail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#define _GNU_SOURCE
+
+#include "strset.h"
+#include "hash.h"
+
+#include <assert.h>
+#include <stdint.h>
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+/* Number of slots whose control bytes are compared at once. */
+#define GROUP 16
+
+/* Control bytes of slots that are not in use; those in use hold 7 bits of the hash. */
+#define CTRL_EMPTY   0x80
+#define CTRL_DELETED 0xfe
+
+#define HASH_SEED 0x9e3779b97f4a7c15ULL
+
+struct slot {
+    const char *key;
+    size_t len;
+    uint64_t hash;
+    void *value;
+};
+
+/*
+ * There are groups * GROUP slots, and as many control bytes, which are
+ * aligned so that a group of them can be loaded at once. Slots are used
+ * until only an eighth of them is empty, counting deleted ones as used, so
+ * that a lookup meets an empty slot soon.
+ */
+struct cs_strset {
+    unsigned char *ctrl;
+    struct slot *slots;
+    size_t groups;
+    size_t size;
+    size_t used;
+    struct cs_arena *arena;
+};
+
+static int resize(struct cs_strset *set, size_t groups);
+static size_t groups_for(size_t count);
+static unsigned match_byte(const unsigned char *ctrl, unsigned char byte);
+static unsigned match_free(const unsigned char *ctrl);
+static struct slot *lookup(const struct cs_strset *set, const char *key, size_t len,
+                           uint64_t hash);
+static size_t free_slot(const struct cs_strset *set, uint64_t hash);
+static int insert(struct cs_strset *set, const char *key, size_t len, void *value,
+                  struct slot **found);
+
+struct cs_strset *cs_strset_new(size_t expected, struct cs_arena *arena)
+{
+    struct cs_strset *set = calloc(1, sizeof (struct cs_strset));
+    if (set == NULL)
+        return NULL;
+
+    set->arena = arena;
+    if (resize(set, groups_for(expected)) < 0) {
+        free(set);
+        return NULL;
+    }
+    return set;
+}
+
+void cs_strset_free(struct cs_strset *set)
+{
+    if (set == NULL)
+        return;
+
+    free(set->ctrl);
+    free(set->slots);
+    free(set);
+}
+
+size_t cs_strset_size(const struct cs_strset *set)
+{
+    assert(set != NULL);
+
+    return set->size;
+}
+
+int cs_strset_add(struct cs_strset *set, const char *key, size_t len, void *value)
+{
+    struct slot *slot;
+
+    return insert(set, key, len, value, &slot);
+}
+
+const char *cs_strset_find(const struct cs_strset *set, const char *key, size_t len,
+                           void **value)
+{
+    assert(set != NULL);
+    assert(key != NULL || len == 0);
+
+    struct slot *slot = lookup(set, key, len, cs_hash64(key, len, HASH_SEED));
+    if (slot == NULL)
+        return NULL;
+    if (value != NULL)
+        *value = slot->value;
+    return slot->key;
+}
+
+bool cs_strset_contains(const struct cs_strset *set, const char *key, size_t len)
+{
+    return cs_strset_find(set, key, len, NULL) != NULL;
+}
+
+int cs_strset_put(struct cs_strset *set, const char *key, size_t len, void *value)
+{
+    struct slot *slot;
+
+    int retval = insert(set, key, len, value, &slot);
+    if (retval < 0)
+        return -1;
+    slot->value = value;
+    return 0;
+}
+
+bool cs_strset_remove(struct cs_strset *set, const char *key, size_t len, void **value)
+{
+    assert(set != NULL);
+    assert(key != NULL || len == 0);
+
+    struct slot *slot = lookup(set, key, len, cs_hash64(key, len, HASH_SEED));
+    if (slot == NULL)
+        return false;
+    if (value != NULL)
+        *value = slot->value;
+
+    /*
+     * A slot in a group with an empty slot can become empty again, since no
+     * lookup can have gone on past that group. Otherwise it is marked as
+     * deleted, so that lookups do go on.
+     */
+    size_t index = slot - set->slots;
+    unsigned char *group = set->ctrl + index / GROUP * GROUP;
+    if (match_byte(group, CTRL_EMPTY) != 0) {
+        set->ctrl[index] = CTRL_EMPTY;
+        set->used--;
+    } else {
+        set->ctrl[index] = CTRL_DELETED;
+    }
+    set->size--;
+    return true;
+}
+
+bool cs_strset_next(const struct cs_strset *set, size_t *pos, const char **key, void **value)
+{
+    assert(set != NULL);
+    assert(pos != NULL);
+    assert(key != NULL);
+
+    size_t count = set->groups * GROUP;
+    for (; *pos < count; (*pos)++) {
+        if (set->ctrl[*pos] & 0x80)
+            continue;
+        *key = set->slots[*pos].key;
+        if (value != NULL)
+            *value = set->slots[*pos].value;
+        (*pos)++;
+        return true;
+    }
+    return false;
+}
+
+long cs_strset_add_list(struct cs_strset *set, const NodeStr *head)
+{
+    assert(set != NULL);
+
+    const NodeStr *node;
+    long count = 0;
+
+    for (node = head; node != NULL; node = node->next) {
+        int retval = cs_strset_add(set, node->data, strlen(node->data), NULL);
+        if (retval < 0)
+            return -1;
+        count += retval;
+    }
+    return count;
+}
+
+/*
+ * Add key unless it is in the set already, and set found to its slot.
+ * Returns the same as cs_strset_add().
+ */
+static int insert(struct cs_strset *set, const char *key, size_t len, void *value,
+                  struct slot **found)
+{
+    assert(set != NULL);
+    assert(key != NULL || len == 0);
+
+    uint64_t hash = cs_hash64(key, len, HASH_SEED);
+    struct slot *slot = lookup(set, key, len, hash);
+    if (slot != NULL) {
+        *found = slot;
+        return 0;
+    }
+
+    size_t index = free_slot(set, hash);
+    if (set->ctrl[index] == CTRL_EMPTY && set->used + 1 > set->groups * GROUP / 8 * 7) {
+        /* Only grow if the table is getting full, not just full of deleted slots. */
+        size_t groups = groups_for(set->size + 1);
+        if (resize(set, groups > set->groups ? groups : set->groups) < 0)
+            return -1;
+        index = free_slot(set, hash);
+    }
+
+    if (set->arena != NULL) {
+        key = cs_arena_strndup(set->arena, key, len);
+        if (key == NULL)
+            return -1;
+    }
+
+    if (set->ctrl[index] == CTRL_EMPTY)
+        set->used++;
+    set->ctrl[index] = hash & 0x7f;
+    slot = &set->slots[index];
+    slot->key = key;
+    slot->len = len;
+    slot->hash = hash;
+    slot->value = value;
+    set->size++;
+    *found = slot;
+    return 1;
+}
+
+/*
+ * Returns the slot of key, or NULL if it is not in the set.
+ *
+ * Groups are probed in the order 0, 1, 3, 6, ... from the first, which
+ * reaches all of them if their number is a power of two. A group with an
+ * empty slot ends the search, since key would have been put there.
+ */
+static struct slot *lookup(const struct cs_strset *set, const char *key, size_t len,
+                           uint64_t hash)
+{
+    size_t mask = set->groups - 1, group = (hash >> 7) & mask, step;
+    unsigned char tag = hash & 0x7f;
+
+    for (step = 1; step <= set->groups; step++) {
+        const unsigned char *ctrl = set->ctrl + group * GROUP;
+        unsigned matches = match_byte(ctrl, tag);
+        while (matches != 0) {
+            struct slot *slot = &set->slots[group * GROUP + __builtin_ctz(matches)];
+            if (slot->hash == hash && slot->len == len && memcmp(slot->key, key, len) == 0)
+                return slot;
+            matches &= matches - 1;
+        }
+        if (match_byte(ctrl, CTRL_EMPTY) != 0)
+            return NULL;
+        group = (group + step) & mask;
+    }
+    return NULL;
+}
+
+/*
+ * Returns the index of the first empty or deleted slot on the way of a
+ * lookup for hash. There always is one, since the table is never full.
+ */
+static size_t free_slot(const struct cs_strset *set, uint64_t hash)
+{
+    size_t mask = set->groups - 1, group = (hash >> 7) & mask, step;
+
+    for (step = 1;; step++) {
+        unsigned matches = match_free(set->ctrl + group * GROUP);
+        if (matches != 0)
+            return group * GROUP + __builtin_ctz(matches);
+        group = (group + step) & mask;
+    }
+}
+
+/*
+ * Put all strings into new tables of the given number of groups, which
+ * leaves no deleted slots. The hashes are kept, so no string is read.
+ */
+static int resize(struct cs_strset *set, size_t groups)
+{
+    unsigned char *old_ctrl = set->ctrl;
+    struct slot *old_slots = set->slots;
+    size_t old_count = set->groups * GROUP, i;
+    void *memory;
+
+    if (posix_memalign(&memory, GROUP, groups * GROUP) != 0)
+        return -1;
+    set->slots = malloc(groups * GROUP * sizeof (struct slot));
+    if (set->slots == NULL) {
+        free(memory);
+        set->slots = old_slots;
+        return -1;
+    }
+    set->ctrl = memory;
+    memset(set->ctrl, CTRL_EMPTY, groups * GROUP);
+    set->groups = groups;
+    set->used = set->size;
+
+    for (i = 0; i < old_count; i++) {
+        if (old_ctrl[i] & 0x80)
+            continue;
+        size_t index = free_slot(set, old_slots[i].hash);
+        set->ctrl[index] = old_ctrl[i];
+        set->slots[index] = old_slots[i];
+    }
+
+    free(old_ctrl);
+    free(old_slots);
+    return 0;
+}
+
+/*
+ * Returns the smallest power of two of groups that holds count strings
+ * without filling more than seven eighths of the slots.
+ */
+static size_t groups_for(size_t count)
+{
+    size_t groups = 1;
+
+    while (groups * GROUP / 8 * 7 < count)
+        groups *= 2;
+    return groups;
+}
+
+/*
+ * Returns a bit mask of the control bytes of the group at ctrl that are
+ * equal to byte.
+ */
+static unsigned match_byte(const unsigned char *ctrl, unsigned char byte)
+{
+#ifdef __SSE2__
+    __m128i group = _mm_load_si128((const __m128i *)ctrl);
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(group, _mm_set1_epi8((char)byte)));
+#else
+    unsigned mask = 0, i;
+    for (i = 0; i < GROUP; i++)
+        if (ctrl[i] == byte)
+            mask |= 1u << i;
+    return mask;
+#endif
+}
+
+/*
+ * Returns a bit mask of the slots of the group at ctrl that are empty or
+ * deleted, which are the control bytes with the high bit set.
+ */
+static unsigned match_free(const unsigned char *ctrl)
+{
+#ifdef __SSE2__
+    return _mm_movemask_epi8(_mm_load_si128((const __m128i *)ctrl));
+#else
+    unsigned mask = 0, i;
+    for (i = 0; i < GROUP; i++)
+        if (ctrl[i] & 0x80)
+            mask |= 1u << i;
+    return mask;
+#endif
+}
@@ -0,0 +1,182 @@
+/*
+ * libcassava/strset.h
+ * vim: set cin ts=4 sw=4 et cc=80:
+ *
+ * Copyright (c) 2012 Ben Morgan <neembi@googlemail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION
+ * OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/**
+ * \file
+ * Hash sets of strings, which can also map every string to a pointer.
+ *
+ * Finding a string in a list with list_search() compares it to every
+ * string of the list, so testing many strings against a list takes time in
+ * proportion to the product of their numbers. A set finds a string in
+ * constant time on average.
+ *
+ * The set is a hash table with open addressing, laid out like the Swiss
+ * tables of Abseil: the slots are split into groups of 16, and every slot
+ * has a control byte with 7 bits of the hash of its string. A lookup loads
+ * the 16 control bytes of a group at once with SSE2 and compares them all to
+ * the hash of the string it is looking for, so that strings are only
+ * compared where the 7 bits match, which is rarely more than once. Without
+ * SSE2, the control bytes are compared one by one. Strings are hashed with
+ * cs_hash64().
+ *
+ * Strings are passed with their length and need not be terminated by
+ * \c '\0'. If the set is given an arena, the strings added are copied into
+ * it, terminated by \c '\0'; otherwise the set only keeps pointers to them,
+ * so they must not change or be freed while they are in the set.
+ *
+ * <b>Example Usage:</b>
+ * \code
+ *     struct cs_arena *arena = cs_arena_new(0);
+ *     struct cs_strset *set = cs_strset_new(0, arena);
+ *     NodeStr *head;
+ *     get_filenames("/usr/include", &head);
+ *     cs_strset_add_list(set, head);
+ *     if (cs_strset_contains(set, "stdio.h", 7))
+ *         puts("found it");
+ *     cs_strset_free(set);
+ *     cs_arena_free(arena);
+ * \endcode
+ *
+ * \author Ben Morgan
+ * \date 17. October 2026
+ */
+
+#ifndef LIBCASSAVA_STRSET_H
+#define LIBCASSAVA_STRSET_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+#include <stdbool.h>
+#include <stdlib.h>
+
+#include "arena.h"
+#include "list_str.h"
+
+/**
+ * \struct cs_strset
+ *
+ * A set of strings, each with a pointer as its value.
+ */
+struct cs_strset;
+
+/**
+ * Returns a new empty set, or \c NULL if out of memory.
+ *
+ * \param expected Number of strings to make room for, so that the set need
+ *                 not grow until then; may be 0.
+ * \param arena    Arena to copy the strings added into, or \c NULL to keep
+ *                 pointers to the strings given.
+ */
+extern struct cs_strset *cs_strset_new(size_t expected, struct cs_arena *arena);
+
+/**
+ * Free a set, but neither the strings nor the values in it.
+ */
+extern void cs_strset_free(struct cs_strset *set);
+
+/**
+ * Returns the number of strings in the set.
+ */
+extern size_t cs_strset_size(const struct cs_strset *set);
+
+/**
+ * Add the string \a key of length \a len with \a value to the set, unless
+ * it is in the set already, in which case its value is left alone.
+ *
+ * \return 1 if the string was added, 0 if it was in the set already, and
+ *         -1 if out of memory.
+ */
+extern int cs_strset_add(struct cs_strset *set, const char *key, size_t len,
+                         void *value);
+
+/**
+ * Find the string \a key of length \a len in the set.
+ *
+ * \param value Set to the value of the string if it is found; may be
+ *              \c NULL.
+ * \return The string as it is kept in the set, or \c NULL if it is not in
+ *         the set.
+ */
+extern const char *cs_strset_find(const struct cs_strset *set,
+                                  const char *key, size_t len, void **value);
+
+/**
+ * Returns true if the string \a key of length \a len is in the set.
+ */
+extern bool cs_strset_contains(const struct cs_strset *set, const char *key,
+                               size_t len);
+
+/**
+ * Set the value of the string \a key of length \a len, adding the string
+ * if it is not in the set yet.
+ *
+ * \return 0 on success, -1 if out of memory.
+ */
+extern int cs_strset_put(struct cs_strset *set, const char *key, size_t len,
+                         void *value);
+
+/**
+ * Remove the string \a key of length \a len from the set. A copy of it in
+ * the arena of the set is only freed with the arena.
+ *
+ * \param value Set to the value of the string if it was in the set; may be
+ *              \c NULL.
+ * \return true if the string was in the set.
+ */
+extern bool cs_strset_remove(struct cs_strset *set, const char *key,
+                             size_t len, void **value);
+
+/**
+ * Go through all strings in the set, in no particular order. The set must
+ * not change in the meantime.
+ *
+ * \b Example:
+ * \code
+ *     size_t pos = 0;
+ *     const char *key;
+ *     while (cs_strset_next(set, &pos, &key, NULL))
+ *         puts(key);
+ * \endcode
+ *
+ * \param pos   Where to continue, 0 at first.
+ * \param key   Set to the next string.
+ * \param value Set to its value; may be \c NULL.
+ * \return false if there are no more strings.
+ */
+extern bool cs_strset_next(const struct cs_strset *set, size_t *pos,
+                           const char **key, void **value);
+
+/**
+ * Add all strings of a list to the set, with \c NULL as their values. If
+ * the set has no arena, the list must outlive the set.
+ *
+ * \return The number of strings added, which were not in the set yet, or
+ *         -1 if out of memory.
+ */
+extern long cs_strset_add_list(struct cs_strset *set, const NodeStr *head);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* LIBCASSAVA_STRSET_H */
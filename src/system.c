@@ -17,24 +17,91 @@
  * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
  */
 
+#define _GNU_SOURCE
+
 #include "system.h"
 
 #include <dirent.h>
-#include <libgen.h>
+#include <errno.h>
+#include <fcntl.h>
 #include <regex.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/ioctl.h>
 #include <sys/stat.h>
 #include <unistd.h>
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
 
+#include "arena.h"
+#include "globset.h"
 #include "list.h"
 #include "list_str.h"
+#include "path.h"
+#include "regex_cache.h"
+#include "stat_batch.h"
 #include "string.h"
 
-static inline int isdir(const char *path);
+#ifdef __linux__
+/*
+ * The record returned by getdents64(2); glibc does not export it.
+ */
+struct linux_dirent64 {
+    uint64_t d_ino;
+    int64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[];
+};
+#endif
+
+/*
+ * The entry that visit_directory() is passing to a visitor at the
+ * moment in this thread; see cs_dir_current().
+ */
+struct dir_context {
+    const void *data;
+    int dirfd;
+    const struct cs_dirent *entry;
+};
+
+static __thread struct dir_context filtering;
+
+/*
+ * State of append_entry() while a directory is read into a list.
+ */
+struct list_builder {
+    NodeStr **head;
+    NodeStr *tail;
+    int count;
+    bool (*filter)(void *, void *);
+    void *arguments;
+    struct cs_arena *arena;
+};
+
+static int file_type(const char *filepath);
+static int visit_directory(int dirfd,
+                           const char *path,
+                           bool full_pathnames,
+                           cs_dir_visitor visit,
+                           void *arg);
+static int append_entry(const char *data,
+                        size_t len,
+                        const struct cs_dirent *entry,
+                        void *arg);
+static int read_directory_filter(int dirfd,
+                                 const char *path,
+                                 NodeStr **head,
+                                 bool full_pathnames,
+                                 bool (*filter)(void *, void *),
+                                 void *arguments,
+                                 struct cs_arena *arena);
+static struct cs_dir *cs_dir_new(int fd);
+static const char *view_string(char *buffer, struct cs_path_view view);
 
 int get_filenames(const char *path, NodeStr **head)
 {
@@ -50,20 +117,14 @@ int get_filenames_filter(const char *path, NodeStr **head, bool (*filter)(void *
 {
     assert(filter != NULL);
 
-    int count = get_filenames(path, head);
-    if (count > 0)
-        count = list_filter(head, filter, arguments);
-    return count;
+    return read_directory_filter(AT_FDCWD, path, head, false, filter, arguments, NULL);
 }
 
 int get_filepaths_filter(const char *path, NodeStr **head, bool (*filter)(void *path, void *arguments), void *arguments)
 {
     assert(filter != NULL);
 
-    int count = get_filepaths(path, head);
-    if (count > 0)
-        count = list_filter(head, filter, arguments);
-    return count;
+    return read_directory_filter(AT_FDCWD, path, head, true, filter, arguments, NULL);
 }
 
 int get_filepaths_filter_regex(const char *path, NodeStr **head, const char *regex)
@@ -76,6 +137,16 @@ int get_filenames_filter_regex(const char *path, NodeStr **head, const char *reg
     return read_directory_filter_regex(path, head, regex, false);
 }
 
+int get_filepaths_filter_glob(const char *path, NodeStr **head, const char *pattern)
+{
+    return read_directory_filter_glob(path, head, pattern, true);
+}
+
+int get_filenames_filter_glob(const char *path, NodeStr **head, const char *pattern)
+{
+    return read_directory_filter_glob(path, head, pattern, false);
+}
+
 unsigned short get_terminal_columns()
 {
     struct winsize w;
@@ -85,91 +156,216 @@ unsigned short get_terminal_columns()
 
 const char *cs_basename(const char *path)
 {
-    static char buffer[BUFSIZ];
-    strncpy(buffer, path, BUFSIZ);
+    static __thread char buffer[BUFSIZ];
 
-    return basename(buffer);
+    if (path == NULL)
+        return ".";
+    return view_string(buffer, cs_path_base(path, strlen(path)));
 }
 
 const char *cs_dirname(const char *path)
 {
-    static char buffer[BUFSIZ];
-    strncpy(buffer, path, BUFSIZ);
+    static __thread char buffer[BUFSIZ];
 
-    return dirname(buffer);
+    if (path == NULL)
+        return ".";
+    return view_string(buffer, cs_path_dir(path, strlen(path)));
 }
 
-int read_directory(const char *path, NodeStr **head, bool full_pathnames)
+struct cs_dir *cs_dir_open(const char *path)
 {
     assert(path != NULL);
-    assert(head != NULL);
 
-    /* Initialize head and count. */
-    *head = NULL;
-    int count = 0;
+    return cs_dir_new(open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC));
+}
 
-    /* Open dir specified by path. */
-    DIR *dp = opendir(path);
-    if (dp == NULL) goto error;
+struct cs_dir *cs_dir_openat(int dirfd, const char *name)
+{
+    assert(name != NULL);
 
-    /* Append directory entries into linked list. */
-    struct dirent *entry;
-    NodeStr *current = NULL;
-    bool trail = (*(path+strlen(path)-1) == '/');
-    while ((entry = readdir(dp)) != NULL) {
-        NodeStr *new = list_node();
-        if (full_pathnames)
-            new->data = cs_strvcat(path, trail ? "" : "/", entry->d_name, NULL);
-        else
-            new->data = cs_strclone(entry->d_name);
+    return cs_dir_new(openat(dirfd, name, O_RDONLY | O_DIRECTORY | O_CLOEXEC));
+}
 
-        if (current == NULL) {
-            *head = current = new;
-        } else {
-            current->next = new;
-            current = current->next;
+void cs_dir_init(struct cs_dir *dir, int fd, char *buffer, size_t size)
+{
+    assert(dir != NULL);
+    assert(buffer != NULL);
+
+    dir->fd = fd;
+    dir->buffer = buffer;
+    dir->size = size;
+    dir->pos = dir->end = 0;
+    dir->owner = false;
+    dir->stream = NULL;
+}
+
+int cs_dir_read(struct cs_dir *dir, struct cs_dirent *entry)
+{
+    assert(dir != NULL);
+    assert(entry != NULL);
+
+#ifdef __linux__
+    const struct linux_dirent64 *d;
+
+    if (dir->pos >= dir->end) {
+        long n = syscall(SYS_getdents64, dir->fd, dir->buffer, dir->size);
+        if (n <= 0)
+            return n == 0 ? 0 : -1;
+        dir->pos = 0;
+        dir->end = n;
+    }
+
+    d = (const struct linux_dirent64 *)(dir->buffer + dir->pos);
+    dir->pos += d->d_reclen;
+    entry->name = d->d_name;
+    entry->len = strlen(d->d_name);
+    entry->type = d->d_type;
+    entry->ino = d->d_ino;
+    return 1;
+#else
+    struct dirent *d;
+
+    if (dir->stream == NULL) {
+        int fd = dup(dir->fd);
+        if (fd < 0)
+            return -1;
+        if ((dir->stream = fdopendir(fd)) == NULL) {
+            close(fd);
+            return -1;
         }
-        ++count;
     }
 
-    closedir(dp);
+    errno = 0;
+    if ((d = readdir(dir->stream)) == NULL)
+        return errno == 0 ? 0 : -1;
+    entry->name = d->d_name;
+    entry->len = strlen(d->d_name);
+    entry->type = d->d_type;
+    entry->ino = d->d_ino;
+    return 1;
+#endif
+}
+
+void cs_dir_close(struct cs_dir *dir)
+{
+    if (dir == NULL)
+        return;
+#ifndef __linux__
+    if (dir->stream != NULL)
+        closedir(dir->stream);
+#endif
+    if (dir->owner) {
+        close(dir->fd);
+        free(dir);
+    }
+}
+
+int read_directory(const char *path, NodeStr **head, bool full_pathnames)
+{
+    return read_directory_filter(AT_FDCWD, path, head, full_pathnames, NULL, NULL, NULL);
+}
+
+int read_directory_arena(const char *path, NodeStr **head, bool full_pathnames,
+                         bool (*filter)(void *, void *), void *arguments, struct cs_arena *arena)
+{
+    assert(arena != NULL);
+
+    return read_directory_filter(AT_FDCWD, path, head, full_pathnames, filter, arguments, arena);
+}
+
+int get_filenames_arena(const char *path, NodeStr **head, struct cs_arena *arena)
+{
+    return read_directory_arena(path, head, false, NULL, NULL, arena);
+}
+
+int get_filepaths_arena(const char *path, NodeStr **head, struct cs_arena *arena)
+{
+    return read_directory_arena(path, head, true, NULL, NULL, arena);
+}
+
+int read_directory_foreach(const char *path, bool full_pathnames, cs_dir_visitor visit, void *arg)
+{
+    int count = visit_directory(AT_FDCWD, path, full_pathnames, visit, arg);
+    if (count < 0)
+        perror("Error (read_directory_foreach)");
     return count;
+}
 
-error:
-    perror("Error (read_directory)");
-    return -1;
+int read_directory_foreach_at(int dirfd, const char *path, cs_dir_visitor visit, void *arg)
+{
+    int count = visit_directory(dirfd, path, false, visit, arg);
+    if (count < 0)
+        perror("Error (read_directory_foreach_at)");
+    return count;
+}
+
+int get_filenames_at(int dirfd, const char *path, NodeStr **head)
+{
+    return read_directory_filter(dirfd, path, head, false, NULL, NULL, NULL);
+}
+
+int foreach_filename(const char *path, cs_dir_visitor visit, void *arg)
+{
+    return read_directory_foreach(path, false, visit, arg);
+}
+
+int foreach_filepath(const char *path, cs_dir_visitor visit, void *arg)
+{
+    return read_directory_foreach(path, true, visit, arg);
 }
 
 int read_directory_filter_regex(const char *path, NodeStr **head, const char *regex, bool full_pathnames)
 {
     assert(regex != NULL);
 
+    const struct cs_regex *compiled = cs_regex_get(regex, REG_EXTENDED | REG_NOSUB);
+    if (compiled == NULL)
+        return -1;
+
     int retval;
-    struct filter_regex_args args;
-    int errcode = regcomp(&args.preg, regex, REG_EXTENDED);
-    if (errcode != 0) {
-        char errbuf[BUFSIZ];
-        regerror(errcode, &args.preg, errbuf, sizeof errbuf);
-        fprintf(stderr, "Error (regcomp): %s\n", errbuf);
-        retval = -1;
-        goto finally;
-    }
+    if (full_pathnames)
+        retval = get_filepaths_filter(path, head, filter_regex_cached, (void *)compiled);
+    else
+        retval = get_filenames_filter(path, head, filter_regex_cached, (void *)compiled);
+
+    cs_regex_release(compiled);
+    return retval;
+}
 
+int read_directory_filter_glob(const char *path, NodeStr **head, const char *pattern, bool full_pathnames)
+{
+    assert(pattern != NULL);
+
+    struct cs_glob *glob = cs_glob_new(pattern);
+    if (glob == NULL)
+        return -1;
+
+    int retval;
     if (full_pathnames)
-        retval = get_filepaths_filter(path, head, filter_regex, (void *)&args);
+        retval = get_filepaths_filter(path, head, filter_glob, glob);
     else
-        retval = get_filenames_filter(path, head, filter_regex, (void *)&args);
+        retval = get_filenames_filter(path, head, filter_glob, glob);
 
-finally:
-    regfree(&args.preg);
+    cs_glob_free(glob);
     return retval;
 }
 
+bool cs_dir_current(const void *data, int *dirfd, const struct cs_dirent **entry)
+{
+    if (data == NULL || data != filtering.data)
+        return false;
+    if (dirfd != NULL)
+        *dirfd = filtering.dirfd;
+    if (entry != NULL)
+        *entry = filtering.entry;
+    return true;
+}
+
 #pragma GCC diagnostic push
 #pragma GCC diagnostic ignored "-Wunused-parameter"
 bool filter_isdir(void *filepath, void *unused)
 {
-    return isdir(filepath) == 1;
+    return file_type(filepath) == DT_DIR;
 }
 #pragma GCC diagnostic pop
 
@@ -177,7 +373,7 @@ bool filter_isdir(void *filepath, void *unused)
 #pragma GCC diagnostic ignored "-Wunused-parameter"
 bool filter_isreg(void *filepath, void *unused)
 {
-    return isdir(filepath) == 0;
+    return file_type(filepath) == DT_REG;
 }
 #pragma GCC diagnostic pop
 
@@ -200,20 +396,521 @@ bool filter_mtime(void *filepath, void *arguments)
         return (fstat.st_mtime == args->time);
 }
 
+long list_filter_mtime(NodeStr **head, const struct filter_time_args *args)
+{
+    assert(head != NULL);
+    assert(args != NULL);
+
+    size_t count = list_length((struct list_node *)*head);
+    if (count == 0)
+        return 0;
+
+    const char **paths = malloc(count * sizeof (char *));
+    struct cs_stat *results = malloc(count * sizeof (struct cs_stat));
+    NodeStr *iter;
+    size_t i = 0;
+    if (paths == NULL || results == NULL) {
+        perror("Error (list_filter_mtime)");
+        free(paths);
+        free(results);
+        return -1;
+    }
+    for (iter = *head; iter != NULL; iter = iter->next)
+        paths[i++] = iter->data;
+    cs_stat_batch(AT_FDCWD, paths, count, 0, results);
+
+    NodeStr *current = NULL;
+    size_t kept = 0;
+    iter = *head;
+    *head = NULL;
+    for (i = 0; iter != NULL; i++) {
+        NodeStr *next = iter->next;
+        bool keep = false;
+        if (results[i].error != 0) {
+            errno = results[i].error;
+            perror("Error (stat)");
+        } else if (args->comparison < 0) {
+            keep = results[i].mtime < args->time;
+        } else if (args->comparison > 0) {
+            keep = results[i].mtime > args->time;
+        } else {
+            keep = results[i].mtime == args->time;
+        }
+
+        if (keep) {
+            if (current == NULL)
+                *head = iter;
+            else
+                current->next = iter;
+            current = iter;
+            current->next = NULL;
+            kept++;
+        } else {
+            free(iter->data);
+            free(iter);
+        }
+        iter = next;
+    }
+
+    free(paths);
+    free(results);
+    return kept;
+}
+
+/*
+ * State of read_directory_top(): a heap of the k best files so far, with
+ * the worst of them at the root, and the names waiting to be looked up.
+ */
+struct top_heap {
+    size_t k;
+    enum cs_top_order order;
+    bool (*filter)(void *, void *);
+    void *arguments;
+
+    struct top_item *items;
+    size_t count;
+
+    struct cs_stat_engine *engine;
+    int dirfd;
+    char *names;
+    size_t names_used;
+    size_t names_size;
+    size_t offsets[CS_TOP_BATCH];
+    size_t pending;
+    struct cs_stat *results;
+};
+
+struct top_item {
+    int64_t key;
+    long nsec;
+    char *name;
+};
+
+static int top_visit(const char *data, size_t len, const struct cs_dirent *entry, void *arg);
+static int top_flush(struct top_heap *top);
+static int top_offer(struct top_heap *top, int64_t key, long nsec, const char *name);
+static int top_compare(const struct top_heap *top, const struct top_item *a,
+                       const struct top_item *b);
+static void top_sift_down(struct top_heap *top, size_t i, size_t count);
+
+int read_directory_top(const char *path, NodeStr **head, bool full_pathnames, size_t k,
+                       enum cs_top_order order, bool (*filter)(void *, void *), void *arguments)
+{
+    assert(path != NULL);
+    assert(head != NULL);
+
+    struct top_heap top = { k, order, filter, arguments, NULL, 0, NULL, -1, NULL, 0, 0, { 0 }, 0,
+                            NULL };
+    int retval = -1;
+    size_t i;
+
+    *head = NULL;
+    top.dirfd = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (top.dirfd < 0)
+        goto error;
+    if (k == 0) {
+        close(top.dirfd);
+        return 0;
+    }
+    top.items = malloc(k < CS_TOP_BATCH ? k * sizeof (struct top_item)
+                                        : CS_TOP_BATCH * sizeof (struct top_item));
+    top.results = malloc(CS_TOP_BATCH * sizeof (struct cs_stat));
+    top.names_size = 16 * CS_TOP_BATCH;
+    top.names = malloc(top.names_size);
+    if (top.items == NULL || top.results == NULL || top.names == NULL)
+        goto error;
+    /* Without an engine, top_flush() makes do with cs_stat_batch(). */
+    top.engine = cs_stat_engine_new(CS_STAT_DEPTH, true);
+
+    /* Read the directory that was opened, which is the one the entries are stat'd in. */
+    if (visit_directory(top.dirfd, ".", false, top_visit, &top) < 0 || top_flush(&top) != 0)
+        goto error;
+
+    /* Take the worst to the back until the items are in order. */
+    for (i = top.count; i > 1; i--) {
+        struct top_item worst = top.items[0];
+        top.items[0] = top.items[i-1];
+        top.items[i-1] = worst;
+        top_sift_down(&top, 0, i - 1);
+    }
+
+    size_t prefix = full_pathnames ? strlen(path) : 0;
+    bool slash = full_pathnames && (prefix == 0 || path[prefix-1] != '/');
+    NodeStr *tail = NULL;
+    for (i = 0; i < top.count; i++) {
+        size_t len = strlen(top.items[i].name);
+        NodeStr *node = list_node();
+        if (node == NULL || (node->data = malloc(prefix + slash + len + 1)) == NULL) {
+            free(node);
+            list_free_all((struct list_node **)head);
+            goto error;
+        }
+        memcpy(node->data, path, prefix);
+        if (slash)
+            node->data[prefix] = '/';
+        memcpy(node->data + prefix + slash, top.items[i].name, len + 1);
+        if (tail == NULL)
+            *head = node;
+        else
+            tail->next = node;
+        tail = node;
+    }
+    retval = top.count;
+    goto finally;
+
+error:
+    perror("Error (read_directory_top)");
+finally:
+    for (i = 0; i < top.count; i++)
+        free(top.items[i].name);
+    free(top.items);
+    free(top.results);
+    free(top.names);
+    cs_stat_engine_free(top.engine);
+    if (top.dirfd >= 0)
+        close(top.dirfd);
+    return retval;
+}
+
+int get_filepaths_newest(const char *path, NodeStr **head, size_t k)
+{
+    return read_directory_top(path, head, true, k, CS_TOP_NEWEST, NULL, NULL);
+}
+
+int get_filepaths_oldest(const char *path, NodeStr **head, size_t k)
+{
+    return read_directory_top(path, head, true, k, CS_TOP_OLDEST, NULL, NULL);
+}
+
+/**
+ * A cs_dir_visitor that queues every file accepted by the filter to be
+ * looked up, and looks up the queue when it is full. Returns -1 if out of
+ * memory.
+ */
+static int top_visit(const char *data, size_t len, const struct cs_dirent *entry, void *arg)
+{
+    struct top_heap *top = arg;
+
+    if (entry->type != DT_REG && entry->type != DT_UNKNOWN)
+        return 0;
+    if (top->filter != NULL && !top->filter((void *)data, top->arguments))
+        return 0;
+
+    if (top->names_used + len + 1 > top->names_size) {
+        size_t size = 2 * (top->names_used + len + 1);
+        char *names = realloc(top->names, size);
+        if (names == NULL)
+            return -1;
+        top->names = names;
+        top->names_size = size;
+    }
+    top->offsets[top->pending++] = top->names_used;
+    memcpy(top->names + top->names_used, data, len + 1);
+    top->names_used += len + 1;
+
+    if (top->pending == CS_TOP_BATCH)
+        return top_flush(top);
+    return 0;
+}
+
+/*
+ * Look up the queued names and offer them to the heap. Returns -1 if out of
+ * memory.
+ */
+static int top_flush(struct top_heap *top)
+{
+    const char *names[CS_TOP_BATCH];
+    size_t i;
+    int retval = 0;
+
+    for (i = 0; i < top->pending; i++)
+        names[i] = top->names + top->offsets[i];
+    if (top->engine != NULL)
+        cs_stat_engine_run(top->engine, top->dirfd, names, top->pending, AT_SYMLINK_NOFOLLOW,
+                           top->results);
+    else
+        cs_stat_batch(top->dirfd, names, top->pending, AT_SYMLINK_NOFOLLOW, top->results);
+
+    for (i = 0; i < top->pending; i++) {
+        const struct cs_stat *st = &top->results[i];
+        if (st->error != 0 || !S_ISREG(st->mode))
+            continue;
+        if (top->order == CS_TOP_NEWEST || top->order == CS_TOP_OLDEST)
+            retval = top_offer(top, st->mtime, st->mtime_nsec, names[i]);
+        else
+            retval = top_offer(top, st->size, 0, names[i]);
+        if (retval != 0)
+            break;
+    }
+    top->pending = 0;
+    top->names_used = 0;
+    return retval;
+}
+
+/*
+ * Put a file into the heap if there is room, or in place of the worst one
+ * if it is better. Returns -1 if out of memory, leaving the heap as it was.
+ */
+static int top_offer(struct top_heap *top, int64_t key, long nsec, const char *name)
+{
+    struct top_item item = { key, nsec, (char *)name };
+    size_t i;
+
+    if (top->count < top->k) {
+        if (top->count > 0 && top->count % CS_TOP_BATCH == 0) {
+            struct top_item *items = realloc(top->items, (top->count + CS_TOP_BATCH)
+                                                         * sizeof (struct top_item));
+            if (items == NULL)
+                return -1;
+            top->items = items;
+        }
+        if ((item.name = cs_strclone(name)) == NULL)
+            return -1;
+        for (i = top->count++; i > 0 && top_compare(top, &top->items[(i-1) / 2], &item) < 0;
+             i = (i-1) / 2)
+            top->items[i] = top->items[(i-1) / 2];
+        top->items[i] = item;
+    } else if (top_compare(top, &item, &top->items[0]) < 0) {
+        if ((item.name = cs_strclone(name)) == NULL)
+            return -1;
+        free(top->items[0].name);
+        top->items[0] = item;
+        top_sift_down(top, 0, top->count);
+    }
+    return 0;
+}
+
+/*
+ * Returns a negative number if a comes before b in the order asked for,
+ * a positive one if after.
+ */
+static int top_compare(const struct top_heap *top, const struct top_item *a,
+                       const struct top_item *b)
+{
+    int cmp = (a->key > b->key) - (a->key < b->key);
+
+    if (cmp == 0)
+        cmp = (a->nsec > b->nsec) - (a->nsec < b->nsec);
+    if (top->order == CS_TOP_NEWEST || top->order == CS_TOP_LARGEST)
+        cmp = -cmp;
+    return cmp != 0 ? cmp : strcmp(a->name, b->name);
+}
+
+/*
+ * Move the item at i down the first count items of the heap until it is
+ * after both its children.
+ */
+static void top_sift_down(struct top_heap *top, size_t i, size_t count)
+{
+    struct top_item item = top->items[i];
+
+    for (;;) {
+        size_t child = 2*i + 1;
+        if (child >= count)
+            break;
+        if (child + 1 < count && top_compare(top, &top->items[child], &top->items[child+1]) < 0)
+            child++;
+        if (top_compare(top, &item, &top->items[child]) >= 0)
+            break;
+        top->items[i] = top->items[child];
+        i = child;
+    }
+    top->items[i] = item;
+}
+
+/**
+ * Call \a visit for every entry of the directory \a path, relative to
+ * \a dirfd as for openat(), as described for read_directory_foreach(), but
+ * leave reporting errors to the caller.
+ *
+ * \return Number of entries visited, -1 on error with \c errno set.
+ */
+static int visit_directory(int dirfd, const char *path, bool full_pathnames, cs_dir_visitor visit,
+                           void *arg)
+{
+    assert(path != NULL);
+    assert(visit != NULL);
+
+    int count = 0;
+
+    /* Open dir specified by path. */
+    struct cs_dir *dir = cs_dir_openat(dirfd, path);
+    if (dir == NULL)
+        return -1;
+
+    /* The directory prefix of full pathnames only has to be built once. */
+    struct cs_pathbuf buffer;
+    cs_pathbuf_init(&buffer);
+    if (full_pathnames && cs_pathbuf_dir(&buffer, path, strlen(path)) < 0) {
+        cs_dir_close(dir);
+        return -1;
+    }
+
+    struct cs_dirent entry;
+    int retval;
+    while ((retval = cs_dir_read(dir, &entry)) > 0) {
+        const char *data = entry.name;
+        size_t len = entry.len;
+        if (full_pathnames) {
+            data = cs_pathbuf_name(&buffer, entry.name, len);
+            if (data == NULL) {
+                retval = -1;
+                break;
+            }
+            len = buffer.len;
+        }
+
+        struct dir_context saved = filtering;
+        filtering.data = data;
+        filtering.dirfd = dir->fd;
+        filtering.entry = &entry;
+        retval = visit(data, len, &entry, arg);
+        filtering = saved;
+
+        ++count;
+        if (retval != 0)
+            break;
+    }
+
+    cs_pathbuf_free(&buffer);
+    cs_dir_close(dir);
+    return retval < 0 ? -1 : count;
+}
+
+/**
+ * A cs_dir_visitor that appends every entry accepted by a filter to a list.
+ */
+static int append_entry(const char *data, size_t len, const struct cs_dirent *entry, void *arg)
+{
+    struct list_builder *list = arg;
+
+    (void)entry;
+    if (list->filter != NULL && !list->filter((void *)data, list->arguments))
+        return 0;
+
+    NodeStr *new;
+    if (list->arena != NULL) {
+        /* Keep each name right behind its node. */
+        new = cs_arena_alloc(list->arena, sizeof (NodeStr) + len + 1);
+        if (new == NULL)
+            return -1;
+        new->data = (char *)(new + 1);
+        new->next = NULL;
+    } else {
+        new = list_node();
+        if (new == NULL)
+            return -1;
+        new->data = malloc(len + 1);
+        if (new->data == NULL) {
+            free(new);
+            return -1;
+        }
+    }
+    memcpy(new->data, data, len + 1);
+
+    if (list->tail == NULL) {
+        *list->head = list->tail = new;
+    } else {
+        list->tail->next = new;
+        list->tail = new;
+    }
+    ++list->count;
+    return 0;
+}
+
 /**
- * Returns whether \a filepath points to a directory.
+ * Read the directory \a path into a list, like read_directory(), but only
+ * keep the entries for which \a filter returns true. The filter sees each
+ * entry before anything is allocated for it, so rejected entries cost nothing.
+ *
+ * \param filter    Filter function as for list_filter(), or \c NULL.
+ * \param arguments Second argument to \a filter.
+ * \return Number of entries in the list, -1 on error.
+ */
+static int read_directory_filter(int dirfd, const char *path, NodeStr **head,
+                                 bool full_pathnames, bool (*filter)(void *, void *),
+                                 void *arguments, struct cs_arena *arena)
+{
+    assert(path != NULL);
+    assert(head != NULL);
+
+    struct list_builder list = { head, NULL, 0, filter, arguments, arena };
+
+    *head = NULL;
+    if (visit_directory(dirfd, path, full_pathnames, append_entry, &list) < 0) {
+        int errnum = errno;
+        if (arena == NULL)
+            list_free_all(head);
+        *head = NULL;
+        errno = errnum;
+        perror("Error (read_directory)");
+        return -1;
+    }
+    return list.count;
+}
+
+/**
+ * Wrap the directory opened as \a fd in a newly allocated struct cs_dir,
+ * which owns both \a fd and its buffer.
+ */
+static struct cs_dir *cs_dir_new(int fd)
+{
+    struct cs_dir *dir;
+
+    if (fd < 0)
+        return NULL;
+    dir = malloc(sizeof (struct cs_dir) + CS_DIR_BUFSIZE);
+    if (dir == NULL) {
+        close(fd);
+        return NULL;
+    }
+    cs_dir_init(dir, fd, (char *)(dir + 1), CS_DIR_BUFSIZE);
+    dir->owner = true;
+    return dir;
+}
+
+/**
+ * Returns \a view as a string terminated by '\0': the view itself if it
+ * already ends where its string does, else a copy in \a buffer, which is
+ * BUFSIZ long.
+ */
+static const char *view_string(char *buffer, struct cs_path_view view)
+{
+    if (view.data[view.len] == '\0')
+        return view.data;
+
+    size_t len = view.len < BUFSIZ ? view.len : BUFSIZ - 1;
+    memcpy(buffer, view.data, len);
+    buffer[len] = '\0';
+    return buffer;
+}
+
+/**
+ * Returns the type of \a filepath as one of the DT_ constants, without
+ * following symbolic links. If \a filepath is the entry being visited by
+ * visit_directory(), the type from the directory is used.
  *
  * \param filepath File to test.
- * \return 0 if regular file, 1 if directory, -1 if error;
+ * \return DT_ constant describing the file, -1 if error.
  */
-static inline int isdir(const char *filepath)
+static int file_type(const char *filepath)
 {
     assert(filepath != NULL);
 
+    const struct cs_dirent *entry;
     struct stat fstat;
-    if (stat(filepath, &fstat) != 0) {
-        perror("Error (stat)");
+    int dirfd;
+
+    if (cs_dir_current(filepath, &dirfd, &entry)) {
+        if (entry->type != DT_UNKNOWN)
+            return entry->type;
+        if (fstatat(dirfd, entry->name, &fstat, AT_SYMLINK_NOFOLLOW) != 0) {
+            perror("Error (fstatat)");
+            return -1;
+        }
+    } else if (lstat(filepath, &fstat) != 0) {
+        perror("Error (lstat)");
         return -1;
     }
-    return ! S_ISREG(fstat.st_mode);
+    return IFTODT(fstat.st_mode);
 }
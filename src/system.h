@@ -38,10 +38,16 @@ extern "C" {
 #include <assert.h>
 #include <regex.h>
 #include <stdbool.h>
+#include <stdlib.h>
+#include <sys/types.h>
 
+#include "arena.h"
 #include "list.h"
 #include "list_str.h"
 
+/** Default size of the buffer cs_dir_open() reads directory entries into. */
+#define CS_DIR_BUFSIZE (128 * 1024)
+
 /**
  * Get the number of columns in the current terminal.
  * This also works correctly if the terminal has been resized.
@@ -56,11 +62,12 @@ extern unsigned short get_terminal_columns();
 
 /**
  * \brief
- * Returns a pointer to an internal character buffer which contents correspond
- * to the basename of the given path.
+ * Returns a pointer to the basename of the given path, either within \a path
+ * itself or in a buffer of the calling thread.
  *
  * \warning If you want the result to remain after successive calls to
- * cs_basename(), then please copy it into a new string.
+ * cs_basename() or after \a path changes, then please copy it into a new
+ * string. To avoid the copy altogether, use cs_path_base() of path.h.
  *
  * \details
  * The  functions  dirname() and basename() break a null-terminated pathname
@@ -89,29 +96,241 @@ extern unsigned short get_terminal_columns();
  *     "."           "."       "."
  *     ".."          "."       ".."
  *
- * \note This is a wrapper of the standard basename and dirname functions given
- * in the basename(3) and dirname(3) man page. The reason is that the library
- * versions of basename and dirname are unpredictable in their behavior, which
- * makes it inconvenient to use them.
+ * \note This behaves like the standard basename and dirname functions given
+ * in the basename(3) and dirname(3) man page, but never modifies \a path.
+ * The reason is that the library versions of basename and dirname are
+ * unpredictable in their behavior, which makes it inconvenient to use them.
  */
 extern const char *cs_basename(const char *path);
 
 /**
  * \brief
- * Returns a pointer to an internal character buffer which contents correspond
- * to the dirname of the given path.
+ * Returns a pointer to the dirname of the given path, in general in a buffer
+ * of the calling thread.
  *
  * \warning If you want the result to remain after successive calls to
- * cs_dirname(), then please copy it into a new string.
+ * cs_dirname(), then please copy it into a new string. To avoid the copy
+ * altogether, use cs_path_dir() of path.h.
  *
  * \details \copydetails basename()
  */
 extern const char *cs_dirname(const char *path);
 
+/**
+ * A directory entry returned by cs_dir_read().
+ *
+ * The entry is a view into the buffer of the struct cs_dir it was read from,
+ * and is only valid until the next call to cs_dir_read() or cs_dir_close().
+ * Copy \a name if you want to keep it.
+ *
+ * \param name Name of the entry, terminated by \c '\0'.
+ * \param len  Length of \a name, not counting the terminating \c '\0'.
+ * \param type Type of the entry as one of the \c DT_ constants of dirent.h;
+ *             may be \c DT_UNKNOWN if the file system does not report types.
+ * \param ino  Inode number of the entry.
+ */
+struct cs_dirent {
+    const char *name;
+    size_t len;
+    unsigned char type;
+    ino_t ino;
+};
+
+/**
+ * A directory opened for reading with cs_dir_open() or cs_dir_init().
+ *
+ * On Linux the entries are read with the getdents64 system call, many at a
+ * time, into \a buffer; cs_dir_read() then hands them out one by one without
+ * copying or allocating anything. Treat the members as private.
+ */
+struct cs_dir {
+    int fd;
+    char *buffer;
+    size_t size;
+    size_t pos;
+    size_t end;
+    bool owner;
+    void *stream;
+};
+
+/**
+ * Open the directory \a path for reading with cs_dir_read().
+ *
+ * \param path Directory to open.
+ * \return Newly allocated directory stream which must be closed with
+ *         cs_dir_close(), or \c NULL on error, with \c errno set.
+ */
+extern struct cs_dir *cs_dir_open(const char *path);
+
+/**
+ * Open the directory \a name relative to the directory \a dirfd, as openat()
+ * does, for reading with cs_dir_read().
+ *
+ * \return Newly allocated directory stream which must be closed with
+ *         cs_dir_close(), or \c NULL on error, with \c errno set.
+ */
+extern struct cs_dir *cs_dir_openat(int dirfd, const char *name);
+
+/**
+ * Prepare \a dir for reading the entries of the open directory \a fd into
+ * a buffer supplied by the caller. Nothing is allocated, and cs_dir_close()
+ * closes neither \a fd nor frees \a buffer; this is useful for reading many
+ * directories one after another with the same buffer.
+ *
+ * \param dir    Directory stream to initialize.
+ * \param fd     Directory opened for reading, positioned at its beginning.
+ * \param buffer Buffer for entries, suitably aligned for any type (as
+ *               returned by malloc()); it should be at least a few KiB.
+ * \param size   Size of \a buffer in bytes.
+ */
+extern void cs_dir_init(struct cs_dir *dir, int fd, char *buffer, size_t size);
+
+/**
+ * Read the next entry of a directory, including "." and "..".
+ *
+ * \param dir   Directory stream.
+ * \param entry Overwritten with a view of the next entry.
+ * \return 1 if an entry was read, 0 at the end of the directory, and -1 on
+ *         error, with \c errno set.
+ */
+extern int cs_dir_read(struct cs_dir *dir, struct cs_dirent *entry);
+
+/**
+ * Close a directory stream and release what it allocated.
+ */
+extern void cs_dir_close(struct cs_dir *dir);
+
 extern int read_directory(const char *path,
                           NodeStr **head,
                           bool full_pathnames);
 
+/**
+ * Read the directory \a path into a list whose nodes and names are all
+ * allocated from \a arena, each name right behind its node. The list is freed
+ * together with the arena by cs_arena_free(), and must not be passed to
+ * functions that free nodes or their data, such as list_free_all() or
+ * list_filter().
+ *
+ * \param path           Directory to read.
+ * \param head           Set to the head of the list.
+ * \param full_pathnames Whether to list full pathnames or just names.
+ * \param filter         Filter function as for get_filepaths_filter(), or
+ *                       \c NULL to keep all entries.
+ * \param arguments      Second argument to \a filter.
+ * \param arena          Arena to allocate from; see arena.h.
+ * \return Number of entries in the list, -1 on error. On error, memory
+ *         already taken from \a arena is only released with the arena.
+ */
+extern int read_directory_arena(const char *path,
+                                NodeStr **head,
+                                bool full_pathnames,
+                                bool (*filter)(void *path, void *arguments),
+                                void *arguments,
+                                struct cs_arena *arena);
+
+/** Same as read_directory_arena() with names only and no filter. */
+extern int get_filenames_arena(const char *path, NodeStr **head, struct cs_arena *arena);
+
+/** Same as read_directory_arena() with full pathnames and no filter. */
+extern int get_filepaths_arena(const char *path, NodeStr **head, struct cs_arena *arena);
+
+/**
+ * Function called by read_directory_foreach() for every entry.
+ *
+ * \param data  Name of the entry, or its full pathname; like \a entry, this
+ *              is only valid during the call.
+ * \param len   Length of \a data.
+ * \param entry The entry as read from the directory.
+ * \param arg   Argument given to read_directory_foreach().
+ * \return 0 to go on with the next entry, anything else to stop.
+ */
+typedef int (*cs_dir_visitor)(const char *data,
+                              size_t len,
+                              const struct cs_dirent *entry,
+                              void *arg);
+
+/**
+ * Call \a visit for every entry of the directory \a path, as it is read.
+ *
+ * Unlike read_directory(), no list is built and nothing is allocated per
+ * entry, so memory use does not depend on the size of the directory, and the
+ * visitor can stop reading early. Filters such as filter_isreg() may be called
+ * from within the visitor on \a data and will make use of \a entry.
+ *
+ * \b Example: Find the first three log files.
+ * \code
+ *     int find_logs(const char *data, size_t len,
+ *                   const struct cs_dirent *entry, void *arg)
+ *     {
+ *         NodeStr **head = arg;
+ *         if (len > 4 && strcmp(data + len - 4, ".log") == 0
+ *             && filter_isreg((void *)data, NULL))
+ *             list_push(head, cs_strclone(data));
+ *         return list_length(*head) == 3;
+ *     }
+ *
+ *     NodeStr *head = NULL;
+ *     foreach_filepath("/var/log", find_logs, &head);
+ * \endcode
+ *
+ * \param path           Directory to read.
+ * \param full_pathnames Whether to pass full pathnames or just names.
+ * \param visit          Function called for every entry, including "." and
+ *                       "..".
+ * \param arg            Passed to \a visit unchanged.
+ * \return Number of entries visited, -1 on error.
+ */
+extern int read_directory_foreach(const char *path,
+                                  bool full_pathnames,
+                                  cs_dir_visitor visit,
+                                  void *arg);
+
+/** Same as read_directory_foreach() with names only. */
+extern int foreach_filename(const char *path, cs_dir_visitor visit, void *arg);
+
+/** Same as read_directory_foreach() with full pathnames. */
+extern int foreach_filepath(const char *path, cs_dir_visitor visit, void *arg);
+
+/**
+ * Call \a visit with the name of every entry of the directory \a path,
+ * which is relative to the open directory \a dirfd as for openat(), or to
+ * the working directory if \a dirfd is \c AT_FDCWD.
+ *
+ * This is meant for visitors that go on with openat() and fstatat() on the
+ * descriptor of the directory being read, which cs_dir_current() gives
+ * them, so that no full pathnames are built at all.
+ *
+ * \b Example: Sizes of the files in a directory.
+ * \code
+ *     int print_size(const char *data, size_t len,
+ *                    const struct cs_dirent *entry, void *arg)
+ *     {
+ *         struct stat st;
+ *         int dirfd;
+ *         cs_dir_current(data, &dirfd, NULL);
+ *         if (fstatat(dirfd, data, &st, AT_SYMLINK_NOFOLLOW) == 0)
+ *             printf("%10lld %s\n", (long long)st.st_size, data);
+ *         return 0;
+ *     }
+ *
+ *     read_directory_foreach_at(AT_FDCWD, "/etc", print_size, NULL);
+ * \endcode
+ *
+ * \return Number of entries visited, -1 on error.
+ */
+extern int read_directory_foreach_at(int dirfd,
+                                     const char *path,
+                                     cs_dir_visitor visit,
+                                     void *arg);
+
+/**
+ * Read the names of the entries of the directory \a path, relative to
+ * \a dirfd as for read_directory_foreach_at(), into a list.
+ *
+ * \return Number of entries in the list, -1 on error.
+ */
+extern int get_filenames_at(int dirfd, const char *path, NodeStr **head);
+
 extern int get_filenames(const char *path, NodeStr **head);
 
 extern int get_filenames_filter(const char *path,
@@ -139,8 +358,55 @@ extern int get_filenames_filter_regex(const char *path,
                                       NodeStr **head,
                                       const char *regex);
 
+/**
+ * Like read_directory_filter_regex(), but keep the files whose names match the
+ * shell glob \a pattern, as described in globset.h. Only the name of each file
+ * is matched, even if \a full_pathnames is true.
+ *
+ * \return Number of files in the list, or -1 on error.
+ */
+extern int read_directory_filter_glob(const char *path,
+                                      NodeStr **head,
+                                      const char *pattern,
+                                      bool full_pathnames);
+
+extern int get_filepaths_filter_glob(const char *path,
+                                     NodeStr **head,
+                                     const char *pattern);
+
+extern int get_filenames_filter_glob(const char *path,
+                                     NodeStr **head,
+                                     const char *pattern);
+
+/**
+ * Find out whether \a data is the entry that a listing function such as
+ * get_filepaths_filter() is currently passing to its filter, and if so, what
+ * the directory told us about it. This lets filters use the entry type and
+ * fstatat() relative to the directory instead of resolving a path again.
+ *
+ * \param data  String that was passed to the filter.
+ * \param dirfd Set to the file descriptor of the directory being read; may be
+ *              \c NULL.
+ * \param entry Set to the entry being filtered; may be \c NULL.
+ * \return true if \a data is the entry being filtered in this thread.
+ */
+extern bool cs_dir_current(const void *data, int *dirfd, const struct cs_dirent **entry);
+
+/**
+ * A filter function for list_filter() and the get_file*_filter() functions,
+ * to keep only regular files.
+ *
+ * When used with a listing function, the type reported by the directory is
+ * used, so that no system call is needed at all; only if the file system
+ * does not report types is fstatat() called. Otherwise lstat() is called on
+ * \a filepath. Symbolic links are not followed in either case.
+ */
 extern bool filter_isreg(void *filepath, void *);
 
+/**
+ * A filter function for list_filter() and the get_file*_filter() functions,
+ * to keep only directories. See filter_isreg() for how the type is found.
+ */
 extern bool filter_isdir(void *filepath, void *);
 
 struct filter_time_args {
@@ -150,6 +416,78 @@ struct filter_time_args {
 
 extern bool filter_mtime(void *filepath, void *arguments);
 
+/**
+ * Keep only the files in the list whose modification time satisfies \a args,
+ * like list_filter() with filter_mtime(), but look up all the files at once
+ * with cs_stat_batch() instead of calling stat() for one after the other.
+ *
+ * Nodes that are removed are freed together with their data, as with
+ * list_filter(). Files that cannot be looked up are removed as well.
+ *
+ * \param head Pointer to pointer to the head of a list of file paths.
+ * \param args The time to compare with.
+ * \return Number of files remaining in the list, or -1 if out of memory, in
+ *         which case the list is left unchanged.
+ */
+extern long list_filter_mtime(NodeStr **head, const struct filter_time_args *args);
+
+/**
+ * Orders for read_directory_top().
+ */
+enum cs_top_order {
+    CS_TOP_NEWEST,   /**< Most recently modified first. */
+    CS_TOP_OLDEST,   /**< Least recently modified first. */
+    CS_TOP_LARGEST,  /**< Largest first. */
+    CS_TOP_SMALLEST  /**< Smallest first. */
+};
+
+/** Number of entries read_directory_top() looks up at once. */
+#define CS_TOP_BATCH 1024
+
+/**
+ * Read the \a k first regular files of the directory \a path in the given
+ * order into a list, without listing the whole directory.
+ *
+ * The directory is read as with read_directory_foreach(); the files are
+ * looked up CS_TOP_BATCH at a time with a stat engine (see stat_batch.h)
+ * and kept in a heap of at most \a k entries. Memory use is thus in
+ * proportion to \a k, and time to the number of entries times log \a k.
+ * Files that compare equal are ordered by name. Symbolic links are not
+ * followed.
+ *
+ * \b Example: The 100 most recently modified logs.
+ * \code
+ *     struct cs_glob *glob = cs_glob_new("*.log");
+ *     read_directory_top("/var/log", &head, true, 100, CS_TOP_NEWEST,
+ *                        filter_glob, glob);
+ *     cs_glob_free(glob);
+ * \endcode
+ *
+ * \param path           Directory to read.
+ * \param head           Set to the head of a newly allocated list, in the
+ *                       given order.
+ * \param full_pathnames Whether to list full pathnames or just names.
+ * \param k              Maximum number of files to list.
+ * \param order          Which files come first.
+ * \param filter         Filter function given the name of each entry, or
+ *                       \c NULL to consider all regular files.
+ * \param arguments      Second argument to \a filter.
+ * \return Number of files in the list, -1 on error.
+ */
+extern int read_directory_top(const char *path,
+                              NodeStr **head,
+                              bool full_pathnames,
+                              size_t k,
+                              enum cs_top_order order,
+                              bool (*filter)(void *path, void *arguments),
+                              void *arguments);
+
+/** Same as read_directory_top() with full pathnames, newest first. */
+extern int get_filepaths_newest(const char *path, NodeStr **head, size_t k);
+
+/** Same as read_directory_top() with full pathnames, oldest first. */
+extern int get_filepaths_oldest(const char *path, NodeStr **head, size_t k);
+
 
 #ifdef __cplusplus
 }
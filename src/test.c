@@ -17,18 +17,38 @@
  * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
  */
 
+#define _DEFAULT_SOURCE
+
 #include <assert.h>
+#include <dirent.h>
+#include <fcntl.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <string.h>
+#include <sys/stat.h>
 
 #include "bitset.h"
 #include "debug.h"
+#include "dircache.h"
+#include "du.h"
+#include "dupes.h"
+#include "filter.h"
+#include "globset.h"
+#include "hash.h"
+#include "ilist.h"
 #include "list.h"
 #include "list_str.h"
+#include "lockfree.h"
+#include "path.h"
+#include "regex_cache.h"
 #include "string.h"
+#include "strset.h"
 #include "system.h"
+#include "treeindex.h"
+#include "ulist.h"
 #include "util.h"
+#include "walk.h"
+#include "watch.h"
 
 //: string.h
 void test_strclone(char *input)
@@ -63,6 +83,80 @@ void test_list_filter(char *path)
     list_free_all(&head);
 }
 
+void test_list_filter_parallel(char *path)
+{
+    printf("test_list_filter_parallel(%s)\n", path);
+    NodeStr *head;
+    get_filepaths(path, &head);
+
+    struct filter_regex_args args;
+    regcomp(&args.preg, "\\.h$", REG_EXTENDED | REG_NOSUB);
+    size_t count = list_filter_parallel(&head, filter_regex, &args, 0);
+    regfree(&args.preg);
+    printf("%zu headers\n", count);
+    list_free_all(&head);
+}
+
+void test_list_head(char *path)
+{
+    printf("test_list_head(%s)\n", path);
+    struct list_head list, more;
+    NodeStr *head;
+    get_filenames(path, &head);
+    list_head_from(&list, (struct list_node *)head);
+    list_head_init(&more);
+    list_head_append(&more, cs_strclone("appended"));
+    list_head_concat(&list, &more);
+    list_head_filter_glob(&list, "[!.]*");
+    char **array;
+    size_t count = list_head_to_array(&list, (void ***)&array);
+    char *joined = list_strjoin((NodeStr *)list.head, ",");
+    printf("%zu of %zu names, last %s, %zu bytes joined\n", count, list.length,
+           ((NodeStr *)list.tail)->data, strlen(joined));
+    free(joined);
+    free(array);
+    list_head_free_all(&list);
+}
+
+void test_list_pool(char *path)
+{
+    printf("test_list_pool(%s)\n", path);
+    struct list_pool *pool = list_pool_new(0);
+    struct list_node *queue = NULL;
+    NodeStr *head;
+    get_filepaths(path, &head);
+    for (NodeStr *node = head; node != NULL; node = node->next)
+        list_pool_push(pool, &queue, cs_strclone(node->data));
+    list_free_all(&head);
+    char *last = list_pool_pop(pool, &queue);
+    printf("%zu paths left after %s\n", list_length(queue), last);
+    free(last);
+    list_pool_free_all(pool, &queue);
+    list_pool_free(pool);
+}
+
+int compare_length(const void *a, const void *b, void *arg)
+{
+    (void)arg;
+    size_t len_a = strlen(a), len_b = strlen(b);
+    return (len_a > len_b) - (len_a < len_b);
+}
+
+void test_list_sort(char *path)
+{
+    printf("test_list_sort(%s)\n", path);
+    NodeStr *head;
+    get_filepaths(path, &head);
+    list_strsort(&head);
+    size_t unsorted = 0;
+    for (NodeStr *node = head; node != NULL && node->next != NULL; node = node->next)
+        if (strcmp(node->data, node->next->data) > 0)
+            unsorted++;
+    list_sort_parallel(&head, compare_length, NULL, 0);
+    printf("%zu paths out of order, shortest %s\n", unsorted, head != NULL ? head->data : "");
+    list_free_all(&head);
+}
+
 //: system.h
 void test_get_filepaths(char *path)
 {
@@ -88,6 +182,115 @@ void test_get_filenames(char *path)
     list_free_all(&head);
 }
 
+void test_filter_isreg(char *path)
+{
+    printf("test_filter_isreg(%s)\n", path);
+    NodeStr *head;
+    int files = get_filepaths_filter(path, &head, filter_isreg, NULL);
+    list_free_all(&head);
+    int dirs = get_filenames_filter(path, &head, filter_isdir, NULL);
+    list_free_all(&head);
+    printf("%d regular files, %d directories\n", files, dirs);
+}
+
+static int stop_after(const char *data, size_t len, const struct cs_dirent *entry, void *arg)
+{
+    (void)len;
+    (void)entry;
+    puts(data);
+    return --*(int *)arg == 0;
+}
+
+void test_foreach_filepath(char *path)
+{
+    printf("test_foreach_filepath(%s)\n", path);
+    int limit = 3;
+    int count = foreach_filepath(path, stop_after, &limit);
+    printf("visited %d entries\n", count);
+}
+
+void test_list_filter_mtime(char *path)
+{
+    printf("test_list_filter_mtime(%s)\n", path);
+    struct filter_time_args args = { time(NULL), -1 };
+    NodeStr *head;
+    get_filepaths(path, &head);
+    long batched = list_filter_mtime(&head, &args);
+    list_free_all(&head);
+    get_filepaths(path, &head);
+    size_t single = list_filter(&head, filter_mtime, &args);
+    list_free_all(&head);
+    printf("%ld batched, %zu one by one\n", batched, single);
+}
+
+void test_get_filepaths_top(char *path)
+{
+    printf("test_get_filepaths_top(%s)\n", path);
+    NodeStr *head;
+    int count = get_filepaths_newest(path, &head, 3);
+    for (NodeStr *node = head; node != NULL; node = node->next)
+        printf("newest: %s\n", node->data);
+    list_free_all(&head);
+    read_directory_top(path, &head, false, 3, CS_TOP_LARGEST, NULL, NULL);
+    for (NodeStr *node = head; node != NULL; node = node->next)
+        printf("largest: %s\n", node->data);
+    list_free_all(&head);
+    printf("%d newest files\n", count);
+}
+
+int print_size(const char *data, size_t len, const struct cs_dirent *entry, void *arg)
+{
+    struct stat st;
+    int dirfd;
+
+    (void)len;
+    (void)entry;
+    (void)arg;
+    if (cs_dir_current(data, &dirfd, NULL) && fstatat(dirfd, data, &st, AT_SYMLINK_NOFOLLOW) == 0)
+        printf("%10lld %s\n", (long long)st.st_size, data);
+    return 0;
+}
+
+void test_read_directory_foreach_at(char *path)
+{
+    printf("test_read_directory_foreach_at(%s)\n", path);
+    int count = read_directory_foreach_at(AT_FDCWD, path, print_size, NULL);
+    NodeStr *head;
+    get_filenames_at(AT_FDCWD, path, &head);
+    printf("%d entries visited, %zu listed\n", count, list_length((struct list_node *)head));
+    list_free_all(&head);
+}
+
+void test_get_filepaths_arena(char *path)
+{
+    printf("test_get_filepaths_arena(%s)\n", path);
+    struct cs_arena *arena = cs_arena_new(0);
+    NodeStr *head;
+    int count = get_filepaths_arena(path, &head, arena);
+    printf("%d entries in %zu bytes, first %s\n", count, cs_arena_size(arena),
+           head != NULL ? head->data : "none");
+    cs_arena_free(arena);
+}
+
+void test_cs_dir_read(char *path)
+{
+    printf("test_cs_dir_read(%s)\n", path);
+    struct cs_dir *dir = cs_dir_open(path);
+    if (dir == NULL) {
+        perror("cs_dir_open");
+        return;
+    }
+
+    struct cs_dirent entry;
+    size_t count = 0, bytes = 0;
+    while (cs_dir_read(dir, &entry) > 0) {
+        count++;
+        bytes += entry.len;
+    }
+    cs_dir_close(dir);
+    printf("%zu entries, %zu bytes of names\n", count, bytes);
+}
+
 //: util.h
 void test_print_columns(char *path)
 {
@@ -120,6 +323,413 @@ void test_bitset(const char *binstr)
     free(bs);
 }
 
+//: filter.h
+void test_filter_all(const char *path)
+{
+    printf("test_filter_all(%s)\n", path);
+
+    struct cs_filter *filter = cs_filter_new();
+    cs_filter_regex(filter, "\\.h$");
+    cs_filter_type(filter, DT_REG);
+    cs_filter_size(filter, 1, 4096);
+    cs_filter_mtime(filter, 1, 0);
+
+    NodeStr *head;
+    int count = get_filepaths_filter(path, &head, filter_all, filter);
+    printf("%d headers larger than 4 KiB\n", count);
+    list_free_all(&head);
+    cs_filter_free(filter);
+}
+
+//: walk.h
+static int count_entry(const struct cs_walk_entry *entry, void *arg)
+{
+    (void)entry;
+    __sync_fetch_and_add((long *)arg, 1);
+    return CS_WALK_CONTINUE;
+}
+
+static int print_entry(const struct cs_walk_entry *entry, void *arg)
+{
+    printf("%*s%s\n", (int)(2*entry->depth), "", entry->name);
+    return --*(int *)arg > 0 ? CS_WALK_CONTINUE : CS_WALK_STOP;
+}
+
+void test_walk(const char *path)
+{
+    printf("test_walk(%s)\n", path);
+
+    long unordered = 0, ordered = 0;
+    struct cs_walk_opts opts = { 4, false, 0 };
+    long n = cs_walk(path, &opts, count_entry, &unordered);
+    printf("%ld entries, %ld counted\n", n, unordered);
+
+    opts.ordered = true;
+    n = cs_walk(path, &opts, count_entry, &ordered);
+    printf("%ld entries in order, %ld counted\n", n, ordered);
+
+    int limit = 20;
+    cs_walk(path, &opts, print_entry, &limit);
+}
+
+//: regex_cache.h
+void test_regex_cache(const char *path)
+{
+    printf("test_regex_cache(%s)\n", path);
+
+    NodeStr *head;
+    int i;
+    for (i = 0; i < 3; i++) {
+        get_filenames_filter_regex(path, &head, "^std.*\\.h$");
+        list_free_all(&head);
+    }
+
+    struct cs_regex_stats stats;
+    cs_regex_cache_stats(&stats);
+    printf("%lu hits, %lu misses, %zu cached\n", stats.hits, stats.misses, stats.size);
+
+    const struct cs_regex *regex = cs_regex_get("^stdio\\.h$", REG_EXTENDED);
+    printf("stdio.h: %d, stdio.hh: %d\n",
+           cs_regex_match(regex, "stdio.h"), cs_regex_match(regex, "stdio.hh"));
+    cs_regex_release(regex);
+}
+
+//: globset.h
+void test_glob(const char *path)
+{
+    printf("test_glob(%s)\n", path);
+
+    NodeStr *head;
+    int headers = get_filepaths_filter_glob(path, &head, "*.h");
+    int std = list_filter_glob(&head, "*/std*");
+    list_free_all(&head);
+    printf("%d headers, %d starting with std\n", headers, std);
+
+    const char *patterns[] = { "*.log", "*.tmp", "core.[0-9]*" };
+    struct cs_glob *glob = cs_glob_set_new(patterns, 3);
+    printf("core.123: %d, a.tmp: %d, core.x: %d\n", cs_glob_find(glob, "core.123"),
+           cs_glob_find(glob, "a.tmp"), cs_glob_find(glob, "core.x"));
+    cs_glob_free(glob);
+}
+
+//: dircache.h
+void test_dircache(const char *path)
+{
+    printf("test_dircache(%s)\n", path);
+
+    struct cs_dircache *cache = cs_dircache_new(1 << 20);
+    NodeStr *head;
+    int i, count = 0;
+    for (i = 0; i < 3; i++) {
+        count = cs_dircache_list(cache, path, true, &head);
+        list_free_all(&head);
+    }
+
+    struct cs_dircache_stats stats;
+    cs_dircache_stats(cache, &stats);
+    printf("%d entries, %lu hits, %lu misses, %zu bytes cached\n",
+           count, stats.hits, stats.misses, stats.bytes);
+    cs_dircache_free(cache);
+}
+
+//: watch.h
+static void print_change(const char *path, enum cs_watch_change change, void *arg)
+{
+    static const char *names[] = { "added", "removed", "modified" };
+    (void)arg;
+    printf("%s %s\n", names[change], path);
+}
+
+void test_watch(void)
+{
+    puts("test_watch()");
+
+    char dir[] = "/tmp/cassava-XXXXXX", path[64];
+    if (mkdtemp(dir) == NULL)
+        return;
+    sprintf(path, "%s/old", dir);
+    fclose(fopen(path, "w"));
+
+    struct cs_watch *watch = cs_watch_new();
+    printf("%d entries\n", cs_watch_add(watch, dir));
+    unsigned long start = cs_watch_generation(watch);
+
+    remove(path);
+    sprintf(path, "%s/new", dir);
+    fclose(fopen(path, "w"));
+    printf("%d changes\n", cs_watch_poll(watch, 0));
+    cs_watch_changes(watch, start, print_change, NULL);
+
+    cs_watch_free(watch);
+    remove(path);
+    remove(dir);
+}
+
+/* Reports an entry created and removed twice, since each generation. */
+void test_watch_cycle(void)
+{
+    puts("test_watch_cycle()");
+
+    char dir[] = "/tmp/cassava-XXXXXX", path[64];
+    if (mkdtemp(dir) == NULL)
+        return;
+    sprintf(path, "%s/file", dir);
+
+    struct cs_watch *watch = cs_watch_new();
+    cs_watch_add(watch, dir);
+    unsigned long since, start = cs_watch_generation(watch);
+    int i;
+
+    for (i = 0; i < 5; i++) {
+        if (i % 2 == 0)
+            fclose(fopen(path, "w"));
+        else
+            remove(path);
+        cs_watch_poll(watch, 0);
+        if (i == 3 && cs_watch_changes(watch, start + 2, print_change, NULL) == 0)
+            puts("nothing since 2 after the second removal");
+    }
+    for (since = start; since <= cs_watch_generation(watch); since++) {
+        printf("since %lu: ", since - start);
+        if (cs_watch_changes(watch, since, print_change, NULL) == 0)
+            puts("nothing");
+    }
+
+    cs_watch_free(watch);
+    remove(path);
+    remove(dir);
+}
+
+//: treeindex.h
+void test_tree_index(const char *path)
+{
+    printf("test_tree_index(%s)\n", path);
+
+    const char *file = "/tmp/cassava-test.idx";
+    printf("%ld entries written\n", cs_tree_build(path, file));
+
+    struct cs_tree tree;
+    if (cs_tree_open(&tree, file) != 0)
+        return;
+    size_t first, count = cs_tree_prefix(&tree, "std", &first);
+    char buffer[4096];
+    if (count > 0) {
+        cs_tree_path(&tree, cs_tree_sorted(&tree, first), buffer, sizeof buffer);
+        printf("%zu names starting with std, first is %s\n", count, buffer);
+        printf("found again at %ld\n", cs_tree_lookup(&tree, buffer));
+    }
+    cs_tree_close(&tree);
+    remove(file);
+}
+
+//: du.h
+void test_du(const char *path)
+{
+    printf("test_du(%s)\n", path);
+
+    struct cs_du *du = cs_du(path, NULL);
+    if (du == NULL)
+        return;
+    const struct cs_du_dir *dirs;
+    size_t count = cs_du_dirs(du, &dirs);
+    printf("%zu directories, %llu bytes in %llu blocks, %llu entries\n", count,
+           (unsigned long long)dirs[0].size, (unsigned long long)dirs[0].blocks,
+           (unsigned long long)dirs[0].entries);
+    cs_du_free(du);
+}
+
+//: hash.h
+void test_hash(void)
+{
+    puts("test_hash()");
+
+    const char *text = "The quick brown fox jumps over the lazy dog";
+    struct cs_hash128 hash = cs_hash128(text, strlen(text), 0);
+    printf("%016llx %016llx\n", (unsigned long long)cs_hash64(text, strlen(text), 0),
+           (unsigned long long)hash.low);
+}
+
+//: dupes.h
+void test_dupes(const char *path)
+{
+    printf("test_dupes(%s)\n", path);
+
+    struct cs_dupes *dupes = cs_dupes_tree(path, NULL);
+    if (dupes == NULL)
+        return;
+    printf("%zu files, %zu groups of duplicates, %llu bytes read\n", dupes->files,
+           dupes->count, (unsigned long long)dupes->bytes_read);
+    if (dupes->count > 0)
+        printf("largest: %s and %s\n", dupes->groups[0].paths[0], dupes->groups[0].paths[1]);
+    cs_dupes_free(dupes);
+}
+
+//: path.h
+void test_path(void)
+{
+    puts("test_path()");
+
+    const char *paths[] = { "/usr/lib", "/usr/", "usr", "/", ".", "..", "", "//a//b//" };
+    for (size_t i = 0; i < sizeof paths / sizeof paths[0]; i++) {
+        struct cs_path_view dir, base;
+        cs_path_split(paths[i], strlen(paths[i]), &dir, &base);
+        printf("\"%s\": \"%.*s\" \"%.*s\" (%s %s)\n", paths[i], (int)dir.len, dir.data,
+               (int)base.len, base.data, cs_dirname(paths[i]), cs_basename(paths[i]));
+    }
+
+    struct cs_pathbuf buf;
+    cs_pathbuf_init(&buf);
+    cs_pathbuf_dir(&buf, "/usr", 4);
+    size_t prefix = cs_pathbuf_push(&buf, "lib", 3);
+    printf("%s ", cs_pathbuf_name(&buf, "libc.so", 7));
+    cs_pathbuf_pop(&buf, prefix);
+    printf("%s\n", cs_pathbuf_name(&buf, "bin", 3));
+    cs_pathbuf_free(&buf);
+
+    char path[] = "/usr/./lib//../share/../../etc/";
+    printf("%s", path);
+    cs_path_normalize(path, strlen(path));
+    printf(" -> %s\n", path);
+
+    char buffer[64];
+    cs_path_join(buffer, sizeof buffer, "/etc", 4, "fstab", 5);
+    puts(buffer);
+}
+
+//: ulist.h
+bool not_hidden(void *name, void *arguments)
+{
+    (void)arguments;
+    return ((char *)name)[0] != '.';
+}
+
+void test_ulist(char *path)
+{
+    printf("test_ulist(%s)\n", path);
+    struct ulist list;
+    NodeStr *head;
+    get_filenames(path, &head);
+    ulist_init(&list);
+    ulist_from_list(&list, &head);
+    ulist_insert(&list, ulist_length(&list) / 2, cs_strclone("middle"));
+    printf("%zu names, %s in the middle\n", ulist_length(&list),
+           ulist_search(&list, "middle") != NULL ? "middle" : "nothing");
+    ulist_filter(&list, not_hidden, NULL);
+    ulist_to_list(&list, &head);
+    list_free_all(&head);
+}
+
+//: lockfree.h
+void test_lockfree(char *path)
+{
+    printf("test_lockfree(%s)\n", path);
+    struct lfstack *stack = lfstack_new();
+    struct mpscq *queue = mpscq_new();
+    NodeStr *head, *tail, *node;
+    get_filepaths(path, &head);
+    for (tail = head; tail != NULL && tail->next != NULL; tail = tail->next)
+        ;
+    if (head != NULL)
+        mpscq_push_list(queue, head, tail);
+    size_t count = 0;
+    while ((node = mpscq_pop(queue)) != NULL) {
+        lfstack_push(stack, node);
+        count++;
+    }
+    node = lfstack_pop(stack);
+    printf("%zu paths queued, last %s\n", count, node != NULL ? node->data : "");
+    if (node != NULL)
+        lfstack_push(stack, node);
+    head = lfstack_pop_all(stack);
+    list_free_all(&head);
+    mpscq_free(queue);
+    lfstack_free(stack);
+}
+
+//: ilist.h
+struct name_entry {
+    size_t len;
+    struct name_entry *next;
+    char name[];
+};
+
+ILIST_DEFINE(name_list, struct name_entry, next)
+
+int compare_entries(const struct name_entry *a, const struct name_entry *b, void *arg)
+{
+    (void)arg;
+    return strcmp(a->name, b->name);
+}
+
+bool entry_not_hidden(struct name_entry *entry, void *arg)
+{
+    (void)arg;
+    return entry->name[0] != '.';
+}
+
+bool entry_is(const struct name_entry *entry, const void *name)
+{
+    return strcmp(entry->name, name) == 0;
+}
+
+void free_entry(struct name_entry *entry)
+{
+    free(entry);
+}
+
+void test_ilist(char *path)
+{
+    printf("test_ilist(%s)\n", path);
+    struct name_list list;
+    struct name_entry *entry;
+    NodeStr *head;
+    get_filenames(path, &head);
+    name_list_init(&list);
+    for (NodeStr *node = head; node != NULL; node = node->next) {
+        size_t len = strlen(node->data);
+        entry = malloc(sizeof (struct name_entry) + len + 1);
+        entry->len = len;
+        memcpy(entry->name, node->data, len + 1);
+        name_list_push(&list, entry);
+    }
+    list_free_all(&head);
+    name_list_sort(&list, compare_entries, NULL);
+    name_list_filter(&list, entry_not_hidden, NULL, free_entry);
+    size_t total = 0;
+    ILIST_FOREACH(entry, &list, next)
+        total += entry->len;
+    printf("%zu names of %zu bytes from %s to %s, %s\n", name_list_length(&list), total,
+           list.head != NULL ? list.head->name : "", list.tail != NULL ? list.tail->name : "",
+           name_list_find(&list, entry_is, "stdio.h") != NULL ? "stdio.h found" : "no stdio.h");
+    name_list_free_all(&list, free_entry);
+}
+
+//: strset.h
+void test_strset(char *path)
+{
+    printf("test_strset(%s)\n", path);
+    struct cs_arena *arena = cs_arena_new(0);
+    struct cs_strset *set = cs_strset_new(0, arena);
+    NodeStr *head, *more, *tail;
+    get_filenames(path, &head);
+    long added = cs_strset_add_list(set, head);
+    cs_strset_remove(set, "stdio.h", 7, NULL);
+    printf("%ld names added, %zu left, %s\n", added, cs_strset_size(set),
+           cs_strset_contains(set, "stdio.h", 7) ? "stdio.h still there" : "stdio.h removed");
+    cs_strset_free(set);
+    cs_arena_free(arena);
+
+    get_filenames(path, &more);
+    for (tail = head; tail != NULL && tail->next != NULL; tail = tail->next)
+        ;
+    if (tail != NULL)
+        tail->next = more;
+    else
+        head = more;
+    printf("%d names left of the list twice\n", list_dedup(&head));
+    list_free_all(&head);
+}
+
 
 int main(int argc, char **argv)
 {
@@ -129,26 +739,77 @@ int main(int argc, char **argv)
     if (argc > 1)
         path = argv[1];
 
-    goto bitset;
-
-string:
     puts("testing string.h functions...");
     test_strclone(path);
 
-list:
     puts("testing list.h functions...");
     test_list_filter(path);
+    test_list_filter_parallel(path);
+    test_list_head(path);
+    test_list_pool(path);
+    test_list_sort(path);
 
-system:
     puts("testing system.h functions...");
     test_get_filepaths(path);
     test_get_filenames(path);
     test_get_filenames_filter_regex(path);
+    test_cs_dir_read(path);
+    test_filter_isreg(path);
+    test_foreach_filepath(path);
+    test_list_filter_mtime(path);
+    test_get_filepaths_arena(path);
+    test_get_filepaths_top(path);
+    test_read_directory_foreach_at(path);
     test_print_columns(path);
 
-bitset:
     puts("testing bitset.h functions...");
     test_bitset(path);
 
+    puts("testing filter.h functions...");
+    test_filter_all(argc > 2 ? argv[2] : "/usr/include");
+
+    puts("testing walk.h functions...");
+    test_walk(argc > 2 ? argv[2] : "/usr/include");
+
+    puts("testing regex_cache.h functions...");
+    test_regex_cache(argc > 2 ? argv[2] : "/usr/include");
+
+    puts("testing globset.h functions...");
+    test_glob(argc > 2 ? argv[2] : "/usr/include");
+
+    puts("testing dircache.h functions...");
+    test_dircache(argc > 2 ? argv[2] : "/usr/include");
+
+    puts("testing watch.h functions...");
+    test_watch();
+    test_watch_cycle();
+
+    puts("testing treeindex.h functions...");
+    test_tree_index(argc > 2 ? argv[2] : "/usr/include");
+
+    puts("testing du.h functions...");
+    test_du(argc > 2 ? argv[2] : "/usr/include");
+
+    puts("testing hash.h functions...");
+    test_hash();
+
+    puts("testing dupes.h functions...");
+    test_dupes(argc > 2 ? argv[2] : "/usr/include");
+
+    puts("testing path.h functions...");
+    test_path();
+
+    puts("testing ulist.h functions...");
+    test_ulist(path);
+
+    puts("testing lockfree.h functions...");
+    test_lockfree(path);
+
+    puts("testing ilist.h functions...");
+    test_ilist(path);
+
+    puts("testing strset.h functions...");
+    test_strset(path);
+
     return 0;
 }
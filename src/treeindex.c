@@ -0,0 +1,699 @@
+/*
+ * libcassava/treeindex.c
+ * vim: set cin ts=4 sw=4 et cc=100:
+ *
+ * Copyright (c) 2012 Ben Morgan <neembi@googlemail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#define _GNU_SOURCE
+
+#include "treeindex.h"
+
+#include <assert.h>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <regex.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "regex_cache.h"
+#include "stat_batch.h"
+#include "walk.h"
+
+#define TREE_MAGIC      "CSTREE\r\n"
+#define TREE_VERSION    1
+#define TREE_BYTE_ORDER 0x01020304u
+
+/* Number of paths given to cs_stat_batch() at once. */
+#define TREE_STAT_CHUNK 4096
+
+/*
+ * The start of an index file. The sections follow in the order names,
+ * entries, sorted, each starting at a multiple of 8.
+ */
+struct tree_header {
+    char magic[8];
+    uint32_t byte_order;
+    uint32_t version;
+    uint32_t count;
+    uint32_t reserved;
+    uint64_t names_offset;
+    uint64_t names_size;
+    uint64_t entries_offset;
+    uint64_t sorted_offset;
+};
+
+/*
+ * An index being put together in memory. Entries are stat()ed in chunks,
+ * after their paths have been queued in pending.
+ */
+struct builder {
+    struct cs_tree_entry *entries;
+    size_t count;
+    size_t capacity;
+    char *names;
+    size_t names_size;
+    size_t names_capacity;
+
+    uint32_t *stack;            /* directory at each depth of a walk */
+    size_t depth;
+    int error;                  /* errno of a failure during a walk */
+
+    char *pending[TREE_STAT_CHUNK];
+    uint32_t pending_index[TREE_STAT_CHUNK];
+    size_t npending;
+};
+
+/* An entry of the sorted index while it is sorted. */
+struct sort_item {
+    const char *name;
+    uint32_t index;
+};
+
+static long add_subtree(struct builder *b, const char *path, const char *name, uint32_t parent);
+static int visit_entry(const struct cs_walk_entry *entry, void *arg);
+static long add_entry(struct builder *b, const char *name, uint32_t parent, unsigned char type);
+static int queue_stat(struct builder *b, uint32_t index, const char *path);
+static int flush_stats(struct builder *b);
+static long write_index(struct builder *b, const char *file);
+static void free_builder(struct builder *b);
+static int compare_items(const void *p1, const void *p2);
+static int compare_indices(const void *p1, const void *p2);
+static size_t align8(size_t n);
+static bool valid_entries(const struct cs_tree *tree, size_t names_size);
+
+long cs_tree_build(const char *path, const char *file)
+{
+    assert(path != NULL);
+    assert(file != NULL);
+
+    struct builder b;
+    long count = -1;
+
+    memset(&b, 0, sizeof b);
+    if (add_subtree(&b, path, path, 0) < 0) {
+        perror("Error (cs_tree_build)");
+        goto finally;
+    }
+    count = write_index(&b, file);
+
+finally:
+    free_builder(&b);
+    return count;
+}
+
+long cs_tree_refresh(const char *file, const char *const *paths, size_t count)
+{
+    assert(file != NULL);
+    assert(paths != NULL || count == 0);
+
+    struct cs_tree old;
+    struct builder b;
+    uint32_t *redo = NULL, *map = NULL;
+    char *path = NULL;
+    size_t next = 0, i;
+    long retval = -1;
+
+    memset(&b, 0, sizeof b);
+    if (cs_tree_open(&old, file) != 0)
+        return -1;
+
+    redo = malloc((count + 1) * sizeof (uint32_t));
+    if (redo == NULL)
+        goto error;
+    for (i = 0; i < count; i++) {
+        long index = cs_tree_lookup(&old, paths[i]);
+        if (index < 0) {
+            errno = ENOENT;
+            goto error;
+        }
+        redo[i] = index;
+    }
+    qsort(redo, count, sizeof (uint32_t), compare_indices);
+    redo[count] = old.count;
+
+    /*
+     * Copy the old entries in order, except for the subtrees to walk
+     * again, remembering where each entry went to find the new parents.
+     */
+    map = malloc(old.count * sizeof (uint32_t));
+    if (map == NULL)
+        goto error;
+    for (i = 0; i < old.count; i++) {
+        const struct cs_tree_entry *entry = &old.entries[i];
+        uint32_t parent = i == 0 ? 0 : map[entry->parent];
+        long index;
+
+        while (redo[next] < i)
+            next++;
+        if (redo[next] == i) {
+            size_t len = cs_tree_path(&old, i, NULL, 0);
+            char *buffer = realloc(path, len + 1);
+            if (buffer == NULL)
+                goto error;
+            path = buffer;
+            cs_tree_path(&old, i, path, len + 1);
+            index = add_subtree(&b, path, cs_tree_name(&old, i), parent);
+            if (index < 0 && (errno != ENOENT || i == 0))
+                goto error;
+            i = entry->end - 1;
+            continue;
+        }
+
+        index = add_entry(&b, cs_tree_name(&old, i), parent, entry->type);
+        if (index < 0)
+            goto error;
+        b.entries[index].size = entry->size;
+        b.entries[index].mtime = entry->mtime;
+        b.entries[index].mtime_nsec = entry->mtime_nsec;
+        map[i] = index;
+    }
+    retval = write_index(&b, file);
+    goto finally;
+
+error:
+    perror("Error (cs_tree_refresh)");
+finally:
+    cs_tree_close(&old);
+    free_builder(&b);
+    free(redo);
+    free(map);
+    free(path);
+    return retval;
+}
+
+int cs_tree_open(struct cs_tree *tree, const char *file)
+{
+    assert(tree != NULL);
+    assert(file != NULL);
+
+    const struct tree_header *header;
+    struct stat st;
+    int fd;
+
+    memset(tree, 0, sizeof (struct cs_tree));
+    fd = open(file, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        goto error;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        goto error;
+    }
+    if ((size_t)st.st_size < sizeof (struct tree_header)) {
+        close(fd);
+        errno = EINVAL;
+        goto error;
+    }
+    tree->map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (tree->map == MAP_FAILED) {
+        tree->map = NULL;
+        goto error;
+    }
+    tree->size = st.st_size;
+
+    header = tree->map;
+    if (memcmp(header->magic, TREE_MAGIC, 8) != 0 || header->byte_order != TREE_BYTE_ORDER
+        || header->version != TREE_VERSION
+        || header->names_offset > tree->size
+        || header->names_size > tree->size - header->names_offset
+        || header->entries_offset > tree->size
+        || header->count > (tree->size - header->entries_offset) / sizeof (struct cs_tree_entry)
+        || header->sorted_offset > tree->size
+        || header->count > (tree->size - header->sorted_offset) / sizeof (uint32_t)
+        || header->entries_offset % 8 != 0 || header->sorted_offset % 4 != 0
+        || header->count == 0 || header->names_size == 0
+        || ((const char *)tree->map)[header->names_offset + header->names_size - 1] != '\0') {
+        cs_tree_close(tree);
+        errno = EINVAL;
+        goto error;
+    }
+    tree->count = header->count;
+    tree->names = (const char *)tree->map + header->names_offset;
+    tree->entries = (const void *)((const char *)tree->map + header->entries_offset);
+    tree->sorted = (const void *)((const char *)tree->map + header->sorted_offset);
+    if (!valid_entries(tree, header->names_size)) {
+        cs_tree_close(tree);
+        errno = EINVAL;
+        goto error;
+    }
+    return 0;
+
+error:
+    perror("Error (cs_tree_open)");
+    return -1;
+}
+
+void cs_tree_close(struct cs_tree *tree)
+{
+    assert(tree != NULL);
+
+    if (tree->map != NULL)
+        munmap(tree->map, tree->size);
+    memset(tree, 0, sizeof (struct cs_tree));
+}
+
+const char *cs_tree_name(const struct cs_tree *tree, uint32_t index)
+{
+    assert(index < tree->count);
+
+    return tree->names + tree->entries[index].name;
+}
+
+uint32_t cs_tree_sorted(const struct cs_tree *tree, size_t i)
+{
+    assert(i < tree->count);
+
+    return tree->sorted[i];
+}
+
+size_t cs_tree_path(const struct cs_tree *tree, uint32_t index, char *buffer, size_t size)
+{
+    assert(index < tree->count);
+    assert(buffer != NULL || size == 0);
+
+    const char *root = cs_tree_name(tree, 0);
+    size_t rootlen = strlen(root);
+    bool trail = rootlen > 0 && root[rootlen-1] == '/';
+    size_t total = rootlen, pos;
+    uint32_t i;
+
+    for (i = index; i != 0; i = tree->entries[i].parent)
+        total += strlen(cs_tree_name(tree, i)) + !(trail && tree->entries[i].parent == 0);
+
+    /* Write the names from the back, dropping whatever does not fit. */
+    pos = total;
+    for (i = index; ; i = tree->entries[i].parent) {
+        const char *name = cs_tree_name(tree, i);
+        size_t len = i == 0 ? rootlen : strlen(name), k;
+        pos -= len;
+        for (k = 0; k < len; k++) {
+            if (pos + k + 1 < size)
+                buffer[pos + k] = name[k];
+        }
+        if (i == 0)
+            break;
+        if (!(trail && tree->entries[i].parent == 0) && --pos + 1 < size)
+            buffer[pos] = '/';
+    }
+    if (size > 0)
+        buffer[total < size ? total : size - 1] = '\0';
+    return total;
+}
+
+long cs_tree_lookup(const struct cs_tree *tree, const char *path)
+{
+    assert(tree != NULL);
+    assert(path != NULL);
+
+    const char *root = cs_tree_name(tree, 0);
+    size_t rootlen = strlen(root);
+    uint32_t current = 0;
+
+    if (strncmp(path, root, rootlen) != 0)
+        return -1;
+    path += rootlen;
+    if (rootlen > 0 && root[rootlen-1] != '/' && *path != '\0' && *path++ != '/')
+        return -1;
+
+    while (*path != '\0') {
+        size_t len = strcspn(path, "/");
+        uint32_t child = current + 1;
+        uint32_t end = tree->entries[current].end;
+
+        for (; child < end; child = tree->entries[child].end) {
+            const char *name = cs_tree_name(tree, child);
+            if (strncmp(name, path, len) == 0 && name[len] == '\0')
+                break;
+        }
+        if (child >= end)
+            return -1;
+        current = child;
+        path += len;
+        while (*path == '/')
+            path++;
+    }
+    return current;
+}
+
+size_t cs_tree_prefix(const struct cs_tree *tree, const char *prefix, size_t *first)
+{
+    assert(tree != NULL);
+    assert(prefix != NULL);
+    assert(first != NULL);
+
+    size_t len = strlen(prefix);
+    size_t low = 0, high = tree->count, begin;
+
+    /* The first name not less than the prefix... */
+    while (low < high) {
+        size_t mid = low + (high - low) / 2;
+        if (strncmp(cs_tree_name(tree, tree->sorted[mid]), prefix, len) < 0)
+            low = mid + 1;
+        else
+            high = mid;
+    }
+    begin = low;
+
+    /* ...and the first one after it not starting with the prefix. */
+    high = tree->count;
+    while (low < high) {
+        size_t mid = low + (high - low) / 2;
+        if (strncmp(cs_tree_name(tree, tree->sorted[mid]), prefix, len) <= 0)
+            low = mid + 1;
+        else
+            high = mid;
+    }
+    *first = begin;
+    return low - begin;
+}
+
+long cs_tree_match(const struct cs_tree *tree, const char *regex, cs_tree_fn callback, void *arg)
+{
+    assert(tree != NULL);
+    assert(regex != NULL);
+    assert(callback != NULL);
+
+    const struct cs_regex *compiled = cs_regex_get(regex, REG_EXTENDED | REG_NOSUB);
+    long count = 0;
+    uint32_t i;
+
+    if (compiled == NULL)
+        return -1;
+    for (i = 0; i < tree->count; i++) {
+        if (cs_regex_match(compiled, cs_tree_name(tree, i))) {
+            count++;
+            if (callback(tree, i, arg) != 0)
+                break;
+        }
+    }
+    cs_regex_release(compiled);
+    return count;
+}
+
+/*
+ * Add the entry at path, under the given name, and everything below it.
+ *
+ * \return Index of the entry, -1 if it cannot be stat()ed, if it is a
+ *         directory that cannot be opened, or if out of memory.
+ */
+static long add_subtree(struct builder *b, const char *path, const char *name, uint32_t parent)
+{
+    struct cs_walk_opts opts = { 0, true, 0 };
+    struct stat st;
+    long index;
+
+    if (lstat(path, &st) != 0)
+        return -1;
+    index = add_entry(b, name, parent, IFTODT(st.st_mode));
+    if (index < 0)
+        return -1;
+    b->entries[index].size = st.st_size;
+    b->entries[index].mtime = st.st_mtim.tv_sec;
+    b->entries[index].mtime_nsec = st.st_mtim.tv_nsec;
+
+    if (S_ISDIR(st.st_mode)) {
+        if (b->stack == NULL) {
+            b->stack = malloc(sizeof (uint32_t));
+            if (b->stack == NULL)
+                return -1;
+            b->depth = 1;
+        }
+        b->stack[0] = index;
+        if (cs_walk(path, &opts, visit_entry, b) < 0)
+            return -1;
+        if (b->error != 0) {
+            errno = b->error;
+            return -1;
+        }
+        if (flush_stats(b) < 0)
+            return -1;
+    }
+    return index;
+}
+
+/*
+ * A cs_walk_fn for add_subtree(); ordered walks call it from one thread,
+ * parents before their children. On failure, it records errno in the
+ * builder and stops the walk.
+ */
+static int visit_entry(const struct cs_walk_entry *entry, void *arg)
+{
+    struct builder *b = arg;
+    long index = add_entry(b, entry->name, b->stack[entry->depth], entry->type);
+
+    if (index < 0 || queue_stat(b, index, entry->path) < 0)
+        goto error;
+    if (entry->type == DT_DIR) {
+        if (entry->depth + 1 >= b->depth) {
+            size_t depth = 2 * (entry->depth + 1);
+            uint32_t *stack = realloc(b->stack, depth * sizeof (uint32_t));
+            if (stack == NULL)
+                goto error;
+            b->stack = stack;
+            b->depth = depth;
+        }
+        b->stack[entry->depth + 1] = index;
+    }
+    return CS_WALK_CONTINUE;
+
+error:
+    b->error = errno;
+    return CS_WALK_STOP;
+}
+
+/*
+ * Returns the index of the new entry, or -1 if out of memory or with errno
+ * EOVERFLOW if the index would no longer fit its 32-bit offsets.
+ */
+static long add_entry(struct builder *b, const char *name, uint32_t parent, unsigned char type)
+{
+    size_t len = strlen(name) + 1;
+    struct cs_tree_entry *entry;
+
+    if (b->count == UINT32_MAX || b->names_size + len > UINT32_MAX) {
+        errno = EOVERFLOW;
+        return -1;
+    }
+
+    if (b->count == b->capacity) {
+        size_t capacity = b->capacity ? 2 * b->capacity : 1024;
+        entry = realloc(b->entries, capacity * sizeof (struct cs_tree_entry));
+        if (entry == NULL)
+            return -1;
+        b->entries = entry;
+        b->capacity = capacity;
+    }
+    if (b->names_size + len > b->names_capacity) {
+        size_t capacity = 2 * (b->names_size + len) + 4096;
+        char *names = realloc(b->names, capacity);
+        if (names == NULL)
+            return -1;
+        b->names = names;
+        b->names_capacity = capacity;
+    }
+
+    entry = &b->entries[b->count];
+    memset(entry, 0, sizeof (struct cs_tree_entry));
+    entry->name = b->names_size;
+    entry->parent = parent;
+    entry->type = type;
+    memcpy(b->names + b->names_size, name, len);
+    b->names_size += len;
+    return b->count++;
+}
+
+/*
+ * Queue path to be stat()ed into the entry at index. Returns -1 if out of
+ * memory.
+ */
+static int queue_stat(struct builder *b, uint32_t index, const char *path)
+{
+    b->pending[b->npending] = strdup(path);
+    if (b->pending[b->npending] == NULL)
+        return -1;
+    b->pending_index[b->npending] = index;
+    if (++b->npending == TREE_STAT_CHUNK)
+        return flush_stats(b);
+    return 0;
+}
+
+/*
+ * Stat the queued paths. Returns -1 if out of memory, leaving them queued.
+ */
+static int flush_stats(struct builder *b)
+{
+    struct cs_stat *results;
+    size_t i;
+
+    if (b->npending == 0)
+        return 0;
+    results = malloc(b->npending * sizeof (struct cs_stat));
+    if (results == NULL)
+        return -1;
+    cs_stat_batch(AT_FDCWD, (const char *const *)b->pending, b->npending, AT_SYMLINK_NOFOLLOW,
+                  results);
+    for (i = 0; i < b->npending; i++) {
+        struct cs_tree_entry *entry = &b->entries[b->pending_index[i]];
+        if (results[i].error == 0) {
+            entry->size = results[i].size;
+            entry->mtime = results[i].mtime;
+            entry->mtime_nsec = results[i].mtime_nsec;
+        }
+        free(b->pending[i]);
+    }
+    free(results);
+    b->npending = 0;
+    return 0;
+}
+
+/*
+ * Work out where the subtrees end, sort the names and write everything to
+ * a new file that then replaces file.
+ */
+static long write_index(struct builder *b, const char *file)
+{
+    static const char zeros[8] = { 0 };
+    struct tree_header header;
+    struct sort_item *items;
+    uint32_t *sorted;
+    size_t len = strlen(file), i;
+    char *temp = malloc(len + 5);
+    long retval = -1;
+    FILE *out;
+
+    items = malloc(b->count * sizeof (struct sort_item));
+    sorted = malloc(b->count * sizeof (uint32_t));
+    if (temp == NULL || items == NULL || sorted == NULL) {
+        perror("Error (cs_tree_build)");
+        free(items);
+        goto finally;
+    }
+
+    for (i = 0; i < b->count; i++)
+        b->entries[i].end = i + 1;
+    for (i = b->count; i-- > 1; ) {
+        struct cs_tree_entry *parent = &b->entries[b->entries[i].parent];
+        if (b->entries[i].end > parent->end)
+            parent->end = b->entries[i].end;
+    }
+
+    for (i = 0; i < b->count; i++) {
+        items[i].name = b->names + b->entries[i].name;
+        items[i].index = i;
+    }
+    qsort(items, b->count, sizeof (struct sort_item), compare_items);
+    for (i = 0; i < b->count; i++)
+        sorted[i] = items[i].index;
+    free(items);
+
+    memset(&header, 0, sizeof header);
+    memcpy(header.magic, TREE_MAGIC, 8);
+    header.byte_order = TREE_BYTE_ORDER;
+    header.version = TREE_VERSION;
+    header.count = b->count;
+    header.names_offset = sizeof header;
+    header.names_size = b->names_size;
+    header.entries_offset = align8(header.names_offset + header.names_size);
+    header.sorted_offset = header.entries_offset + b->count * sizeof (struct cs_tree_entry);
+
+    memcpy(temp, file, len);
+    memcpy(temp + len, ".tmp", 5);
+    out = fopen(temp, "wb");
+    if (out == NULL)
+        goto error;
+    fwrite(&header, sizeof header, 1, out);
+    fwrite(b->names, 1, b->names_size, out);
+    fwrite(zeros, 1, header.entries_offset - header.names_offset - header.names_size, out);
+    fwrite(b->entries, sizeof (struct cs_tree_entry), b->count, out);
+    fwrite(sorted, sizeof (uint32_t), b->count, out);
+    if (ferror(out)) {
+        fclose(out);
+        goto error;
+    }
+    if (fclose(out) != 0 || rename(temp, file) != 0)
+        goto error;
+    retval = b->count;
+    goto finally;
+
+error:
+    perror("Error (cs_tree_build)");
+    unlink(temp);
+finally:
+    free(sorted);
+    free(temp);
+    return retval;
+}
+
+static void free_builder(struct builder *b)
+{
+    size_t i;
+
+    for (i = 0; i < b->npending; i++)
+        free(b->pending[i]);
+    free(b->entries);
+    free(b->names);
+    free(b->stack);
+}
+
+static int compare_items(const void *p1, const void *p2)
+{
+    const struct sort_item *a = p1, *b = p2;
+    int cmp = strcmp(a->name, b->name);
+
+    if (cmp != 0)
+        return cmp;
+    return (a->index > b->index) - (a->index < b->index);
+}
+
+static int compare_indices(const void *p1, const void *p2)
+{
+    uint32_t a = *(const uint32_t *)p1, b = *(const uint32_t *)p2;
+
+    return (a > b) - (a < b);
+}
+
+static size_t align8(size_t n)
+{
+    return (n + 7) & ~(size_t)7;
+}
+
+/*
+ * Check that every offset in the entries and the sorted index stays within
+ * the file, so that a damaged index is refused rather than read out of
+ * bounds. Parents come before their children, so cs_tree_path() ends at the
+ * root, and every end lies past its entry, so lookups move forward.
+ */
+static bool valid_entries(const struct cs_tree *tree, size_t names_size)
+{
+    const struct cs_tree_entry *entry;
+    uint32_t i;
+
+    for (i = 0; i < tree->count; i++) {
+        entry = &tree->entries[i];
+        if (entry->name >= names_size
+            || (i == 0 ? entry->parent != 0 : entry->parent >= i)
+            || entry->end <= i || entry->end > tree->count
+            || tree->sorted[i] >= tree->count)
+            return false;
+    }
+    return true;
+}
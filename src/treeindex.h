@@ -0,0 +1,205 @@
+/*
+ * libcassava/treeindex.h
+ * vim: set cin ts=4 sw=4 et cc=80:
+ *
+ * Copyright (c) 2012 Ben Morgan <neembi@googlemail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION
+ * OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/**
+ * \file
+ * An index of a directory tree in a file that is used where it is mapped.
+ *
+ * cs_tree_build() walks a tree with cs_walk() and writes every entry to an
+ * index file: a header, a table of the names, a table of the entries and an
+ * index of the entries sorted by name. cs_tree_open() maps that file
+ * read-only and checks that its offsets stay within it in one pass over the
+ * entries; nothing is parsed or allocated, so opening the index of millions
+ * of files is cheap, and the pages are shared between all processes that use
+ * it.
+ *
+ * The entries are stored in depth-first order with the entries of every
+ * directory sorted by name, so the entries below a directory are the ones
+ * between it and its \c end. Entry 0 is the root of the tree.
+ *
+ * The file is in the byte order of the machine that wrote it and is refused
+ * by cs_tree_open() on others.
+ *
+ * <b>Example Usage:</b>
+ * \code
+ *     struct cs_tree tree;
+ *     size_t first, count, i;
+ *     char path[4096];
+ *
+ *     cs_tree_build("/usr/include", "include.idx");
+ *     cs_tree_open(&tree, "include.idx");
+ *     count = cs_tree_prefix(&tree, "std", &first);
+ *     for (i = first; i < first + count; i++) {
+ *         cs_tree_path(&tree, cs_tree_sorted(&tree, i), path, sizeof path);
+ *         puts(path);
+ *     }
+ *     cs_tree_close(&tree);
+ * \endcode
+ *
+ * \author Ben Morgan
+ * \date 17. October 2026
+ */
+
+#ifndef LIBCASSAVA_TREEINDEX_H
+#define LIBCASSAVA_TREEINDEX_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+#include <stdint.h>
+#include <stdlib.h>
+
+/**
+ * An entry of the index, as stored in the file.
+ *
+ * \param size       Size of the file in bytes.
+ * \param mtime      Time of last modification, in seconds since the epoch.
+ * \param mtime_nsec Nanoseconds of \a mtime.
+ * \param name       Offset of the name in the table of names.
+ * \param parent     Index of the directory containing the entry; the root
+ *                   is its own parent.
+ * \param end        Index after the last entry below this one; for entries
+ *                   that are not directories, the index after their own.
+ * \param type       Type of the entry as one of the \c DT_ constants of
+ *                   dirent.h. Symbolic links are not followed.
+ */
+struct cs_tree_entry {
+    uint64_t size;
+    int64_t mtime;
+    uint32_t mtime_nsec;
+    uint32_t name;
+    uint32_t parent;
+    uint32_t end;
+    uint8_t type;
+    uint8_t reserved[7];
+};
+
+/**
+ * An index file mapped into memory by cs_tree_open(). The members point into
+ * the mapping and are only valid until cs_tree_close().
+ */
+struct cs_tree {
+    void *map;
+    size_t size;
+    uint32_t count;                      /**< Number of entries. */
+    const struct cs_tree_entry *entries; /**< Entries in depth-first order. */
+    const char *names;                   /**< The names, each ending in '\0'. */
+    const uint32_t *sorted;              /**< Entries sorted by name. */
+};
+
+/**
+ * Callback for cs_tree_match().
+ *
+ * \return 0 to go on, anything else to stop.
+ */
+typedef int (*cs_tree_fn)(const struct cs_tree *tree, uint32_t index,
+                          void *arg);
+
+/**
+ * Walk the tree below \a path and write an index of it to \a file, replacing
+ * the file only once the new index is complete.
+ *
+ * \return Number of entries written, -1 on error; errno is EOVERFLOW if the
+ *         tree has more entries or longer names than the 32-bit offsets of
+ *         the index can address.
+ */
+extern long cs_tree_build(const char *path, const char *file);
+
+/**
+ * Update the index \a file by walking the subtrees at \a paths again and
+ * copying all other entries from the old index, so that only what changed
+ * is read from the disk.
+ *
+ * \param file  Index written by cs_tree_build().
+ * \param paths Array of \a count directories or files in the index, with
+ *              the path of the root as given to cs_tree_build(). Subtrees
+ *              that no longer exist are removed; for new ones, give their
+ *              parent directory.
+ * \param count Number of paths.
+ * \return Number of entries written, -1 on error.
+ */
+extern long cs_tree_refresh(const char *file, const char *const *paths,
+                            size_t count);
+
+/**
+ * Map the index \a file into memory.
+ *
+ * \return 0 on success, -1 if the file cannot be mapped or is not an index
+ *         written on this machine, in which case the reason is printed;
+ *         errno is EINVAL if the header or any entry is damaged.
+ */
+extern int cs_tree_open(struct cs_tree *tree, const char *file);
+
+/**
+ * Unmap an index opened by cs_tree_open().
+ */
+extern void cs_tree_close(struct cs_tree *tree);
+
+/**
+ * Returns the name of the entry \a index; for the root, its path.
+ */
+extern const char *cs_tree_name(const struct cs_tree *tree, uint32_t index);
+
+/**
+ * Returns the index of the \a i-th entry in order of the names.
+ */
+extern uint32_t cs_tree_sorted(const struct cs_tree *tree, size_t i);
+
+/**
+ * Write the full path of the entry \a index to \a buffer, as snprintf()
+ * does.
+ *
+ * \return Length of the path, which was truncated if it is \a size or more.
+ */
+extern size_t cs_tree_path(const struct cs_tree *tree, uint32_t index,
+                           char *buffer, size_t size);
+
+/**
+ * Returns the index of the entry with the full path \a path, or -1 if there
+ * is none. \a path has to start with the path of the root.
+ */
+extern long cs_tree_lookup(const struct cs_tree *tree, const char *path);
+
+/**
+ * Find the entries whose names start with \a prefix, by binary search.
+ *
+ * \param first Set to the position of the first of them in the order of
+ *              cs_tree_sorted().
+ * \return Number of entries found, which follow each other in that order.
+ */
+extern size_t cs_tree_prefix(const struct cs_tree *tree, const char *prefix,
+                             size_t *first);
+
+/**
+ * Call \a callback for every entry whose name matches the extended regular
+ * expression \a regex, in depth-first order.
+ *
+ * \return Number of entries matched, -1 if \a regex is invalid.
+ */
+extern long cs_tree_match(const struct cs_tree *tree, const char *regex,
+                          cs_tree_fn callback, void *arg);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* LIBCASSAVA_TREEINDEX_H */
@@ -0,0 +1,334 @@
+/*
+ * libcassava/ulist.c
+ * vim: set cin ts=4 sw=4 et cc=100:
+ *
+ * Copyright (c) 2012 Ben Morgan <neembi@googlemail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#define _GNU_SOURCE
+
+#include "ulist.h"
+#include "list.h"
+
+#include <assert.h>
+#include <string.h>
+
+/* Chunks start on a cache line, so that each one takes up exactly two. */
+#define CHUNK_ALIGN 64
+
+static struct ulist_chunk *chunk_new(unsigned short first);
+static void chunk_insert(struct ulist_chunk *chunk, unsigned pos, void *data);
+
+void ulist_init(struct ulist *list)
+{
+    assert(list != NULL);
+
+    list->head = list->tail = NULL;
+    list->length = 0;
+}
+
+bool ulist_empty(const struct ulist *list)
+{
+    assert(list != NULL);
+
+    return list->length == 0;
+}
+
+size_t ulist_length(const struct ulist *list)
+{
+    assert(list != NULL);
+
+    return list->length;
+}
+
+void *ulist_get(const struct ulist *list, size_t index)
+{
+    assert(list != NULL);
+    assert(index < list->length);
+
+    const struct ulist_chunk *chunk = list->head;
+    while (index >= (size_t)(chunk->end - chunk->first)) {
+        index -= chunk->end - chunk->first;
+        chunk = chunk->next;
+    }
+    return chunk->data[chunk->first + index];
+}
+
+bool ulist_push(struct ulist *list, void *data)
+{
+    assert(list != NULL);
+
+    struct ulist_chunk *chunk = list->head;
+    if (chunk == NULL || chunk->first == 0) {
+        /* Fill new chunks in front from the back, so the next push fits. */
+        chunk = chunk_new(ULIST_CHUNK);
+        if (chunk == NULL)
+            return false;
+        chunk->next = list->head;
+        list->head = chunk;
+        if (list->tail == NULL)
+            list->tail = chunk;
+    }
+    chunk->data[--chunk->first] = data;
+    list->length++;
+    return true;
+}
+
+bool ulist_append(struct ulist *list, void *data)
+{
+    assert(list != NULL);
+
+    struct ulist_chunk *chunk = list->tail;
+    if (chunk == NULL || chunk->end == ULIST_CHUNK) {
+        chunk = chunk_new(0);
+        if (chunk == NULL)
+            return false;
+        if (list->tail == NULL)
+            list->head = chunk;
+        else
+            list->tail->next = chunk;
+        list->tail = chunk;
+    }
+    chunk->data[chunk->end++] = data;
+    list->length++;
+    return true;
+}
+
+void *ulist_pop(struct ulist *list)
+{
+    assert(list != NULL);
+
+    struct ulist_chunk *chunk = list->head;
+    void *data;
+
+    if (chunk == NULL)
+        return NULL;
+
+    data = chunk->data[chunk->first++];
+    list->length--;
+    if (chunk->first == chunk->end) {
+        list->head = chunk->next;
+        if (list->head == NULL)
+            list->tail = NULL;
+        free(chunk);
+    }
+    return data;
+}
+
+bool ulist_insert(struct ulist *list, size_t index, void *data)
+{
+    assert(list != NULL);
+    assert(index <= list->length);
+
+    if (index == 0)
+        return ulist_push(list, data);
+    if (index == list->length)
+        return ulist_append(list, data);
+
+    struct ulist_chunk *chunk = list->head;
+    while (index >= (size_t)(chunk->end - chunk->first)) {
+        index -= chunk->end - chunk->first;
+        chunk = chunk->next;
+    }
+    unsigned pos = chunk->first + index;
+
+    if (chunk->first == 0 && chunk->end == ULIST_CHUNK) {
+        /* Move the upper half of the full chunk into a new one after it. */
+        struct ulist_chunk *upper = chunk_new(0);
+        if (upper == NULL)
+            return false;
+        upper->end = ULIST_CHUNK - ULIST_CHUNK/2;
+        memcpy(upper->data, chunk->data + ULIST_CHUNK/2, upper->end * sizeof (void *));
+        chunk->end = ULIST_CHUNK/2;
+        upper->next = chunk->next;
+        chunk->next = upper;
+        if (list->tail == chunk)
+            list->tail = upper;
+        if (pos > ULIST_CHUNK/2) {
+            chunk = upper;
+            pos -= ULIST_CHUNK/2;
+        }
+    }
+    chunk_insert(chunk, pos, data);
+    list->length++;
+    return true;
+}
+
+size_t ulist_filter(struct ulist *list, bool (*filter)(void *, void *), void *arguments)
+{
+    assert(list != NULL);
+    assert(filter != NULL);
+
+    struct ulist_chunk **link = &list->head, *chunk;
+    size_t count = 0;
+
+    list->tail = NULL;
+    while ((chunk = *link) != NULL) {
+        unsigned i, kept = chunk->first;
+        for (i = chunk->first; i < chunk->end; i++) {
+            if (filter(chunk->data[i], arguments))
+                chunk->data[kept++] = chunk->data[i];
+            else
+                free(chunk->data[i]);
+        }
+        chunk->end = kept;
+        count += kept - chunk->first;
+
+        if (kept == chunk->first) {
+            *link = chunk->next;
+            free(chunk);
+        } else {
+            list->tail = chunk;
+            link = &chunk->next;
+        }
+    }
+    list->length = count;
+    return count;
+}
+
+size_t ulist_to_array(const struct ulist *list, void ***output)
+{
+    assert(list != NULL);
+    assert(output != NULL);
+
+    const struct ulist_chunk *chunk;
+    size_t count = 0;
+    unsigned i;
+
+    /* The length is known, so the array is filled in one pass. */
+    *output = malloc((list->length + 1) * sizeof (void *));
+    if (*output == NULL)
+        return 0;
+    for (chunk = list->head; chunk != NULL; chunk = chunk->next)
+        for (i = chunk->first; i < chunk->end; i++)
+            if (chunk->data[i] != NULL)
+                (*output)[count++] = chunk->data[i];
+    (*output)[count] = NULL;
+
+    return count;
+}
+
+const char *ulist_search(const struct ulist *list, const char *needle)
+{
+    assert(list != NULL);
+    assert(needle != NULL);
+
+    const struct ulist_chunk *chunk;
+    unsigned i;
+
+    for (chunk = list->head; chunk != NULL; chunk = chunk->next) {
+        for (i = chunk->first; i < chunk->end; i++) {
+            const char *string = chunk->data[i];
+            if (string != NULL && strcmp(string, needle) == 0)
+                return string;
+        }
+    }
+    return NULL;
+}
+
+bool ulist_from_list(struct ulist *list, NodeStr **head)
+{
+    assert(list != NULL);
+    assert(head != NULL);
+
+    while (*head != NULL) {
+        NodeStr *node = *head;
+        if (!ulist_append(list, node->data))
+            return false;
+        *head = node->next;
+        free(node);
+    }
+    return true;
+}
+
+bool ulist_to_list(struct ulist *list, NodeStr **head)
+{
+    assert(list != NULL);
+    assert(head != NULL);
+
+    NodeStr **link = head;
+
+    /* Popping frees every chunk as soon as it has been moved. */
+    *head = NULL;
+    while (list->head != NULL) {
+        NodeStr *node = list_node();
+        if (node == NULL)
+            return false;
+        node->data = ulist_pop(list);
+        *link = node;
+        link = &node->next;
+    }
+    return true;
+}
+
+void ulist_free_chunks(struct ulist *list)
+{
+    assert(list != NULL);
+
+    while (list->head != NULL) {
+        struct ulist_chunk *next = list->head->next;
+        free(list->head);
+        list->head = next;
+    }
+    ulist_init(list);
+}
+
+void ulist_free_all(struct ulist *list)
+{
+    assert(list != NULL);
+
+    struct ulist_chunk *chunk;
+    unsigned i;
+
+    for (chunk = list->head; chunk != NULL; chunk = chunk->next)
+        for (i = chunk->first; i < chunk->end; i++)
+            free(chunk->data[i]);
+    ulist_free_chunks(list);
+}
+
+/*
+ * Returns a new empty chunk whose entries start and end at first, or NULL
+ * if out of memory.
+ */
+static struct ulist_chunk *chunk_new(unsigned short first)
+{
+    void *memory;
+
+    if (posix_memalign(&memory, CHUNK_ALIGN, sizeof (struct ulist_chunk)) != 0)
+        return NULL;
+
+    struct ulist_chunk *chunk = memory;
+    chunk->next = NULL;
+    chunk->first = chunk->end = first;
+    return chunk;
+}
+
+/*
+ * Insert data at pos into a chunk that is not full, moving the entries on
+ * whichever side there is room.
+ */
+static void chunk_insert(struct ulist_chunk *chunk, unsigned pos, void *data)
+{
+    if (chunk->end < ULIST_CHUNK) {
+        memmove(chunk->data + pos + 1, chunk->data + pos, (chunk->end - pos) * sizeof (void *));
+        chunk->end++;
+    } else {
+        memmove(chunk->data + chunk->first - 1, chunk->data + chunk->first,
+                (pos - chunk->first) * sizeof (void *));
+        chunk->first--;
+        pos--;
+    }
+    chunk->data[pos] = data;
+}
@@ -0,0 +1,208 @@
+/*
+ * libcassava/ulist.h
+ * vim: set cin ts=4 sw=4 et cc=80:
+ *
+ * Copyright (c) 2012 Ben Morgan <neembi@googlemail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION
+ * OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/**
+ * \file
+ * Unrolled lists, which store many data pointers per node.
+ *
+ * A struct list_node holds a single pointer, so going through a list of
+ * a million entries means a million cache misses. An unrolled list keeps up
+ * to ULIST_CHUNK pointers in each chunk, and the chunks are aligned to cache
+ * lines, so that going through it touches about an eighth of the memory and
+ * the processor can prefetch most of it.
+ *
+ * The functions mirror those of list.h and list_str.h, and lists can be
+ * converted in both directions without copying the data. Like those of
+ * list.h, the functions that free data assume it was allocated with
+ * malloc(), and list_to_array() and ulist_to_array() alike skip \c NULL data.
+ *
+ * <b>Example Usage:</b>
+ * \code
+ *     struct ulist names;
+ *     NodeStr *head;
+ *     get_filenames("/usr/include", &head);
+ *     ulist_init(&names);
+ *     ulist_from_list(&names, &head);
+ *     if (ulist_search(&names, "stdio.h") != NULL)
+ *         puts("found it");
+ *     ulist_free_all(&names);
+ * \endcode
+ *
+ * \author Ben Morgan
+ * \date 17. October 2026
+ */
+
+#ifndef LIBCASSAVA_ULIST_H
+#define LIBCASSAVA_ULIST_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+#include <stdbool.h>
+#include <stdlib.h>
+
+#include "list_str.h"
+
+/** Number of data pointers in a chunk, which is then 128 bytes long. */
+#define ULIST_CHUNK 14
+
+/**
+ * A chunk of an unrolled list, of which only the entries from \a first up
+ * to but not including \a end are used.
+ *
+ * To go through a list quickly without calling a function per entry:
+ * \code
+ *     const struct ulist_chunk *chunk;
+ *     unsigned i;
+ *     for (chunk = list.head; chunk != NULL; chunk = chunk->next)
+ *         for (i = chunk->first; i < chunk->end; i++)
+ *             puts(chunk->data[i]);
+ * \endcode
+ */
+struct ulist_chunk {
+    struct ulist_chunk *next;
+    unsigned short first;
+    unsigned short end;
+    void *data[ULIST_CHUNK];
+};
+
+/**
+ * An unrolled list. A zero-initialized struct is an empty list.
+ *
+ * \param head   First chunk, \c NULL if the list is empty.
+ * \param tail   Last chunk, \c NULL if the list is empty.
+ * \param length Number of entries in the list.
+ */
+struct ulist {
+    struct ulist_chunk *head;
+    struct ulist_chunk *tail;
+    size_t length;
+};
+
+/**
+ * Initialize an empty list.
+ */
+extern void ulist_init(struct ulist *list);
+
+/**
+ * Returns true if the list is empty.
+ */
+extern bool ulist_empty(const struct ulist *list);
+
+/**
+ * Returns the number of entries of the list, in constant time.
+ */
+extern size_t ulist_length(const struct ulist *list);
+
+/**
+ * Returns the entry at \a index, which must be less than the length.
+ */
+extern void *ulist_get(const struct ulist *list, size_t index);
+
+/**
+ * Push data in front of the list, as list_push() does.
+ *
+ * \return false if out of memory, in which case the list is unchanged.
+ */
+extern bool ulist_push(struct ulist *list, void *data);
+
+/**
+ * Append data to the end of the list.
+ *
+ * \return false if out of memory, in which case the list is unchanged.
+ */
+extern bool ulist_append(struct ulist *list, void *data);
+
+/**
+ * Remove the first entry of the list and return it, as list_pop() does.
+ *
+ * \return The data of the first entry, or \c NULL if the list is empty.
+ */
+extern void *ulist_pop(struct ulist *list);
+
+/**
+ * Insert data at \a index, which may be at most the length of the list, so
+ * that it becomes the entry at \a index. A full chunk is split in two.
+ *
+ * \return false if out of memory, in which case the list is unchanged.
+ */
+extern bool ulist_insert(struct ulist *list, size_t index, void *data);
+
+/**
+ * Remove all entries for which \a filter does not return true, and free
+ * their data, as list_filter() does.
+ *
+ * \return The number of entries left.
+ */
+extern size_t ulist_filter(struct ulist *list, bool (*filter)(void *, void *),
+                           void *arguments);
+
+/**
+ * Returns a \c NULL-terminated array with all data pointers that are not
+ * \c NULL, as list_to_array() does. The array must be freed.
+ *
+ * \return Number of pointers in the array, without the \c NULL; 0 with
+ *         \a output set to \c NULL if out of memory.
+ */
+extern size_t ulist_to_array(const struct ulist *list, void ***output);
+
+/**
+ * Returns the first entry that is equal to the string \a needle, as
+ * list_search() does for a list of strings, or \c NULL if there is none.
+ */
+extern const char *ulist_search(const struct ulist *list, const char *needle);
+
+/**
+ * Append all entries of the list \a head to \a list, and free the nodes of
+ * \a head, but not the data, which now belongs to \a list.
+ *
+ * \param head Pointer to the head of a list; becomes \c NULL.
+ * \return false if out of memory, in which case the entries not yet moved
+ *         are still in \a head.
+ */
+extern bool ulist_from_list(struct ulist *list, NodeStr **head);
+
+/**
+ * Move all entries of \a list, in order, to a new list \a head, leaving
+ * \a list empty.
+ *
+ * \param head Set to the head of a newly allocated list.
+ * \return false if out of memory, in which case the entries not yet moved
+ *         are still in \a list.
+ */
+extern bool ulist_to_list(struct ulist *list, NodeStr **head);
+
+/**
+ * Free all chunks (not the data) of the list, leaving it empty.
+ */
+extern void ulist_free_chunks(struct ulist *list);
+
+/**
+ * Free all chunks and the data of the list, leaving it empty.
+ */
+extern void ulist_free_all(struct ulist *list);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* LIBCASSAVA_ULIST_H */
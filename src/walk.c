@@ -0,0 +1,767 @@
+/*
+ * libcassava/walk.c
+ * vim: set cin ts=4 sw=4 et cc=100:
+ *
+ * Copyright (c) 2012 Ben Morgan <neembi@googlemail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#define _GNU_SOURCE
+
+#include "walk.h"
+#include "path.h"
+#include "system.h"
+
+#include <assert.h>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define WALK_DEQUE_INITIAL 64
+
+/*
+ * An open directory whose subdirectories still have to be opened.
+ * Every job for a subdirectory holds a reference, as does the job that
+ * is reading the directory; the last one to let go closes it.
+ */
+struct walk_dir {
+    int fd;
+    unsigned refs;
+};
+
+/*
+ * A directory to be read. In ordered walks the job also stores the entries
+ * of the directory until the calling thread has passed them to the callback.
+ * A job that is deferred has not been queued, since the walk was as far
+ * ahead of the callback as it may get; the calling thread reads it itself.
+ */
+struct walk_job {
+    struct walk_dir *parent;
+    int fd;
+    char *path;
+    size_t name;
+    size_t depth;
+
+    struct walk_item *items;
+    size_t count;
+    char *names;
+    bool done;
+    bool cancelled;
+    bool deferred;
+};
+
+struct walk_item {
+    union {
+        size_t offset;
+        const char *ptr;
+    } name;
+    unsigned char type;
+    ino_t ino;
+    struct walk_job *child;
+};
+
+/*
+ * The owner pushes and pops jobs at the back of its deque, so that it
+ * works depth-first, while thieves take the oldest jobs from the front.
+ */
+struct walk_deque {
+    pthread_mutex_t lock;
+    struct walk_job **jobs;
+    size_t cap;
+    size_t first;
+    size_t count;
+};
+
+struct walk {
+    struct cs_walk_opts opts;
+    cs_walk_fn callback;
+    void *arg;
+
+    unsigned nworkers;
+    struct walk_deque *deques;
+
+    long pending;
+    long visited;
+    long ahead;                 /* jobs of an ordered walk queued or not yet emitted */
+    unsigned long seq;
+    int idle;
+    int stop;
+    int error;                  /* errno of a failure that stopped the walk */
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+
+    pthread_mutex_t done_lock;
+    pthread_cond_t done_cond;
+
+    struct walk_worker *reader; /* of the calling thread in ordered walks */
+    bool threaded;
+};
+
+struct walk_worker {
+    struct walk *walk;
+    unsigned id;
+    pthread_t thread;
+    struct cs_pathbuf path;
+    char *entries;
+};
+
+static int deque_push(struct walk_deque *dq, struct walk_job *job);
+static struct walk_job *deque_pop(struct walk_deque *dq);
+static struct walk_job *deque_steal(struct walk_deque *dq);
+static int walk_push(struct walk_worker *self, struct walk_job *job);
+static struct walk_job *walk_next(struct walk_worker *self);
+static void *walk_worker(void *arg);
+static void walk_drain(struct walk_worker *self);
+static void walk_run(struct walk_worker *self, struct walk_job *job);
+static struct walk_job *walk_child(struct walk_dir *parent, const struct walk_job *job,
+                                   const char *name);
+static void walk_release(struct walk_dir *dir);
+static void walk_finish(struct walk *w);
+static void walk_fail(struct walk *w);
+static bool walk_emit(struct walk *w, struct walk_job *job, struct cs_pathbuf *path);
+static void walk_discard(struct walk *w, struct walk_job *job);
+static void walk_read_now(struct walk *w, struct walk_job *job);
+static void walk_drop(struct walk *w, struct walk_job *job);
+static void walk_wait(struct walk *w, struct walk_job *job);
+static void job_free(struct walk_job *job);
+static int compare_items(const void *p1, const void *p2);
+
+long cs_walk(const char *path, const struct cs_walk_opts *opts, cs_walk_fn callback, void *arg)
+{
+    assert(path != NULL);
+    assert(callback != NULL);
+
+    struct walk w;
+    struct walk_worker *workers;
+    struct walk_job *root;
+    unsigned i, started;
+
+    int fd = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0) {
+        perror("Error (cs_walk)");
+        return -1;
+    }
+
+    memset(&w, 0, sizeof w);
+    if (opts != NULL)
+        w.opts = *opts;
+    w.callback = callback;
+    w.arg = arg;
+    w.nworkers = w.opts.threads;
+    if (w.nworkers == 0) {
+        long n = sysconf(_SC_NPROCESSORS_ONLN);
+        w.nworkers = n > 0 ? (unsigned)n : 1;
+    }
+
+    w.deques = calloc(w.nworkers, sizeof (struct walk_deque));
+    workers = calloc(w.nworkers, sizeof (struct walk_worker));
+    root = calloc(1, sizeof (struct walk_job));
+    if (w.deques == NULL || workers == NULL || root == NULL
+        || (root->path = strdup(path)) == NULL) {
+        perror("Error (cs_walk)");
+        errno = ENOMEM;
+        close(fd);
+        free(root);
+        free(workers);
+        free(w.deques);
+        return -1;
+    }
+    root->fd = fd;
+
+    pthread_mutex_init(&w.lock, NULL);
+    pthread_cond_init(&w.wake, NULL);
+    pthread_mutex_init(&w.done_lock, NULL);
+    pthread_cond_init(&w.done_cond, NULL);
+    for (i = 0; i < w.nworkers; i++) {
+        pthread_mutex_init(&w.deques[i].lock, NULL);
+        workers[i].walk = &w;
+        workers[i].id = i;
+        cs_pathbuf_init(&workers[i].path);
+    }
+
+    if (walk_push(&workers[0], root) != 0) {
+        close(fd);
+        job_free(root);
+        w.error = ENOMEM;
+        goto finally;
+    }
+
+    /* In unordered walks the calling thread is worker 0, otherwise it
+     * passes the entries to the callback while the workers read ahead.
+     * It then counts as a pending job itself, so that the workers keep
+     * waiting for the jobs it may still queue. */
+    started = w.opts.ordered ? 0 : 1;
+    if (w.opts.ordered) {
+        w.ahead = 1;
+        w.pending++;
+    }
+    for (i = started; i < w.nworkers; i++) {
+        if (pthread_create(&workers[i].thread, NULL, walk_worker, &workers[i]) != 0)
+            break;
+    }
+    started = i;
+
+    if (!w.opts.ordered) {
+        walk_worker(&workers[0]);
+        i = 1;
+    } else {
+        struct walk_worker reader;
+        struct cs_pathbuf path;
+
+        memset(&reader, 0, sizeof reader);
+        reader.walk = &w;
+        cs_pathbuf_init(&reader.path);
+        w.reader = &reader;
+        w.threaded = started > 0;
+        if (!w.threaded)
+            walk_drain(&reader);
+
+        cs_pathbuf_init(&path);
+        if (cs_pathbuf_dir(&path, root->path, strlen(root->path)) == 0)
+            walk_emit(&w, root, &path);
+        else
+            walk_discard(&w, root);
+        cs_pathbuf_free(&path);
+        cs_pathbuf_free(&reader.path);
+        free(reader.entries);
+        walk_finish(&w);
+        i = 0;
+    }
+    for (; i < started; i++)
+        pthread_join(workers[i].thread, NULL);
+
+finally:
+    for (i = 0; i < w.nworkers; i++) {
+        pthread_mutex_destroy(&w.deques[i].lock);
+        free(w.deques[i].jobs);
+        cs_pathbuf_free(&workers[i].path);
+        free(workers[i].entries);
+    }
+    free(w.deques);
+    free(workers);
+    pthread_mutex_destroy(&w.lock);
+    pthread_cond_destroy(&w.wake);
+    pthread_mutex_destroy(&w.done_lock);
+    pthread_cond_destroy(&w.done_cond);
+    if (w.error != 0) {
+        errno = w.error;
+        perror("Error (cs_walk)");
+        errno = w.error;
+        return -1;
+    }
+    return w.visited;
+}
+
+/*
+ * Returns -1 if out of memory, in which case job has not been queued.
+ */
+static int deque_push(struct walk_deque *dq, struct walk_job *job)
+{
+    pthread_mutex_lock(&dq->lock);
+    if (dq->count == dq->cap) {
+        size_t cap = dq->cap ? 2*dq->cap : WALK_DEQUE_INITIAL;
+        struct walk_job **jobs = malloc(cap * sizeof (struct walk_job *));
+        size_t i;
+        if (jobs == NULL) {
+            pthread_mutex_unlock(&dq->lock);
+            return -1;
+        }
+        for (i = 0; i < dq->count; i++)
+            jobs[i] = dq->jobs[(dq->first + i) % dq->cap];
+        free(dq->jobs);
+        dq->jobs = jobs;
+        dq->cap = cap;
+        dq->first = 0;
+    }
+    dq->jobs[(dq->first + dq->count) % dq->cap] = job;
+    __atomic_store_n(&dq->count, dq->count + 1, __ATOMIC_RELAXED);
+    pthread_mutex_unlock(&dq->lock);
+    return 0;
+}
+
+static struct walk_job *deque_pop(struct walk_deque *dq)
+{
+    struct walk_job *job = NULL;
+
+    pthread_mutex_lock(&dq->lock);
+    if (dq->count > 0) {
+        __atomic_store_n(&dq->count, dq->count - 1, __ATOMIC_RELAXED);
+        job = dq->jobs[(dq->first + dq->count) % dq->cap];
+    }
+    pthread_mutex_unlock(&dq->lock);
+    return job;
+}
+
+static struct walk_job *deque_steal(struct walk_deque *dq)
+{
+    struct walk_job *job = NULL;
+
+    if (__atomic_load_n(&dq->count, __ATOMIC_RELAXED) == 0)
+        return NULL;
+    pthread_mutex_lock(&dq->lock);
+    if (dq->count > 0) {
+        job = dq->jobs[dq->first];
+        dq->first = (dq->first + 1) % dq->cap;
+        __atomic_store_n(&dq->count, dq->count - 1, __ATOMIC_RELAXED);
+    }
+    pthread_mutex_unlock(&dq->lock);
+    return job;
+}
+
+/*
+ * Queue a job on the deque of self and wake up a sleeping worker, if any.
+ *
+ * The sequence number is increased before looking at the number of idle
+ * workers, and a worker going to sleep increases that number before looking
+ * at the sequence number; so either we see the sleeper or it sees the job.
+ * Returns -1 if out of memory, leaving the job to the caller.
+ */
+static int walk_push(struct walk_worker *self, struct walk_job *job)
+{
+    struct walk *w = self->walk;
+
+    __atomic_add_fetch(&w->pending, 1, __ATOMIC_SEQ_CST);
+    if (deque_push(&w->deques[self->id], job) != 0) {
+        __atomic_sub_fetch(&w->pending, 1, __ATOMIC_SEQ_CST);
+        return -1;
+    }
+    __atomic_add_fetch(&w->seq, 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&w->idle, __ATOMIC_SEQ_CST) > 0) {
+        pthread_mutex_lock(&w->lock);
+        pthread_cond_signal(&w->wake);
+        pthread_mutex_unlock(&w->lock);
+    }
+    return 0;
+}
+
+/*
+ * Return the next job for self, sleeping while there is none,
+ * or NULL once all jobs have been finished.
+ */
+static struct walk_job *walk_next(struct walk_worker *self)
+{
+    struct walk *w = self->walk;
+    struct walk_job *job;
+    unsigned long seq;
+    unsigned i;
+
+    for (;;) {
+        seq = __atomic_load_n(&w->seq, __ATOMIC_SEQ_CST);
+        if ((job = deque_pop(&w->deques[self->id])) != NULL)
+            return job;
+        for (i = 1; i < w->nworkers; i++)
+            if ((job = deque_steal(&w->deques[(self->id + i) % w->nworkers])) != NULL)
+                return job;
+
+        pthread_mutex_lock(&w->lock);
+        __atomic_add_fetch(&w->idle, 1, __ATOMIC_SEQ_CST);
+        while (__atomic_load_n(&w->pending, __ATOMIC_SEQ_CST) > 0
+               && __atomic_load_n(&w->seq, __ATOMIC_SEQ_CST) == seq)
+            pthread_cond_wait(&w->wake, &w->lock);
+        __atomic_sub_fetch(&w->idle, 1, __ATOMIC_SEQ_CST);
+        pthread_mutex_unlock(&w->lock);
+
+        if (__atomic_load_n(&w->pending, __ATOMIC_SEQ_CST) == 0)
+            return NULL;
+    }
+}
+
+static void *walk_worker(void *arg)
+{
+    struct walk_worker *self = arg;
+    struct walk_job *job;
+
+    while ((job = walk_next(self)) != NULL)
+        walk_run(self, job);
+    return NULL;
+}
+
+/*
+ * Run the jobs queued on the deque of self until there are none left,
+ * for ordered walks without worker threads.
+ */
+static void walk_drain(struct walk_worker *self)
+{
+    struct walk_job *job;
+
+    while ((job = deque_pop(&self->walk->deques[self->id])) != NULL)
+        walk_run(self, job);
+}
+
+/*
+ * Read the directory of job. Unordered walks pass every entry to the
+ * callback right away; ordered walks keep them in the job for walk_emit().
+ */
+static void walk_run(struct walk_worker *self, struct walk_job *job)
+{
+    struct walk *w = self->walk;
+    struct walk_dir *dir = NULL;
+    struct cs_dir stream;
+    struct cs_dirent ent;
+    size_t alloc = 0, used = 0, names_alloc = 0, names_used = 0, i;
+    bool descend;
+    int status, fd = job->fd;
+
+    if (__atomic_load_n(&w->stop, __ATOMIC_RELAXED)
+        || __atomic_load_n(&job->cancelled, __ATOMIC_ACQUIRE)) {
+        if (fd >= 0)
+            close(fd);
+        walk_release(job->parent);
+        goto finish;
+    }
+
+    if (fd < 0)
+        fd = openat(job->parent->fd, job->path + job->name,
+                    O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+    walk_release(job->parent);
+    if (fd < 0) {
+        fprintf(stderr, "Error (cs_walk): %s: %s\n", job->path, strerror(errno));
+        goto finish;
+    }
+
+    dir = malloc(sizeof (struct walk_dir));
+    if (dir == NULL) {
+        close(fd);
+        walk_fail(w);
+        goto finish;
+    }
+    dir->fd = fd;
+    dir->refs = 1;
+    if (self->entries == NULL && (self->entries = malloc(CS_DIR_BUFSIZE)) == NULL) {
+        walk_fail(w);
+        goto finish;
+    }
+    cs_dir_init(&stream, fd, self->entries, CS_DIR_BUFSIZE);
+
+    descend = w->opts.max_depth == 0 || job->depth + 1 < w->opts.max_depth;
+    /* The path of the directory is the same for all of its entries. */
+    if (!w->opts.ordered && cs_pathbuf_dir(&self->path, job->path, strlen(job->path)) < 0) {
+        fprintf(stderr, "Error (cs_walk): %s: %s\n", job->path, strerror(errno));
+        goto finish;
+    }
+    while ((status = cs_dir_read(&stream, &ent)) > 0) {
+        const char *name = ent.name;
+        unsigned char type = ent.type;
+
+        if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0')))
+            continue;
+        if (type == DT_UNKNOWN) {
+            struct stat st;
+            if (fstatat(dir->fd, name, &st, AT_SYMLINK_NOFOLLOW) != 0)
+                continue;
+            type = IFTODT(st.st_mode);
+        }
+
+        if (!w->opts.ordered) {
+            struct cs_walk_entry entry;
+            int retval;
+
+            entry.path = cs_pathbuf_name(&self->path, name, ent.len);
+            if (entry.path == NULL)
+                continue;
+            entry.name = entry.path + self->path.prefix;
+            entry.dirfd = dir->fd;
+            entry.type = type;
+            entry.ino = ent.ino;
+            entry.depth = job->depth;
+
+            __atomic_add_fetch(&w->visited, 1, __ATOMIC_RELAXED);
+            retval = w->callback(&entry, w->arg);
+            if (retval == CS_WALK_STOP) {
+                __atomic_store_n(&w->stop, 1, __ATOMIC_RELAXED);
+                break;
+            }
+            if (retval == CS_WALK_CONTINUE && type == DT_DIR && descend) {
+                struct walk_job *child = walk_child(dir, job, name);
+                if (child == NULL || walk_push(self, child) != 0) {
+                    if (child != NULL) {
+                        walk_release(dir);
+                        job_free(child);
+                    }
+                    walk_fail(w);
+                    break;
+                }
+            }
+        } else {
+            size_t len = ent.len + 1;
+            if (used == alloc) {
+                size_t n = alloc ? 2*alloc : 16;
+                struct walk_item *items = realloc(job->items, n * sizeof (struct walk_item));
+                if (items == NULL) {
+                    walk_fail(w);
+                    break;
+                }
+                job->items = items;
+                alloc = n;
+            }
+            if (names_used + len > names_alloc) {
+                size_t n = 2*(names_used + len);
+                char *names = realloc(job->names, n);
+                if (names == NULL) {
+                    walk_fail(w);
+                    break;
+                }
+                job->names = names;
+                names_alloc = n;
+            }
+            memcpy(job->names + names_used, name, len);
+            job->items[used].name.offset = names_used;
+            job->items[used].type = type;
+            job->items[used].ino = ent.ino;
+            job->items[used].child = NULL;
+            names_used += len;
+            used++;
+        }
+    }
+    if (status < 0)
+        fprintf(stderr, "Error (cs_walk): %s: %s\n", job->path, strerror(errno));
+    cs_dir_close(&stream);
+
+    if (w->opts.ordered) {
+        job->count = used;
+        for (i = 0; i < used; i++)
+            job->items[i].name.ptr = job->names + job->items[i].name.offset;
+        if (used > 1)
+            qsort(job->items, used, sizeof (struct walk_item), compare_items);
+
+        /*
+         * Only read as far ahead as allowed, starting with the first
+         * subdirectory, which the callback needs first; the others are
+         * deferred. Push in reverse, so that the first is read first.
+         */
+        if (descend) {
+            for (i = 0; i < used; i++) {
+                struct walk_job *child;
+                if (job->items[i].type != DT_DIR)
+                    continue;
+                child = walk_child(dir, job, job->items[i].name.ptr);
+                if (child == NULL) {
+                    walk_fail(w);
+                    break;
+                }
+                if (__atomic_add_fetch(&w->ahead, 1, __ATOMIC_RELAXED) > CS_WALK_READAHEAD) {
+                    __atomic_sub_fetch(&w->ahead, 1, __ATOMIC_RELAXED);
+                    child->deferred = true;
+                }
+                job->items[i].child = child;
+            }
+            for (i = used; i-- > 0; ) {
+                struct walk_job *child = job->items[i].child;
+                /* A job that cannot be queued is read by the calling thread. */
+                if (child != NULL && !child->deferred && walk_push(self, child) != 0) {
+                    __atomic_sub_fetch(&w->ahead, 1, __ATOMIC_RELAXED);
+                    child->deferred = true;
+                }
+            }
+        }
+    }
+
+finish:
+    if (w->opts.ordered) {
+        pthread_mutex_lock(&w->done_lock);
+        job->done = true;
+        pthread_cond_broadcast(&w->done_cond);
+        pthread_mutex_unlock(&w->done_lock);
+    } else {
+        job_free(job);
+    }
+    walk_release(dir);
+    walk_finish(w);
+}
+
+/*
+ * Returns a job for the subdirectory name of job, which holds a reference
+ * to parent, or NULL if out of memory.
+ */
+static struct walk_job *walk_child(struct walk_dir *parent, const struct walk_job *job,
+                                   const char *name)
+{
+    struct walk_job *child = calloc(1, sizeof (struct walk_job));
+    size_t len = strlen(job->path);
+    bool trail = len > 0 && job->path[len-1] == '/';
+
+    if (child == NULL)
+        return NULL;
+    child->path = malloc(len + strlen(name) + 2);
+    if (child->path == NULL) {
+        free(child);
+        return NULL;
+    }
+    __atomic_add_fetch(&parent->refs, 1, __ATOMIC_RELAXED);
+    child->parent = parent;
+    child->fd = -1;
+    memcpy(child->path, job->path, len);
+    if (!trail)
+        child->path[len++] = '/';
+    strcpy(child->path + len, name);
+    child->name = len;
+    child->depth = job->depth + 1;
+    return child;
+}
+
+static void walk_release(struct walk_dir *dir)
+{
+    if (dir != NULL && __atomic_sub_fetch(&dir->refs, 1, __ATOMIC_ACQ_REL) == 0) {
+        close(dir->fd);
+        free(dir);
+    }
+}
+
+/*
+ * Count a job as finished and wake everyone up if it was the last.
+ */
+static void walk_finish(struct walk *w)
+{
+    if (__atomic_sub_fetch(&w->pending, 1, __ATOMIC_SEQ_CST) == 0) {
+        pthread_mutex_lock(&w->lock);
+        pthread_cond_broadcast(&w->wake);
+        pthread_mutex_unlock(&w->lock);
+    }
+}
+
+/*
+ * Stop the walk because memory ran out, so that cs_walk() returns -1.
+ */
+static void walk_fail(struct walk *w)
+{
+    __atomic_store_n(&w->error, ENOMEM, __ATOMIC_RELAXED);
+    __atomic_store_n(&w->stop, 1, __ATOMIC_RELAXED);
+}
+
+/*
+ * Pass the entries of job and its subdirectories to the callback in order.
+ * Returns true if the walk has been stopped.
+ */
+static bool walk_emit(struct walk *w, struct walk_job *job, struct cs_pathbuf *path)
+{
+    bool stopped = false;
+    size_t i;
+
+    walk_wait(w, job);
+    for (i = 0; i < job->count; i++) {
+        struct walk_item *item = &job->items[i];
+        size_t len = strlen(item->name.ptr);
+        int retval = CS_WALK_SKIP;
+
+        /* The workers stop the walk if they run out of memory. */
+        if (__atomic_load_n(&w->stop, __ATOMIC_RELAXED))
+            stopped = true;
+        if (!stopped) {
+            struct cs_walk_entry entry;
+
+            entry.path = cs_pathbuf_name(path, item->name.ptr, len);
+            entry.name = entry.path + path->prefix;
+            entry.dirfd = -1;
+            entry.type = item->type;
+            entry.ino = item->ino;
+            entry.depth = job->depth;
+
+            w->visited++;
+            if (entry.path != NULL)
+                retval = w->callback(&entry, w->arg);
+            if (retval == CS_WALK_STOP) {
+                __atomic_store_n(&w->stop, 1, __ATOMIC_RELAXED);
+                stopped = true;
+            }
+        }
+        if (item->child != NULL) {
+            size_t prefix;
+            if (retval == CS_WALK_CONTINUE
+                && (prefix = cs_pathbuf_push(path, item->name.ptr, len)) != (size_t)-1) {
+                if (item->child->deferred)
+                    walk_read_now(w, item->child);
+                stopped = walk_emit(w, item->child, path);
+                cs_pathbuf_pop(path, prefix);
+            } else {
+                walk_discard(w, item->child);
+            }
+        }
+    }
+    walk_drop(w, job);
+    return stopped;
+}
+
+/*
+ * Throw away a job of an ordered walk together with all jobs it has spawned.
+ */
+static void walk_discard(struct walk *w, struct walk_job *job)
+{
+    size_t i;
+
+    if (job->deferred) {
+        walk_release(job->parent);
+        job_free(job);
+        return;
+    }
+    __atomic_store_n(&job->cancelled, true, __ATOMIC_RELEASE);
+    walk_wait(w, job);
+    for (i = 0; i < job->count; i++)
+        if (job->items[i].child != NULL)
+            walk_discard(w, job->items[i].child);
+    walk_drop(w, job);
+}
+
+/*
+ * Read a deferred job of an ordered walk in the calling thread, since the
+ * callback needs its entries now. The jobs for its subdirectories are
+ * queued for the workers as usual, as far as the walk may read ahead.
+ */
+static void walk_read_now(struct walk *w, struct walk_job *job)
+{
+    job->deferred = false;
+    __atomic_add_fetch(&w->ahead, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&w->pending, 1, __ATOMIC_SEQ_CST);
+    walk_run(w->reader, job);
+    if (!w->threaded)
+        walk_drain(w->reader);
+}
+
+/*
+ * Free a job of an ordered walk whose entries have been passed on, making
+ * room to read ahead another one.
+ */
+static void walk_drop(struct walk *w, struct walk_job *job)
+{
+    __atomic_sub_fetch(&w->ahead, 1, __ATOMIC_RELAXED);
+    job_free(job);
+}
+
+static void walk_wait(struct walk *w, struct walk_job *job)
+{
+    pthread_mutex_lock(&w->done_lock);
+    while (!job->done)
+        pthread_cond_wait(&w->done_cond, &w->done_lock);
+    pthread_mutex_unlock(&w->done_lock);
+}
+
+static void job_free(struct walk_job *job)
+{
+    free(job->path);
+    free(job->items);
+    free(job->names);
+    free(job);
+}
+
+static int compare_items(const void *p1, const void *p2)
+{
+    return strcmp(((const struct walk_item *)p1)->name.ptr,
+                  ((const struct walk_item *)p2)->name.ptr);
+}
@@ -0,0 +1,147 @@
+/*
+ * libcassava/walk.h
+ * vim: set cin ts=4 sw=4 et cc=80:
+ *
+ * Copyright (c) 2012 Ben Morgan <neembi@googlemail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION
+ * OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/**
+ * \file
+ * Recursive traversal of directory trees with a pool of worker threads.
+ *
+ * Where read_directory() lists a single directory, cs_walk() visits every
+ * entry below a directory. Each subdirectory becomes a job that is put on the
+ * deque of the worker that found it; idle workers steal jobs from the other
+ * end of other workers' deques. Subdirectories are opened with openat()
+ * relative to their parent, so no path is resolved more than once.
+ *
+ * <b>Example Usage:</b>
+ * \code
+ *     int count(const struct cs_walk_entry *entry, void *arg)
+ *     {
+ *         if (entry->type == DT_REG)
+ *             __sync_fetch_and_add((long *)arg, 1);
+ *         return CS_WALK_CONTINUE;
+ *     }
+ *
+ *     long files = 0;
+ *     cs_walk("/usr", NULL, count, &files);
+ * \endcode
+ *
+ * \author Ben Morgan
+ * \date 17. October 2026
+ */
+
+#ifndef LIBCASSAVA_WALK_H
+#define LIBCASSAVA_WALK_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <sys/types.h>
+
+/** Return value of a cs_walk_fn: go on as normal. */
+#define CS_WALK_CONTINUE 0
+/** Return value of a cs_walk_fn: do not descend into this directory. */
+#define CS_WALK_SKIP     1
+/** Return value of a cs_walk_fn: stop the walk as soon as possible. */
+#define CS_WALK_STOP     2
+
+/**
+ * Number of directories an ordered walk reads ahead of the callback at
+ * most. Their entries are kept in memory until they have been passed to the
+ * callback; further directories are only read when it is their turn.
+ */
+#define CS_WALK_READAHEAD 1024
+
+/**
+ * An entry found during a walk, as passed to the callback.
+ *
+ * \param path  Full path of the entry, starting with the path given to
+ *              cs_walk(). Only valid for the duration of the callback.
+ * \param name  Name of the entry, pointing into \a path.
+ * \param dirfd File descriptor of the directory containing the entry, for use
+ *              with fstatat() and openat(), or -1 in ordered walks.
+ * \param type  Type of the entry as one of the \c DT_ constants of dirent.h;
+ *              this is never \c DT_UNKNOWN. Symbolic links are not followed.
+ * \param ino   Inode number of the entry.
+ * \param depth Depth of the entry, 0 for entries in the starting directory.
+ */
+struct cs_walk_entry {
+    const char *path;
+    const char *name;
+    int dirfd;
+    unsigned char type;
+    ino_t ino;
+    size_t depth;
+};
+
+/**
+ * Options for cs_walk(). Passing \c NULL to cs_walk() is the same as
+ * passing a zero-initialized struct.
+ *
+ * \param threads   Number of worker threads, or 0 for one per online CPU.
+ * \param ordered   If true, the callback is called from the calling thread
+ *                  only, in depth-first order with the entries of each
+ *                  directory sorted by name. Directories are still read in
+ *                  parallel ahead of the callback, up to
+ *                  CS_WALK_READAHEAD of them.
+ * \param max_depth Do not descend into directories of this depth, 0 for no
+ *                  limit. A \a max_depth of 1 visits only the entries of the
+ *                  starting directory.
+ */
+struct cs_walk_opts {
+    unsigned threads;
+    bool ordered;
+    size_t max_depth;
+};
+
+/**
+ * Callback for cs_walk().
+ *
+ * \return One of CS_WALK_CONTINUE, CS_WALK_SKIP or CS_WALK_STOP.
+ */
+typedef int (*cs_walk_fn)(const struct cs_walk_entry *entry, void *arg);
+
+/**
+ * Call \a callback for every entry below the directory \a path, not
+ * including \a path itself and the entries "." and "..".
+ *
+ * Unless \a opts->ordered is set, the callback is called concurrently from
+ * several threads and in no particular order, so it has to be thread-safe.
+ * Directories that cannot be read are reported with perror() and skipped.
+ *
+ * \param path     Directory to walk.
+ * \param opts     Options for the walk, may be \c NULL.
+ * \param callback Function called for every entry.
+ * \param arg      Passed to \a callback unchanged.
+ * \return Number of entries visited, -1 if \a path could not be opened or
+ *         if memory ran out during the walk, with errno ENOMEM.
+ */
+extern long cs_walk(const char *path,
+                    const struct cs_walk_opts *opts,
+                    cs_walk_fn callback,
+                    void *arg);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* LIBCASSAVA_WALK_H */
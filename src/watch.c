@@ -0,0 +1,655 @@
+/*
+ * libcassava/watch.c
+ * vim: set cin ts=4 sw=4 et cc=100:
+ *
+ * Copyright (c) 2012 Ben Morgan <neembi@googlemail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#define _GNU_SOURCE
+
+#include "watch.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <poll.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+#include "list.h"
+#include "system.h"
+
+#define WATCH_EVENTS (IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_MODIFY \
+                      | IN_ATTRIB | IN_CLOSE_WRITE | IN_DELETE_SELF | IN_MOVE_SELF)
+
+/*
+ * An entry of the snapshot. Entries that were removed are kept, as
+ * tombstones, until they are forgotten, so that their removal can be
+ * reported.
+ *
+ * Whether the entry was there at some generation is told by its history:
+ * flips holds the generations at the end of which it was there if it was
+ * not at the end of the one before, or the other way round, in ascending
+ * order. Before the first of them, it was there if was_present is true.
+ * Flips up to the horizon are folded into was_present as the history is
+ * added to, since nobody can ask about them any longer.
+ */
+struct watch_entry {
+    struct watch_entry *chain;  /* next in the same hash bucket */
+    struct watch_entry *prev;   /* towards the least recently changed */
+    struct watch_entry *next;
+    uint32_t hash;
+    bool present;
+    bool was_present;
+    unsigned long *flips;
+    size_t nflips;
+    unsigned long changed;
+    unsigned long scan;
+    size_t dir;
+    char path[];
+};
+
+struct watch_dir {
+    int wd;
+    char *path;
+    size_t len;                 /* of the prefix, including a '/' */
+};
+
+struct cs_watch {
+    int fd;
+    unsigned long generation;
+    unsigned long horizon;      /* changes before this one are forgotten */
+    unsigned long scan;
+    bool dirty;                 /* changes in generation + 1 */
+    bool failed;                /* out of memory while applying changes */
+    int changes;
+
+    struct watch_dir *dirs;
+    size_t ndirs;
+
+    struct watch_entry **buckets;
+    size_t nbuckets;            /* a power of two */
+    size_t nentries;
+    struct watch_entry *oldest; /* in order of the last change */
+    struct watch_entry *newest;
+};
+
+/* Argument of scan_entry(). */
+struct scan {
+    struct cs_watch *watch;
+    size_t dir;
+    int count;
+};
+
+static int list_dir(struct cs_watch *watch, size_t dir);
+static int scan_entry(const char *data, size_t len, const struct cs_dirent *entry, void *arg);
+static void rescan(struct cs_watch *watch);
+static void apply(struct cs_watch *watch, const struct inotify_event *event);
+static void vanish_dir(struct cs_watch *watch, size_t dir);
+static struct watch_entry *lookup(struct cs_watch *watch, size_t dir, const char *name,
+                                  bool create);
+static int appear(struct cs_watch *watch, struct watch_entry *entry);
+static int vanish(struct cs_watch *watch, struct watch_entry *entry);
+static int flip(struct cs_watch *watch, struct watch_entry *entry);
+static bool present_at(const struct watch_entry *entry, unsigned long generation);
+static void touch(struct cs_watch *watch, struct watch_entry *entry);
+static void unlink_entry(struct cs_watch *watch, struct watch_entry *entry);
+static uint32_t hash_path(const char *path);
+
+struct cs_watch *cs_watch_new(void)
+{
+    struct cs_watch *watch;
+    int fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+
+    if (fd < 0) {
+        perror("Error (cs_watch_new)");
+        return NULL;
+    }
+    watch = calloc(1, sizeof (struct cs_watch));
+    if (watch == NULL)
+        goto error;
+    watch->fd = fd;
+    watch->nbuckets = 64;
+    watch->buckets = calloc(watch->nbuckets, sizeof (struct watch_entry *));
+    if (watch->buckets == NULL)
+        goto error;
+    return watch;
+
+error:
+    perror("Error (cs_watch_new)");
+    free(watch);
+    close(fd);
+    return NULL;
+}
+
+void cs_watch_free(struct cs_watch *watch)
+{
+    struct watch_entry *entry;
+    size_t i;
+
+    if (watch == NULL)
+        return;
+    close(watch->fd);
+    entry = watch->oldest;
+    while (entry != NULL) {
+        struct watch_entry *next = entry->next;
+        free(entry->flips);
+        free(entry);
+        entry = next;
+    }
+    for (i = 0; i < watch->ndirs; i++)
+        free(watch->dirs[i].path);
+    free(watch->dirs);
+    free(watch->buckets);
+    free(watch);
+}
+
+int cs_watch_add(struct cs_watch *watch, const char *path)
+{
+    assert(watch != NULL);
+    assert(path != NULL);
+
+    struct watch_dir *dirs, *dir;
+    size_t len = strlen(path);
+    int wd, count;
+
+    /* Watch first, so that no change after the listing is missed. */
+    wd = inotify_add_watch(watch->fd, path, WATCH_EVENTS | IN_ONLYDIR);
+    if (wd < 0) {
+        perror("Error (cs_watch_add)");
+        return -1;
+    }
+
+    dirs = realloc(watch->dirs, (watch->ndirs + 1) * sizeof (struct watch_dir));
+    if (dirs == NULL)
+        goto error;
+    watch->dirs = dirs;
+    dir = &watch->dirs[watch->ndirs];
+    dir->wd = wd;
+    dir->path = malloc(len + 2);
+    if (dir->path == NULL)
+        goto error;
+    memcpy(dir->path, path, len);
+    if (len == 0 || path[len-1] != '/')
+        dir->path[len++] = '/';
+    dir->path[len] = '\0';
+    dir->len = len;
+
+    watch->changes = 0;
+    watch->failed = false;
+    count = list_dir(watch, watch->ndirs++);
+    if (count < 0) {
+        inotify_rm_watch(watch->fd, wd);
+        vanish_dir(watch, watch->ndirs - 1);
+        dir->wd = -1;
+    }
+    if (watch->dirty) {
+        watch->generation++;
+        watch->dirty = false;
+    }
+    return count;
+
+error:
+    perror("Error (cs_watch_add)");
+    inotify_rm_watch(watch->fd, wd);
+    return -1;
+}
+
+int cs_watch_fd(const struct cs_watch *watch)
+{
+    assert(watch != NULL);
+
+    return watch->fd;
+}
+
+int cs_watch_poll(struct cs_watch *watch, int timeout)
+{
+    assert(watch != NULL);
+
+    union {
+        struct inotify_event event;
+        char bytes[16 * 1024];
+    } buffer;
+    struct pollfd pfd = { watch->fd, POLLIN, 0 };
+    bool overflow = false;
+
+    watch->changes = 0;
+    watch->failed = false;
+    if (poll(&pfd, 1, timeout) < 0) {
+        if (errno == EINTR)
+            return 0;
+        perror("Error (cs_watch_poll)");
+        return -1;
+    }
+
+    for (;;) {
+        ssize_t size = read(watch->fd, buffer.bytes, sizeof buffer.bytes);
+        ssize_t offset = 0;
+
+        if (size < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                break;
+            if (errno == EINTR)
+                continue;
+            perror("Error (cs_watch_poll)");
+            return -1;
+        }
+        while (offset < size) {
+            const struct inotify_event *event = (void *)(buffer.bytes + offset);
+            if (event->mask & IN_Q_OVERFLOW)
+                overflow = true;
+            else
+                apply(watch, event);
+            offset += sizeof (struct inotify_event) + event->len;
+        }
+    }
+
+    /* Some events were lost: read the directories again and compare. */
+    if (overflow)
+        rescan(watch);
+
+    if (watch->dirty) {
+        watch->generation++;
+        watch->dirty = false;
+    }
+    if (watch->failed) {
+        errno = ENOMEM;
+        perror("Error (cs_watch_poll)");
+        return -1;
+    }
+    return watch->changes;
+}
+
+unsigned long cs_watch_generation(const struct cs_watch *watch)
+{
+    assert(watch != NULL);
+
+    return watch->generation;
+}
+
+long cs_watch_changes(struct cs_watch *watch, unsigned long since, cs_watch_fn callback,
+                      void *arg)
+{
+    assert(watch != NULL);
+    assert(callback != NULL);
+
+    struct watch_entry *entry;
+    long count = 0;
+
+    if (since < watch->horizon)
+        return -1;
+
+    for (entry = watch->newest; entry != NULL && entry->changed > since; entry = entry->prev) {
+        bool then = present_at(entry, since);
+
+        if (entry->present && then)
+            callback(entry->path, CS_WATCH_MODIFIED, arg);
+        else if (entry->present)
+            callback(entry->path, CS_WATCH_ADDED, arg);
+        else if (then)
+            callback(entry->path, CS_WATCH_REMOVED, arg);
+        else
+            continue;
+        count++;
+    }
+    return count;
+}
+
+void cs_watch_forget(struct cs_watch *watch, unsigned long generation)
+{
+    assert(watch != NULL);
+
+    struct watch_entry *entry = watch->oldest;
+
+    if (generation > watch->generation)
+        generation = watch->generation;
+    if (generation > watch->horizon)
+        watch->horizon = generation;
+
+    while (entry != NULL && entry->changed <= generation) {
+        struct watch_entry *next = entry->next;
+        if (!entry->present) {
+            struct watch_entry **link = &watch->buckets[entry->hash & (watch->nbuckets - 1)];
+            while (*link != entry)
+                link = &(*link)->chain;
+            *link = entry->chain;
+            unlink_entry(watch, entry);
+            watch->nentries--;
+            free(entry->flips);
+            free(entry);
+        } else {
+            /* Its whole history is before the horizon now. */
+            entry->was_present = true;
+            entry->nflips = 0;
+        }
+        entry = next;
+    }
+}
+
+int cs_watch_snapshot(struct cs_watch *watch, NodeStr **head)
+{
+    assert(watch != NULL);
+    assert(head != NULL);
+
+    struct watch_entry *entry;
+    int count = 0;
+
+    *head = NULL;
+    for (entry = watch->newest; entry != NULL; entry = entry->prev) {
+        if (entry->present) {
+            char *path = strdup(entry->path);
+            if (path == NULL || !list_push((struct list_node **)head, path)) {
+                perror("Error (cs_watch_snapshot)");
+                free(path);
+                list_free_all((struct list_node **)head);
+                return -1;
+            }
+            count++;
+        }
+    }
+    return count;
+}
+
+/*
+ * Add the entries of a directory to the snapshot, and mark them as seen in
+ * the current scan.
+ */
+static int list_dir(struct cs_watch *watch, size_t dir)
+{
+    struct scan scan = { watch, dir, 0 };
+
+    watch->scan++;
+    if (read_directory_foreach(watch->dirs[dir].path, false, scan_entry, &scan) < 0)
+        return -1;
+    return scan.count;
+}
+
+/*
+ * A cs_dir_visitor for list_dir().
+ */
+static int scan_entry(const char *data, size_t len, const struct cs_dirent *entry, void *arg)
+{
+    struct scan *scan = arg;
+    struct watch_entry *found;
+
+    (void)entry;
+    if (data[0] == '.' && (len == 1 || (len == 2 && data[1] == '.')))
+        return 0;
+    found = lookup(scan->watch, scan->dir, data, true);
+    if (found == NULL)
+        return -1;
+    if (!found->present && appear(scan->watch, found) < 0)
+        return -1;
+    found->scan = scan->watch->scan;
+    scan->count++;
+    return 0;
+}
+
+/*
+ * List all directories again, and let the entries that are no longer
+ * there vanish.
+ */
+static void rescan(struct cs_watch *watch)
+{
+    size_t dir;
+
+    for (dir = 0; dir < watch->ndirs; dir++) {
+        struct watch_entry *entry, *prev;
+        if (watch->dirs[dir].wd < 0)
+            continue;
+        if (list_dir(watch, dir) < 0) {
+            /* Out of memory says nothing about the entries that were not listed. */
+            if (watch->failed)
+                return;
+            vanish_dir(watch, dir);
+            continue;
+        }
+        for (entry = watch->newest; entry != NULL; entry = prev) {
+            prev = entry->prev;
+            if (entry->dir == dir && entry->present && entry->scan != watch->scan)
+                vanish(watch, entry);
+        }
+    }
+}
+
+static void apply(struct cs_watch *watch, const struct inotify_event *event)
+{
+    struct watch_entry *entry;
+    size_t dir;
+
+    for (dir = 0; dir < watch->ndirs; dir++) {
+        if (watch->dirs[dir].wd == event->wd)
+            break;
+    }
+    if (dir == watch->ndirs)
+        return;
+
+    if (event->mask & (IN_DELETE_SELF | IN_MOVE_SELF | IN_IGNORED)) {
+        if (event->mask & IN_MOVE_SELF)
+            inotify_rm_watch(watch->fd, event->wd);
+        vanish_dir(watch, dir);
+        watch->dirs[dir].wd = -1;
+        return;
+    }
+    if (event->len == 0)
+        return;
+
+    if (event->mask & (IN_CREATE | IN_MOVED_TO)) {
+        entry = lookup(watch, dir, event->name, true);
+        if (entry == NULL)
+            return;
+        if (entry->present)
+            touch(watch, entry);
+        else
+            appear(watch, entry);
+    } else if (event->mask & (IN_DELETE | IN_MOVED_FROM)) {
+        entry = lookup(watch, dir, event->name, false);
+        if (entry != NULL && entry->present)
+            vanish(watch, entry);
+    } else {
+        entry = lookup(watch, dir, event->name, false);
+        if (entry != NULL && entry->present)
+            touch(watch, entry);
+    }
+}
+
+static void vanish_dir(struct cs_watch *watch, size_t dir)
+{
+    struct watch_entry *entry, *prev;
+
+    for (entry = watch->newest; entry != NULL; entry = prev) {
+        prev = entry->prev;
+        if (entry->dir == dir && entry->present)
+            vanish(watch, entry);
+    }
+}
+
+/*
+ * Find the entry name in a directory, creating a tombstone for it if
+ * there is none and create is true. Returns NULL if there is none, or if
+ * out of memory, in which case the watch is marked as failed.
+ */
+static struct watch_entry *lookup(struct cs_watch *watch, size_t dir, const char *name,
+                                  bool create)
+{
+    const struct watch_dir *d = &watch->dirs[dir];
+    size_t len = strlen(name);
+    struct watch_entry *entry;
+    uint32_t hash;
+    char path[d->len + len + 1];
+
+    memcpy(path, d->path, d->len);
+    memcpy(path + d->len, name, len + 1);
+    hash = hash_path(path);
+
+    entry = watch->buckets[hash & (watch->nbuckets - 1)];
+    while (entry != NULL) {
+        if (entry->hash == hash && strcmp(entry->path, path) == 0)
+            return entry;
+        entry = entry->chain;
+    }
+    if (!create)
+        return NULL;
+
+    /* If there is no memory for more buckets, the chains just get longer. */
+    struct watch_entry **buckets;
+    if (watch->nentries >= watch->nbuckets
+        && (buckets = calloc(watch->nbuckets * 2, sizeof (struct watch_entry *))) != NULL) {
+        struct watch_entry *iter;
+        free(watch->buckets);
+        watch->buckets = buckets;
+        watch->nbuckets *= 2;
+        for (iter = watch->oldest; iter != NULL; iter = iter->next) {
+            struct watch_entry **link = &watch->buckets[iter->hash & (watch->nbuckets - 1)];
+            iter->chain = *link;
+            *link = iter;
+        }
+    }
+
+    entry = calloc(1, sizeof (struct watch_entry) + d->len + len + 1);
+    if (entry == NULL) {
+        watch->failed = true;
+        return NULL;
+    }
+    memcpy(entry->path, path, d->len + len + 1);
+    entry->hash = hash;
+    entry->dir = dir;
+    entry->chain = watch->buckets[hash & (watch->nbuckets - 1)];
+    watch->buckets[hash & (watch->nbuckets - 1)] = entry;
+    watch->nentries++;
+
+    /* Link it in as the oldest, touch() moves it when it changes. */
+    entry->next = watch->oldest;
+    if (watch->oldest != NULL)
+        watch->oldest->prev = entry;
+    else
+        watch->newest = entry;
+    watch->oldest = entry;
+    return entry;
+}
+
+static int appear(struct cs_watch *watch, struct watch_entry *entry)
+{
+    if (flip(watch, entry) < 0)
+        return -1;
+    entry->present = true;
+    touch(watch, entry);
+    return 0;
+}
+
+static int vanish(struct cs_watch *watch, struct watch_entry *entry)
+{
+    if (flip(watch, entry) < 0)
+        return -1;
+    entry->present = false;
+    touch(watch, entry);
+    return 0;
+}
+
+/*
+ * Add the coming generation to the history of entry, which is about to
+ * appear or vanish. If it already flipped in that generation, it is back
+ * to how it was before. Returns -1 if out of memory, in which case the
+ * watch is marked as failed.
+ */
+static int flip(struct cs_watch *watch, struct watch_entry *entry)
+{
+    unsigned long generation = watch->generation + 1;
+    size_t i;
+
+    if (entry->nflips > 0 && entry->flips[entry->nflips - 1] == generation) {
+        entry->nflips--;
+        return 0;
+    }
+
+    for (i = 0; i < entry->nflips && entry->flips[i] <= watch->horizon; i++)
+        entry->was_present = !entry->was_present;
+    if (i > 0) {
+        entry->nflips -= i;
+        memmove(entry->flips, entry->flips + i, entry->nflips * sizeof (unsigned long));
+    }
+
+    /* The array is allocated in powers of two. */
+    if ((entry->nflips & (entry->nflips - 1)) == 0) {
+        size_t size = entry->nflips == 0 ? 1 : entry->nflips * 2;
+        unsigned long *flips = realloc(entry->flips, size * sizeof (unsigned long));
+        if (flips == NULL) {
+            watch->failed = true;
+            return -1;
+        }
+        entry->flips = flips;
+    }
+    entry->flips[entry->nflips++] = generation;
+    return 0;
+}
+
+/*
+ * Returns true if entry was there at the end of generation, which must
+ * not be before the horizon.
+ */
+static bool present_at(const struct watch_entry *entry, unsigned long generation)
+{
+    bool present = entry->was_present;
+    size_t i;
+
+    for (i = 0; i < entry->nflips && entry->flips[i] <= generation; i++)
+        present = !present;
+    return present;
+}
+
+/*
+ * Record a change of entry in the coming generation, making it the most
+ * recently changed entry.
+ */
+static void touch(struct cs_watch *watch, struct watch_entry *entry)
+{
+    if (entry->changed != watch->generation + 1)
+        watch->changes++;
+    entry->changed = watch->generation + 1;
+    watch->dirty = true;
+
+    if (entry == watch->newest)
+        return;
+    unlink_entry(watch, entry);
+    entry->prev = watch->newest;
+    entry->next = NULL;
+    watch->newest->next = entry;
+    watch->newest = entry;
+}
+
+static void unlink_entry(struct cs_watch *watch, struct watch_entry *entry)
+{
+    if (entry->prev != NULL)
+        entry->prev->next = entry->next;
+    else
+        watch->oldest = entry->next;
+    if (entry->next != NULL)
+        entry->next->prev = entry->prev;
+    else
+        watch->newest = entry->prev;
+}
+
+/* FNV-1a */
+static uint32_t hash_path(const char *path)
+{
+    uint32_t hash = 2166136261u;
+
+    while (*path != '\0')
+        hash = (hash ^ (unsigned char)*path++) * 16777619u;
+    return hash;
+}
@@ -0,0 +1,170 @@
+/*
+ * libcassava/watch.h
+ * vim: set cin ts=4 sw=4 et cc=80:
+ *
+ * Copyright (c) 2012 Ben Morgan <neembi@googlemail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION
+ * OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/**
+ * \file
+ * Snapshots of directories that are kept current with inotify.
+ *
+ * Instead of listing a directory again and again and comparing the lists,
+ * a watch lists it once with read_directory_foreach() and then applies the
+ * inotify events for it to the snapshot. Every call of cs_watch_poll() that
+ * changes the snapshot starts a new generation, and cs_watch_changes()
+ * reports what was added, removed or modified since a given generation. It
+ * costs time in proportion to the number of changes since then, not to the
+ * number of entries.
+ *
+ * Only the entries of the directories added are watched, not those of their
+ * subdirectories. If the kernel drops events because too many were queued,
+ * the directories are listed again and the snapshot corrected.
+ *
+ * The functions are not thread-safe; a watch is meant to be used by one
+ * thread at a time.
+ *
+ * <b>Example Usage:</b>
+ * \code
+ *     struct cs_watch *watch = cs_watch_new();
+ *     unsigned long seen = 0;
+ *     cs_watch_add(watch, "/var/spool/jobs");
+ *     while (cs_watch_poll(watch, -1) >= 0) {
+ *         cs_watch_changes(watch, seen, handle, NULL);
+ *         seen = cs_watch_generation(watch);
+ *     }
+ * \endcode
+ *
+ * \author Ben Morgan
+ * \date 17. October 2026
+ */
+
+#ifndef LIBCASSAVA_WATCH_H
+#define LIBCASSAVA_WATCH_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+#include <stdbool.h>
+#include <stdlib.h>
+
+#include "list_str.h"
+
+/**
+ * A set of watched directories and their snapshot; see watch.h.
+ */
+struct cs_watch;
+
+/**
+ * How an entry changed between two generations.
+ */
+enum cs_watch_change {
+    CS_WATCH_ADDED,    /**< Not there then, there now. */
+    CS_WATCH_REMOVED,  /**< There then, not there now. */
+    CS_WATCH_MODIFIED  /**< There then and now, written to or replaced. */
+};
+
+/**
+ * Callback for cs_watch_changes().
+ *
+ * \param path   Full path of the entry, the directory as given to
+ *               cs_watch_add() followed by the name.
+ * \param change How the entry changed.
+ * \param arg    Argument given to cs_watch_changes().
+ */
+typedef void (*cs_watch_fn)(const char *path,
+                            enum cs_watch_change change,
+                            void *arg);
+
+/**
+ * Create a watch without any directories, at generation 0.
+ *
+ * \return Newly allocated watch to be freed with cs_watch_free(), or \c NULL
+ *         if inotify is not available, in which case the reason is printed.
+ */
+extern struct cs_watch *cs_watch_new(void);
+
+/**
+ * Stop watching and free all memory of a watch.
+ */
+extern void cs_watch_free(struct cs_watch *watch);
+
+/**
+ * Start watching the directory \a path and add its entries to the snapshot,
+ * as added in a new generation.
+ *
+ * \return Number of entries added, -1 on error.
+ */
+extern int cs_watch_add(struct cs_watch *watch, const char *path);
+
+/**
+ * Returns the inotify file descriptor of \a watch, which becomes readable
+ * when there are events for cs_watch_poll(), for use with poll() or select().
+ */
+extern int cs_watch_fd(const struct cs_watch *watch);
+
+/**
+ * Apply the pending events to the snapshot, waiting up to \a timeout
+ * milliseconds for the first one as poll() does: -1 waits forever and
+ * 0 not at all. A new generation starts if the snapshot changed.
+ *
+ * \return Number of entries changed, -1 on error. If out of memory, the
+ *         changes that could be applied are kept in a new generation.
+ */
+extern int cs_watch_poll(struct cs_watch *watch, int timeout);
+
+/**
+ * Returns the current generation of \a watch.
+ */
+extern unsigned long cs_watch_generation(const struct cs_watch *watch);
+
+/**
+ * Call \a callback for every entry that changed after generation \a since,
+ * most recently changed first. An entry that was created and removed again
+ * in the meantime is not reported.
+ *
+ * \return Number of entries reported, or -1 if \a since is older than the
+ *         generation given to cs_watch_forget(), in which case the caller
+ *         has to start again from cs_watch_snapshot().
+ */
+extern long cs_watch_changes(struct cs_watch *watch,
+                             unsigned long since,
+                             cs_watch_fn callback,
+                             void *arg);
+
+/**
+ * Free the memory kept for entries that were removed up to and including
+ * \a generation. Afterwards, changes can no longer be asked for since any
+ * generation before it.
+ */
+extern void cs_watch_forget(struct cs_watch *watch, unsigned long generation);
+
+/**
+ * Make a list of the full paths of all entries in the snapshot.
+ *
+ * \param head Set to the head of a newly allocated list, to be freed with
+ *             list_free_all().
+ * \return Number of entries in the list, -1 if out of memory.
+ */
+extern int cs_watch_snapshot(struct cs_watch *watch, NodeStr **head);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* LIBCASSAVA_WATCH_H */